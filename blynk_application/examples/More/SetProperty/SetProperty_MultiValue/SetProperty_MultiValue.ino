@@ -42,7 +42,7 @@ BLYNK_WRITE(V1) {
     Serial.println("Item 1 selected");
   } else if (value == 2) {
     // If item 2 is selected, change menu items...
-    BlynkParamAllocated items(128); // list length, in bytes
+    BlynkParamFixed<128> items; // list length, in bytes
     items.add("New item 1");
     items.add("New item 2");
     items.add("New item 3");
@@ -12,6 +12,7 @@
 #define BlynkApiLinux_h
 
 #include <Blynk/BlynkApi.h>
+#include <utility/BlynkProbes.h>
 
 #ifndef BLYNK_INFO_DEVICE
     #define BLYNK_INFO_DEVICE  "Linux"
@@ -126,9 +127,18 @@ void BlynkApi<Proto>::processCmd(const void* buff, size_t len)
 #endif
 
     case BLYNK_HW_VR: {
+        BLYNK_PROBE1(pin__read, pin);
+#ifdef BLYNK_HAS_PIN_CACHE
+        if (readFromCache(pin))
+            break;
+#endif
         BlynkReq req = { pin };
         WidgetReadHandler handler = GetReadHandler(pin);
         if (handler && (handler != BlynkWidgetRead)) {
+#ifdef BLYNK_USE_WORKERS
+            if (static_cast<Proto*>(this)->runOnWorker(handler, pin))
+                break;
+#endif
             handler(req);
         } else {
             BlynkWidgetReadDefault(req);
@@ -138,9 +148,17 @@ void BlynkApi<Proto>::processCmd(const void* buff, size_t len)
         ++it;
         char* start = (char*)it.asStr();
         BlynkParam param2(start, len - (start - (char*)buff));
+        BLYNK_PROBE2(pin__write, pin, uint32_t(param2.getLength()));
         BlynkReq req = { pin };
+        BlynkWriteHook hook = static_cast<Proto*>(this)->writeHook;
+        if (hook && hook(req, param2))
+            break;
         WidgetWriteHandler handler = GetWriteHandler(pin);
         if (handler && (handler != BlynkWidgetWrite)) {
+#ifdef BLYNK_USE_WORKERS
+            if (static_cast<Proto*>(this)->runOnWorker(handler, pin, param2))
+                break;
+#endif
             handler(req, param2);
         } else {
             BlynkWidgetWriteDefault(req, param2);
@@ -5,6 +5,12 @@
  * @copyright  Copyright (c) 2015 Volodymyr Shymanskyy
  * @date       Mar 2015
  * @brief
+ *
+ * Half-open connections are noticed within BLYNK_DEAD_LINK_MS: unacked
+ * data (TCP_USER_TIMEOUT), an idle link (keepalive) and a blocked write
+ * (SO_SNDTIMEO) all fail the socket by then, and available() reports a
+ * socket error or EOF as soon as it happens. The protocol's pings cover
+ * a server that still acks, but no longer answers.
  */
 
 #ifndef BlynkSocket_h
@@ -16,6 +22,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -29,44 +36,46 @@ class BlynkTransportSocket
 {
 public:
     BlynkTransportSocket()
-        : sockfd(-1), domain(NULL), port(0)
+        : sockfd(-1), domain(NULL), port(0), addrlen(0)
     {}
 
     void begin(const char* h, uint16_t p) {
         this->domain = h;
         this->port = p;
+        addrlen = 0;
     }
 
     bool connect()
     {
         BLYNK_LOG4(BLYNK_F("Connecting to "), domain, ':', port);
 
-        struct addrinfo hints;
-        struct addrinfo *res = NULL;  // will point to the results
-
-        memset(&hints, 0, sizeof hints); // make sure the struct is empty
-        hints.ai_family = AF_UNSPEC;     // don't care IPv4 or IPv6
-        hints.ai_socktype = SOCK_STREAM; // TCP stream sockets
-
-        // get ready to connect
-        char port_str[8];
-        snprintf(port_str, sizeof(port_str), "%u", port);
-        getaddrinfo(domain, port_str, &hints, &res);
-
-        if (res == NULL) {
+        // The address is resolved once (getaddrinfo allocates), and again
+        // only after a failed connection attempt
+        if (!addrlen && !resolve()) {
             BLYNK_LOG1(BLYNK_F("Cannot get addr info"));
             return false;
         }
 
-        if ((sockfd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0)
+        if ((sockfd = ::socket(addr.ss_family, SOCK_STREAM, 0)) < 0)
         {
             BLYNK_LOG1(BLYNK_F("Can't create socket"));
             return false;
         }
 
-        if (::connect(sockfd, res->ai_addr, res->ai_addrlen) < 0)
+        // Also bounds connect() itself
+        struct timeval stv;
+        stv.tv_sec = BLYNK_DEAD_LINK_MS / 1000;
+        stv.tv_usec = (BLYNK_DEAD_LINK_MS % 1000) * 1000;
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, (char *)&stv, sizeof(struct timeval));
+
+        unsigned userTimeout = BLYNK_DEAD_LINK_MS;
+        setsockopt(sockfd, SOL_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+
+        if (::connect(sockfd, (struct sockaddr*)&addr, addrlen) < 0)
         {
             BLYNK_LOG2(BLYNK_F("Can't connect to "), domain);
+            disconnect();
+            addrlen = 0;
             return false;
         }
 
@@ -78,7 +87,14 @@ public:
         int one = 1;
         setsockopt(sockfd, SOL_TCP, TCP_NODELAY, &one, sizeof(one));
 
-        freeaddrinfo(res); // TODO: Leak here
+        // Idle links: 3 unanswered probes, the first after half the bound
+        int idle = BlynkMax(1, int(BLYNK_DEAD_LINK_MS / 2000));
+        int intvl = BlynkMax(1, int(BLYNK_DEAD_LINK_MS / 6000));
+        int cnt = 3;
+        setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        setsockopt(sockfd, SOL_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(sockfd, SOL_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+        setsockopt(sockfd, SOL_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
 
         return true;
     }
@@ -97,17 +113,25 @@ public:
         ssize_t rlen = ::read(sockfd, buf, len);
         if (rlen == -1) {
             //BLYNK_LOG4("Read error ", errno, ": ", strerror(errno));
-            if (errno == ETIMEDOUT || errno == EWOULDBLOCK || errno == EAGAIN) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 return 0;
             }
+            BLYNK_LOG2(BLYNK_F("Connection lost: "), strerror(errno));
             disconnect();
             return -1;
         }
         return rlen;
     }
 
+    // Returns less than 'len' when the link failed or stayed blocked for
+    // BLYNK_DEAD_LINK_MS, and the protocol reconnects
     size_t write(const void* buf, size_t len) {
-        return ::write(sockfd, buf, len);
+        const ssize_t wlen = ::write(sockfd, buf, len);
+        if (wlen < 0) {
+            BLYNK_LOG2(BLYNK_F("Write failed: "), strerror(errno));
+            return 0;
+        }
+        return wlen;
     }
 
     bool connected() {
@@ -120,19 +144,55 @@ public:
         }
 
         int count = 0;
-        if (0 == ioctl(sockfd, FIONREAD, &count)) {
-            if (!count) {
-                usleep(10000); // not to stall CPU with 100% load
+        if (0 != ioctl(sockfd, FIONREAD, &count)) {
+            return 0;
+        }
+        if (!count) {
+            // Waits for data a little, not to stall CPU with 100% load
+            struct pollfd pfd = { sockfd, POLLIN, 0 };
+            if (poll(&pfd, 1, 10) <= 0) {
+                return 0;
+            }
+            if (0 != ioctl(sockfd, FIONREAD, &count)) {
+                return 0;
+            }
+            if (!count && (pfd.revents & (POLLIN | POLLERR | POLLHUP))) {
+                // Readable with nothing to read: closed or failed
+                int err = 0;
+                socklen_t errlen = sizeof(err);
+                getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+                BLYNK_LOG2(BLYNK_F("Connection lost: "), (err ? strerror(err) : "closed by peer"));
+                disconnect();
             }
-            return count;
         }
-        return 0;
+        return count;
     }
 
 protected:
+    bool resolve() {
+        struct addrinfo hints;
+        struct addrinfo *res = NULL;  // will point to the results
+
+        memset(&hints, 0, sizeof hints); // make sure the struct is empty
+        hints.ai_family = AF_UNSPEC;     // don't care IPv4 or IPv6
+        hints.ai_socktype = SOCK_STREAM; // TCP stream sockets
+
+        char port_str[8];
+        snprintf(port_str, sizeof(port_str), "%u", port);
+        if (getaddrinfo(domain, port_str, &hints, &res) != 0 || res == NULL) {
+            return false;
+        }
+        memcpy(&addr, res->ai_addr, res->ai_addrlen);
+        addrlen = res->ai_addrlen;
+        freeaddrinfo(res);
+        return true;
+    }
+
     int         sockfd;
     const char* domain;
     uint16_t    port;
+    struct sockaddr_storage addr;
+    socklen_t   addrlen;
 };
 
 class BlynkSocket
@@ -17,6 +17,14 @@
  
 
 //#define BLYNK_DEBUG
+//#define BLYNK_LOG_ASYNC
+#define BLYNK_USE_CAPTURE
+#define BLYNK_USE_OUTBOX
+#define BLYNK_USE_LATENCY
+#define BLYNK_USE_TRACE
+#define BLYNK_USE_SCHEDULER
+#define BLYNK_USE_PIN_CACHE
+#define BLYNK_DEAD_LINK_MS 6000UL   // samples go to the outbox sooner
 #define BLYNK_PRINT stdout
 #ifdef RASPBERRY
   #include <BlynkApiWiringPi.h>
@@ -33,6 +41,12 @@ static const char *auth, *serv;
 static uint16_t port;
 
 #include <BlynkWidgets.h>
+#include <utility/BlynkSnapshot.h>
+#include <utility/BlynkStream.h>
+#include <utility/BlynkPeriodic.h>
+#include <utility/BlynkLatency.h>
+#include <utility/BlynkTrace.h>
+#include <utility/BlynkProbes.h>
 #include <iostream>
 #include <fstream>
 using namespace std;
@@ -62,12 +76,33 @@ bool alarmTriggered=false; // Initial state
 int sampleInterval[3]={1,2,5};
 int start=0;
 
+// Sampling runs on fixed deadlines, so the interval doesn't drift with the work done per sample
+BlynkPeriodic sampler;
+
+// Time spent in each stage of a sample (see BlynkLatency.h), dumped on SIGUSR1
+BlynkLatency latencyAdc("sample.adc");
+BlynkLatency latencyRtc("sample.rtc");
+BlynkLatency latencyConvert("sample.convert");
+BlynkLatency latencyAlarm("sample.alarm");
+BlynkLatency latencyFormat("sample.format");
+BlynkLatency latencyPrint("sample.printf");
+BlynkLatency latencyBlynk("sample.virtualWrite");
+BlynkLatency latencyPublish("sample.publish");
+BlynkLatency latencyDac("sample.dac");
+BlynkLatency latencyTotal("sample.total");
+unsigned long sampleCount = 0;
+
+// Values published to local readers, see BlynkSnapshot.h and BlynkStream.h
+const char* const snapshotNames[] = {"humidity", "temperature", "light", "dac", "alarm"};
+
 
 /*
  * startStop
  * Start or stop montering
  */
 void startStop(void){
+    BLYNK_TRACE_SCOPE("isr.startStop");
+    BLYNK_PROBE1(isr, "startStop");
     //Debounce
 	long interruptTime = millis();
 
@@ -93,6 +128,8 @@ void startStop(void){
  * Software Debouncing used
  */
 void stopAlarm(void){
+    BLYNK_TRACE_SCOPE("isr.stopAlarm");
+    BLYNK_PROBE1(isr, "stopAlarm");
     //Debounce
 	long interruptTime = millis();
 
@@ -114,6 +151,8 @@ void stopAlarm(void){
  * Software Debouncing used
  */
 void changeInterval(void){
+    BLYNK_TRACE_SCOPE("isr.changeInterval");
+    BLYNK_PROBE1(isr, "changeInterval");
     //Debounce
 	long interruptTime = millis();
 
@@ -123,6 +162,7 @@ void changeInterval(void){
         if (sampleIntervalIndex>(sizeof(sampleInterval)/sizeof(sampleInterval[0])-1)) {
             sampleIntervalIndex=0;
         }
+        sampler.setPeriod(sampleInterval[sampleIntervalIndex]*1000000000ULL);
 
 	}
 	lastInterruptTime = interruptTime;
@@ -144,10 +184,12 @@ void buzz(int pin){
 void *sound_alarm(void *threadargs){
     printf("Starting alarm thread\n");
     fflush(stdout); // Make sure printf works
+    BlynkTraceThreadName("sound_alarm");
     for (;;){
         //Check for alarm activation
         fflush(stdout); // Make sure printf works
         while (alarmActive){
+            BLYNK_TRACE_SCOPE("beep");
             softToneWrite (BUZZER,2200) ;
             usleep(400*100);
             softToneWrite (BUZZER,0) ;
@@ -163,25 +205,63 @@ void *sound_alarm(void *threadargs){
 void *sample_sensors(void *threadargs){
     printf("Starting sensor thread\n");
     fflush(stdout); // Make sure printf works
+    BlynkTraceThreadName("sample_sensors");
+
+    // Optional real-time setup: BLYNK_RT_PRIORITY=1..99 (SCHED_FIFO), BLYNK_RT_CPU=n, BLYNK_MLOCK=1
+    const char* rtPriority = getenv("BLYNK_RT_PRIORITY");
+    const char* rtCpu = getenv("BLYNK_RT_CPU");
+    const char* rtMlock = getenv("BLYNK_MLOCK");
+    if (rtPriority || rtCpu || rtMlock) {
+        if (!BlynkRealtimeSetup(rtPriority ? atoi(rtPriority) : 0, rtCpu ? atoi(rtCpu) : -1,
+                                rtMlock && atoi(rtMlock))) {
+            printf("Real-time setup of the sensor thread failed (needs root or CAP_SYS_NICE)\n");
+        }
+    }
+
+    bool running = false;
     for (;;){
-        while(start!=1){
-            sleep(1);
-            //wait
+        if (start!=1) {
+            if (running) {
+                sampler.printStats(stdout);
+                running = false;
+            }
+            while(start!=1){
+                sleep(1);
+                //wait
+            }
+        }
+        if (!running) {
+            // The first sample is taken now, the next ones on its phase
+            sampler.start(sampleInterval[sampleIntervalIndex]*1000000000ULL);
+            sampler.resetStats();
+            sampler.wait();
+            running = true;
         }
         
+        BlynkLatencyTimer stage;
+        const uint64_t sampleStart = BlynkLatency::now();
+        BlynkTraceBegin("sample");
+        sampleCount++;
+        BLYNK_PROBE1(sample__start, sampleCount);
+        BlynkTraceBegin("adc");
+
         humidity = sampleHumidity()/(float)1023 *3.3;
         temperature=sampleTemperature();
         light=sampleLight();
+        stage.lap(latencyAdc);
+        BlynkTraceEnd("adc");
 
 
         //  Get time
         hours= getHoursRTC() ;
         mins= getMinsRCTC() ;
         secs= getSecsRTC();
+        stage.lap(latencyRtc);
 
         //Conversions
         float dac_output = light/(float)1023 * humidity;
         float environmental_temperature= ((temperature*3.3/1024)-V_0)/Tc;
+        stage.lap(latencyConvert);
         
         //printf("Min since last activation %d Hours since last activation %d\n",getAlarmMinutes(),getAlarmHours()); //Test
         
@@ -201,25 +281,41 @@ void *sample_sensors(void *threadargs){
         else {
             alarm = ' ';
         }
+        stage.lap(latencyAlarm);
 
         char buffer [80];
         int n=sprintf (buffer,"%02d:%02d:%02d\t%02d:%02d:%02d\t%1.2f V\t\t%2.2f C\t%4d\t%1.2fV\t%c",hours, mins, secs,getSystemRunHours(), getSystemRunMin(), getSystemRunSec(),humidity,environmental_temperature,light,dac_output,alarm);
+        stage.lap(latencyFormat);
 
         //printf("%02d:%02d:%02d\t%02d:%02d:%02d\t%1.2f V\t%1.2f C\t%4d\t%1.2fV\t%c",hours, mins, secs,getSystemRunHours(), getSystemRunMin(), getSystemRunSec(),humidity,environmental_temperature,light,dac_output,alarm);
         //Blynk.virtualWrite(V0, hours+":"+ mins +";"+secs+"\t"+getSystemRunHours()+":"+getSystemRunMin()+":"+getSystemRunSec+"\t"+humidity+"\t"+environmental_temperature+" C\t"+light+"\t"+dac_output+"\t"+dac_output+"\t"+alarm+"\n");
         printf("%s",buffer);
         printf("\n"); 
+        stage.lap(latencyPrint);
+        BlynkTraceBegin("virtualWrite");
         Blynk.virtualWrite(0,buffer);
         Blynk.virtualWrite(1,environmental_temperature);
         Blynk.virtualWrite(2,humidity);
         Blynk.virtualWrite(4,light);
+        stage.lap(latencyBlynk);
+        BlynkTraceEnd("virtualWrite");
+
+        const float snapshot[] = {humidity, environmental_temperature, (float)light, dac_output, (float)alarmActive};
+        BlynkSnapshotPublish(snapshot, sizeof(snapshot)/sizeof(snapshot[0]));
+        BlynkStreamPublish(snapshot, sizeof(snapshot)/sizeof(snapshot[0]));
+        stage.lap(latencyPublish);
 
         dac_output=(int)(dac_output/3.3*1024);
         setVoltage(dac_output);
+        stage.lap(latencyDac);
+        const uint64_t sampleNs = BlynkLatency::now() - sampleStart;
+        latencyTotal.record(sampleNs);
+        BLYNK_PROBE2(sample__done, sampleCount, sampleNs);
+        BlynkTraceEnd("sample");
         
 
         fflush(stdout); // Make sure printf works
-        sleep(sampleInterval[sampleIntervalIndex]);
+        sampler.wait();
         
         
     }    
@@ -299,6 +395,8 @@ int getSecsRTC(){
  * Reset the system time
  */
 void resetTime(void){
+    BLYNK_TRACE_SCOPE("isr.resetTime");
+    BLYNK_PROBE1(isr, "resetTime");
         //Debounce
 	long interruptTime = millis();
 
@@ -438,6 +536,10 @@ void setup()
 {
     Blynk.begin(auth, serv, port);
 
+    // The alarm LED goes out ahead of sensor values, the terminal after them
+    Blynk.scheduler().setPinClass(V3, BLYNK_PRIO_ALARM);
+    Blynk.scheduler().setPinClass(V0, BLYNK_PRIO_LOG);
+
     wiringPiSPISetup(SPI_CHAN_DAC,SPI_SPEED); //Init DAC
     mcp3004Setup (BASE, SPI_CHAN_ADC) ; // Init ADC
     RTC = wiringPiI2CSetup(RTCAddr); //Set up the RTC
@@ -486,10 +588,55 @@ void loop()
 }
 
 
+/*
+ * toggleCapture
+ * Start or stop recording protocol traffic (SIGUSR2)
+ */
+void toggleCapture(int sig){
+    BlynkCaptureEnable(!BlynkCaptureEnabled());
+}
+
 int main(int argc, char* argv[])
 {
     parse_options(argc, argv, auth, serv, port);
 
+    // Protocol capture to a pcapng ring file, e.g. BLYNK_CAPTURE=/tmp/blynk.pcapng
+    const char* capture = getenv("BLYNK_CAPTURE");
+    if (capture && BlynkCaptureOpen(capture)) {
+        BlynkCaptureEnable(true);
+    }
+    signal(SIGUSR2, toggleCapture);
+
+    // Stage latencies: on SIGUSR1, and every BLYNK_LATENCY_REPORT seconds (default 60, 0: never)
+    const char* latencyReport = getenv("BLYNK_LATENCY_REPORT");
+    BlynkLatencyReporterStart(stdout, latencyReport ? atoi(latencyReport) : 60, SIGUSR1);
+
+    // Timeline of the first BLYNK_TRACE_SECONDS (default 10), e.g. BLYNK_TRACE=/tmp/blynk.json
+    const char* trace = getenv("BLYNK_TRACE");
+    if (trace) {
+        BlynkTraceThreadName("main");
+        const char* traceSeconds = getenv("BLYNK_TRACE_SECONDS");
+        BlynkTraceStart(trace, traceSeconds ? atoi(traceSeconds) : 10);
+    }
+
+    // Keep samples taken while offline, e.g. BLYNK_OUTBOX=/var/lib/blynk/outbox.bin
+    const char* outbox = getenv("BLYNK_OUTBOX");
+    if (outbox && !BlynkOutboxOpen(outbox)) {
+        printf("Cannot open outbox %s\n", outbox);
+    }
+
+    // Latest sample for local processes, e.g. BLYNK_SNAPSHOT=/blynk-sensors
+    const char* snapshot = getenv("BLYNK_SNAPSHOT");
+    if (!BlynkSnapshotOpen(snapshot ? snapshot : BLYNK_SNAPSHOT_NAME, snapshotNames, 5)) {
+        printf("Cannot create shared memory snapshot\n");
+    }
+
+    // Latest sample, live stream and history on a Unix socket, e.g. BLYNK_STREAM=/run/blynk.sock
+    const char* stream = getenv("BLYNK_STREAM");
+    if (!BlynkStreamOpen(stream ? stream : BLYNK_STREAM_PATH, snapshotNames, 5)) {
+        printf("Cannot open stream socket\n");
+    }
+
     setup();
     sleep(2);
     led1.off();
@@ -12,6 +12,7 @@
 #include <stdlib.h> // For system functions
 #include <unistd.h> // Sleep function
 #include <pthread.h>
+#include <signal.h>
 
 
 // Function definitions
@@ -32,6 +33,7 @@ int getMinsRCTC();
 int getSecsRTC();
 int bcdConverter(int BCD);
 void resetTime(void);
+void toggleCapture(int sig);
 void toggleTime(void);
 int decCompensation(int units);
 int getSystemRunHours(void); //Determine time system has been running
@@ -17,11 +17,38 @@
 #include <Blynk/BlynkTimer.h>
 #include <Blynk/BlynkHandlers.h>
 #include <Blynk/BlynkProtocolDefs.h>
+#include <utility/BlynkFramePool.h>
 
 #if defined(BLYNK_EXPERIMENTAL)
     #include <Blynk/BlynkEveryN.h>
 #endif
 
+#if defined(BLYNK_USE_PIN_CACHE) && defined(LINUX)
+    #include <utility/BlynkPinCache.h>
+    #define BLYNK_HAS_PIN_CACHE
+#endif
+
+// Builds command parameters in 'cmd' with the given statements and sends
+// them. If they do not fit into BLYNK_MAX_SENDBYTES, they are built again in
+// a larger frame buffer of the connection; a command that fits nowhere is
+// streamed to the transport as it is built (see sendParamStreamed()).
+#define BLYNK_SEND_PARAM(command, ...)                              \
+    {                                                               \
+        char mem[BLYNK_MAX_SENDBYTES];                              \
+        BlynkParam cmd(mem, 0, sizeof(mem));                        \
+        __VA_ARGS__;                                                \
+        BlynkFrame frame(static_cast<Proto*>(this)->frames);        \
+        while (cmd.isTruncated() && static_cast<Proto*>(this)->growParam(cmd, frame)) { \
+            __VA_ARGS__;                                            \
+        }                                                           \
+        if (cmd.isTruncated()) {                                    \
+            frame.release();                                        \
+            sendParamStreamed(command, [&](BlynkParam& cmd) { __VA_ARGS__; }); \
+        } else {                                                    \
+            sendParam(command, cmd);                                \
+        }                                                           \
+    }
+
 /**
  * Represents high-level functions of Blynk
  */
@@ -74,12 +101,7 @@ public:
      */
     template <typename... Args>
     void virtualWrite(int pin, Args... values) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add("vw");
-        cmd.add(pin);
-        cmd.add_multi(values...);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_HARDWARE, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_HARDWARE, cmd.add("vw"); cmd.add(pin); cmd.add_multi(values...));
     }
 
     /**
@@ -94,6 +116,9 @@ public:
         BlynkParam cmd(mem, 0, sizeof(mem));
         cmd.add("vw");
         cmd.add(pin);
+#ifdef BLYNK_HAS_PIN_CACHE
+        BlynkPinCacheStore(pin, buff, len);
+#endif
         static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_HARDWARE, 0, cmd.getBuffer(), cmd.getLength(), buff, len);
     }
 
@@ -111,6 +136,11 @@ public:
         virtualWriteBinary(pin, param.getBuffer(), param.getLength());
     }
 
+    template <size_t N>
+    void virtualWrite(int pin, const BlynkParamFixed<N>& param) {
+        virtualWriteBinary(pin, param.getBuffer(), param.getLength());
+    }
+
     /**
      * Requests Server to re-send current values for all widgets.
      */
@@ -123,10 +153,7 @@ public:
      */
     template <typename... Args>
     void sendInternal(Args... params) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add_multi(params...);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_INTERNAL, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_INTERNAL, cmd.add_multi(params...));
     }
 
     /**
@@ -137,11 +164,7 @@ public:
      */
     template <typename... Args>
     void syncVirtual(Args... pins) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add("vr");
-        cmd.add_multi(pins...);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_HARDWARE_SYNC, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_HARDWARE_SYNC, cmd.add("vr"); cmd.add_multi(pins...));
     }
 
     /**
@@ -151,10 +174,7 @@ public:
      */
     template<typename T>
     void tweet(const T& msg) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(msg);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_TWEET, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_TWEET, cmd.add(msg));
     }
 
     /**
@@ -164,10 +184,7 @@ public:
      */
     template<typename T>
     void notify(const T& msg) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(msg);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_NOTIFY, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_NOTIFY, cmd.add(msg));
     }
 
     /**
@@ -177,10 +194,7 @@ public:
      */
     template<typename T>
     void sms(const T& msg) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(msg);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_SMS, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_SMS, cmd.add(msg));
     }
 
     /**
@@ -192,12 +206,7 @@ public:
      */
     template <typename T1, typename T2>
     void email(const char* email, const T1& subject, const T2& msg) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(email);
-        cmd.add(subject);
-        cmd.add(msg);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_EMAIL, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_EMAIL, cmd.add(email); cmd.add(subject); cmd.add(msg));
     }
 
     /**
@@ -208,11 +217,7 @@ public:
      */
     template <typename T1, typename T2>
     void email(const T1& subject, const T2& msg) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(subject);
-        cmd.add(msg);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_EMAIL, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_EMAIL, cmd.add(subject); cmd.add(msg));
     }
 
     /**
@@ -226,12 +231,7 @@ public:
      */
     template <typename T, typename... Args>
     void setProperty(int pin, const T& property, Args... values) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(pin);
-        cmd.add(property);
-        cmd.add_multi(values...);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_PROPERTY, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_PROPERTY, cmd.add(pin); cmd.add(property); cmd.add_multi(values...));
     }
 
     template <typename T>
@@ -252,21 +252,19 @@ public:
         static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_PROPERTY, 0, cmd.getBuffer(), cmd.getLength(), param.getBuffer(), param.getLength());
     }
 
+    template <typename T, size_t N>
+    void setProperty(int pin, const T& property, const BlynkParamFixed<N>& param) {
+        setProperty(pin, property, static_cast<const BlynkParam&>(param));
+    }
+
     template <typename NAME>
     void logEvent(const NAME& event_name) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(event_name);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_EVENT_LOG, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_EVENT_LOG, cmd.add(event_name));
     }
 
     template <typename NAME, typename DESCR>
     void logEvent(const NAME& event_name, const DESCR& description) {
-        char mem[BLYNK_MAX_SENDBYTES];
-        BlynkParam cmd(mem, 0, sizeof(mem));
-        cmd.add(event_name);
-        cmd.add(description);
-        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_EVENT_LOG, 0, cmd.getBuffer(), cmd.getLength()-1);
+        BLYNK_SEND_PARAM(BLYNK_CMD_EVENT_LOG, cmd.add(event_name); cmd.add(description));
     }
 
 #if defined(BLYNK_EXPERIMENTAL)
@@ -315,6 +313,74 @@ public:
 protected:
     void processCmd(const void* buff, size_t len);
     void sendInfo();
+
+    void sendParam(uint8_t command, const BlynkParam& cmd) {
+        if (cmd.isTruncated()) {
+            BLYNK_LOG2(BLYNK_F("Message too big, dropped: "), command);
+            return;
+        }
+#ifdef BLYNK_HAS_PIN_CACHE
+        if (command == BLYNK_CMD_HARDWARE) {
+            BlynkPinCacheStoreCmd(cmd.getBuffer(), cmd.getLength()-1);
+        }
+#endif
+        static_cast<Proto*>(this)->sendCmd(command, 0, cmd.getBuffer(), cmd.getLength()-1);
+    }
+
+    struct ParamSize {
+        size_t length;
+        char   head[16];        // "vw\0<pin>\0..." for the pin cache
+    };
+
+    static void countParam(void* ctx, const void* data, size_t len) {
+        ParamSize& size = *(ParamSize*)ctx;
+        if (!size.length) {
+            const size_t n = (len < sizeof(size.head)) ? len : sizeof(size.head) - 1;
+            memcpy(size.head, data, n);
+            size.head[n] = '\0';
+        }
+        size.length += len;
+    }
+
+    // Parameters too long for any buffer: 'fill' adds them once to be
+    // counted, and once more as they are written out
+    template <typename Fill>
+    void sendParamStreamed(uint8_t command, Fill fill) {
+        ParamSize size = { 0, "" };
+        char mem[BLYNK_MAX_SENDBYTES];
+        BlynkParam cmd(mem, 0, sizeof(mem));
+        cmd.setSink(countParam, &size);
+        fill(cmd);
+        cmd.flush();
+        if (cmd.isTruncated() || size.length < 1) {
+            BLYNK_LOG2(BLYNK_F("Message too big, dropped: "), command);
+            return;
+        }
+#ifdef BLYNK_HAS_PIN_CACHE
+        if (command == BLYNK_CMD_HARDWARE && !memcmp(size.head, "vw\0", 3)) {
+            // Not cached: the previous value must not stay
+            BlynkPinCacheClear(atoi(size.head + 3));
+        }
+#endif
+        static_cast<Proto*>(this)->sendCmdStreamed(command, size.length - 1, fill);
+    }
+
+#ifdef BLYNK_HAS_PIN_CACHE
+    // Sends the cached value of the pin, if it may answer a read
+    bool readFromCache(uint8_t pin) {
+        char mem[8];
+        BlynkParam cmd(mem, 0, sizeof(mem));
+        cmd.add("vw");
+        cmd.add(pin);
+        char value[BLYNK_PIN_CACHE_DATA];
+        const int len = BlynkPinCacheRead(pin, value);
+        if (len < 0) {
+            return false;
+        }
+        static_cast<Proto*>(this)->sendCmd(BLYNK_CMD_HARDWARE, 0, cmd.getBuffer(), cmd.getLength(), value, len);
+        return true;
+    }
+#endif
 };
 
 
@@ -37,6 +37,12 @@
 #define BLYNK_TIMEOUT_MS     3000UL
 #endif
 
+// A link that answers nothing for this long is considered dead, and
+// pings are timed from the measured round trip so it is noticed in time.
+#ifndef BLYNK_DEAD_LINK_MS
+#define BLYNK_DEAD_LINK_MS   (1000UL * BLYNK_HEARTBEAT + BLYNK_TIMEOUT_MS*3)
+#endif
+
 // Limit the amount of outgoing commands per second.
 #ifndef BLYNK_MSG_LIMIT
 #define BLYNK_MSG_LIMIT      15
@@ -52,6 +58,21 @@
 #define BLYNK_MAX_SENDBYTES  128
 #endif
 
+// Preallocated frame buffers, per connection (see utility/BlynkFramePool.h).
+// Small ones take the usual short commands, large ones the rest.
+#ifndef BLYNK_FRAME_SMALL_SIZE
+#define BLYNK_FRAME_SMALL_SIZE   64
+#endif
+#ifndef BLYNK_FRAME_SMALL_COUNT
+#define BLYNK_FRAME_SMALL_COUNT  2
+#endif
+#ifndef BLYNK_FRAME_LARGE_SIZE
+#define BLYNK_FRAME_LARGE_SIZE   BLYNK_MAX_READBYTES
+#endif
+#ifndef BLYNK_FRAME_LARGE_COUNT
+#define BLYNK_FRAME_LARGE_COUNT  1
+#endif
+
 // Uncomment to use Let's Encrypt Root CA
 //#define BLYNK_SSL_USE_LETSENCRYPT
 
@@ -64,6 +85,9 @@
 // Uncomment to enable debug prints.
 //#define BLYNK_DEBUG
 
+// Uncomment to print logs from a background thread (Linux only).
+//#define BLYNK_LOG_ASYNC
+
 // Uncomment to force-enable 128 virtual pins
 //#define BLYNK_USE_128_VPINS
 
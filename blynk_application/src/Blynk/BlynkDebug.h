@@ -241,6 +241,25 @@ void            BlynkFatal() BLYNK_NORETURN;
 
         #include <iostream>
         using namespace std;
+
+#if defined(BLYNK_LOG_ASYNC)
+        // Records are captured here and printed by a background thread
+        #include <utility/BlynkLogAsync.h>
+
+        #define BLYNK_LOG(msg, ...)       { BlynkLogAsync(BLYNK_LOGREC_FMT, msg BLYNK_NEWLINE, ##__VA_ARGS__); }
+        #define BLYNK_LOG1(p1)            { BlynkLogAsync(BLYNK_LOGREC_STREAM, NULL, p1); }
+        #define BLYNK_LOG2(p1,p2)         { BlynkLogAsync(BLYNK_LOGREC_STREAM, NULL, p1, p2); }
+        #define BLYNK_LOG3(p1,p2,p3)      { BlynkLogAsync(BLYNK_LOGREC_STREAM, NULL, p1, p2, p3); }
+        #define BLYNK_LOG4(p1,p2,p3,p4)   { BlynkLogAsync(BLYNK_LOGREC_STREAM, NULL, p1, p2, p3, p4); }
+        #define BLYNK_LOG6(p1,p2,p3,p4,p5,p6)   { BlynkLogAsync(BLYNK_LOGREC_STREAM, NULL, p1, p2, p3, p4, p5, p6); }
+
+#ifdef BLYNK_DEBUG
+        #define BLYNK_DBG_BREAK()    raise(SIGTRAP);
+        #define BLYNK_ASSERT(expr)   assert(expr)
+        #define BLYNK_DBG_DUMP(msg, addr, len) BlynkLogAsyncDump(msg, addr, len)
+#endif
+
+#else
         #define BLYNK_LOG(msg, ...)       { fprintf(BLYNK_PRINT, "[%ld] " msg BLYNK_NEWLINE, BlynkMillis(), ##__VA_ARGS__); }
         #define BLYNK_LOG1(p1)            { BLYNK_LOG_TIME(); cout << p1 << endl; }
         #define BLYNK_LOG2(p1,p2)         { BLYNK_LOG_TIME(); cout << p1 << p2 << endl; }
@@ -277,6 +296,8 @@ void            BlynkFatal() BLYNK_NORETURN;
         }
 #endif
 
+#endif // BLYNK_LOG_ASYNC
+
     #else
 
         #warning "Cannot detect platform"
@@ -216,6 +216,9 @@ struct BlynkReq
 typedef void (*WidgetReadHandler)(BlynkReq BLYNK_UNUSED &request);
 typedef void (*WidgetWriteHandler)(BlynkReq BLYNK_UNUSED &request, const BlynkParam BLYNK_UNUSED &param);
 
+// Sees each virtual pin write before its handler; returning true consumes it
+typedef bool (*BlynkWriteHook)(const BlynkReq& request, const BlynkParam& param);
+
 WidgetReadHandler GetReadHandler(uint8_t pin);
 WidgetWriteHandler GetWriteHandler(uint8_t pin);
 
@@ -19,6 +19,9 @@
 #define BLYNK_PARAM_KV(k, v) k "\0" v "\0"
 #define BLYNK_PARAM_PLACEHOLDER_64 "PlaceholderPlaceholderPlaceholderPlaceholderPlaceholderPlaceholder"
 
+// Takes the contents of a streaming BlynkParam, one buffer-full at a time
+typedef void (*BlynkParamSink)(void* ctx, const void* data, size_t len);
+
 class BlynkParam
 {
 public:
@@ -59,12 +62,14 @@ public:
 public:
     explicit
     BlynkParam(const void* addr, size_t length)
-        : buff((char*)addr), len(length), buff_size(length)
+        : buff((char*)addr), len(length), buff_size(length), truncated(false)
+        , sink(NULL), sinkCtx(NULL)
     {}
 
     explicit
     BlynkParam(void* addr, size_t length, size_t buffsize)
-        : buff((char*)addr), len(length), buff_size(buffsize)
+        : buff((char*)addr), len(length), buff_size(buffsize), truncated(false)
+        , sink(NULL), sinkCtx(NULL)
     {}
 
     const char* asStr() const       { return buff; }
@@ -86,6 +91,16 @@ public:
 
     void*  getBuffer() const { return (void*)buff; }
     size_t getLength() const { return len; }
+    size_t getBufferSize() const { return buff_size; }
+
+    // True if some value did not fit and was left out
+    bool isTruncated() const { return truncated; }
+
+    // Streams: when the buffer is full, its contents are passed to 'sink'
+    // and it is reused, so values of any length can be added. The rest is
+    // passed on by flush().
+    void setSink(BlynkParamSink s, void* ctx) { sink = s; sinkCtx = ctx; }
+    void flush();
 
     // Modification
     void add(int value);
@@ -125,12 +140,19 @@ public:
     }
 
 protected:
+    template <typename T>
+    void add_format(const char* fmt, T value);
+
     char*    buff;
     size_t   len;
     size_t   buff_size;
+    bool     truncated;
+    BlynkParamSink sink;
+    void*    sinkCtx;
 };
 
 
+// Allocates its buffer on the heap, every time it is created
 class BlynkParamAllocated
     : public BlynkParam
 {
@@ -143,6 +165,23 @@ public:
     }
 };
 
+// Same, with the buffer inside of the object (e.g. on the stack)
+template <size_t N>
+class BlynkParamFixed
+    : public BlynkParam
+{
+public:
+    BlynkParamFixed()
+        : BlynkParam(mem, 0, N)
+    {}
+
+private:
+    BlynkParamFixed(const BlynkParamFixed&);
+    BlynkParamFixed& operator=(const BlynkParamFixed&);
+
+    char mem[N];
+};
+
 inline
 BlynkParam::iterator BlynkParam::operator[](int index) const
 {
@@ -169,11 +208,33 @@ BlynkParam::iterator BlynkParam::operator[](const char* key) const
     return iterator::invalid();
 }
 
+inline
+void BlynkParam::flush()
+{
+    if (sink && len) {
+        sink(sinkCtx, buff, len);
+        len = 0;
+    }
+}
+
 inline
 void BlynkParam::add(const void* b, size_t l)
 {
-    if (len + l > buff_size)
-        return;
+    if (len + l > buff_size) {
+        if (!sink) {
+            truncated = true;
+            return;
+        }
+        // Fill up the buffer and pass it on, as often as needed
+        while (len + l > buff_size) {
+            const size_t n = buff_size - len;
+            memcpy(buff+len, b, n);
+            len += n;
+            flush();
+            b = (const char*)b + n;
+            l -= n;
+        }
+    }
     memcpy(buff+len, b, l);
     len += l;
 }
@@ -182,7 +243,7 @@ inline
 void BlynkParam::add(const char* str)
 {
     if (str == NULL) {
-        buff[len++] = '\0';
+        add("", 1);
         return;
     }
     add(str, strlen(str)+1);
@@ -212,8 +273,10 @@ void BlynkParam::add(const __FlashStringHelper* ifsh)
 {
     PGM_P p = reinterpret_cast<PGM_P>(ifsh);
     size_t l = strlen_P(p) + 1;
-    if (len + l > buff_size)
+    if (len + l > buff_size) {
+        truncated = true;
         return;
+    }
     memcpy_P(buff+len, p, l);
     len += l;
     buff[len] = '\0';
@@ -298,40 +361,59 @@ void BlynkParam::add(const __FlashStringHelper* ifsh)
 
     #include <stdio.h>
 
+    template <typename T>
+    inline
+    void BlynkParam::add_format(const char* fmt, T value)
+    {
+        size_t room = (len < buff_size) ? (buff_size - len) : 0;
+        int l = snprintf(buff+len, room, fmt, value);
+        if (sink && l >= 0 && size_t(l) >= room && len) {
+            // Again at the start of an empty buffer
+            flush();
+            room = buff_size;
+            l = snprintf(buff, room, fmt, value);
+        }
+        if (l < 0 || size_t(l) >= room) {
+            truncated = true;
+            return;
+        }
+        len += l+1;
+    }
+
     inline
     void BlynkParam::add(int value)
     {
-        len += snprintf(buff+len, buff_size-len, "%i", value)+1;
+        add_format("%i", value);
     }
 
     inline
     void BlynkParam::add(unsigned int value)
     {
-        len += snprintf(buff+len, buff_size-len, "%u", value)+1;
+        add_format("%u", value);
     }
 
     inline
     void BlynkParam::add(long value)
     {
-        len += snprintf(buff+len, buff_size-len, "%li", value)+1;
+        add_format("%li", value);
     }
 
     inline
     void BlynkParam::add(unsigned long value)
     {
-        len += snprintf(buff+len, buff_size-len, "%lu", value)+1;
+        add_format("%lu", value);
     }
 
     inline
     void BlynkParam::add(long long value)
     {
-        len += snprintf(buff+len, buff_size-len, "%lli", value)+1;
+        add_format("%lli", value);
     }
 
     inline
     void BlynkParam::add(unsigned long long value)
     {
-        len += snprintf(buff+len, buff_size-len, "%llu", value)+1;
+        add_format("%llu", value);
     }
 
 #ifndef BLYNK_NO_FLOAT
@@ -361,13 +443,13 @@ void BlynkParam::add(const __FlashStringHelper* ifsh)
     inline
     void BlynkParam::add(float value)
     {
-        len += snprintf(buff+len, buff_size-len, "%2.3f", value)+1;
+        add_format("%2.3f", value);
     }
 
     inline
     void BlynkParam::add(double value)
     {
-        len += snprintf(buff+len, buff_size-len, "%2.7f", value)+1;
+        add_format("%2.7f", value);
     }
 
 #endif
@@ -17,6 +17,117 @@
 #include <Blynk/BlynkProtocolDefs.h>
 #include <Blynk/BlynkApi.h>
 #include <utility/BlynkUtility.h>
+#include <utility/BlynkProbes.h>
+#include <utility/BlynkFramePool.h>
+
+#if defined(BLYNK_USE_CAPTURE) && defined(LINUX)
+    #include <utility/BlynkCapture.h>
+    #define BLYNK_HAS_CAPTURE
+    #define BLYNK_CAPTURE_FRAME(dir, ...) { if (BlynkCaptureEnabled()) BlynkCaptureFrame(dir, __VA_ARGS__); }
+#else
+    #define BLYNK_CAPTURE_FRAME(dir, ...)
+#endif
+
+#if defined(BLYNK_USE_OUTBOX) && defined(LINUX)
+    #include <utility/BlynkOutbox.h>
+    #define BLYNK_HAS_OUTBOX
+#endif
+
+#if defined(BLYNK_USE_SCHEDULER)
+    #include <utility/BlynkScheduler.h>
+    #define BLYNK_HAS_SCHEDULER
+#endif
+
+#if defined(BLYNK_USE_WORKERS) && defined(LINUX)
+    #include <utility/BlynkWorkers.h>
+    #define BLYNK_HAS_WORKERS
+#endif
+
+#if defined(BLYNK_USE_LATENCY) && defined(LINUX)
+    #include <utility/BlynkLatency.h>
+    #define BLYNK_HAS_LATENCY
+    #define BLYNK_PROTO_LATENCY(name) BLYNK_LATENCY_SCOPE(name)
+#else
+    #define BLYNK_PROTO_LATENCY(name)
+#endif
+
+#if defined(BLYNK_USE_TRACE) && defined(LINUX)
+    #include <utility/BlynkTrace.h>
+    #define BLYNK_HAS_TRACE
+    #define BLYNK_PROTO_TRACE(...)          BLYNK_TRACE_SCOPE(__VA_ARGS__)
+    #define BLYNK_PROTO_TRACE_INSTANT(...)  BlynkTraceInstant(__VA_ARGS__)
+#else
+    #define BLYNK_PROTO_TRACE(...)
+    #define BLYNK_PROTO_TRACE_INSTANT(...)
+#endif
+
+typedef void (*BlynkRunHook)(millis_time_t now);
+
+// Receives a frame that is too big for the frame buffers, one chunk at a time.
+// 'hdr.length' is the full length; 'data' is zero-terminated.
+typedef void (*BlynkFrameStreamHandler)(const BlynkHeader& hdr, size_t offset, const uint8_t* data, size_t len);
+
+// Receives the status code of each response, once connected
+typedef void (*BlynkResponseHandler)(uint16_t msgId, uint16_t code);
+
+// Callbacks polled by run() while connected, e.g. to flush buffered widget output
+class BlynkRunHooks
+{
+public:
+    enum { MAX_HOOKS = 4 };
+
+    static bool add(BlynkRunHook hook) {
+        BlynkRunHook* hooks = list();
+        for (unsigned i = 0; i < MAX_HOOKS; i++) {
+            if (hooks[i] == hook) return true;
+            if (!hooks[i]) { hooks[i] = hook; return true; }
+        }
+        return false;
+    }
+
+    static void call(millis_time_t now) {
+        BlynkRunHook* hooks = list();
+        for (unsigned i = 0; i < MAX_HOOKS && hooks[i]; i++) {
+            hooks[i](now);
+        }
+    }
+
+private:
+    static BlynkRunHook* list() {
+        static BlynkRunHook hooks[MAX_HOOKS];
+        return hooks;
+    }
+};
+
+// Response handlers of helpers (BlynkSync, BlynkCoroLoop), called after the
+// one given to setResponseHandler()
+class BlynkResponseHooks
+{
+public:
+    enum { MAX_HOOKS = 4 };
+
+    static bool add(BlynkResponseHandler hook) {
+        BlynkResponseHandler* hooks = list();
+        for (unsigned i = 0; i < MAX_HOOKS; i++) {
+            if (hooks[i] == hook) return true;
+            if (!hooks[i]) { hooks[i] = hook; return true; }
+        }
+        return false;
+    }
+
+    static void call(uint16_t msgId, uint16_t code) {
+        BlynkResponseHandler* hooks = list();
+        for (unsigned i = 0; i < MAX_HOOKS && hooks[i]; i++) {
+            hooks[i](msgId, code);
+        }
+    }
+
+private:
+    static BlynkResponseHandler* list() {
+        static BlynkResponseHandler hooks[MAX_HOOKS];
+        return hooks;
+    }
+};
 
 template <class Transp>
 class BlynkProtocol
@@ -34,13 +145,27 @@ public:
     BlynkProtocol(Transp& transp)
         : conn(transp)
         , authkey(NULL)
-        , redir_serv(NULL)
         , lastActivityIn(0)
         , lastActivityOut(0)
         , lastHeartbeat(0)
         , msgIdOut(0)
         , msgIdOutOverride(0)
+        , pingId(0)
         , nesting(0)
+        , rttAvg(0)
+        , rttVar(0)
+#ifdef BLYNK_HAS_OUTBOX
+        , outboxReplay(false)
+#endif
+#ifdef BLYNK_HAS_SCHEDULER
+        , schedSending(false)
+#if defined(LINUX)
+        , runThread(0)
+#endif
+#endif
+        , streamHandler(NULL)
+        , writeHook(NULL)
+        , responseHandler(NULL)
         , state(CONNECTING)
     {}
 
@@ -48,6 +173,16 @@ public:
 
     bool isTokenInvalid() const { return state == TOKEN_INVALID; }
 
+    // Smoothed round trip of pings, in ms (0 until measured)
+    uint32_t rtt() const { return rttAvg; }
+
+    // How long a ping may go unanswered: the round trip plus four times
+    // its variation, within 1/4..1/2 of BLYNK_DEAD_LINK_MS
+    uint32_t responseTimeout() const {
+        const uint32_t rto = rttAvg + 4 * rttVar;
+        return BlynkMin(BlynkMax(rto, uint32_t(BLYNK_DEAD_LINK_MS / 4)), uint32_t(BLYNK_DEAD_LINK_MS / 2));
+    }
+
     bool connect(uint32_t timeout = BLYNK_TIMEOUT_MS*3) {
         conn.disconnect();
         state = CONNECTING;
@@ -68,6 +203,49 @@ public:
 
     bool run(bool avail = false);
 
+    // Frames larger than BlynkFramePool::maxSize() are passed here in chunks.
+    // Without a handler, they are skipped.
+    void setFrameStreamHandler(BlynkFrameStreamHandler handler) {
+        streamHandler = handler;
+    }
+
+    void setWriteHook(BlynkWriteHook hook) {
+        writeHook = hook;
+    }
+
+    void setResponseHandler(BlynkResponseHandler handler) {
+        responseHandler = handler;
+    }
+
+    // True if a rate-limited command sent now goes out right away,
+    // without waiting for the BLYNK_MSG_LIMIT budget
+    bool canSend() const {
+        if (state != CONNECTED) {
+            return false;
+        }
+#ifdef BLYNK_HAS_SCHEDULER
+        if (sched.pending()) {
+            return false;
+        }
+#endif
+#if defined(BLYNK_MSG_LIMIT) && BLYNK_MSG_LIMIT > 0
+        const millis_time_t allowed_time = BlynkMax(lastActivityOut, lastActivityIn) + 1000/BLYNK_MSG_LIMIT;
+        if (int32_t(allowed_time - BlynkMillis()) >= 0) {
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    // Id of the last command sent (or queued), to match its response.
+    // Inside a handler, commands carry the id of the server's request.
+    uint16_t lastMsgId() const { return msgIdOutOverride ? msgIdOutOverride : msgIdOut; }
+
+#ifdef BLYNK_HAS_SCHEDULER
+    // Outbound queue: pin classes, weights and statistics
+    BlynkScheduler& scheduler() { return sched; }
+#endif
+
     // TODO: Fixme
     void startSession() {
         conn.connect();
@@ -76,7 +254,11 @@ public:
         lastHeartbeat = lastActivityIn = lastActivityOut = (BlynkMillis() - 5000UL);
     }
 
-    void sendCmd(uint8_t cmd, uint16_t id = 0, const void* data = NULL, size_t length = 0, const void* data2 = NULL, size_t length2 = 0);
+    // True if the command was written to the transport (not stored, queued or skipped)
+    bool sendCmd(uint8_t cmd, uint16_t id = 0, const void* data = NULL, size_t length = 0, const void* data2 = NULL, size_t length2 = 0);
+
+    template <typename Fill>
+    void sendCmdStreamed(uint8_t cmd, size_t length, Fill fill);
 
     void printBanner() {
 #if defined(BLYNK_NO_FANCY_LOGO)
@@ -95,13 +277,50 @@ public:
 private:
 
     void internalReconnect() {
+        BLYNK_PROTO_TRACE_INSTANT("reconnect");
+        BLYNK_PROBE1(reconnect, int(state));
         state = CONNECTING;
         conn.disconnect();
         BlynkOnDisconnected();
     }
 
     int readHeader(BlynkHeader& hdr);
+    bool readBody(uint8_t* buff, size_t len);
+    bool streamInput(const BlynkHeader& hdr);
+#if defined(BLYNK_SEND_ATOMIC) || defined(ESP8266) || defined(ESP32) || defined(SPARK) || defined(PARTICLE) || defined(ENERGIA)
+    size_t writeAtomic(BlynkFrame& frame, const BlynkHeader& hdr, const void* data, size_t length, const void* data2, size_t length2);
+    bool writeChunked(const uint8_t* buff, size_t len, size_t& wlen);
+#endif
     uint16_t getNextMsgId();
+    bool growParam(BlynkParam& cmd, BlynkFrame& frame);
+    void waitForMsgLimit(uint8_t cmd);
+
+    struct StreamOut {
+        BlynkProtocol* self;
+        size_t left;            // body bytes still to write
+        size_t written;
+        bool   failed;
+    };
+    static void writeStreamed(void* ctx, const void* data, size_t len);
+    void rttSample(uint32_t ms);
+#ifdef BLYNK_HAS_OUTBOX
+    void replayOutbox(millis_time_t t);
+#endif
+#ifdef BLYNK_HAS_SCHEDULER
+    void schedule(uint8_t cmd, uint16_t id, const void* data, size_t length, const void* data2, size_t length2);
+    void sendScheduled();
+    bool onRunThread() const;
+    bool schedBypass() const {
+        // Only the thread inside sendScheduled() bypasses the queue
+        return onRunThread() && schedSending;
+    }
+#endif
+#ifdef BLYNK_HAS_WORKERS
+    bool runOnWorker(WidgetWriteHandler handler, uint8_t pin, const BlynkParam& param);
+    bool runOnWorker(WidgetReadHandler handler, uint8_t pin);
+    bool waitForWorker(BlynkWorkerDispatch res);
+    void sendWorkerResults();
+#endif
 
 protected:
     void begin(const char* auth) {
@@ -118,7 +337,7 @@ protected:
 
 private:
     const char* authkey;
-    char*       redir_serv;
+    char        redir_serv[32];
     millis_time_t lastActivityIn;
     millis_time_t lastActivityOut;
     union {
@@ -127,7 +346,24 @@ private:
     };
     uint16_t msgIdOut;
     uint16_t msgIdOutOverride;
+    uint16_t pingId;            // of the unanswered ping
     uint8_t  nesting;
+    uint32_t rttAvg;
+    uint32_t rttVar;
+#ifdef BLYNK_HAS_OUTBOX
+    bool     outboxReplay;
+#endif
+#ifdef BLYNK_HAS_SCHEDULER
+    BlynkScheduler sched;
+    bool     schedSending;
+#if defined(LINUX)
+    pthread_t runThread;        // the last one that called run()
+#endif
+#endif
+    BlynkFramePool frames;
+    BlynkFrameStreamHandler streamHandler;
+    BlynkWriteHook          writeHook;
+    BlynkResponseHandler    responseHandler;
 protected:
     BlynkState state;
 };
@@ -147,12 +383,18 @@ bool BlynkProtocol<Transp>::run(bool avail)
       //BLYNK_LOG1(BLYNK_F("Nested run() skipped"));
       return true;
     }
+    BLYNK_PROTO_LATENCY("proto.run");
+#if defined(BLYNK_HAS_SCHEDULER) && defined(LINUX)
+    __atomic_store_n(&runThread, pthread_self(), __ATOMIC_RELAXED);
+#endif
 
     if (conn.connected()) {
-        while (avail || conn.available() > 0) {
+        // Input waits while a nested run() would have no buffer for it
+        while ((avail || conn.available() > 0) && frames.canReceive()) {
             //BLYNK_LOG2(BLYNK_F("Available: "), conn.available());
             //const unsigned long t = micros();
             if (!processInput()) {
+                BLYNK_PROTO_TRACE_INSTANT("disconnect");
                 conn.disconnect();
 // TODO: Only when in direct mode?
 #ifdef BLYNK_USE_DIRECT_CONNECT
@@ -178,7 +420,12 @@ bool BlynkProtocol<Transp>::run(bool avail)
             return false;
         }
 
-        if (t - lastActivityIn > (1000UL * BLYNK_HEARTBEAT + BLYNK_TIMEOUT_MS*3)) {
+        // The next ping leaves time for its answer within BLYNK_DEAD_LINK_MS
+        const uint32_t rto = responseTimeout();
+        const uint32_t pingIdle = BlynkMin(uint32_t(BLYNK_DEAD_LINK_MS - rto), uint32_t(1000UL * BLYNK_HEARTBEAT));
+        const bool pingPending = int32_t(lastHeartbeat - lastActivityIn) > 0;
+
+        if (t - lastActivityIn > BLYNK_DEAD_LINK_MS || (pingPending && t - lastHeartbeat > rto)) {
 #ifdef BLYNK_DEBUG
             BLYNK_LOG6(BLYNK_F("Heartbeat timeout: "), t, BLYNK_F(", "), lastActivityIn, BLYNK_F(", "), lastHeartbeat);
 #else
@@ -186,15 +433,30 @@ bool BlynkProtocol<Transp>::run(bool avail)
 #endif
             internalReconnect();
             return false;
-        } else if ((t - lastActivityIn  > 1000UL * BLYNK_HEARTBEAT ||
-                    t - lastActivityOut > 1000UL * BLYNK_HEARTBEAT) &&
-                    t - lastHeartbeat   > BLYNK_TIMEOUT_MS)
+        } else if (!pingPending &&
+                   (t - lastActivityIn  > pingIdle ||
+                    t - lastActivityOut > 1000UL * BLYNK_HEARTBEAT))
         {
-            // Send ping if we didn't either send or receive something
-            // for BLYNK_HEARTBEAT seconds
+            // Send ping if we didn't receive anything for pingIdle,
+            // or didn't send anything for BLYNK_HEARTBEAT seconds
+            BLYNK_PROTO_TRACE_INSTANT("heartbeat");
+            BLYNK_PROBE2(heartbeat, uint32_t(t - lastActivityIn), uint32_t(t - lastActivityOut));
             sendCmd(BLYNK_CMD_PING);
+            pingId = lastMsgId();
             lastHeartbeat = t;
         }
+        if (nesting == 1) {
+            BlynkRunHooks::call(t);
+#ifdef BLYNK_HAS_WORKERS
+            sendWorkerResults();
+#endif
+#ifdef BLYNK_HAS_SCHEDULER
+            sendScheduled();
+#endif
+#ifdef BLYNK_HAS_OUTBOX
+            replayOutbox(t);
+#endif
+        }
     } else if (state == CONNECTING) {
 #ifdef BLYNK_USE_DIRECT_CONNECT
         if (!tconn)
@@ -213,6 +475,7 @@ bool BlynkProtocol<Transp>::run(bool avail)
             }
 
             msgIdOut = 1;
+            BLYNK_PROTO_TRACE_INSTANT("login");
             sendCmd(BLYNK_CMD_HW_LOGIN, 1, authkey, strlen(authkey));
             lastLogin = lastActivityOut;
             return true;
@@ -226,6 +489,7 @@ template <class Transp>
 BLYNK_FORCE_INLINE
 bool BlynkProtocol<Transp>::processInput(void)
 {
+    BLYNK_PROTO_TRACE("receive");
     BlynkHeader hdr;
     const int ret = readHeader(hdr);
 
@@ -242,6 +506,10 @@ bool BlynkProtocol<Transp>::processInput(void)
 
     if (hdr.type == BLYNK_CMD_RESPONSE) {
         lastActivityIn = BlynkMillis();
+#ifdef BLYNK_HAS_CAPTURE
+        BlynkHeader raw = { hdr.type, htons(hdr.msg_id), htons(hdr.length) };
+        BLYNK_CAPTURE_FRAME(BLYNK_CAPTURE_IN, &raw, sizeof(raw));
+#endif
 
 #ifndef BLYNK_USE_DIRECT_CONNECT
         if (state == CONNECTING && (1 == hdr.msg_id)) {
@@ -249,8 +517,10 @@ bool BlynkProtocol<Transp>::processInput(void)
             case BLYNK_SUCCESS:
             case BLYNK_ALREADY_REGISTERED:
                 BLYNK_LOG3(BLYNK_F("Ready (ping: "), lastActivityIn-lastHeartbeat, BLYNK_F("ms)."));
+                rttSample(lastActivityIn - lastHeartbeat);
                 lastHeartbeat = lastActivityIn;
                 state = CONNECTED;
+                BLYNK_PROTO_TRACE_INSTANT("connected");
 #ifdef BLYNK_DEBUG
                 if (size_t ram = BlynkFreeRam()) {
                     BLYNK_LOG2(BLYNK_F("Free RAM: "), ram);
@@ -274,26 +544,36 @@ bool BlynkProtocol<Transp>::processInput(void)
         }
 #endif
         // TODO: return code may indicate App presence
+        if (pingId && hdr.msg_id == pingId) {
+            rttSample(lastActivityIn - lastHeartbeat);
+            pingId = 0;
+        }
+        if (responseHandler) {
+            responseHandler(hdr.msg_id, hdr.length);
+        }
+        BlynkResponseHooks::call(hdr.msg_id, hdr.length);
         return true;
     }
 
-    if (hdr.length > BLYNK_MAX_READBYTES) {
-        BLYNK_LOG2(BLYNK_F("Packet too big: "), hdr.length);
-        // TODO: Flush
-        internalReconnect();
-        return true;
+    BlynkFrame frame(frames);
+    if (!frame.acquire(hdr.length)) {
+        return streamInput(hdr);
     }
 
-    uint8_t inputBuffer[hdr.length+1]; // Add 1 to zero-terminate
-    if (hdr.length != conn.read(inputBuffer, hdr.length)) {
-#ifdef BLYNK_DEBUG
-        BLYNK_LOG1(BLYNK_F("Can't read body"));
-#endif
+    uint8_t* inputBuffer = frame.data(); // Has room to zero-terminate
+    if (!readBody(inputBuffer, hdr.length)) {
         return false;
     }
     inputBuffer[hdr.length] = '\0';
+    BLYNK_PROBE3(input, hdr.type, hdr.msg_id, hdr.length);
 
     BLYNK_DBG_DUMP(">", inputBuffer, hdr.length);
+#ifdef BLYNK_HAS_CAPTURE
+    {
+        BlynkHeader raw = { hdr.type, htons(hdr.msg_id), htons(hdr.length) };
+        BLYNK_CAPTURE_FRAME(BLYNK_CAPTURE_IN, &raw, sizeof(raw), inputBuffer, hdr.length);
+    }
+#endif
 
     lastActivityIn = BlynkMillis();
 
@@ -311,6 +591,7 @@ bool BlynkProtocol<Transp>::processInput(void)
         if (state == CONNECTING) {
             BLYNK_LOG1(BLYNK_F("Ready"));
             state = CONNECTED;
+            BLYNK_PROTO_TRACE_INSTANT("connected");
 #ifdef BLYNK_DEBUG
             if (size_t ram = BlynkFreeRam()) {
                 BLYNK_LOG2(BLYNK_F("Free RAM: "), ram);
@@ -326,9 +607,6 @@ bool BlynkProtocol<Transp>::processInput(void)
         sendCmd(BLYNK_CMD_RESPONSE, hdr.msg_id, NULL, BLYNK_SUCCESS);
     } break;
     case BLYNK_CMD_REDIRECT: {
-        if (!redir_serv) {
-             redir_serv = (char*)malloc(32);
-        }
         BlynkParam param(inputBuffer, hdr.length);
         uint16_t redir_port = BLYNK_DEFAULT_PORT; // TODO: Fixit
 
@@ -336,8 +614,8 @@ bool BlynkProtocol<Transp>::processInput(void)
         if (it >= param.end())
             return false;
 
-        strncpy(redir_serv, it.asStr(), 32);
-        redir_serv[31] = '\0';
+        strncpy(redir_serv, it.asStr(), sizeof(redir_serv));
+        redir_serv[sizeof(redir_serv)-1] = '\0';
 
         if (++it < param.end())
             redir_port = it.asLong();
@@ -392,6 +670,7 @@ bool BlynkProtocol<Transp>::processInput(void)
     } break;
     }
 
+    BLYNK_PROBE3(input__done, hdr.type, hdr.msg_id, hdr.length);
     return true;
 }
 
@@ -411,10 +690,61 @@ int BlynkProtocol<Transp>::readHeader(BlynkHeader& hdr)
 
     hdr.msg_id = ntohs(hdr.msg_id);
     hdr.length = ntohs(hdr.length);
+    BLYNK_PROBE3(header, hdr.type, hdr.msg_id, hdr.length);
 
     return rlen;
 }
 
+template <class Transp>
+bool BlynkProtocol<Transp>::readBody(uint8_t* buff, size_t len)
+{
+    size_t rlen = 0;
+    while (rlen < len) {
+        const size_t r = conn.read(buff + rlen, len - rlen);
+        if (r == 0 || r > len - rlen) {
+            break;
+        }
+        rlen += r;
+    }
+    if (rlen != len) {
+#ifdef BLYNK_DEBUG
+        BLYNK_LOG1(BLYNK_F("Can't read body"));
+#endif
+        return false;
+    }
+    return true;
+}
+
+template <class Transp>
+bool BlynkProtocol<Transp>::streamInput(const BlynkHeader& hdr)
+{
+    BlynkFrame frame(frames);
+    if (!frame.acquireLargest()) {
+        return false;
+    }
+    if (!streamHandler) {
+        BLYNK_LOG2(BLYNK_F("Packet too big: "), hdr.length);
+    }
+    BLYNK_PROBE3(input, hdr.type, hdr.msg_id, hdr.length);
+
+    // Consumed in chunks, so the connection stays in sync
+    for (size_t offset = 0; offset < hdr.length; ) {
+        const size_t chunk = BlynkMin(frame.size(), size_t(hdr.length - offset));
+        if (!readBody(frame.data(), chunk)) {
+            return false;
+        }
+        frame.data()[chunk] = '\0';
+        if (streamHandler) {
+            streamHandler(hdr, offset, frame.data(), chunk);
+        }
+        offset += chunk;
+    }
+
+    lastActivityIn = BlynkMillis();
+    BLYNK_PROBE3(input__done, hdr.type, hdr.msg_id, hdr.length);
+    return true;
+}
+
 #ifndef BLYNK_SEND_THROTTLE
 #define BLYNK_SEND_THROTTLE 0
 #endif
@@ -424,27 +754,140 @@ int BlynkProtocol<Transp>::readHeader(BlynkHeader& hdr)
 #endif
 
 template <class Transp>
-void BlynkProtocol<Transp>::sendCmd(uint8_t cmd, uint16_t id, const void* data, size_t length, const void* data2, size_t length2)
+bool BlynkProtocol<Transp>::sendCmd(uint8_t cmd, uint16_t id, const void* data, size_t length, const void* data2, size_t length2)
 {
+    BLYNK_PROTO_LATENCY("proto.sendCmd");
+    BLYNK_PROTO_TRACE("send", cmd);
+#ifdef BLYNK_HAS_WORKERS
+    // Called from a handler on a worker thread: run() sends it
+    if (BlynkWorkersPost(cmd, id, data, length, data2, length2)) {
+        return false;
+    }
+#endif
     if (!conn.connected() || (cmd != BLYNK_CMD_RESPONSE && cmd != BLYNK_CMD_PING && cmd != BLYNK_CMD_LOGIN && cmd != BLYNK_CMD_HW_LOGIN && state != CONNECTED) ) {
+#ifdef BLYNK_HAS_OUTBOX
+        if (!outboxReplay && BlynkOutboxAccepts(cmd, data, length)) {
+            BlynkOutboxPush(cmd, data, length, data2, length2);
+            return false;
+        }
+#endif
 #ifdef BLYNK_DEBUG_ALL
         BLYNK_LOG2(BLYNK_F("Cmd skipped:"), cmd);
 #endif
-        return;
+        return false;
     }
 
     if (0 == id) {
         id = getNextMsgId();
     }
 
+#ifdef BLYNK_HAS_SCHEDULER
+    if (!schedBypass() && cmd >= BLYNK_CMD_TWEET && cmd <= BLYNK_CMD_HARDWARE &&
+        BlynkScheduler::fits((data ? length : 0) + (data2 ? length2 : 0)))
+    {
+        schedule(cmd, id, data, length, data2, length2);
+        return false;
+    }
+#endif
+    BLYNK_PROBE3(send__start, cmd, id, uint32_t(length + length2));
+    waitForMsgLimit(cmd);
+
+    const size_t full_length = (sizeof(BlynkHeader)) +
+                               (data  ? length  : 0) +
+                               (data2 ? length2 : 0);
+
+    BlynkHeader hdr;
+    hdr.type = cmd;
+    hdr.msg_id = htons(id);
+    hdr.length = htons(length+length2);
+
+    size_t wlen;
+#if defined(BLYNK_SEND_ATOMIC) || defined(ESP8266) || defined(ESP32) || defined(SPARK) || defined(PARTICLE) || defined(ENERGIA)
+    // Those have more RAM and like single write at a time...
+    BlynkFrame frame(frames);
+    if (frame.acquire(full_length) || frame.acquireLargest()) {
+        wlen = writeAtomic(frame, hdr, data, length, data2, length2);
+    } else
+#endif
+    {
+        BLYNK_DBG_DUMP("<", &hdr, sizeof(hdr));
+        wlen = conn.write(&hdr, sizeof(hdr));
+        BlynkDelay(BLYNK_SEND_THROTTLE);
+
+        if (cmd != BLYNK_CMD_RESPONSE) {
+            if (length) {
+                BLYNK_DBG_DUMP("<", data, length);
+                wlen += conn.write(data, length);
+                BlynkDelay(BLYNK_SEND_THROTTLE);
+            }
+            if (length2) {
+                BLYNK_DBG_DUMP("<", data2, length2);
+                wlen += conn.write(data2, length2);
+                BlynkDelay(BLYNK_SEND_THROTTLE);
+            }
+        }
+    }
+
+    if (wlen != full_length) {
+#ifdef BLYNK_DEBUG
+        BLYNK_LOG4(BLYNK_F("Sent "), wlen, '/', full_length);
+#endif
+        BLYNK_PROBE3(send__error, cmd, id, uint32_t(wlen));
+        internalReconnect();
+        return false;
+    }
+
+#ifdef BLYNK_HAS_CAPTURE
+    if (cmd != BLYNK_CMD_RESPONSE) {
+        BLYNK_CAPTURE_FRAME(BLYNK_CAPTURE_OUT, &hdr, sizeof(hdr), data, data ? length : 0, data2, data2 ? length2 : 0);
+    } else {
+        BLYNK_CAPTURE_FRAME(BLYNK_CAPTURE_OUT, &hdr, sizeof(hdr));
+    }
+#endif
+
+    lastActivityOut = BlynkMillis();
+    BLYNK_PROBE3(send__done, cmd, id, uint32_t(wlen));
+    return true;
+}
+
+// Gives 'cmd' a larger, empty buffer, to build it again. False if there is none.
+template <class Transp>
+bool BlynkProtocol<Transp>::growParam(BlynkParam& cmd, BlynkFrame& frame)
+{
+#ifdef BLYNK_HAS_WORKERS
+    // The frame pool belongs to the protocol thread
+    if (char* own = BlynkWorkersSendBuffer()) {
+        if (cmd.getBufferSize() >= BLYNK_WORKER_DATA + 1) {
+            return false;
+        }
+        cmd = BlynkParam(own, 0, BLYNK_WORKER_DATA + 1);
+        return true;
+    }
+#endif
+    if (!frame.grow(cmd.getBufferSize())) {
+        return false;
+    }
+    cmd = BlynkParam(frame.data(), 0, frame.size());
+    return true;
+}
+
+template <class Transp>
+void BlynkProtocol<Transp>::waitForMsgLimit(uint8_t cmd)
+{
 #if defined(BLYNK_MSG_LIMIT) && BLYNK_MSG_LIMIT > 0
+#ifdef BLYNK_HAS_SCHEDULER
+    // sendScheduled() has waited for the budget already
+    if (cmd >= BLYNK_CMD_TWEET && cmd <= BLYNK_CMD_HARDWARE && !schedBypass()) {
+#else
     if (cmd >= BLYNK_CMD_TWEET && cmd <= BLYNK_CMD_HARDWARE) {
+#endif
         const millis_time_t allowed_time = BlynkMax(lastActivityOut, lastActivityIn) + 1000/BLYNK_MSG_LIMIT;
         int32_t wait_time = allowed_time - BlynkMillis();
         if (wait_time >= 0) {
 #ifdef BLYNK_DEBUG_ALL
             BLYNK_LOG2(BLYNK_F("Waiting:"), wait_time);
 #endif
+            BLYNK_PROTO_TRACE("rateLimit", wait_time);
             while (wait_time >= 0) {
                 run();
                 wait_time = allowed_time - BlynkMillis();
@@ -453,85 +896,338 @@ void BlynkProtocol<Transp>::sendCmd(uint8_t cmd, uint16_t id, const void* data,
             run();
         }
     }
+#else
+    (void)cmd;
 #endif
+}
 
-    const size_t full_length = (sizeof(BlynkHeader)) +
-                               (data  ? length  : 0) +
-                               (data2 ? length2 : 0);
+template <class Transp>
+void BlynkProtocol<Transp>::writeStreamed(void* ctx, const void* data, size_t len)
+{
+    StreamOut& out = *(StreamOut*)ctx;
+    len = BlynkMin(len, out.left);      // not the final zero of the parameters
+    if (out.failed || !len) {
+        return;
+    }
+    BLYNK_DBG_DUMP("<", data, len);
+    const size_t w = out.self->conn.write(data, len);
+    BlynkDelay(BLYNK_SEND_THROTTLE);
+    out.written += w;
+    out.left -= len;
+    if (w != len) {
+        out.failed = true;
+    }
+}
 
-#if defined(BLYNK_SEND_ATOMIC) || defined(ESP8266) || defined(ESP32) || defined(SPARK) || defined(PARTICLE) || defined(ENERGIA)
-    // Those have more RAM and like single write at a time...
+// For a command larger than any frame buffer: the header goes out with the
+// 'length' counted beforehand, then the body a buffer-full at a time, as
+// 'fill' adds it to a streaming BlynkParam.
+template <class Transp>
+template <typename Fill>
+void BlynkProtocol<Transp>::sendCmdStreamed(uint8_t cmd, size_t length, Fill fill)
+{
+    BLYNK_PROTO_LATENCY("proto.sendCmd");
+    BLYNK_PROTO_TRACE("send", cmd);
+#ifdef BLYNK_HAS_WORKERS
+    // On a worker thread: longer than a result can be, so it is counted
+    // and dropped there (nothing is read from the buffer)
+    if (char* own = BlynkWorkersSendBuffer()) {
+        BlynkWorkersPost(cmd, 0, own, length, NULL, 0);
+        return;
+    }
+#endif
+    if (length > 0xFFFF) {
+        BLYNK_LOG2(BLYNK_F("Message too big, dropped: "), cmd);
+        return;
+    }
+    if (!conn.connected() || state != CONNECTED) {
+#ifdef BLYNK_HAS_OUTBOX
+        // Stored whole, if it fits into a record
+        if (!outboxReplay && length <= BLYNK_OUTBOX_MAX_RECORD) {
+            char buff[BLYNK_OUTBOX_MAX_RECORD + 1];
+            BlynkParam param(buff, 0, sizeof(buff));
+            fill(param);
+            sendCmd(cmd, 0, buff, length);
+            return;
+        }
+#endif
+#ifdef BLYNK_DEBUG_ALL
+        BLYNK_LOG2(BLYNK_F("Cmd skipped:"), cmd);
+#endif
+        return;
+    }
 
-    uint8_t buff[full_length];
+    const uint16_t id = getNextMsgId();
+    BLYNK_PROBE3(send__start, cmd, id, uint32_t(length));
+    waitForMsgLimit(cmd);
 
-    BlynkHeader* hdr = (BlynkHeader*)buff;
-    hdr->type = cmd;
-    hdr->msg_id = htons(id);
-    hdr->length = htons(length+length2);
+    BlynkHeader hdr;
+    hdr.type = cmd;
+    hdr.msg_id = htons(id);
+    hdr.length = htons(length);
+    BLYNK_DBG_DUMP("<", &hdr, sizeof(hdr));
+    size_t wlen = conn.write(&hdr, sizeof(hdr));
+    BlynkDelay(BLYNK_SEND_THROTTLE);
 
-    size_t pos = sizeof(BlynkHeader);
-    if (data && length) {
-        memcpy(buff + pos, data, length);
-        pos += length;
-    }
-    if (data2 && length2) {
-        memcpy(buff + pos, data2, length2);
+    StreamOut out = { this, length, 0, wlen != sizeof(hdr) };
+    char mem[BLYNK_MAX_SENDBYTES];
+    BlynkFrame frame(frames);
+    BlynkParam param = frame.acquireLargest() ? BlynkParam(frame.data(), 0, frame.size())
+                                              : BlynkParam(mem, 0, sizeof(mem));
+    param.setSink(writeStreamed, &out);
+    fill(param);
+    param.flush();
+    wlen += out.written;
+
+    if (wlen != sizeof(hdr) + length || param.isTruncated()) {
+#ifdef BLYNK_DEBUG
+        BLYNK_LOG4(BLYNK_F("Sent "), wlen, '/', sizeof(hdr) + length);
+#endif
+        BLYNK_PROBE3(send__error, cmd, id, uint32_t(wlen));
+        internalReconnect();
+        return;
     }
 
+    lastActivityOut = BlynkMillis();
+    BLYNK_PROBE3(send__done, cmd, id, uint32_t(wlen));
+}
+
+#if defined(BLYNK_SEND_ATOMIC) || defined(ESP8266) || defined(ESP32) || defined(SPARK) || defined(PARTICLE) || defined(ENERGIA)
+
+// Gathers header and body into the frame buffer, one buffer-full at a time
+template <class Transp>
+size_t BlynkProtocol<Transp>::writeAtomic(BlynkFrame& frame, const BlynkHeader& hdr, const void* data, size_t length, const void* data2, size_t length2)
+{
+    const uint8_t* parts[3] = { (const uint8_t*)&hdr, (const uint8_t*)data, (const uint8_t*)data2 };
+    const size_t   lens[3]  = { sizeof(hdr), data ? length : 0, data2 ? length2 : 0 };
+
+    uint8_t* buff = frame.data();
+    size_t pos = 0;
     size_t wlen = 0;
-    while (wlen < full_length) {
-        const size_t chunk = BlynkMin(size_t(BLYNK_SEND_CHUNK), full_length - wlen);
-        BLYNK_DBG_DUMP("<", buff + wlen, chunk);
-        const size_t w = conn.write(buff + wlen, chunk);
+    for (unsigned i = 0; i < 3; i++) {
+        for (size_t off = 0; off < lens[i]; ) {
+            const size_t n = BlynkMin(frame.size() - pos, lens[i] - off);
+            memcpy(buff + pos, parts[i] + off, n);
+            pos += n;
+            off += n;
+            if (pos == frame.size()) {
+                if (!writeChunked(buff, pos, wlen)) {
+                    return wlen;
+                }
+                pos = 0;
+            }
+        }
+    }
+    if (pos) {
+        writeChunked(buff, pos, wlen);
+    }
+    return wlen;
+}
+
+template <class Transp>
+bool BlynkProtocol<Transp>::writeChunked(const uint8_t* buff, size_t len, size_t& wlen)
+{
+    size_t done = 0;
+    while (done < len) {
+        const size_t chunk = BlynkMin(size_t(BLYNK_SEND_CHUNK), len - done);
+        BLYNK_DBG_DUMP("<", buff + done, chunk);
+        const size_t w = conn.write(buff + done, chunk);
         BlynkDelay(BLYNK_SEND_THROTTLE);
-        if (w == 0) {
+        if (w == 0 || w > chunk) {
 #ifdef BLYNK_DEBUG
             BLYNK_LOG1(BLYNK_F("Cmd error"));
 #endif
-            conn.disconnect();
-            state = CONNECTING;
-            BlynkOnDisconnected();
-            return;
+            return false;
         }
+        done += w;
         wlen += w;
     }
+    return true;
+}
 
-#else
-
-    BlynkHeader hdr;
-    hdr.type = cmd;
-    hdr.msg_id = htons(id);
-    hdr.length = htons(length+length2);
+#endif
 
-    BLYNK_DBG_DUMP("<", &hdr, sizeof(hdr));
-    size_t wlen = conn.write(&hdr, sizeof(hdr));
-    BlynkDelay(BLYNK_SEND_THROTTLE);
+#ifdef BLYNK_HAS_OUTBOX
 
-    if (cmd != BLYNK_CMD_RESPONSE) {
-        if (length) {
-            BLYNK_DBG_DUMP("<", data, length);
-            wlen += conn.write(data, length);
-            BlynkDelay(BLYNK_SEND_THROTTLE);
+template <class Transp>
+void BlynkProtocol<Transp>::replayOutbox(millis_time_t t)
+{
+    if (!BlynkOutboxPending()) {
+        return;
+    }
+    uint8_t buff[BLYNK_OUTBOX_MAX_RECORD];
+    for (unsigned n = BlynkOutboxReplayBudget(t); n > 0; n--) {
+#ifdef BLYNK_HAS_SCHEDULER
+        // Written right away, within the budget like sendScheduled() does:
+        // in the queue, a record could be replaced by the next one of its
+        // pin, or dropped
+#if defined(BLYNK_MSG_LIMIT) && BLYNK_MSG_LIMIT > 0
+        const millis_time_t allowed_time = BlynkMax(lastActivityOut, lastActivityIn) + 1000/BLYNK_MSG_LIMIT;
+        if (int32_t(allowed_time - BlynkMillis()) >= 0) {
+            break;
         }
-        if (length2) {
-            BLYNK_DBG_DUMP("<", data2, length2);
-            wlen += conn.write(data2, length2);
-            BlynkDelay(BLYNK_SEND_THROTTLE);
+#endif
+#endif
+        uint8_t cmd;
+        uint32_t seq;
+        const int len = BlynkOutboxPeek(cmd, buff, sizeof(buff), seq);
+        if (len < 0) {
+            break;
+        }
+        outboxReplay = true;
+#ifdef BLYNK_HAS_SCHEDULER
+        schedSending = true;
+#endif
+        const bool sent = sendCmd(cmd, 0, buff, len);
+#ifdef BLYNK_HAS_SCHEDULER
+        schedSending = false;
+#endif
+        outboxReplay = false;
+        if (!sent) {
+            break; // Keep the record for the next connection
         }
+        BlynkOutboxPop(seq, BlynkMillis());
     }
+}
 
 #endif
 
-    if (wlen != full_length) {
-#ifdef BLYNK_DEBUG
-        BLYNK_LOG4(BLYNK_F("Sent "), wlen, '/', full_length);
+#ifdef BLYNK_HAS_SCHEDULER
+
+template <class Transp>
+void BlynkProtocol<Transp>::schedule(uint8_t cmd, uint16_t id, const void* data, size_t length, const void* data2, size_t length2)
+{
+    int pin;
+    BlynkPriority cls = sched.classify(cmd, data, data ? length : 0, pin);
+    if (msgIdOutOverride) {
+        cls = BLYNK_PRIO_CONTROL;   // reply to a server read
+        pin = -1;
+    }
+    const bool sender = onRunThread();
+    while (sched.push(cls, pin, cmd, id, data, length, data2, length2, BlynkMillis()) == BlynkScheduler::FULL) {
+        // Only alarms, state and control are queued: wait for a free slot
+        if (state != CONNECTED) {
+            return;
+        }
+        if (sender) {
+            if (!conn.connected()) {
+                return;
+            }
+            run();
+            sendScheduled();
+        }
+#if defined(LINUX)
+        else {
+            // Sent by the thread in run(); the protocol is not ours to drive
+            sched.waitForRoom(100);
+        }
 #endif
-        internalReconnect();
+    }
+    if (sender) {
+        sendScheduled();
+    }
+}
+
+template <class Transp>
+bool BlynkProtocol<Transp>::onRunThread() const
+{
+#if defined(LINUX)
+    const pthread_t t = __atomic_load_n(&runThread, __ATOMIC_RELAXED);
+    return t && pthread_equal(t, pthread_self());
+#else
+    return true;
+#endif
+}
+
+// Sends queued commands while the BLYNK_MSG_LIMIT budget allows
+template <class Transp>
+void BlynkProtocol<Transp>::sendScheduled()
+{
+    if (schedSending) {
         return;
     }
+    BlynkScheduler::Entry e;
+    while (sched.pending() && state == CONNECTED && conn.connected()) {
+#if defined(BLYNK_MSG_LIMIT) && BLYNK_MSG_LIMIT > 0
+        const millis_time_t allowed_time = BlynkMax(lastActivityOut, lastActivityIn) + 1000/BLYNK_MSG_LIMIT;
+        if (int32_t(allowed_time - BlynkMillis()) >= 0) {
+            break;
+        }
+#endif
+        if (!sched.pop(e, BlynkMillis())) {
+            break;
+        }
+        BLYNK_PROBE3(send__queued, e.cls, e.id, uint32_t(BlynkMillis() - e.queuedAt));
+        schedSending = true;
+        sendCmd(e.cmd, e.id, e.data, e.length);
+        schedSending = false;
+    }
+}
 
-    lastActivityOut = BlynkMillis();
+#endif
 
+#ifdef BLYNK_HAS_WORKERS
+
+// Queues a handler for its worker. False if it should run inline.
+template <class Transp>
+bool BlynkProtocol<Transp>::runOnWorker(WidgetWriteHandler handler, uint8_t pin, const BlynkParam& param)
+{
+    BlynkWorkerDispatch res;
+    while ((res = BlynkWorkersWrite(handler, pin, msgIdOutOverride, param)) == BLYNK_WORKER_BUSY) {
+        waitForWorker(res);
+    }
+    return waitForWorker(res);
+}
+
+template <class Transp>
+bool BlynkProtocol<Transp>::runOnWorker(WidgetReadHandler handler, uint8_t pin)
+{
+    BlynkWorkerDispatch res;
+    while ((res = BlynkWorkersRead(handler, pin, msgIdOutOverride)) == BLYNK_WORKER_BUSY) {
+        waitForWorker(res);
+    }
+    return waitForWorker(res);
+}
+
+template <class Transp>
+bool BlynkProtocol<Transp>::waitForWorker(BlynkWorkerDispatch res)
+{
+    // The worker may be waiting for room in its result queue
+    sendWorkerResults();
+    if (res == BLYNK_WORKER_BUSY) {
+        BlynkDelay(1);
+    }
+    return res == BLYNK_WORKER_QUEUED;
+}
+
+// Sends the commands posted by handlers on worker threads
+template <class Transp>
+void BlynkProtocol<Transp>::sendWorkerResults()
+{
+    BlynkWorkerResult r;
+    const uint16_t saved = msgIdOutOverride;
+    while (BlynkWorkersTake(r)) {
+        // As if the handler was still answering the request
+        msgIdOutOverride = r.id;
+        sendCmd(r.cmd, r.id, r.data, r.length);
+    }
+    msgIdOutOverride = saved;
+}
+
+#endif
+
+// Smoothed like TCP does (RFC 6298): gains of 1/8 and 1/4
+template <class Transp>
+void BlynkProtocol<Transp>::rttSample(uint32_t ms)
+{
+    if (!rttAvg && !rttVar) {
+        rttAvg = ms;
+        rttVar = ms / 2;
+    } else {
+        const uint32_t err = (ms > rttAvg) ? (ms - rttAvg) : (rttAvg - ms);
+        rttVar = (3 * rttVar + err) / 4;
+        rttAvg = (7 * rttAvg + ms) / 8;
+    }
 }
 
 template <class Transp>
@@ -11,28 +11,194 @@
 #define WidgetLCD_h
 
 #include <Blynk/BlynkWidgetBase.h>
+#include <Blynk/BlynkProtocol.h>
 
+#ifndef BLYNK_LCD_COLS
+#define BLYNK_LCD_COLS 16
+#endif
+
+#ifndef BLYNK_LCD_ROWS
+#define BLYNK_LCD_ROWS 2
+#endif
+
+// Changes are sent this long (ms) after the first one, so a redraw
+// made of several calls goes out as a whole
+#ifndef BLYNK_LCD_FLUSH_MS
+#define BLYNK_LCD_FLUSH_MS 50
+#endif
+
+/*
+ * clear() and print() only update a local framebuffer.
+ * On the flush tick (driven by run()) or on flush(), it is compared to
+ * what the app shows, and each row with changes is sent as a single
+ * "p x y text" command covering its changed cells. If that takes more
+ * messages than "clr" + redrawing the non-blank rows, the latter is sent.
+ */
 class WidgetLCD
     : public BlynkWidgetBase
 {
 public:
-    WidgetLCD(uint8_t vPin) : BlynkWidgetBase(vPin) {}
+    WidgetLCD(uint8_t vPin)
+        : BlynkWidgetBase(vPin)
+        , mDirty(false)
+        , mShownValid(false)
+        , mDirtyAt(0)
+        , mCalls(0)
+        , mMsgsSent(0)
+        , mNext(NULL)
+    {
+        memset(mCells, ' ', sizeof(mCells));
+        memset(mShown, ' ', sizeof(mShown));
+        mNext = first();
+        first() = this;
+        BlynkRunHooks::add(pollAll);
+    }
+
+    ~WidgetLCD() {
+        for (WidgetLCD** l = &first(); *l; l = &(*l)->mNext) {
+            if (*l == this) {
+                *l = mNext;
+                break;
+            }
+        }
+    }
 
     void clear() {
-        Blynk.virtualWrite(mPin, "clr");
+        memset(mCells, ' ', sizeof(mCells));
+        touch();
     }
 
     template<typename T>
     void print(int x, int y, const T& str) {
+        char mem[BLYNK_MAX_SENDBYTES];
+        BlynkParam text(mem, 0, sizeof(mem));
+        text.add(str);
+        touch();
+        if (y < 0 || y >= BLYNK_LCD_ROWS || !text.getLength()) {
+            return;
+        }
+        const char* s = (const char*)text.getBuffer();
+        for (size_t i = 0; i < text.getLength() - 1 && x < BLYNK_LCD_COLS; i++, x++) {
+            if (x >= 0) {
+                mCells[y][x] = s[i];
+            }
+        }
+    }
+
+    // Sends pending changes now
+    void flush() {
+        if (!mDirty || !Blynk.connected()) {
+            return;
+        }
+        mDirty = false;
+
+        int rows = 0;
+        for (int y = 0; y < BLYNK_LCD_ROWS; y++) {
+            int from, to;
+            if (changes(y, from, to)) rows++;
+        }
+
+        // "clr" + non-blank rows, if that's fewer messages
+        int redraw = 1;
+        for (int y = 0; y < BLYNK_LCD_ROWS; y++) {
+            if (!isBlank(mCells[y])) redraw++;
+        }
+        if (!mShownValid || redraw < rows) {
+            Blynk.virtualWrite(mPin, "clr");
+            mMsgsSent++;
+            memset(mShown, ' ', sizeof(mShown));
+            mShownValid = true;
+        }
+
+        for (int y = 0; y < BLYNK_LCD_ROWS; y++) {
+            int from, to;
+            if (changes(y, from, to)) {
+                sendRun(from, y, to - from);
+            }
+        }
+    }
+
+    // The app state is unknown (e.g. after reconnect): redraw everything
+    void invalidate() {
+        mShownValid = false;
+        touch();
+    }
+
+    // Sends what is due, called from run()
+    void poll(millis_time_t now) {
+        if (mDirty && (now - mDirtyAt >= BLYNK_LCD_FLUSH_MS)) {
+            flush();
+        }
+    }
+
+    static void pollAll(millis_time_t now) {
+        for (WidgetLCD* l = first(); l; l = l->mNext) {
+            l->poll(now);
+        }
+    }
+
+    // Efficiency stats: clear/print calls vs messages actually sent
+    uint32_t calls() const        { return mCalls; }
+    uint32_t messagesSent() const { return mMsgsSent; }
+    uint32_t messagesSaved() const {
+        return (mCalls > mMsgsSent) ? mCalls - mMsgsSent : 0;
+    }
+
+private:
+    static WidgetLCD*& first() {
+        static WidgetLCD* head = NULL;
+        return head;
+    }
+
+    static bool isBlank(const char* row) {
+        for (int x = 0; x < BLYNK_LCD_COLS; x++) {
+            if (row[x] != ' ') return false;
+        }
+        return true;
+    }
+
+    void touch() {
+        if (!mDirty) {
+            mDirty = true;
+            mDirtyAt = BlynkMillis();
+        }
+        mCalls++;
+    }
+
+    // Span [from, to) between the first and the last changed cell of a row
+    bool changes(int y, int& from, int& to) const {
+        from = 0;
+        while (from < BLYNK_LCD_COLS && mCells[y][from] == mShown[y][from]) from++;
+        if (from == BLYNK_LCD_COLS) return false;
+        to = BLYNK_LCD_COLS;
+        while (mCells[y][to - 1] == mShown[y][to - 1]) to--;
+        return true;
+    }
+
+    void sendRun(int x, int y, int len) {
+        char text[BLYNK_LCD_COLS + 1];
+        memcpy(text, &mCells[y][x], len);
+        text[len] = '\0';
+
         char mem[BLYNK_MAX_SENDBYTES];
         BlynkParam cmd(mem, 0, sizeof(mem));
         cmd.add("p");
         cmd.add(x);
         cmd.add(y);
-        cmd.add(str);
+        cmd.add(text);
         Blynk.virtualWrite(mPin, cmd);
+        mMsgsSent++;
+        memcpy(&mShown[y][x], text, len);
     }
 
+    char     mCells[BLYNK_LCD_ROWS][BLYNK_LCD_COLS];  // what should be shown
+    char     mShown[BLYNK_LCD_ROWS][BLYNK_LCD_COLS];  // what the app shows
+    bool     mDirty;
+    bool     mShownValid;
+    millis_time_t mDirtyAt;
+    uint32_t mCalls;
+    uint32_t mMsgsSent;
+    WidgetLCD* mNext;
 };
 
 #endif
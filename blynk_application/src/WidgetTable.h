@@ -64,4 +64,178 @@ private:
 
 };
 
+// Pack several add/update operations into one message.
+// Needs a server that accepts more than one operation per table write.
+#ifndef BLYNK_TABLE_PACK_OPS
+#define BLYNK_TABLE_PACK_OPS 0
+#endif
+
+/*
+ * Table contents kept on the device. setRow() only records changes;
+ * sync() sends the rows that differ from what was last published,
+ * as "update" for existing rows and "add" for new ones.
+ *
+ * A "replace all" is written as:
+ *   table.beginReplace();
+ *   table.setRow(0, ...); ... table.setRow(n-1, ...);
+ *   table.endReplace();
+ *   table.sync();
+ * Unchanged rows are not resent. If the table shrinks, it's cleared
+ * and all rows are added again (rows can't be removed one by one).
+ */
+template <size_t MAX_ROWS, size_t NAME_LEN = 32, size_t VALUE_LEN = 16>
+class WidgetTableModel
+    : public WidgetTable
+{
+public:
+    WidgetTableModel(uint8_t vPin = -1)
+        : WidgetTable(vPin)
+        , mRows(0)
+        , mSentRows(0)
+        , mReplaceRows(0)
+        , mReplacing(false)
+        , mClear(true)
+        , mPack(BLYNK_TABLE_PACK_OPS)
+        , mOpsSent(0)
+        , mMsgsSent(0)
+    {
+        memset(mName, 0, sizeof(mName));
+        memset(mValue, 0, sizeof(mValue));
+        memset(mDirty, 0, sizeof(mDirty));
+    }
+
+    void setPacking(bool pack) { mPack = pack; }
+
+    // Removes all rows
+    void clear() {
+        memset(mName, 0, sizeof(mName));
+        memset(mValue, 0, sizeof(mValue));
+        memset(mDirty, 0, sizeof(mDirty));
+        mRows = 0;
+        mClear = true;
+    }
+
+    template <typename T1, typename T2>
+    bool setRow(size_t index, const T1& name, const T2& value) {
+        if (index >= MAX_ROWS) {
+            return false;
+        }
+        char mem[BLYNK_MAX_SENDBYTES];
+        BlynkParam text(mem, 0, sizeof(mem));
+        text.add(name);
+        copyText(mName[index], NAME_LEN, mem, text.getLength(), index);
+        text = BlynkParam(mem, 0, sizeof(mem));
+        text.add(value);
+        copyText(mValue[index], VALUE_LEN, mem, text.getLength(), index);
+
+        size_t& rows = mReplacing ? mReplaceRows : mRows;
+        for (; rows <= index; rows++) {
+            if (rows >= mSentRows) {
+                setDirty(rows);     // gaps are added as empty rows
+            }
+        }
+        return true;
+    }
+
+    void beginReplace() {
+        mReplacing = true;
+        mReplaceRows = 0;
+    }
+
+    void endReplace() {
+        mReplacing = false;
+        if (mReplaceRows < mSentRows) {
+            mClear = true;
+        }
+        for (size_t i = mReplaceRows; i < mRows; i++) {
+            mName[i][0] = mValue[i][0] = '\0';
+            clearDirty(i);
+        }
+        mRows = mReplaceRows;
+    }
+
+    // Sends pending changes. Returns the number of messages sent.
+    unsigned sync() {
+        if (!Blynk.connected()) {
+            return 0;
+        }
+        unsigned msgs = 0;
+        if (mClear) {
+            Blynk.virtualWrite(mPin, "clr");
+            msgs++;
+            mClear = false;
+            mSentRows = 0;
+            for (size_t i = 0; i < mRows; i++) {
+                setDirty(i);
+            }
+        }
+
+        // Leave room for "vw\0<pin>\0"
+        char mem[BLYNK_MAX_SENDBYTES - 8];
+        BlynkParam cmd(mem, 0, sizeof(mem));
+        for (size_t i = 0; i < mRows; i++) {
+            if (!isDirty(i)) {
+                continue;
+            }
+            const char* op = (i < mSentRows) ? "update" : "add";
+            char idx[8];
+            const size_t opLen = strlen(op) + 1 + snprintf(idx, sizeof(idx), "%u", unsigned(i)) + 1
+                               + strlen(mName[i]) + 1 + strlen(mValue[i]) + 1;
+            if (cmd.getLength() && (!mPack || cmd.getLength() + opLen > sizeof(mem))) {
+                Blynk.virtualWrite(mPin, cmd);
+                msgs++;
+                cmd = BlynkParam(mem, 0, sizeof(mem));
+            }
+            cmd.add(op);
+            cmd.add(idx);
+            cmd.add(mName[i]);
+            cmd.add(mValue[i]);
+            clearDirty(i);
+            mOpsSent++;
+            if (i >= mSentRows) {
+                mSentRows = i + 1;
+            }
+        }
+        if (cmd.getLength()) {
+            Blynk.virtualWrite(mPin, cmd);
+            msgs++;
+        }
+        mMsgsSent += msgs;
+        return msgs;
+    }
+
+    size_t rows() const            { return mReplacing ? mReplaceRows : mRows; }
+    const char* name(size_t i) const  { return mName[i]; }
+    const char* value(size_t i) const { return mValue[i]; }
+
+    uint32_t opsSent() const       { return mOpsSent; }
+    uint32_t messagesSent() const  { return mMsgsSent; }
+
+private:
+    void copyText(char* dst, size_t size, const char* src, size_t len, size_t index) {
+        len = BlynkMin(len ? len - 1 : 0, size - 1);
+        if (strncmp(dst, src, len) || dst[len] != '\0') {
+            memcpy(dst, src, len);
+            dst[len] = '\0';
+            setDirty(index);
+        }
+    }
+
+    bool isDirty(size_t i) const { return mDirty[i / 8] & (1 << (i % 8)); }
+    void setDirty(size_t i)      { mDirty[i / 8] |= (1 << (i % 8)); }
+    void clearDirty(size_t i)    { mDirty[i / 8] &= ~(1 << (i % 8)); }
+
+    char     mName[MAX_ROWS][NAME_LEN];
+    char     mValue[MAX_ROWS][VALUE_LEN];
+    uint8_t  mDirty[(MAX_ROWS + 7) / 8];
+    size_t   mRows;         // rows in the model
+    size_t   mSentRows;     // rows the app has
+    size_t   mReplaceRows;  // rows set since beginReplace()
+    bool     mReplacing;
+    bool     mClear;        // "clr" must be sent first
+    bool     mPack;
+    uint32_t mOpsSent;
+    uint32_t mMsgsSent;
+};
+
 #endif
@@ -17,6 +17,7 @@
 #endif
 
 #include <Blynk/BlynkWidgetBase.h>
+#include <Blynk/BlynkProtocol.h>
 
 #ifdef BLYNK_USE_PRINT_CLASS
     #if !(defined(SPARK) || defined(PARTICLE) || (PLATFORM_ID==88) || defined(ARDUINO_RedBear_Duo)) // 88 -> RBL Duo
@@ -25,6 +26,28 @@
     #endif
 #endif
 
+// Output buffer: one message carries up to this many bytes
+#ifndef BLYNK_TERMINAL_BUFFER
+    #if defined(__AVR__)
+        #define BLYNK_TERMINAL_BUFFER 64
+    #else
+        // Leave room for "vw\0<pin>\0"
+        #define BLYNK_TERMINAL_BUFFER (BLYNK_MAX_SENDBYTES - 8)
+    #endif
+#endif
+
+// Partial lines are sent after this delay (ms)
+#ifndef BLYNK_TERMINAL_FLUSH_MS
+#define BLYNK_TERMINAL_FLUSH_MS 100
+#endif
+
+/*
+ * Output is collected and sent:
+ *  - on the next run() after a newline, so lines printed together share a message
+ *  - when the buffer is full (complete lines only, if there are any)
+ *  - on the next run() after BLYNK_TERMINAL_FLUSH_MS, for partial lines
+ *  - on flush()
+ */
 class WidgetTerminal
     : public BlynkWidgetBase
 #ifdef BLYNK_USE_PRINT_CLASS
@@ -32,33 +55,94 @@ class WidgetTerminal
 #endif
 {
 public:
+    enum FlushReason {
+        FLUSH_NEWLINE,
+        FLUSH_SIZE,
+        FLUSH_DEADLINE,
+        FLUSH_MANUAL,
+        FLUSH_REASONS
+    };
+
     WidgetTerminal(uint8_t vPin)
         : BlynkWidgetBase(vPin)
         , mOutQty(0)
-    {}
+        , mLineEnd(0)
+        , mFirstAt(0)
+        , mBytesSent(0)
+        , mMsgsSent(0)
+        , mSending(false)
+        , mNext(NULL)
+    {
+        memset(mFlushes, 0, sizeof(mFlushes));
+        mNext = first();
+        first() = this;
+        BlynkRunHooks::add(pollAll);
+    }
 
-    //virtual ~WidgetTerminal() {}
+    ~WidgetTerminal() {
+        for (WidgetTerminal** t = &first(); *t; t = &(*t)->mNext) {
+            if (*t == this) {
+                *t = mNext;
+                break;
+            }
+        }
+    }
 
     virtual size_t write(uint8_t byte) {
+        if (mOutQty >= sizeof(mOutBuf)) {
+            // Only while a send waits in run(), and a handler prints more
+            return 0;
+        }
+        if (!mOutQty) {
+            mFirstAt = BlynkMillis();
+        }
         mOutBuf[mOutQty++] = byte;
+        if (byte == '\n') {
+            mLineEnd = mOutQty;
+        }
         if (mOutQty >= sizeof(mOutBuf)) {
-            flush();
+            send(FLUSH_SIZE);
         }
         return 1;
     }
 
     virtual void flush() {
-        if (mOutQty) {
-            Blynk.virtualWriteBinary(mPin, mOutBuf, mOutQty);
-            mOutQty = 0;
-        }
+        mLineEnd = mOutQty;
+        send(FLUSH_MANUAL);
     }
-    
+
     void clear() {
         flush();
         Blynk.virtualWrite(mPin, "clr");
     }
 
+    // Sends what is due, called from run()
+    void poll(millis_time_t now) {
+        if (mSending) {
+            return;
+        }
+        if (mLineEnd) {
+            send(FLUSH_NEWLINE);
+        } else if (mOutQty && (now - mFirstAt >= BLYNK_TERMINAL_FLUSH_MS)) {
+            mLineEnd = mOutQty;
+            send(FLUSH_DEADLINE);
+        }
+    }
+
+    static void pollAll(millis_time_t now) {
+        for (WidgetTerminal* t = first(); t; t = t->mNext) {
+            t->poll(now);
+        }
+    }
+
+    // Efficiency stats
+    uint32_t bytesSent() const    { return mBytesSent; }
+    uint32_t messagesSent() const { return mMsgsSent; }
+    uint32_t flushes(FlushReason r) const { return mFlushes[r]; }
+    float    bytesPerMessage() const {
+        return mMsgsSent ? float(mBytesSent) / mMsgsSent : 0;
+    }
+
 #ifdef BLYNK_USE_PRINT_CLASS
 
     using Print::write;
@@ -85,8 +169,44 @@ public:
 #endif
 
 private:
-    uint8_t mOutBuf[64];
-    uint8_t mOutQty;
+    static WidgetTerminal*& first() {
+        static WidgetTerminal* head = NULL;
+        return head;
+    }
+
+    // Sends complete lines (or everything, if there is no newline).
+    // virtualWriteBinary() may call run() while waiting for the message
+    // limit; until it returns, the first 'len' bytes stay where they are
+    // and nothing else is sent, so bytes added meanwhile go after them.
+    void send(FlushReason reason) {
+        const uint16_t len = mLineEnd ? mLineEnd : mOutQty;
+        if (mSending || !len) {
+            return;
+        }
+        mSending = true;
+        Blynk.virtualWriteBinary(mPin, mOutBuf, len);
+        mSending = false;
+        mBytesSent += len;
+        mMsgsSent++;
+        mFlushes[reason]++;
+
+        mOutQty -= len;
+        if (mOutQty) {
+            memmove(mOutBuf, mOutBuf + len, mOutQty);
+            mFirstAt = BlynkMillis();
+        }
+        mLineEnd = (mLineEnd > len) ? mLineEnd - len : 0;
+    }
+
+    uint8_t  mOutBuf[BLYNK_TERMINAL_BUFFER];
+    uint16_t mOutQty;
+    uint16_t mLineEnd;      // end of the last complete line in mOutBuf
+    millis_time_t mFirstAt; // when the oldest unsent byte was written
+    uint32_t mBytesSent;
+    uint32_t mMsgsSent;
+    uint32_t mFlushes[FLUSH_REASONS];
+    bool     mSending;      // inside virtualWriteBinary()
+    WidgetTerminal* mNext;
 };
 
 #endif
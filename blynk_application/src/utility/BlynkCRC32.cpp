@@ -0,0 +1,344 @@
+/**
+ * @file       BlynkCRC32.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Fast CRC-32 engines and runtime dispatch (Linux)
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkUtility.h>
+#include <utility/BlynkCRC32.h>
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define BLYNK_CRC32_HAS_PCLMUL
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FEATURE_CRC32))
+    #include <sys/auxv.h>
+    #if defined(__aarch64__)
+        #pragma GCC push_options
+        #pragma GCC target("+crc")
+    #endif
+    #include <arm_acle.h>
+    #if defined(__aarch64__)
+        #pragma GCC pop_options
+    #endif
+    #define BLYNK_CRC32_HAS_ARMV8
+#endif
+
+typedef uint32_t (*crc_fn_t)(uint32_t crc, const uint8_t* p, size_t len);
+
+static uint32_t crc_table[16][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static crc_fn_t crc_engines[BLYNK_CRC32_ENGINES];
+static crc_fn_t crc_best = NULL;
+static BlynkCRC32Engine crc_best_id = BLYNK_CRC32_SLICE16;
+
+/*
+ * All engines work on the inverted CRC state and return it inverted,
+ * which lets them hand the tail of a buffer to each other.
+ */
+
+static uint32_t crc_bytes(uint32_t crc, const uint8_t* p, size_t len)
+{
+    while (len--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+static uint32_t crc_bitwise(uint32_t crc, const uint8_t* p, size_t len)
+{
+    return ~BlynkCRC32Bitwise(p, len, ~crc);
+}
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+static inline uint32_t load32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+#define T(n, v, s) crc_table[n][((v) >> (s)) & 0xFF]
+
+static uint32_t crc_slice8(uint32_t crc, const uint8_t* p, size_t len)
+{
+    while (len >= 8) {
+        const uint32_t a = load32(p) ^ crc;
+        const uint32_t b = load32(p + 4);
+        crc = T(7, a, 0) ^ T(6, a, 8) ^ T(5, a, 16) ^ T(4, a, 24) ^
+              T(3, b, 0) ^ T(2, b, 8) ^ T(1, b, 16) ^ T(0, b, 24);
+        p += 8;
+        len -= 8;
+    }
+    return crc_bytes(crc, p, len);
+}
+
+static uint32_t crc_slice16(uint32_t crc, const uint8_t* p, size_t len)
+{
+    while (len >= 16) {
+        const uint32_t a = load32(p) ^ crc;
+        const uint32_t b = load32(p + 4);
+        const uint32_t c = load32(p + 8);
+        const uint32_t d = load32(p + 12);
+        crc = T(15, a, 0) ^ T(14, a, 8) ^ T(13, a, 16) ^ T(12, a, 24) ^
+              T(11, b, 0) ^ T(10, b, 8) ^ T( 9, b, 16) ^ T( 8, b, 24) ^
+              T( 7, c, 0) ^ T( 6, c, 8) ^ T( 5, c, 16) ^ T( 4, c, 24) ^
+              T( 3, d, 0) ^ T( 2, d, 8) ^ T( 1, d, 16) ^ T( 0, d, 24);
+        p += 16;
+        len -= 16;
+    }
+    return crc_slice8(crc, p, len);
+}
+
+#undef T
+
+#else
+
+// Slicing relies on little-endian loads
+#define crc_slice8  crc_bytes
+#define crc_slice16 crc_bytes
+
+#endif
+
+#if defined(BLYNK_CRC32_HAS_ARMV8)
+
+#if defined(__aarch64__)
+__attribute__((target("+crc")))
+#endif
+static uint32_t crc_armv8(uint32_t crc, const uint8_t* p, size_t len)
+{
+    while (len && (uintptr_t(p) & 7)) {
+        crc = __crc32b(crc, *p++);
+        len--;
+    }
+#if defined(__aarch64__)
+    while (len >= 32) {
+        uint64_t v[4];
+        memcpy(v, p, sizeof(v));
+        crc = __crc32d(crc, v[0]);
+        crc = __crc32d(crc, v[1]);
+        crc = __crc32d(crc, v[2]);
+        crc = __crc32d(crc, v[3]);
+        p += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32d(crc, v);
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len >= 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = __crc32w(crc, v);
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        crc = __crc32b(crc, *p++);
+    }
+    return crc;
+}
+
+static bool crc_armv8_supported()
+{
+#if defined(__aarch64__)
+    #ifndef HWCAP_CRC32
+    #define HWCAP_CRC32 (1 << 7)
+    #endif
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#else
+    #ifndef HWCAP2_CRC32
+    #define HWCAP2_CRC32 (1 << 4)
+    #endif
+    return getauxval(AT_HWCAP2) & HWCAP2_CRC32;
+#endif
+}
+
+#endif
+
+#if defined(BLYNK_CRC32_HAS_PCLMUL)
+
+/*
+ * Carry-less multiplication folding, as described in Intel's
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+ * Constants are for the bit-reflected 0x04C11DB7 polynomial.
+ */
+
+#define CRC_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+
+CRC_PCLMUL_TARGET
+static uint32_t crc_pclmul(uint32_t crc, const uint8_t* p, size_t len)
+{
+    if (len < 64) {
+        return crc_slice16(crc, p, len);
+    }
+
+    static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+    p += 64;
+    len -= 64;
+
+    // Fold 4 x 128 bits in parallel
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+        p += 64;
+        len -= 64;
+    }
+
+    // Fold into 128 bits
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Single 128-bit blocks
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)p)), x5);
+        p += 16;
+        len -= 16;
+    }
+
+    // Fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    crc = _mm_extract_epi32(x1, 1);
+
+    return crc_slice16(crc, p, len);
+}
+
+static bool crc_pclmul_supported()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+#endif
+
+static void crc_init()
+{
+    for (unsigned i = 0; i < 256; i++) {
+        const uint8_t b = i;
+        crc_table[0][i] = ~BlynkCRC32Bitwise(&b, 1, 0xFFFFFFFF);
+    }
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t crc = crc_table[0][i];
+        for (unsigned t = 1; t < 16; t++) {
+            crc = (crc >> 8) ^ crc_table[0][crc & 0xFF];
+            crc_table[t][i] = crc;
+        }
+    }
+
+    crc_engines[BLYNK_CRC32_BITWISE] = crc_bitwise;
+    crc_engines[BLYNK_CRC32_SLICE8]  = crc_slice8;
+    crc_engines[BLYNK_CRC32_SLICE16] = crc_slice16;
+    crc_fn_t best = crc_slice16;
+    crc_best_id = BLYNK_CRC32_SLICE16;
+#if defined(BLYNK_CRC32_HAS_ARMV8)
+    if (crc_armv8_supported()) {
+        crc_engines[BLYNK_CRC32_ARMV8] = crc_armv8;
+        best = crc_armv8;
+        crc_best_id = BLYNK_CRC32_ARMV8;
+    }
+#endif
+#if defined(BLYNK_CRC32_HAS_PCLMUL)
+    if (crc_pclmul_supported()) {
+        crc_engines[BLYNK_CRC32_PCLMUL] = crc_pclmul;
+        best = crc_pclmul;
+        crc_best_id = BLYNK_CRC32_PCLMUL;
+    }
+#endif
+    __atomic_store_n(&crc_best, best, __ATOMIC_RELEASE);
+}
+
+uint32_t BlynkCRC32(const void* data, size_t length, uint32_t previousCrc32)
+{
+    crc_fn_t fn = __atomic_load_n(&crc_best, __ATOMIC_ACQUIRE);
+    if (!fn) {
+        pthread_once(&crc_once, crc_init);
+        fn = crc_best;
+    }
+    return ~fn(~previousCrc32, (const uint8_t*)data, length);
+}
+
+uint32_t BlynkCRC32With(BlynkCRC32Engine engine, const void* data, size_t length, uint32_t previousCrc32)
+{
+    pthread_once(&crc_once, crc_init);
+    crc_fn_t fn = (engine < BLYNK_CRC32_ENGINES && crc_engines[engine]) ? crc_engines[engine] : crc_slice16;
+    return ~fn(~previousCrc32, (const uint8_t*)data, length);
+}
+
+bool BlynkCRC32Supported(BlynkCRC32Engine engine)
+{
+    pthread_once(&crc_once, crc_init);
+    return engine < BLYNK_CRC32_ENGINES && crc_engines[engine];
+}
+
+BlynkCRC32Engine BlynkCRC32Selected()
+{
+    pthread_once(&crc_once, crc_init);
+    return crc_best_id;
+}
+
+const char* BlynkCRC32Name(BlynkCRC32Engine engine)
+{
+    switch (engine) {
+    case BLYNK_CRC32_BITWISE: return "bitwise";
+    case BLYNK_CRC32_SLICE8:  return "slice-by-8";
+    case BLYNK_CRC32_SLICE16: return "slice-by-16";
+    case BLYNK_CRC32_ARMV8:   return "armv8-crc";
+    case BLYNK_CRC32_PCLMUL:  return "pclmul";
+    default:                  return "?";
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file       BlynkCRC32.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Fast CRC-32 (IEEE 802.3, reflected 0xEDB88320) engines (Linux)
+ *
+ * Results are identical to BlynkCRC32Bitwise(), including chaining
+ * through previousCrc32.
+ *
+ * Engines:
+ *   slice-by-8, slice-by-16  portable, 8 or 16 KiB of tables
+ *   ARMv8 CRC32              Raspberry Pi 3/4 (AArch64, or AArch32 built
+ *                            with -march=armv8-a+crc)
+ *   PCLMUL folding           x86 with PCLMULQDQ + SSE4.1
+ *
+ * The best engine available on the running CPU is selected on first use.
+ */
+
+#ifndef BlynkCRC32_h
+#define BlynkCRC32_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum BlynkCRC32Engine {
+    BLYNK_CRC32_BITWISE,
+    BLYNK_CRC32_SLICE8,
+    BLYNK_CRC32_SLICE16,
+    BLYNK_CRC32_ARMV8,
+    BLYNK_CRC32_PCLMUL,
+    BLYNK_CRC32_ENGINES
+};
+
+uint32_t BlynkCRC32(const void* data, size_t length, uint32_t previousCrc32 = 0);
+
+// Use a specific engine (falls back to slice-by-16 if not supported)
+uint32_t BlynkCRC32With(BlynkCRC32Engine engine, const void* data, size_t length, uint32_t previousCrc32 = 0);
+
+bool             BlynkCRC32Supported(BlynkCRC32Engine engine);
+BlynkCRC32Engine BlynkCRC32Selected();
+const char*      BlynkCRC32Name(BlynkCRC32Engine engine);
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ * @file       BlynkCapture.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Protocol traffic capture to a pcapng ring file (Linux)
+ *
+ * File layout:
+ *   SHB | IDB | ring of blocks
+ *
+ * Every byte of the ring area always belongs to some block:
+ * either an EPB (a captured frame) or a padding Custom Block.
+ * When a new EPB partially overwrites an old block, the rest of that
+ * block is turned into padding, so the file can be parsed at any time.
+ */
+
+#if defined(LINUX)
+
+#include <utility/BlynkCapture.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PCAPNG_SHB          0x0A0D0D0AUL
+#define PCAPNG_IDB          0x00000001UL
+#define PCAPNG_EPB          0x00000006UL
+#define PCAPNG_CB_NO_COPY   0x40000BADUL
+#define PCAPNG_BOM          0x1A2B3C4DUL
+#define PCAPNG_PAD_PEN      32473       // IANA example enterprise number
+#define PCAPNG_PAD_MIN      16          // type, length, PEN, length
+#define LINKTYPE_USER0      147
+
+#define EPB_FIXED           (28 + 12 + 4) // header, flags option + end, trailing length
+
+int _blynkCaptureOn = 0;
+
+static uint8_t* cap_base = NULL;
+static size_t   cap_size = 0;
+static size_t   cap_start = 0;              // first byte of the ring area
+static size_t   cap_head = 0;               // next write position
+static uint32_t cap_frames = 0;
+static uint32_t cap_wraps = 0;
+static int      cap_lock = 0;
+
+// Timestamps: a raw CPU counter converted to wall-clock time,
+// as clock_gettime() alone can take half of the frame budget.
+static uint64_t clk_base_ns = 0;
+static uint64_t clk_base_cnt = 0;
+static uint64_t clk_mult = 0;               // ns per tick, 32.32 fixed point
+
+static inline uint64_t clk_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    static inline uint64_t clk_counter() { return __rdtsc(); }
+#elif defined(__aarch64__)
+    static inline uint64_t clk_counter() {
+        uint64_t v;
+        __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(v));
+        return v;
+    }
+#else
+    static inline uint64_t clk_counter() { return 0; }
+#endif
+
+static void clk_calibrate()
+{
+    clk_mult = 0;
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+    const uint64_t ns0 = clk_now_ns(), c0 = clk_counter();
+    struct timespec ts = { 0, 20 * 1000000L };
+    nanosleep(&ts, NULL);
+    const uint64_t ns1 = clk_now_ns(), c1 = clk_counter();
+    if (c1 > c0) {
+        clk_mult = ((ns1 - ns0) << 32) / (c1 - c0);
+    }
+    clk_base_ns = ns1;
+    clk_base_cnt = c1;
+#endif
+}
+
+static inline uint64_t clk_timestamp()
+{
+    if (!clk_mult) {
+        return clk_now_ns();
+    }
+    const uint64_t d = clk_counter() - clk_base_cnt;
+    return clk_base_ns + (d >> 32) * clk_mult + (((d & 0xFFFFFFFFULL) * clk_mult) >> 32);
+}
+
+static inline size_t align4(size_t v) { return (v + 3) & ~size_t(3); }
+
+static inline void put32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+static inline uint32_t get32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static void write_pad(size_t pos, size_t len)
+{
+    uint8_t* p = cap_base + pos;
+    put32(p, PCAPNG_CB_NO_COPY);
+    put32(p + 4, len);
+    put32(p + 8, PCAPNG_PAD_PEN);
+    put32(p + len - 4, len);
+}
+
+static size_t write_headers(uint8_t* p)
+{
+    // Section Header Block
+    put32(p + 0, PCAPNG_SHB);
+    put32(p + 4, 28);
+    put32(p + 8, PCAPNG_BOM);
+    put32(p + 12, 0x00000001);          // version 1.0
+    put32(p + 16, 0xFFFFFFFF);          // section length: unknown
+    put32(p + 20, 0xFFFFFFFF);
+    put32(p + 24, 28);
+    p += 28;
+
+    // Interface Description Block
+    static const char name[] = "blynk";
+    const size_t idb = 16 + (4 + align4(sizeof(name) - 1)) + (4 + 4) + 4 + 4;
+    memset(p, 0, idb);
+    put32(p + 0, PCAPNG_IDB);
+    put32(p + 4, idb);
+    put32(p + 8, LINKTYPE_USER0);       // linktype + reserved
+    put32(p + 12, BLYNK_CAPTURE_SNAPLEN);
+    uint8_t* o = p + 16;
+    put32(o, 2 | ((sizeof(name) - 1) << 16)); // if_name
+    memcpy(o + 4, name, sizeof(name) - 1);
+    o += 4 + align4(sizeof(name) - 1);
+    put32(o, 9 | (1 << 16));            // if_tsresol: 10^-9
+    o[4] = 9;
+    o += 8;
+    put32(o, 0);                        // opt_endofopt
+    put32(p + idb - 4, idb);
+
+    return 28 + idb;
+}
+
+bool BlynkCaptureOpen(const char* path, size_t size)
+{
+    BlynkCaptureClose();
+
+    size &= ~size_t(3);
+    const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, size) < 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+
+    cap_base = (uint8_t*)mem;
+    cap_size = size;
+    cap_start = write_headers(cap_base);
+    if (cap_size < cap_start + 4 * (EPB_FIXED + BLYNK_CAPTURE_SNAPLEN)) {
+        BlynkCaptureClose();
+        return false;
+    }
+    write_pad(cap_start, cap_size - cap_start);
+    cap_head = cap_start;
+    cap_frames = cap_wraps = 0;
+    clk_calibrate();
+    return true;
+}
+
+void BlynkCaptureClose()
+{
+    BlynkCaptureEnable(false);
+    while (__atomic_exchange_n(&cap_lock, 1, __ATOMIC_ACQUIRE)) {}
+    if (cap_base) {
+        msync(cap_base, cap_size, MS_ASYNC);
+        munmap(cap_base, cap_size);
+        cap_base = NULL;
+    }
+    __atomic_store_n(&cap_lock, 0, __ATOMIC_RELEASE);
+}
+
+// Makes room for a block of 'len' bytes at cap_head
+static size_t reserve(size_t len)
+{
+    size_t end = cap_head + len;
+    if (end > cap_size - PCAPNG_PAD_MIN && end != cap_size) {
+        // Not enough space till the end of file: wrap
+        write_pad(cap_head, cap_size - cap_head);
+        cap_head = cap_start;
+        end = cap_head + len;
+        cap_wraps++;
+    }
+    // Find the first old block boundary after the new block
+    size_t next = cap_head;
+    while (next < end) {
+        next += get32(cap_base + next + 4);
+    }
+    if (next != end && next - end < PCAPNG_PAD_MIN) {
+        next += get32(cap_base + next + 4);
+    }
+    if (next > end) {
+        write_pad(end, next - end);
+    }
+    const size_t pos = cap_head;
+    cap_head = (end == cap_size) ? cap_start : end;
+    return pos;
+}
+
+void BlynkCaptureFrame(uint8_t dir,
+                       const void* p1, size_t l1,
+                       const void* p2, size_t l2,
+                       const void* p3, size_t l3)
+{
+    const uint64_t t = clk_timestamp();
+
+    const size_t orig = l1 + l2 + l3;
+    const size_t cap = (orig < BLYNK_CAPTURE_SNAPLEN) ? orig : BLYNK_CAPTURE_SNAPLEN;
+    const size_t len = EPB_FIXED + align4(cap);
+
+    while (__atomic_exchange_n(&cap_lock, 1, __ATOMIC_ACQUIRE)) {}
+    if (!cap_base) {
+        __atomic_store_n(&cap_lock, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    uint8_t* p = cap_base + reserve(len);
+    put32(p + 8, 0);                    // interface id
+    put32(p + 12, uint32_t(t >> 32));
+    put32(p + 16, uint32_t(t));
+    put32(p + 20, cap);
+    put32(p + 24, orig);
+
+    uint8_t* d = p + 28;
+    size_t left = cap;
+    const void*  parts[3] = { p1, p2, p3 };
+    const size_t lens[3]  = { l1, l2, l3 };
+    for (int i = 0; i < 3 && left; i++) {
+        const size_t n = (lens[i] < left) ? lens[i] : left;
+        if (n) {
+            memcpy(d, parts[i], n);
+            d += n;
+            left -= n;
+        }
+    }
+    memset(d, 0, align4(cap) - cap);
+
+    uint8_t* o = p + 28 + align4(cap);
+    put32(o, 2 | (4 << 16));            // epb_flags
+    put32(o + 4, dir);                  // bits 0-1: 1 = inbound, 2 = outbound
+    put32(o + 8, 0);                    // opt_endofopt
+    put32(o + 12, len);
+
+    put32(p + 4, len);
+    put32(p + 0, PCAPNG_EPB);
+    cap_frames++;
+
+    __atomic_store_n(&cap_lock, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t BlynkCaptureFrames()
+{
+    return __atomic_load_n(&cap_frames, __ATOMIC_RELAXED);
+}
+
+uint32_t BlynkCaptureWraps()
+{
+    return __atomic_load_n(&cap_wraps, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file       BlynkCapture.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Protocol traffic capture to a pcapng ring file (Linux)
+ *
+ * With BLYNK_USE_CAPTURE defined, every frame sent or received by
+ * BlynkProtocol is passed to BlynkCaptureFrame() while capture is enabled.
+ * Frames are stored as Enhanced Packet Blocks (LINKTYPE_USER0, ns timestamps,
+ * inbound/outbound flags) in a memory-mapped file of fixed size.
+ *
+ * The file is a ring: when it is full, the oldest packets are overwritten.
+ * It always stays a valid pcapng file that Wireshark can open;
+ * after a wrap, sort by time to get chronological order.
+ */
+
+#ifndef BlynkCapture_h
+#define BlynkCapture_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default ring file size
+#ifndef BLYNK_CAPTURE_FILE_SIZE
+#define BLYNK_CAPTURE_FILE_SIZE (4UL * 1024 * 1024)
+#endif
+
+// Frames longer than this are truncated
+#ifndef BLYNK_CAPTURE_SNAPLEN
+#define BLYNK_CAPTURE_SNAPLEN   1024
+#endif
+
+enum BlynkCaptureDir {
+    BLYNK_CAPTURE_IN  = 1,
+    BLYNK_CAPTURE_OUT = 2
+};
+
+extern int _blynkCaptureOn;
+
+// Opens (creates or truncates) the ring file. Capture stays disabled.
+bool BlynkCaptureOpen(const char* path, size_t size = BLYNK_CAPTURE_FILE_SIZE);
+void BlynkCaptureClose();
+
+// Enable/disable recording. Async-signal-safe.
+static inline
+void BlynkCaptureEnable(bool on)
+{
+    __atomic_store_n(&_blynkCaptureOn, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+static inline
+bool BlynkCaptureEnabled()
+{
+    return __atomic_load_n(&_blynkCaptureOn, __ATOMIC_RELAXED);
+}
+
+// Records one frame, given as up to 3 consecutive pieces
+void BlynkCaptureFrame(uint8_t dir,
+                       const void* p1, size_t l1,
+                       const void* p2 = NULL, size_t l2 = 0,
+                       const void* p3 = NULL, size_t l3 = 0);
+
+// Stats
+uint32_t BlynkCaptureFrames();
+uint32_t BlynkCaptureWraps();
+
+#endif
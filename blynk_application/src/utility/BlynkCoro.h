@@ -0,0 +1,418 @@
+/**
+ * @file       BlynkCoro.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      C++20 coroutines for sequenced device logic
+ *
+ * Logic like "connect, sync, wait for the answer, then publish every
+ * second" can be written as one coroutine instead of timer slots, flags
+ * and BLYNK_CONNECTED callbacks:
+ *
+ *   static BlynkCoroLoop<BlynkSocket> loop(Blynk);
+ *
+ *   BlynkTask session() {
+ *       for (;;) {
+ *           co_await loop.connected();
+ *           Blynk.syncVirtual(V1);
+ *           const int target = (co_await loop.write(V1)).asInt();
+ *           millis_time_t next = BlynkMillis();
+ *           while (Blynk.connected()) {
+ *               Blynk.virtualWrite(V2, readSensor(target));
+ *               co_await loop.sleepUntil(next += 1000);
+ *           }
+ *       }
+ *   }
+ *
+ *   loop.spawn(session());
+ *   for (;;) loop.run();           // instead of Blynk.run()
+ *
+ * Awaitables:
+ *   connected()            until the device is connected
+ *   sleep(ms)              at least 'ms' (0 lets the others run)
+ *   sleepUntil(t)          until BlynkMillis() reaches 't', no drift
+ *   response(id, ms)       status code of the response to message 'id'
+ *                          (see lastMsgId()), or BLYNK_CORO_TIMEOUT
+ *   write(pin)             next value written to a virtual pin; valid
+ *                          until the next co_await
+ *
+ * Pin writes and responses resume the waiting coroutines right away,
+ * inside Blynk.run(), just like a BLYNK_WRITE handler would run; a write
+ * taken by a coroutine does not reach BLYNK_WRITE. Sleeps and connected()
+ * are checked by BlynkCoroLoop::run().
+ *
+ * Coroutine frames come from a fixed pool (BLYNK_CORO_FRAMES frames of
+ * BLYNK_CORO_FRAME_SIZE bytes), so starting and running coroutines never
+ * allocates; spawn() fails when the pool is exhausted or a frame is too
+ * big. Waiting coroutines are linked through their awaiters, which live in
+ * the frames, so the number of waiters is not limited. Everything runs on
+ * the thread that calls run().
+ *
+ * Needs C++20 (-std=c++20 or -std=gnu++20).
+ */
+
+#ifndef BlynkCoro_h
+#define BlynkCoro_h
+
+#if !defined(__cpp_impl_coroutine)
+    #error "BlynkCoro.h needs C++20 coroutines (build with -std=c++20)"
+#endif
+
+#include <coroutine>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <Blynk/BlynkDebug.h>
+#include <Blynk/BlynkParam.h>
+#include <Blynk/BlynkHandlers.h>
+
+// Coroutines that can exist at the same time
+#ifndef BLYNK_CORO_FRAMES
+#define BLYNK_CORO_FRAMES      8
+#endif
+
+// Largest coroutine frame (parameters, locals kept across co_await)
+#ifndef BLYNK_CORO_FRAME_SIZE
+#define BLYNK_CORO_FRAME_SIZE  512
+#endif
+
+// Returned by response() when nothing came in time, or the link dropped
+#define BLYNK_CORO_TIMEOUT     (-1)
+
+// Fixed pool of coroutine frames
+class BlynkCoroFrames
+{
+public:
+    static void* alloc(size_t size) {
+        Pool& p = pool();
+        if (size > BLYNK_CORO_FRAME_SIZE || !p.free) {
+            p.failed++;
+            return NULL;
+        }
+        Slot* s = p.free;
+        p.free = s->next;
+        if (++p.used > p.maxUsed) {
+            p.maxUsed = p.used;
+        }
+        return s;
+    }
+
+    static void release(void* ptr) {
+        if (!ptr) return;
+        Pool& p = pool();
+        Slot* s = static_cast<Slot*>(ptr);
+        s->next = p.free;
+        p.free = s;
+        p.used--;
+    }
+
+    static unsigned used()    { return pool().used; }
+    static unsigned maxUsed() { return pool().maxUsed; }
+    // Coroutines that could not be started
+    static unsigned failed()  { return pool().failed; }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(max_align_t) uint8_t data[BLYNK_CORO_FRAME_SIZE];
+    };
+
+    struct Pool {
+        Pool() : used(0), maxUsed(0), failed(0) {
+            for (unsigned i = 0; i < BLYNK_CORO_FRAMES; i++) {
+                slots[i].next = (i + 1 < BLYNK_CORO_FRAMES) ? &slots[i + 1] : NULL;
+            }
+            free = &slots[0];
+        }
+        Slot     slots[BLYNK_CORO_FRAMES];
+        Slot*    free;
+        unsigned used;
+        unsigned maxUsed;
+        unsigned failed;
+    };
+
+    static Pool& pool() {
+        static Pool p;
+        return p;
+    }
+};
+
+// A coroutine started with BlynkCoroLoop::spawn(); its frame is returned
+// to the pool when it finishes
+class BlynkTask
+{
+public:
+    struct promise_type {
+        static void* operator new(size_t size) noexcept {
+            return BlynkCoroFrames::alloc(size);
+        }
+        static void operator delete(void* ptr) noexcept {
+            BlynkCoroFrames::release(ptr);
+        }
+        static BlynkTask get_return_object_on_allocation_failure() noexcept {
+            return BlynkTask();
+        }
+        BlynkTask get_return_object() noexcept {
+            return BlynkTask(Handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { abort(); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    BlynkTask() : handle(nullptr) {}
+    BlynkTask(BlynkTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    ~BlynkTask() {
+        if (handle) handle.destroy();   // never started
+    }
+
+    bool valid() const { return bool(handle); }
+
+    Handle release() {
+        Handle h = handle;
+        handle = nullptr;
+        return h;
+    }
+
+private:
+    explicit BlynkTask(Handle h) : handle(h) {}
+    BlynkTask(const BlynkTask&) = delete;
+    BlynkTask& operator=(const BlynkTask&) = delete;
+
+    Handle handle;
+};
+
+template <class Device>
+class BlynkCoroLoop
+{
+    enum { SLEEP, CONNECT, RESPONSE, WRITE, LISTS };
+
+    struct Waiter {
+        Waiter*                 next;
+        std::coroutine_handle<> handle;
+        millis_time_t           deadline;
+        const BlynkParam*       param;
+        int                     result;
+        uint16_t                key;        // pin or message id
+    };
+
+    class Wait : protected Waiter {
+    public:
+        void await_suspend(std::coroutine_handle<> h) noexcept {
+            this->handle = h;
+            loop.link(list, this);
+        }
+    protected:
+        Wait(BlynkCoroLoop& l, uint8_t lst, uint16_t k = 0, millis_time_t d = 0)
+            : loop(l), list(lst)
+        {
+            this->next = NULL;
+            this->deadline = d;
+            this->param = NULL;
+            this->result = 0;
+            this->key = k;
+        }
+        BlynkCoroLoop& loop;
+        uint8_t        list;
+    };
+
+public:
+    class Sleep : public Wait {
+    public:
+        Sleep(BlynkCoroLoop& l, millis_time_t d, bool yield)
+            : Wait(l, SLEEP, 0, d), yield(yield) {}
+        bool await_ready() const noexcept {
+            return !yield && int32_t(BlynkMillis() - this->deadline) >= 0;
+        }
+        void await_resume() const noexcept {}
+    private:
+        bool yield;
+    };
+
+    class Connected : public Wait {
+    public:
+        Connected(BlynkCoroLoop& l) : Wait(l, CONNECT) {}
+        bool await_ready() const noexcept { return this->loop.dev.connected(); }
+        void await_resume() const noexcept {}
+    };
+
+    class Response : public Wait {
+    public:
+        Response(BlynkCoroLoop& l, uint16_t id, millis_time_t d) : Wait(l, RESPONSE, id, d) {}
+        bool await_ready() const noexcept { return false; }
+        int await_resume() const noexcept { return this->result; }
+    };
+
+    class Write : public Wait {
+    public:
+        Write(BlynkCoroLoop& l, uint8_t pin) : Wait(l, WRITE, pin) {}
+        bool await_ready() const noexcept { return false; }
+        const BlynkParam& await_resume() const noexcept { return *this->param; }
+    };
+
+    explicit BlynkCoroLoop(Device& device)
+        : dev(device)
+    {
+        for (unsigned i = 0; i < LISTS; i++) {
+            head[i] = tail[i] = NULL;
+        }
+    }
+
+    // Runs 'task' up to its first co_await. Call it once the device exists
+    // (e.g. in setup()): the first call installs the protocol hooks.
+    bool spawn(BlynkTask task) {
+        if (!task.valid()) {
+            BLYNK_LOG1(BLYNK_F("No free coroutine frame"));
+            return false;
+        }
+        instance = this;
+        dev.setWriteHook(onWrite);
+        BlynkResponseHooks::add(onResponse);
+        task.release().resume();
+        return true;
+    }
+
+    // Runs the device, then the coroutines whose sleep, connection or
+    // response timeout is due
+    void run() {
+        dev.run();
+
+        const millis_time_t now = BlynkMillis();
+        const bool online = dev.connected();
+        Waiter* ready = NULL;
+        Waiter** last = &ready;
+        for (unsigned l = 0; l < LISTS; l++) {
+            Waiter* prev = NULL;
+            for (Waiter* w = head[l]; w; ) {
+                Waiter* next = w->next;
+                bool due = false;
+                switch (l) {
+                case SLEEP:    due = int32_t(now - w->deadline) >= 0; break;
+                case CONNECT:  due = online; break;
+                case RESPONSE: due = !online || int32_t(now - w->deadline) >= 0; break;
+                }
+                if (due) {
+                    w->result = BLYNK_CORO_TIMEOUT;
+                    unlink(l, prev, w);
+                    *last = w;
+                    last = &w->next;
+                } else {
+                    prev = w;
+                }
+                w = next;
+            }
+        }
+        *last = NULL;
+        resumeAll(ready);
+    }
+
+    Sleep sleep(uint32_t ms) {
+        return Sleep(*this, BlynkMillis() + ms, true);
+    }
+
+    Sleep sleepUntil(millis_time_t t) {
+        return Sleep(*this, t, false);
+    }
+
+    Connected connected() {
+        return Connected(*this);
+    }
+
+    Response response(uint16_t msgId, uint32_t timeout = BLYNK_TIMEOUT_MS) {
+        return Response(*this, msgId, BlynkMillis() + timeout);
+    }
+
+    Write write(uint8_t pin) {
+        return Write(*this, pin);
+    }
+
+    // Coroutines waiting for anything
+    unsigned waiting() const {
+        unsigned n = 0;
+        for (unsigned l = 0; l < LISTS; l++) {
+            for (const Waiter* w = head[l]; w; w = w->next) n++;
+        }
+        return n;
+    }
+
+private:
+    void link(uint8_t l, Waiter* w) {
+        w->next = NULL;
+        if (tail[l]) {
+            tail[l]->next = w;
+        } else {
+            head[l] = w;
+        }
+        tail[l] = w;
+    }
+
+    void unlink(uint8_t l, Waiter* prev, Waiter* w) {
+        if (prev) {
+            prev->next = w->next;
+        } else {
+            head[l] = w->next;
+        }
+        if (tail[l] == w) {
+            tail[l] = prev;
+        }
+    }
+
+    // Takes the waiters of list 'l' for 'key', in the order they came
+    Waiter* take(uint8_t l, uint16_t key) {
+        Waiter* ready = NULL;
+        Waiter** last = &ready;
+        Waiter* prev = NULL;
+        for (Waiter* w = head[l]; w; ) {
+            Waiter* next = w->next;
+            if (w->key == key) {
+                unlink(l, prev, w);
+                *last = w;
+                last = &w->next;
+            } else {
+                prev = w;
+            }
+            w = next;
+        }
+        *last = NULL;
+        return ready;
+    }
+
+    static void resumeAll(Waiter* w) {
+        while (w) {
+            Waiter* next = w->next;     // the awaiter ends with the resume
+            w->handle.resume();
+            w = next;
+        }
+    }
+
+    static bool onWrite(const BlynkReq& req, const BlynkParam& param) {
+        Waiter* ready = instance->take(WRITE, req.pin);
+        if (!ready) {
+            return false;
+        }
+        for (Waiter* w = ready; w; w = w->next) {
+            w->param = &param;
+        }
+        resumeAll(ready);
+        return true;
+    }
+
+    static void onResponse(uint16_t msgId, uint16_t code) {
+        Waiter* ready = instance->take(RESPONSE, msgId);
+        for (Waiter* w = ready; w; w = w->next) {
+            w->result = code;
+        }
+        resumeAll(ready);
+    }
+
+    Device& dev;
+    Waiter* head[LISTS];
+    Waiter* tail[LISTS];
+
+    static BlynkCoroLoop* instance;
+};
+
+template <class Device>
+BlynkCoroLoop<Device>* BlynkCoroLoop<Device>::instance = NULL;
+
+#endif
@@ -220,7 +220,11 @@
 
     void BlynkDelay(millis_time_t ms)
     {
-        usleep(ms * 1000);
+        // usleep(0) still sleeps for the timer slack (~50 us), and sendCmd()
+        // calls BlynkDelay(BLYNK_SEND_THROTTLE) after every write
+        if (ms) {
+            usleep(ms * 1000);
+        }
     }
 
     millis_time_t BlynkMillis()
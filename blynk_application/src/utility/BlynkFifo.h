@@ -6,26 +6,96 @@
  * @date       Feb 2015
  * @brief      FIFO implementation
  *
+ * Single-producer / single-consumer ring buffer.
+ * One thread (or ISR) may write, one other thread may read, without locks.
+ *
+ * Indices are free-running counters published with acquire/release
+ * ordering, so the FIFO is also correct on multi-core CPUs.
+ * Storage is rounded up to a power of two, but at most N items are queued.
+ *
+ * On Linux, the indices are kept on separate cache lines and blocking
+ * waits sleep on a futex after a short spin (define BLYNK_FIFO_NO_FUTEX
+ * to always spin).
  */
 
 #ifndef BlynkFifo_h
 #define BlynkFifo_h
 
+#include <string.h>
 #include <utility/BlynkUtility.h>
 
+#if defined(LINUX)
+    #include <unistd.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+    #if !defined(BLYNK_FIFO_NO_FUTEX)
+        #define BLYNK_FIFO_USE_FUTEX
+    #endif
+    #ifndef BLYNK_FIFO_CACHELINE
+        #define BLYNK_FIFO_CACHELINE 64
+    #endif
+#endif
+
+#ifdef BLYNK_FIFO_CACHELINE
+    #define BLYNK_FIFO_ALIGN alignas(BLYNK_FIFO_CACHELINE)
+#else
+    #define BLYNK_FIFO_ALIGN
+#endif
+
+// Amount of polls before a blocking call goes to sleep
+#ifndef BLYNK_FIFO_SPIN
+#define BLYNK_FIFO_SPIN 256
+#endif
+
+#if defined(__AVR__) || !defined(__ATOMIC_ACQUIRE)
+    // No atomics here, rely on volatile access (single core)
+    #define BLYNK_FIFO_LOAD(x)          (*(volatile unsigned*)&(x))
+    #define BLYNK_FIFO_STORE(x, v)      (*(volatile unsigned*)&(x) = (v))
+    #define BLYNK_FIFO_FENCE()
+#else
+    #define BLYNK_FIFO_LOAD(x)          __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+    #define BLYNK_FIFO_STORE(x, v)      __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+    #define BLYNK_FIFO_FENCE()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+static inline
+void BlynkCpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && (__ARM_ARCH >= 7))
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static constexpr
+unsigned BlynkFifoStorage(unsigned v, unsigned p = 1)
+{
+    return (p >= v) ? p : BlynkFifoStorage(v, p << 1);
+}
+
 template <class T, unsigned N>
 class BlynkFifo
 {
 public:
+    enum {
+        CAPACITY = N,
+        STORAGE  = BlynkFifoStorage(N),
+        MASK     = STORAGE - 1
+    };
+
     BlynkFifo()
     {
         clear();
     }
 
+    // Not thread-safe: both sides should be idle
     void clear()
     {
-        _r = 0;
-        _w = 0;
+        _r = _rCache = 0;
+        _w = _wCache = 0;
+        _readerSleeping = 0;
+        _writerSleeping = 0;
     }
 
     ~BlynkFifo(void)
@@ -41,21 +111,20 @@ public:
 
     int free(void)
     {
-        int s = _r - _w;
-        if (s <= 0)
-            s += N;
-        return s - 1;
+        return N - (_w - BLYNK_FIFO_LOAD(_r));
     }
 
     T put(const T& c)
     {
-        int i = _w;
-        int j = i;
-        i = _inc(i);
-        while (i == _r) // = !writeable()
-            /* nothing / just wait */;
-        _b[j] = c;
-        _w = i;
+        const unsigned w = _w;
+        while (w - _rCache >= N) {
+            _rCache = BLYNK_FIFO_LOAD(_r);
+            if (w - _rCache >= N) {
+                _wait(_r, _rCache, _writerSleeping);
+            }
+        }
+        _b[w & MASK] = c;
+        _publishWrite(w + 1);
         return c;
     }
 
@@ -64,57 +133,67 @@ public:
         int c = n;
         while (c)
         {
+            T* span;
             int f;
-            while ((f = free()) == 0) // wait for space
+            while ((f = writeSpan(span)) == 0) // wait for space
             {
                 if (!blocking) return n - c; // no more space and not blocking
-                /* nothing / just wait */;
+                _wait(_r, _rCache, _writerSleeping);
             }
-            // check free space
             if (c < f) f = c;
-            int w = _w;
-            int m = N - w;
-            // check wrap
-            if (f > m) f = m;
-            memcpy(&_b[w], p, f);
-            _w = _inc(w, f);
+            memcpy(span, p, f * sizeof(T));
+            commitWrite(f);
             c -= f;
             p += f;
         }
         return n - c;
     }
 
+    // Zero-copy write: get the largest contiguous free region,
+    // fill it, then commit the amount actually written.
+    size_t writeSpan(T*& span)
+    {
+        const unsigned w = _w;
+        unsigned f = N - (w - _rCache);
+        if (f == 0) {
+            _rCache = BLYNK_FIFO_LOAD(_r);
+            f = N - (w - _rCache);
+        }
+        const unsigned wi = w & MASK;
+        span = &_b[wi];
+        return BlynkMin(f, unsigned(STORAGE - wi));
+    }
+
+    void commitWrite(size_t n)
+    {
+        _publishWrite(_w + n);
+    }
+
     // reading thread/context API
     // --------------------------------------------------------
 
     bool readable(void)
     {
-        return (_r != _w);
+        return (_r != BLYNK_FIFO_LOAD(_w));
     }
 
     size_t size(void)
     {
-        int s = _w - _r;
-        if (s < 0)
-            s += N;
-        return s;
+        return BLYNK_FIFO_LOAD(_w) - BLYNK_FIFO_LOAD(_r);
     }
 
     T get(void)
     {
-        int r = _r;
-        while (r == _w) // = !readable()
-            /* nothing / just wait */;
-        T t = _b[r];
-        _r = _inc(r);
+        const unsigned r = _waitReadable();
+        T t = _b[r & MASK];
+        _publishRead(r + 1);
         return t;
     }
 
     T peek(void)
     {
-        int r = _r;
-        while (r == _w);
-        return _b[r];
+        const unsigned r = _waitReadable();
+        return _b[r & MASK];
     }
 
     int get(T* p, int n, bool blocking = false)
@@ -122,37 +201,111 @@ public:
         int c = n;
         while (c)
         {
+            const T* span;
             int f;
-            for (;;) // wait for data
+            while ((f = readSpan(span)) == 0) // wait for data
             {
-                f = size();
-                if (f)  break;        // free space
-                if (!blocking) return n - c; // no space and not blocking
-                /* nothing / just wait */;
+                if (!blocking) return n - c; // no data and not blocking
+                _wait(_w, _wCache, _readerSleeping);
             }
-            // check available data
             if (c < f) f = c;
-            int r = _r;
-            int m = N - r;
-            // check wrap
-            if (f > m) f = m;
-            memcpy(p, &_b[r], f);
-            _r = _inc(r, f);
+            memcpy(p, span, f * sizeof(T));
+            commitRead(f);
             c -= f;
             p += f;
         }
         return n - c;
     }
 
+    // Zero-copy read: get the largest contiguous readable region,
+    // consume it, then commit the amount actually read.
+    size_t readSpan(const T*& span)
+    {
+        const unsigned r = _r;
+        unsigned f = _wCache - r;
+        if (f == 0) {
+            _wCache = BLYNK_FIFO_LOAD(_w);
+            f = _wCache - r;
+        }
+        const unsigned ri = r & MASK;
+        span = &_b[ri];
+        return BlynkMin(f, unsigned(STORAGE - ri));
+    }
+
+    void commitRead(size_t n)
+    {
+        _publishRead(_r + n);
+    }
+
 private:
-    int _inc(int i, int n = 1)
+    unsigned _waitReadable()
+    {
+        const unsigned r = _r;
+        while (r == _wCache) {
+            _wCache = BLYNK_FIFO_LOAD(_w);
+            if (r == _wCache) {
+                _wait(_w, _wCache, _readerSleeping);
+            }
+        }
+        return r;
+    }
+
+    void _publishWrite(unsigned w)
     {
-        return (i + n) % N;
+        BLYNK_FIFO_STORE(_w, w);
+        _wake(_w, _readerSleeping);
     }
 
-    T             _b[N];
-    volatile int  _w;
-    volatile int  _r;
+    void _publishRead(unsigned r)
+    {
+        BLYNK_FIFO_STORE(_r, r);
+        _wake(_r, _writerSleeping);
+    }
+
+    // Wait until the other side moves its index away from 'val'
+    static void _wait(unsigned& idx, unsigned val, unsigned& sleeping)
+    {
+        for (int i = 0; i < BLYNK_FIFO_SPIN; i++) {
+            if (BLYNK_FIFO_LOAD(idx) != val) return;
+            BlynkCpuRelax();
+        }
+#ifdef BLYNK_FIFO_USE_FUTEX
+        __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&idx, __ATOMIC_SEQ_CST) == val) {
+            syscall(SYS_futex, &idx, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+        }
+        __atomic_store_n(&sleeping, 0, __ATOMIC_RELAXED);
+#else
+        (void)sleeping;
+        while (BLYNK_FIFO_LOAD(idx) == val) {
+            BlynkCpuRelax();
+        }
+#endif
+    }
+
+    static void _wake(unsigned& idx, unsigned& sleeping)
+    {
+#ifdef BLYNK_FIFO_USE_FUTEX
+        BLYNK_FIFO_FENCE();
+        if (__atomic_load_n(&sleeping, __ATOMIC_RELAXED)) {
+            syscall(SYS_futex, &idx, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+#else
+        (void)idx; (void)sleeping;
+#endif
+    }
+
+    T _b[STORAGE];
+
+    // Owned by the writer
+    BLYNK_FIFO_ALIGN unsigned _w;
+    unsigned _rCache;            // last seen read index
+    unsigned _readerSleeping;    // set by the reader before it sleeps on _w
+
+    // Owned by the reader
+    BLYNK_FIFO_ALIGN unsigned _r;
+    unsigned _wCache;            // last seen write index
+    unsigned _writerSleeping;    // set by the writer before it sleeps on _r
 };
 
 #endif
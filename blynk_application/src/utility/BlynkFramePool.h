@@ -0,0 +1,161 @@
+/**
+ * @file       BlynkFramePool.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Preallocated frame buffers in two capacity tiers
+ *
+ * Every connection owns BLYNK_FRAME_SMALL_COUNT buffers of
+ * BLYNK_FRAME_SMALL_SIZE bytes and BLYNK_FRAME_LARGE_COUNT buffers of
+ * BLYNK_FRAME_LARGE_SIZE bytes, each with one extra byte for a terminating
+ * zero. A frame takes the smallest free buffer that it fits in, so the
+ * protocol neither allocates nor needs variable-length arrays on the stack.
+ *
+ * Buffers are held by a BlynkFrame and go back to the pool when it goes
+ * out of scope:
+ *
+ *   BlynkFrame frame(pool);
+ *   if (frame.acquire(len)) {
+ *       read(frame.data(), len);
+ *   }
+ *
+ * A pool belongs to one connection and, like the rest of the protocol
+ * state, is not thread-safe.
+ */
+
+#ifndef BlynkFramePool_h
+#define BlynkFramePool_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Blynk/BlynkConfig.h>
+
+class BlynkFramePool
+{
+public:
+    enum {
+        SLOTS = BLYNK_FRAME_SMALL_COUNT + BLYNK_FRAME_LARGE_COUNT
+    };
+
+    BlynkFramePool() : busy(0) {}
+
+    // Slots are ordered by capacity: small ones first
+    static size_t capacity(unsigned slot) {
+        return (slot < BLYNK_FRAME_SMALL_COUNT) ? BLYNK_FRAME_SMALL_SIZE : BLYNK_FRAME_LARGE_SIZE;
+    }
+
+    // The largest frame that fits into one buffer
+    static size_t maxSize() {
+        return capacity(SLOTS - 1);
+    }
+
+    // Smallest free slot with room for 'size' bytes, or -1
+    int take(size_t size) {
+        for (unsigned i = 0; i < SLOTS; i++) {
+            if (!(busy & (1U << i)) && capacity(i) >= size) {
+                busy |= (1U << i);
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Largest free slot, or -1
+    int takeLargest() {
+        for (unsigned i = SLOTS; i-- > 0; ) {
+            if (!(busy & (1U << i))) {
+                busy |= (1U << i);
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void give(int slot) {
+        busy &= ~(1U << slot);
+    }
+
+    uint8_t* data(unsigned slot) {
+        if (slot < BLYNK_FRAME_SMALL_COUNT) {
+            return mem + slot * (BLYNK_FRAME_SMALL_SIZE + 1);
+        }
+        return mem + BLYNK_FRAME_SMALL_COUNT * (BLYNK_FRAME_SMALL_SIZE + 1) +
+                     (slot - BLYNK_FRAME_SMALL_COUNT) * (BLYNK_FRAME_LARGE_SIZE + 1);
+    }
+
+    // True if a frame of any size up to maxSize() can be taken now
+    bool canReceive() const {
+        for (unsigned i = SLOTS; i-- > 0 && capacity(i) == maxSize(); ) {
+            if (!(busy & (1U << i))) return true;
+        }
+        return false;
+    }
+
+    unsigned inUse() const {
+        unsigned n = 0;
+        for (unsigned i = 0; i < SLOTS; i++) {
+            if (busy & (1U << i)) n++;
+        }
+        return n;
+    }
+
+private:
+    static_assert(SLOTS > 0 && SLOTS <= 16, "BLYNK_FRAME_*_COUNT: 1 to 16 buffers in total");
+    static_assert(BLYNK_FRAME_LARGE_SIZE >= BLYNK_FRAME_SMALL_SIZE, "BLYNK_FRAME_LARGE_SIZE is smaller than BLYNK_FRAME_SMALL_SIZE");
+
+    uint16_t busy;
+    uint8_t  mem[BLYNK_FRAME_SMALL_COUNT * (BLYNK_FRAME_SMALL_SIZE + 1) +
+                 BLYNK_FRAME_LARGE_COUNT * (BLYNK_FRAME_LARGE_SIZE + 1)];
+};
+
+// A buffer borrowed from a BlynkFramePool for one scope
+class BlynkFrame
+{
+public:
+    explicit BlynkFrame(BlynkFramePool& pool)
+        : pool(pool), slot(-1)
+    {}
+
+    ~BlynkFrame() { release(); }
+
+    // Smallest free buffer with room for 'size' bytes
+    bool acquire(size_t size) {
+        release();
+        slot = pool.take(size);
+        return slot >= 0;
+    }
+
+    // Largest free buffer, for data that is handled in chunks
+    bool acquireLargest() {
+        release();
+        slot = pool.takeLargest();
+        return slot >= 0;
+    }
+
+    // Moves to a free buffer larger than 'above' bytes, keeping the current
+    // one if there is none
+    bool grow(size_t above) {
+        const int s = pool.take(above + 1);
+        if (s < 0) return false;
+        release();
+        slot = s;
+        return true;
+    }
+
+    void release() {
+        if (slot >= 0) {
+            pool.give(slot);
+            slot = -1;
+        }
+    }
+
+    uint8_t* data() const { return (slot >= 0) ? pool.data(slot) : NULL; }
+    size_t   size() const { return (slot >= 0) ? BlynkFramePool::capacity(slot) : 0; }
+
+private:
+    BlynkFrame(const BlynkFrame&);
+    BlynkFrame& operator=(const BlynkFrame&);
+
+    BlynkFramePool& pool;
+    int             slot;
+};
+
+#endif
@@ -0,0 +1,196 @@
+/**
+ * @file       BlynkLatency.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Per-stage latency histograms (Linux)
+ */
+
+#if defined(LINUX)
+
+#include <utility/BlynkLatency.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+BlynkLatency* BlynkLatency::sFirst = NULL;
+
+BlynkLatency::BlynkLatency(const char* name)
+    : mName(name)
+    , mNext(NULL)
+    , mSum(0)
+    , mMax(0)
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    // Stages may be created lazily from any thread
+    BlynkLatency* head = __atomic_load_n(&sFirst, __ATOMIC_RELAXED);
+    do {
+        mNext = head;
+    } while (!__atomic_compare_exchange_n(&sFirst, &head, this, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+uint64_t BlynkLatency::bucketHigh(unsigned b)
+{
+    if (b < (1U << BLYNK_LATENCY_SUB_BITS)) return b;
+    const unsigned shift = (b >> BLYNK_LATENCY_SUB_BITS) - 1;
+    const uint64_t sub = b & ((1U << BLYNK_LATENCY_SUB_BITS) - 1);
+    const uint64_t low = ((1ULL << BLYNK_LATENCY_SUB_BITS) + sub) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+uint64_t BlynkLatency::count() const
+{
+    uint64_t n = 0;
+    for (unsigned b = 0; b < BLYNK_LATENCY_BUCKETS; b++) {
+        n += __atomic_load_n(&mBuckets[b], __ATOMIC_RELAXED);
+    }
+    return n;
+}
+
+uint64_t BlynkLatency::mean() const
+{
+    const uint64_t n = count();
+    return n ? __atomic_load_n(&mSum, __ATOMIC_RELAXED) / n : 0;
+}
+
+uint64_t BlynkLatency::percentile(double p) const
+{
+    uint64_t counts[BLYNK_LATENCY_BUCKETS];
+    uint64_t n = 0;
+    for (unsigned b = 0; b < BLYNK_LATENCY_BUCKETS; b++) {
+        counts[b] = __atomic_load_n(&mBuckets[b], __ATOMIC_RELAXED);
+        n += counts[b];
+    }
+    if (!n) return 0;
+
+    uint64_t rank = uint64_t(p / 100.0 * double(n) + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < BLYNK_LATENCY_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= rank) {
+            const uint64_t high = bucketHigh(b);
+            const uint64_t m = max();
+            return (high < m) ? high : m;
+        }
+    }
+    return max();
+}
+
+void BlynkLatency::reset()
+{
+    for (unsigned b = 0; b < BLYNK_LATENCY_BUCKETS; b++) {
+        __atomic_store_n(&mBuckets[b], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&mSum, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mMax, 0, __ATOMIC_RELAXED);
+}
+
+int BlynkLatency::format(char* buf, size_t len) const
+{
+    return snprintf(buf, len, "%-20s %10llu  mean %9.1f  p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us",
+                    mName, (unsigned long long)count(), mean() / 1e3,
+                    percentile(50) / 1e3, percentile(99) / 1e3, percentile(99.9) / 1e3,
+                    max() / 1e3);
+}
+
+void BlynkLatency::printAll(FILE* out)
+{
+    char line[160];
+    for (BlynkLatency* s = first(); s; s = s->next()) {
+        s->format(line, sizeof(line));
+        fprintf(out, "%s\n", line);
+    }
+    fflush(out);
+}
+
+void BlynkLatency::resetAll()
+{
+    for (BlynkLatency* s = first(); s; s = s->next()) {
+        s->reset();
+    }
+}
+
+static pthread_t reporter;
+static bool      reporterRunning = false;
+static int       reporterPipe[2] = { -1, -1 };
+static int       reporterSig = 0;
+static FILE*     reporterOut = NULL;
+static unsigned  reporterPeriod = 0;
+
+// Only write() is async-signal-safe; the reporter thread does the printing
+static void reporter_signal(int)
+{
+    const int saved = errno;
+    const char c = 'd';
+    if (write(reporterPipe[1], &c, 1) < 0) {}
+    errno = saved;
+}
+
+static void* reporter_thread(void*)
+{
+    const int timeout = reporterPeriod ? int(reporterPeriod * 1000) : -1;
+    for (;;) {
+        struct pollfd p = { reporterPipe[0], POLLIN, 0 };
+        const int r = poll(&p, 1, timeout);
+        if (r < 0 && errno == EINTR) continue;
+        if (r > 0) {
+            char c[16];
+            const ssize_t n = read(reporterPipe[0], c, sizeof(c));
+            if (memchr(c, 'q', n > 0 ? size_t(n) : 0)) break;
+        }
+        fprintf(reporterOut, "--- latency (%s) ---\n", r > 0 ? "signal" : "periodic");
+        BlynkLatency::printAll(reporterOut);
+    }
+    return NULL;
+}
+
+bool BlynkLatencyReporterStart(FILE* out, unsigned periodSec, int sig)
+{
+    if (reporterRunning) return false;
+    if (pipe(reporterPipe) < 0) return false;
+    fcntl(reporterPipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(reporterPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(reporterPipe[1], F_SETFD, FD_CLOEXEC);
+    reporterOut = out;
+    reporterPeriod = periodSec;
+    reporterSig = sig;
+
+    if (pthread_create(&reporter, NULL, reporter_thread, NULL) != 0) {
+        close(reporterPipe[0]);
+        close(reporterPipe[1]);
+        return false;
+    }
+    reporterRunning = true;
+
+    if (sig) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = reporter_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(sig, &sa, NULL);
+    }
+    return true;
+}
+
+void BlynkLatencyReporterStop()
+{
+    if (!reporterRunning) return;
+    if (reporterSig) {
+        signal(reporterSig, SIG_DFL);
+    }
+    const char c = 'q';
+    if (write(reporterPipe[1], &c, 1) < 0) {}
+    pthread_join(reporter, NULL);
+    close(reporterPipe[0]);
+    close(reporterPipe[1]);
+    reporterRunning = false;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * @file       BlynkLatency.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Per-stage latency histograms (Linux)
+ *
+ * Each BlynkLatency is a named stage with a log-linear (HDR-style)
+ * histogram of durations in nanoseconds: 16 sub-buckets per power of two,
+ * so percentiles are within 6.25% of the true value over the whole range.
+ * The maximum is exact.
+ *
+ * Recording is lock-free and takes a few relaxed atomic adds; stages can
+ * be recorded from several threads. All stages are linked in one list,
+ * so they can be dumped together:
+ *
+ *   static BlynkLatency adc("sample.adc");
+ *   BlynkLatencyTimer t;
+ *   readAdc();
+ *   t.lap(adc);            // records the time since the last lap
+ *
+ *   void f() {
+ *       BLYNK_LATENCY_SCOPE("f");  // records the time until the scope ends
+ *   }
+ *
+ * Timestamps are CLOCK_MONOTONIC_RAW, which is read through the vDSO and
+ * is not slewed by NTP.
+ */
+
+#ifndef BlynkLatency_h
+#define BlynkLatency_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <utility/BlynkProbes.h>
+
+#define BLYNK_LATENCY_SUB_BITS  4
+#define BLYNK_LATENCY_BUCKETS   ((64 - BLYNK_LATENCY_SUB_BITS + 1) << BLYNK_LATENCY_SUB_BITS)
+
+class BlynkLatency
+{
+public:
+    // Stages are never unlinked, so they should have static storage
+    explicit BlynkLatency(const char* name);
+
+    static uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    void record(uint64_t ns) {
+        BLYNK_PROBE2(stage, mName, ns);
+        __atomic_fetch_add(&mBuckets[bucket(ns)], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&mSum, ns, __ATOMIC_RELAXED);
+        uint64_t m = __atomic_load_n(&mMax, __ATOMIC_RELAXED);
+        while (ns > m && !__atomic_compare_exchange_n(&mMax, &m, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+    }
+
+    const char* name() const { return mName; }
+
+    uint64_t count() const;
+    uint64_t max() const { return __atomic_load_n(&mMax, __ATOMIC_RELAXED); }
+    uint64_t mean() const;
+
+    // Highest value equivalent to the given percentile (0..100), in ns
+    uint64_t percentile(double p) const;
+
+    void reset();
+
+    // One line: name, count, mean, p50, p99, p99.9, max (in us)
+    int format(char* buf, size_t len) const;
+
+    static BlynkLatency* first() { return __atomic_load_n(&sFirst, __ATOMIC_ACQUIRE); }
+    BlynkLatency* next() const { return mNext; }
+
+    static void printAll(FILE* out);
+    static void resetAll();
+
+    static unsigned bucket(uint64_t ns) {
+        if (ns < (1U << BLYNK_LATENCY_SUB_BITS)) return unsigned(ns);
+        const unsigned e = 63 - __builtin_clzll(ns);
+        const unsigned sub = unsigned(ns >> (e - BLYNK_LATENCY_SUB_BITS)) & ((1U << BLYNK_LATENCY_SUB_BITS) - 1);
+        return ((e - BLYNK_LATENCY_SUB_BITS + 1) << BLYNK_LATENCY_SUB_BITS) + sub;
+    }
+
+    // Largest value that falls into bucket 'b'
+    static uint64_t bucketHigh(unsigned b);
+
+private:
+    BlynkLatency(const BlynkLatency&);
+    BlynkLatency& operator=(const BlynkLatency&);
+
+    static BlynkLatency* sFirst;
+
+    const char*   mName;
+    BlynkLatency* mNext;
+    uint64_t      mSum;
+    uint64_t      mMax;
+    uint64_t      mBuckets[BLYNK_LATENCY_BUCKETS];
+};
+
+// Measures consecutive stages of one pass
+class BlynkLatencyTimer
+{
+public:
+    BlynkLatencyTimer() : mLast(BlynkLatency::now()) {}
+
+    void restart() { mLast = BlynkLatency::now(); }
+
+    // Records the time since the last lap (or start) into 'stage'
+    uint64_t lap(BlynkLatency& stage) {
+        const uint64_t t = BlynkLatency::now();
+        const uint64_t d = t - mLast;
+        stage.record(d);
+        mLast = t;
+        return d;
+    }
+
+private:
+    uint64_t mLast;
+};
+
+// Records the lifetime of a scope
+class BlynkLatencyScope
+{
+public:
+    explicit BlynkLatencyScope(BlynkLatency& stage)
+        : mStage(stage), mStart(BlynkLatency::now())
+    {}
+    ~BlynkLatencyScope() { mStage.record(BlynkLatency::now() - mStart); }
+
+private:
+    BlynkLatency& mStage;
+    uint64_t      mStart;
+};
+
+#define BLYNK_LATENCY_CONCAT2(a, b) a##b
+#define BLYNK_LATENCY_CONCAT(a, b)  BLYNK_LATENCY_CONCAT2(a, b)
+
+// The stage is created (and listed) the first time the scope is entered
+#define BLYNK_LATENCY_SCOPE(name) \
+    static BlynkLatency BLYNK_LATENCY_CONCAT(_blynkLatencyStage, __LINE__)(name); \
+    BlynkLatencyScope BLYNK_LATENCY_CONCAT(_blynkLatencyScope, __LINE__)(BLYNK_LATENCY_CONCAT(_blynkLatencyStage, __LINE__))
+
+// Starts a thread that prints all stages to 'out' every 'periodSec' seconds
+// (0: never) and whenever signal 'sig' arrives (0: none), e.g. SIGUSR1.
+bool BlynkLatencyReporterStart(FILE* out, unsigned periodSec, int sig);
+void BlynkLatencyReporterStop();
+
+#endif
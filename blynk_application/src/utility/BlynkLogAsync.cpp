@@ -0,0 +1,318 @@
+/**
+ * @file       BlynkLogAsync.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Asynchronous binary logger (Linux): registration and writer
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkLogAsync.h>
+
+#include <new>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+thread_local BlynkLogRing* _blynkLogRing = NULL;
+
+static BlynkLogRing*   blynk_log_rings[BLYNK_LOG_ASYNC_THREADS];
+static unsigned        blynk_log_ring_qty = 0;
+static uint32_t        blynk_log_unregistered = 0;
+static pthread_mutex_t blynk_log_reg_lock   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t blynk_log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  blynk_log_once = PTHREAD_ONCE_INIT;
+static FILE*           blynk_log_out = NULL;
+
+// Releases the ring when its owner thread exits, so it can be reused
+struct BlynkLogRingOwner {
+    ~BlynkLogRingOwner() {
+        if (_blynkLogRing) {
+            __atomic_store_n(&_blynkLogRing->owned, false, __ATOMIC_RELEASE);
+            _blynkLogRing = NULL;
+        }
+    }
+};
+static thread_local BlynkLogRingOwner blynk_log_owner;
+static thread_local bool blynk_log_no_ring = false;
+
+static void print_arg_stream(FILE* out, const BlynkLogRecord& r, unsigned a)
+{
+    switch (r.types[a]) {
+    case BLYNK_LOGARG_INT:    fprintf(out, "%lld", (long long)r.args[a].i);           break;
+    case BLYNK_LOGARG_UINT:   fprintf(out, "%llu", (unsigned long long)r.args[a].u);  break;
+    case BLYNK_LOGARG_DOUBLE: fprintf(out, "%g", r.args[a].d);                        break;
+    case BLYNK_LOGARG_CHAR:   fputc((char)r.args[a].i, out);                         break;
+    case BLYNK_LOGARG_STR:    fputs(r.data + r.args[a].off, out);                     break;
+    case BLYNK_LOGARG_PTR:    fprintf(out, "%p", r.args[a].p);                        break;
+    }
+}
+
+static long long arg_int(const BlynkLogRecord& r, unsigned a)
+{
+    switch (r.types[a]) {
+    case BLYNK_LOGARG_DOUBLE: return (long long)r.args[a].d;
+    case BLYNK_LOGARG_STR:    return 0;
+    default:                  return r.args[a].i;
+    }
+}
+
+static double arg_double(const BlynkLogRecord& r, unsigned a)
+{
+    switch (r.types[a]) {
+    case BLYNK_LOGARG_DOUBLE: return r.args[a].d;
+    case BLYNK_LOGARG_UINT:   return (double)r.args[a].u;
+    case BLYNK_LOGARG_STR:    return 0;
+    default:                  return (double)r.args[a].i;
+    }
+}
+
+// Re-applies the printf format, one conversion at a time,
+// with length modifiers replaced to match the captured types.
+static void print_fmt(FILE* out, const BlynkLogRecord& r)
+{
+    const char* f = r.fmt;
+    unsigned a = 0;
+    while (*f) {
+        if (*f != '%') {
+            const char* next = strchr(f, '%');
+            const size_t n = next ? size_t(next - f) : strlen(f);
+            fwrite(f, 1, n, out);
+            f += n;
+            continue;
+        }
+        if (f[1] == '%') {
+            fputc('%', out);
+            f += 2;
+            continue;
+        }
+        char spec[48];
+        size_t n = 0;
+        spec[n++] = *f++;
+        while (*f && strchr("-+ #0123456789.*", *f) && n < sizeof(spec) - 16) {
+            if (*f != '*') {
+                spec[n++] = *f++;
+                continue;
+            }
+            // Width or precision from the arguments: written into the spec
+            const int v = (a < r.nargs) ? (int)arg_int(r, a) : 0;
+            a++;
+            f++;
+            if (v < 0 && spec[n-1] == '.') {
+                n--;            // a negative precision is as if omitted
+            } else {
+                n += snprintf(spec + n, sizeof(spec) - n, "%d", v);
+            }
+        }
+        while (*f && strchr("hlLqjzt", *f)) {
+            f++;
+        }
+        const char conv = *f;
+        if (!conv) break;
+        f++;
+        if (a >= r.nargs) {
+            fputs("<?>", out);
+            continue;
+        }
+        switch (conv) {
+        case 'd': case 'i':
+            strcpy(spec + n, "ll"); spec[n+2] = conv; spec[n+3] = '\0';
+            fprintf(out, spec, arg_int(r, a));
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            strcpy(spec + n, "ll"); spec[n+2] = conv; spec[n+3] = '\0';
+            fprintf(out, spec, (unsigned long long)arg_int(r, a));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec[n] = conv; spec[n+1] = '\0';
+            fprintf(out, spec, arg_double(r, a));
+            break;
+        case 'c':
+            spec[n] = conv; spec[n+1] = '\0';
+            fprintf(out, spec, (int)arg_int(r, a));
+            break;
+        case 's':
+            spec[n] = conv; spec[n+1] = '\0';
+            fprintf(out, spec, (r.types[a] == BLYNK_LOGARG_STR) ? r.data + r.args[a].off : "<?>");
+            break;
+        default:
+            print_arg_stream(out, r, a);
+            break;
+        }
+        a++;
+    }
+}
+
+static void print_dump(FILE* out, const BlynkLogRecord& r)
+{
+    fputs(r.fmt, out);
+    const uint8_t* octets = (const uint8_t*)r.data;
+    bool prev_print = true;
+    for (unsigned i = 0; i < r.used; i++) {
+        const uint8_t c = octets[i];
+        if (c >= 32 && c < 127) {
+            if (!prev_print) { fputc(']', out); }
+            fputc((char)c, out);
+            prev_print = true;
+        } else {
+            fputc(prev_print?'[':'|', out);
+            fprintf(out, "%02x", c);
+            prev_print = false;
+        }
+    }
+    fprintf(out, "%s%s" BLYNK_NEWLINE, prev_print?"":"]", (r.dumpLen > r.used) ? "..." : "");
+}
+
+static void print_record(FILE* out, const BlynkLogRecord& r)
+{
+    fprintf(out, "[%ld] ", (long)r.time);
+    switch (r.kind) {
+    case BLYNK_LOGREC_FMT:
+        print_fmt(out, r);
+        break;
+    case BLYNK_LOGREC_STREAM:
+        for (unsigned a = 0; a < r.nargs; a++) {
+            print_arg_stream(out, r, a);
+        }
+        fputc('\n', out);
+        break;
+    case BLYNK_LOGREC_DUMP:
+        print_dump(out, r);
+        break;
+    }
+}
+
+static size_t drain()
+{
+    FILE* out = blynk_log_out ? blynk_log_out : stdout;
+    size_t total = 0;
+    const unsigned qty = __atomic_load_n(&blynk_log_ring_qty, __ATOMIC_ACQUIRE);
+    for (unsigned i = 0; i < qty; i++) {
+        BlynkLogRing* ring = blynk_log_rings[i];
+        const uint32_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->reported) {
+            fprintf(out, "[%ld] Log records dropped: %u\n", (long)BlynkMillis(), dropped - ring->reported);
+            ring->reported = dropped;
+        }
+        const BlynkLogRecord* rec;
+        size_t n;
+        while ((n = ring->fifo.readSpan(rec)) > 0) {
+            for (size_t j = 0; j < n; j++) {
+                print_record(out, rec[j]);
+            }
+            ring->fifo.commitRead(n);
+            total += n;
+        }
+    }
+    if (total) {
+        fflush(out);
+    }
+    return total;
+}
+
+static void* blynk_log_thread(void*)
+{
+    for (;;) {
+        pthread_mutex_lock(&blynk_log_drain_lock);
+        const size_t n = drain();
+        pthread_mutex_unlock(&blynk_log_drain_lock);
+        if (!n) {
+            struct timespec ts = { 0, BLYNK_LOG_ASYNC_POLL_MS * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+// At exit: like BlynkLogAsyncFlush(), but the writer may be blocked on an
+// output nobody reads while holding the lock, so give up after a while
+static void blynk_log_exit()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const long ns = ts.tv_nsec + (BLYNK_LOG_ASYNC_EXIT_MS % 1000) * 1000000L;
+    ts.tv_sec += BLYNK_LOG_ASYNC_EXIT_MS / 1000 + ns / 1000000000L;
+    ts.tv_nsec = ns % 1000000000L;
+    if (0 == pthread_mutex_timedlock(&blynk_log_drain_lock, &ts)) {
+        drain();
+        pthread_mutex_unlock(&blynk_log_drain_lock);
+    }
+}
+
+static void blynk_log_start()
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 == pthread_create(&thread, &attr, blynk_log_thread, NULL)) {
+        pthread_setname_np(thread, "blynk-log");
+    }
+    pthread_attr_destroy(&attr);
+    atexit(blynk_log_exit);
+}
+
+void BlynkLogAsyncBegin(FILE* out)
+{
+    blynk_log_out = out;
+    pthread_once(&blynk_log_once, blynk_log_start);
+}
+
+BlynkLogRing* BlynkLogAsyncRegister()
+{
+    if (blynk_log_no_ring) {
+        // All rings were taken when this thread first logged
+        __atomic_fetch_add(&blynk_log_unregistered, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    pthread_once(&blynk_log_once, blynk_log_start);
+
+    BlynkLogRing* ring = NULL;
+    pthread_mutex_lock(&blynk_log_reg_lock);
+    // Reuse a ring left by an exited thread, once it is drained
+    for (unsigned i = 0; i < blynk_log_ring_qty; i++) {
+        BlynkLogRing* r = blynk_log_rings[i];
+        if (!__atomic_load_n(&r->owned, __ATOMIC_ACQUIRE) && !r->fifo.readable()) {
+            ring = r;
+            break;
+        }
+    }
+    if (!ring && blynk_log_ring_qty < BLYNK_LOG_ASYNC_THREADS) {
+        ring = new (std::nothrow) BlynkLogRing();
+        if (ring) {
+            ring->dropped = ring->reported = 0;
+            blynk_log_rings[blynk_log_ring_qty] = ring;
+            __atomic_store_n(&blynk_log_ring_qty, blynk_log_ring_qty + 1, __ATOMIC_RELEASE);
+        }
+    }
+    if (ring) {
+        __atomic_store_n(&ring->owned, true, __ATOMIC_RELEASE);
+    } else {
+        __atomic_fetch_add(&blynk_log_unregistered, 1, __ATOMIC_RELAXED);
+        blynk_log_no_ring = true;
+    }
+    pthread_mutex_unlock(&blynk_log_reg_lock);
+
+    _blynkLogRing = ring;
+    (void)&blynk_log_owner; // instantiate the exit hook for this thread
+    return ring;
+}
+
+void BlynkLogAsyncFlush()
+{
+    pthread_mutex_lock(&blynk_log_drain_lock);
+    drain();
+    pthread_mutex_unlock(&blynk_log_drain_lock);
+}
+
+uint32_t BlynkLogAsyncDropped()
+{
+    uint32_t total = __atomic_load_n(&blynk_log_unregistered, __ATOMIC_RELAXED);
+    const unsigned qty = __atomic_load_n(&blynk_log_ring_qty, __ATOMIC_ACQUIRE);
+    for (unsigned i = 0; i < qty; i++) {
+        total += __atomic_load_n(&blynk_log_rings[i]->dropped, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+#endif
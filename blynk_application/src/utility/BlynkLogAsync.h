@@ -0,0 +1,229 @@
+/**
+ * @file       BlynkLogAsync.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Asynchronous binary logger (Linux)
+ *
+ * With BLYNK_LOG_ASYNC defined, BLYNK_LOG* and BLYNK_DBG_DUMP do not print.
+ * A call site only captures a fixed-size record (timestamp, format pointer,
+ * arguments, a bounded copy of strings) into a per-thread lock-free ring.
+ * A background thread formats and writes the records.
+ *
+ * Cost per call site is bounded: no locks, no syscalls, no allocation
+ * (except the first call on each thread, which registers its ring).
+ * If the ring is full, the record is dropped and counted; the writer
+ * reports the drops in the log.
+ */
+
+#ifndef BlynkLogAsync_h
+#define BlynkLogAsync_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkFifo.h>
+
+// Max arguments captured per record
+#ifndef BLYNK_LOG_ASYNC_ARGS
+#define BLYNK_LOG_ASYNC_ARGS    8
+#endif
+
+// Inline storage for strings and dumps (per record)
+#ifndef BLYNK_LOG_ASYNC_DATA
+#define BLYNK_LOG_ASYNC_DATA    96
+#endif
+
+// Records per thread
+#ifndef BLYNK_LOG_ASYNC_DEPTH
+#define BLYNK_LOG_ASYNC_DEPTH   256
+#endif
+
+// Max threads that can log at the same time
+#ifndef BLYNK_LOG_ASYNC_THREADS
+#define BLYNK_LOG_ASYNC_THREADS 16
+#endif
+
+// Writer poll period when idle
+#ifndef BLYNK_LOG_ASYNC_POLL_MS
+#define BLYNK_LOG_ASYNC_POLL_MS 5
+#endif
+
+// How long the flush at exit waits for a writer that is stuck on its output
+#ifndef BLYNK_LOG_ASYNC_EXIT_MS
+#define BLYNK_LOG_ASYNC_EXIT_MS 500
+#endif
+
+enum BlynkLogKind {
+    BLYNK_LOGREC_FMT,       // printf-style: fmt + args
+    BLYNK_LOGREC_STREAM,    // BLYNK_LOGn-style: args printed one after another
+    BLYNK_LOGREC_DUMP       // fmt is a prefix, data holds the bytes
+};
+
+enum BlynkLogArgType {
+    BLYNK_LOGARG_INT,
+    BLYNK_LOGARG_UINT,
+    BLYNK_LOGARG_DOUBLE,
+    BLYNK_LOGARG_CHAR,
+    BLYNK_LOGARG_STR,
+    BLYNK_LOGARG_PTR
+};
+
+struct BlynkLogRecord {
+    millis_time_t time;
+    const char*   fmt;
+    uint8_t       kind;
+    uint8_t       nargs;
+    uint8_t       types[BLYNK_LOG_ASYNC_ARGS];
+    uint16_t      used;         // bytes used in data
+    uint16_t      dumpLen;      // original length of a dump
+    union {
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        const void* p;
+        uint16_t    off;        // string offset in data
+    } args[BLYNK_LOG_ASYNC_ARGS];
+    char          data[BLYNK_LOG_ASYNC_DATA];
+};
+
+struct BlynkLogRing {
+    BlynkFifo<BlynkLogRecord, BLYNK_LOG_ASYNC_DEPTH> fifo;
+    uint32_t dropped;           // written by the owner thread
+    uint32_t reported;          // written by the log thread
+    bool     owned;             // cleared when the owner thread exits
+};
+
+extern thread_local BlynkLogRing* _blynkLogRing;
+
+BlynkLogRing* BlynkLogAsyncRegister();
+
+// Start the writer thread (called automatically on first use)
+void     BlynkLogAsyncBegin(FILE* out = stdout);
+// Write out everything queued so far, from the calling thread
+void     BlynkLogAsyncFlush();
+// Total amount of records dropped because a ring was full
+uint32_t BlynkLogAsyncDropped();
+
+static inline
+BlynkLogRecord* BlynkLogAsyncAcquire()
+{
+    BlynkLogRing* ring = _blynkLogRing;
+    if (!ring && !(ring = BlynkLogAsyncRegister())) {
+        return NULL;
+    }
+    BlynkLogRecord* rec;
+    if (!ring->fifo.writeSpan(rec)) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return rec;
+}
+
+static inline
+void BlynkLogAsyncCommit()
+{
+    _blynkLogRing->fifo.commitWrite(1);
+}
+
+static inline
+uint8_t BlynkLogAsyncArg(BlynkLogRecord& r, uint8_t type)
+{
+    if (r.nargs >= BLYNK_LOG_ASYNC_ARGS) {
+        return BLYNK_LOG_ASYNC_ARGS;
+    }
+    r.types[r.nargs] = type;
+    return r.nargs++;
+}
+
+#define BLYNK_LOG_PACK(ctype, type, field)                          \
+    static inline                                                   \
+    void BlynkLogPack(BlynkLogRecord& r, ctype v) {                 \
+        const uint8_t a = BlynkLogAsyncArg(r, type);                \
+        if (a < BLYNK_LOG_ASYNC_ARGS) r.args[a].field = v;          \
+    }
+
+BLYNK_LOG_PACK(char,               BLYNK_LOGARG_CHAR,   i)
+BLYNK_LOG_PACK(unsigned char,      BLYNK_LOGARG_CHAR,   i)
+BLYNK_LOG_PACK(signed char,        BLYNK_LOGARG_INT,    i)
+BLYNK_LOG_PACK(short,              BLYNK_LOGARG_INT,    i)
+BLYNK_LOG_PACK(int,                BLYNK_LOGARG_INT,    i)
+BLYNK_LOG_PACK(long,               BLYNK_LOGARG_INT,    i)
+BLYNK_LOG_PACK(long long,          BLYNK_LOGARG_INT,    i)
+BLYNK_LOG_PACK(bool,               BLYNK_LOGARG_UINT,   u)
+BLYNK_LOG_PACK(unsigned short,     BLYNK_LOGARG_UINT,   u)
+BLYNK_LOG_PACK(unsigned int,       BLYNK_LOGARG_UINT,   u)
+BLYNK_LOG_PACK(unsigned long,      BLYNK_LOGARG_UINT,   u)
+BLYNK_LOG_PACK(unsigned long long, BLYNK_LOGARG_UINT,   u)
+BLYNK_LOG_PACK(float,              BLYNK_LOGARG_DOUBLE, d)
+BLYNK_LOG_PACK(double,             BLYNK_LOGARG_DOUBLE, d)
+BLYNK_LOG_PACK(const void*,        BLYNK_LOGARG_PTR,    p)
+
+#undef BLYNK_LOG_PACK
+
+// Strings may live on the caller's stack, so a bounded copy is taken
+static inline
+void BlynkLogPack(BlynkLogRecord& r, const char* s)
+{
+    const uint8_t a = BlynkLogAsyncArg(r, BLYNK_LOGARG_STR);
+    if (a >= BLYNK_LOG_ASYNC_ARGS) {
+        return;
+    }
+    if (!s) s = "(null)";
+    const size_t room = sizeof(r.data) - r.used;
+    if (room == 0) {
+        r.types[a] = BLYNK_LOGARG_PTR;
+        r.args[a].p = NULL;
+        return;
+    }
+    char* dst = r.data + r.used;
+    size_t len = 0;
+    while (len < room - 1 && s[len]) {
+        dst[len] = s[len];
+        len++;
+    }
+    dst[len] = '\0';
+    r.args[a].off = r.used;
+    r.used += len + 1;
+}
+
+static inline
+void BlynkLogPackAll(BlynkLogRecord&) {}
+
+template <typename T, typename... Args>
+void BlynkLogPackAll(BlynkLogRecord& r, const T& head, const Args&... tail)
+{
+    BlynkLogPack(r, head);
+    BlynkLogPackAll(r, tail...);
+}
+
+template <typename... Args>
+void BlynkLogAsync(uint8_t kind, const char* fmt, const Args&... args)
+{
+    if (BlynkLogRecord* r = BlynkLogAsyncAcquire()) {
+        r->time = BlynkMillis();
+        r->fmt = fmt;
+        r->kind = kind;
+        r->nargs = 0;
+        r->used = 0;
+        BlynkLogPackAll(*r, args...);
+        BlynkLogAsyncCommit();
+    }
+}
+
+static inline
+void BlynkLogAsyncDump(const char* msg, const void* addr, size_t len)
+{
+    if (!len) return;
+    if (BlynkLogRecord* r = BlynkLogAsyncAcquire()) {
+        r->time = BlynkMillis();
+        r->fmt = msg;
+        r->kind = BLYNK_LOGREC_DUMP;
+        r->nargs = 0;
+        r->used = BlynkMin(len, sizeof(r->data));
+        r->dumpLen = BlynkMin(len, size_t(0xFFFF));
+        memcpy(r->data, addr, r->used);
+        BlynkLogAsyncCommit();
+    }
+}
+
+#endif
@@ -0,0 +1,494 @@
+/**
+ * @file       BlynkOutbox.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Persistent store-and-forward outbox (Linux)
+ *
+ * File layout:
+ *   header (64 bytes) | ring of records
+ *
+ * Records are 8-byte aligned and never split. If a record does not fit
+ * before the end of the ring, a wrap marker fills the rest (or, when less
+ * than a record header is left, the gap is skipped implicitly).
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <Blynk/BlynkProtocolDefs.h>
+#include <utility/BlynkUtility.h>
+#include <utility/BlynkOutbox.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OUTBOX_MAGIC    0x31584F42UL    // "BOX1"
+#define OUTBOX_VERSION  1
+#define OUTBOX_WRAP     0xFF            // cmd of a wrap marker
+
+struct OutboxFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved0;
+    uint64_t tail;          // (sequence << 32) | offset of the oldest record
+    uint8_t  reserved[40];
+};
+
+struct OutboxRecord {
+    uint32_t len;           // total length, including this header and padding
+    uint32_t seq;
+    uint32_t crc;           // over seq, cmd, flags, plen and payload
+    uint8_t  cmd;
+    uint8_t  flags;
+    uint16_t plen;
+};
+
+static pthread_mutex_t ob_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t*          ob_base = NULL;
+static size_t            ob_size = 0;
+static OutboxFileHeader* ob_hdr = NULL;
+static uint8_t*          ob_data = NULL;
+static uint32_t          ob_cap = 0;
+
+static uint32_t ob_tail, ob_head, ob_used, ob_count;
+static uint32_t ob_tailSeq, ob_nextSeq;
+static BlynkOutboxPolicy ob_policy = BLYNK_OUTBOX_DROP_OLDEST;
+static BlynkOutboxStats  ob_stats;
+static uint32_t ob_lastSync;
+
+// Replay rate limiting and measurement
+static unsigned ob_rate  = BLYNK_OUTBOX_REPLAY_RATE;
+static unsigned ob_burst = BLYNK_OUTBOX_REPLAY_BURST;
+static float    ob_tokens = BLYNK_OUTBOX_REPLAY_BURST;
+static uint32_t ob_tokensTime = 0;
+static bool     ob_replaying = false;
+static uint32_t ob_replayStart, ob_replayMsgs, ob_replayBytes;
+
+static inline uint32_t align8(uint32_t v) { return (v + 7) & ~uint32_t(7); }
+
+static uint32_t mono_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static uint32_t record_crc(const OutboxRecord* r, const void* payload)
+{
+    uint32_t crc = BlynkCRC32(&r->seq, sizeof(r->seq));
+    crc = BlynkCRC32(&r->cmd, 4, crc);  // cmd, flags, plen
+    return BlynkCRC32(payload, r->plen, crc);
+}
+
+enum { REC_INVALID, REC_DATA, REC_MARKER };
+
+static int check_record(uint32_t off, uint32_t seq)
+{
+    if (ob_cap - off < sizeof(OutboxRecord)) {
+        return REC_INVALID;
+    }
+    OutboxRecord r;
+    memcpy(&r, ob_data + off, sizeof(r));
+    if (r.seq != seq || r.len < sizeof(r) || (r.len & 7) || r.len > ob_cap - off) {
+        return REC_INVALID;
+    }
+    if (r.cmd == OUTBOX_WRAP) {
+        if (r.plen || r.crc != record_crc(&r, NULL)) return REC_INVALID;
+        return REC_MARKER;
+    }
+    if (align8(sizeof(r) + r.plen) != r.len ||
+        r.crc != record_crc(&r, ob_data + off + sizeof(r)))
+    {
+        return REC_INVALID;
+    }
+    return REC_DATA;
+}
+
+static void store_tail()
+{
+    __atomic_store_n(&ob_hdr->tail, (uint64_t(ob_tailSeq) << 32) | ob_tail, __ATOMIC_RELEASE);
+}
+
+// Skips the gap or wrap marker at the tail, if any
+static void normalize_tail()
+{
+    if (ob_cap - ob_tail < sizeof(OutboxRecord)) {
+        ob_used -= ob_cap - ob_tail;
+        ob_tail = 0;
+    } else if (ob_count && ob_data[ob_tail + offsetof(OutboxRecord, cmd)] == OUTBOX_WRAP) {
+        ob_used -= ob_cap - ob_tail;
+        ob_tail = 0;
+    }
+}
+
+static void advance_head(uint32_t len)
+{
+    ob_head += len;
+    ob_used += len;
+    if (ob_cap - ob_head < sizeof(OutboxRecord)) {
+        ob_used += ob_cap - ob_head;
+        ob_head = 0;
+    }
+}
+
+// Removes the oldest record, returns its payload length
+static uint32_t drop_tail()
+{
+    OutboxRecord r;
+    memcpy(&r, ob_data + ob_tail, sizeof(r));
+    ob_tail += r.len;
+    ob_used -= r.len;
+    ob_count--;
+    ob_tailSeq++;
+    normalize_tail();
+    store_tail();
+    return r.plen;
+}
+
+static void recover()
+{
+    const uint64_t tail = ob_hdr->tail;
+    ob_tail = uint32_t(tail);
+    ob_tailSeq = uint32_t(tail >> 32);
+    if (ob_tail >= ob_cap || (ob_tail & 7)) {
+        ob_tail = 0;
+    }
+    ob_used = ob_count = 0;
+    ob_head = ob_tail;
+    ob_nextSeq = ob_tailSeq;
+    if (ob_cap - ob_head < sizeof(OutboxRecord)) {
+        ob_head = ob_tail = 0;
+    }
+
+    // Walk forward while the records are valid and consecutive
+    for (;;) {
+        const int kind = check_record(ob_head, ob_nextSeq);
+        if (kind == REC_INVALID) {
+            break;
+        }
+        const uint32_t len = (kind == REC_MARKER) ? ob_cap - ob_head : ((OutboxRecord*)(ob_data + ob_head))->len;
+        if (ob_used + len > ob_cap) {
+            break;
+        }
+        if (kind == REC_MARKER) {
+            ob_used += len;
+            ob_head = 0;
+            continue;
+        }
+        advance_head(len);
+        ob_count++;
+        ob_nextSeq++;
+        if (ob_head == ob_tail) {
+            break;  // completely full
+        }
+    }
+    if (!ob_count) {
+        ob_head = ob_tail;
+        ob_used = 0;
+    }
+    store_tail();
+}
+
+bool BlynkOutboxOpen(const char* path, size_t size, BlynkOutboxPolicy policy)
+{
+    BlynkOutboxClose();
+
+    size &= ~size_t(7);
+    if (size < sizeof(OutboxFileHeader) + 4 * (sizeof(OutboxRecord) + BLYNK_OUTBOX_MAX_RECORD)) {
+        return false;
+    }
+    const int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool fresh = (fstat(fd, &st) < 0 || size_t(st.st_size) != size);
+    if (fresh && ftruncate(fd, 0) < 0) {
+        ::close(fd);
+        return false;
+    }
+    if (ftruncate(fd, size) < 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+
+    pthread_mutex_lock(&ob_lock);
+    ob_base = (uint8_t*)mem;
+    ob_size = size;
+    ob_hdr  = (OutboxFileHeader*)ob_base;
+    ob_data = ob_base + sizeof(OutboxFileHeader);
+    ob_cap  = size - sizeof(OutboxFileHeader);
+    ob_policy = policy;
+
+    if (fresh || ob_hdr->magic != OUTBOX_MAGIC ||
+        ob_hdr->version != OUTBOX_VERSION || ob_hdr->size != size)
+    {
+        memset(ob_hdr, 0, sizeof(*ob_hdr));
+        ob_hdr->magic = OUTBOX_MAGIC;
+        ob_hdr->version = OUTBOX_VERSION;
+        ob_hdr->size = size;
+        ob_hdr->tail = uint64_t(1) << 32;
+    }
+    recover();
+
+    memset(&ob_stats, 0, sizeof(ob_stats));
+    ob_stats.recovered = ob_count;
+    ob_replaying = false;
+    ob_tokens = ob_burst;
+    ob_tokensTime = 0;
+    ob_lastSync = mono_ms();
+    pthread_mutex_unlock(&ob_lock);
+
+    if (ob_count) {
+        BLYNK_LOG2(BLYNK_F("Outbox: records to replay: "), ob_count);
+    }
+    return true;
+}
+
+void BlynkOutboxClose()
+{
+    pthread_mutex_lock(&ob_lock);
+    if (ob_base) {
+        msync(ob_base, ob_size, MS_SYNC);
+        munmap(ob_base, ob_size);
+        ob_base = NULL;
+        ob_hdr = NULL;
+        ob_data = NULL;
+    }
+    pthread_mutex_unlock(&ob_lock);
+}
+
+bool BlynkOutboxIsOpen()
+{
+    return __atomic_load_n(&ob_base, __ATOMIC_RELAXED) != NULL;
+}
+
+void BlynkOutboxSetPolicy(BlynkOutboxPolicy policy)
+{
+    pthread_mutex_lock(&ob_lock);
+    ob_policy = policy;
+    pthread_mutex_unlock(&ob_lock);
+}
+
+void BlynkOutboxSetReplayRate(unsigned msgPerSec, unsigned burst)
+{
+    pthread_mutex_lock(&ob_lock);
+    ob_rate = msgPerSec;
+    ob_burst = burst ? burst : 1;
+    if (ob_tokens > ob_burst) ob_tokens = ob_burst;
+    pthread_mutex_unlock(&ob_lock);
+}
+
+bool BlynkOutboxAccepts(uint8_t cmd, const void* data, size_t length)
+{
+    if (!BlynkOutboxIsOpen()) {
+        return false;
+    }
+    switch (cmd) {
+    case BLYNK_CMD_EVENT_LOG:
+        return true;
+    case BLYNK_CMD_HARDWARE:
+        // Only virtualWrite, not the replies to server reads
+        return data && length >= 3 && !memcmp(data, "vw\0", 3);
+    default:
+        return false;
+    }
+}
+
+// Called under ob_lock: returns the mapping if a write-back is due.
+// The caller starts it after unlocking, and doesn't wait for it
+// (MS_ASYNC), so Push and Pop never stall the protocol thread on storage.
+static uint8_t* sync_due()
+{
+#if BLYNK_OUTBOX_SYNC_MS > 0
+    const uint32_t now = mono_ms();
+    if (now - ob_lastSync >= BLYNK_OUTBOX_SYNC_MS) {
+        ob_lastSync = now;
+        return ob_base;
+    }
+#endif
+    return NULL;
+}
+
+bool BlynkOutboxPush(uint8_t cmd, const void* data, size_t length,
+                     const void* data2, size_t length2)
+{
+    if (!data)  length = 0;
+    if (!data2) length2 = 0;
+    const size_t plen = length + length2;
+    if (plen > BLYNK_OUTBOX_MAX_RECORD || cmd == OUTBOX_WRAP) {
+        return false;
+    }
+    const uint32_t need = align8(sizeof(OutboxRecord) + plen);
+
+    pthread_mutex_lock(&ob_lock);
+    if (!ob_base) {
+        pthread_mutex_unlock(&ob_lock);
+        return false;
+    }
+
+    if (!ob_count && ob_head) {
+        // Empty: restart at the beginning, so no wrap marker is needed
+        ob_head = ob_tail = ob_used = 0;
+        store_tail();
+    }
+
+    uint32_t waste;
+    for (;;) {
+        waste = (ob_cap - ob_head < need) ? ob_cap - ob_head : 0;
+        if (ob_used + waste + need <= ob_cap) {
+            break;
+        }
+        if (ob_policy == BLYNK_OUTBOX_DROP_OLDEST && ob_count) {
+            drop_tail();
+            ob_stats.droppedOldest++;
+            continue;
+        }
+        ob_stats.droppedNewest++;
+        pthread_mutex_unlock(&ob_lock);
+        return false;
+    }
+
+    if (waste) {
+        OutboxRecord m = { waste, ob_nextSeq, 0, OUTBOX_WRAP, 0, 0 };
+        m.crc = record_crc(&m, NULL);
+        memcpy(ob_data + ob_head, &m, sizeof(m));
+        ob_used += waste;
+        ob_head = 0;
+    }
+
+    OutboxRecord r = { need, ob_nextSeq, 0, cmd, 0, uint16_t(plen) };
+    uint8_t* p = ob_data + ob_head;
+    memcpy(p + sizeof(r), data, length);
+    memcpy(p + sizeof(r) + length, data2, length2);
+    memset(p + sizeof(r) + plen, 0, need - sizeof(r) - plen);
+    r.crc = record_crc(&r, p + sizeof(r));
+    memcpy(p, &r, sizeof(r));
+
+    advance_head(need);
+    ob_count++;
+    ob_nextSeq++;
+    ob_stats.stored++;
+    uint8_t* const sync = sync_due();
+    const size_t size = ob_size;
+    pthread_mutex_unlock(&ob_lock);
+    if (sync) {
+        msync(sync, size, MS_ASYNC);
+    }
+    return true;
+}
+
+unsigned BlynkOutboxPending()
+{
+    return __atomic_load_n(&ob_count, __ATOMIC_RELAXED);
+}
+
+unsigned BlynkOutboxReplayBudget(uint32_t nowMs)
+{
+    pthread_mutex_lock(&ob_lock);
+    unsigned budget = ob_count;
+    if (ob_rate) {
+        if (ob_tokensTime) {
+            ob_tokens += float(nowMs - ob_tokensTime) * ob_rate / 1000.0f;
+            if (ob_tokens > ob_burst) ob_tokens = ob_burst;
+        }
+        ob_tokensTime = nowMs;
+        budget = BlynkMin(budget, unsigned(ob_tokens));
+    }
+    pthread_mutex_unlock(&ob_lock);
+    return budget;
+}
+
+int BlynkOutboxPeek(uint8_t& cmd, void* buff, size_t size, uint32_t& seq)
+{
+    int len = -1;
+    pthread_mutex_lock(&ob_lock);
+    if (ob_base && ob_count) {
+        OutboxRecord r;
+        memcpy(&r, ob_data + ob_tail, sizeof(r));
+        if (r.plen <= size) {
+            memcpy(buff, ob_data + ob_tail + sizeof(r), r.plen);
+            cmd = r.cmd;
+            seq = r.seq;
+            len = r.plen;
+        } else {
+            drop_tail();    // can't be replayed into this buffer
+            ob_stats.droppedOldest++;
+        }
+    }
+    pthread_mutex_unlock(&ob_lock);
+    return len;
+}
+
+void BlynkOutboxPop(uint32_t seq, uint32_t nowMs)
+{
+    uint8_t* sync = NULL;
+    pthread_mutex_lock(&ob_lock);
+    if (ob_base && ob_count && ob_tailSeq == seq) {
+        const uint32_t plen = drop_tail();
+        ob_stats.replayed++;
+        if (ob_rate && ob_tokens >= 1) {
+            ob_tokens -= 1;
+        }
+        if (!ob_replaying) {
+            ob_replaying = true;
+            ob_replayStart = nowMs;
+            ob_replayMsgs = ob_replayBytes = 0;
+        }
+        ob_replayMsgs++;
+        ob_replayBytes += plen;
+        const uint32_t elapsed = nowMs - ob_replayStart;
+        ob_stats.replayMs = elapsed;
+        if (elapsed) {
+            ob_stats.replayMsgRate  = ob_replayMsgs  * 1000.0f / elapsed;
+            ob_stats.replayByteRate = ob_replayBytes * 1000.0f / elapsed;
+        }
+        if (!ob_count) {
+            ob_replaying = false;
+            BLYNK_LOG4(BLYNK_F("Outbox: replayed "), ob_replayMsgs, BLYNK_F(" records, ms: "), elapsed);
+        }
+        sync = sync_due();
+    }
+    const size_t size = ob_size;
+    pthread_mutex_unlock(&ob_lock);
+    if (sync) {
+        msync(sync, size, MS_ASYNC);
+    }
+}
+
+void BlynkOutboxGetStats(BlynkOutboxStats& stats)
+{
+    pthread_mutex_lock(&ob_lock);
+    stats = ob_stats;
+    stats.pending = ob_count;
+    stats.pendingBytes = ob_used;
+    stats.capacity = ob_cap;
+    pthread_mutex_unlock(&ob_lock);
+}
+
+void BlynkOutboxSync()
+{
+    // Waits for storage without holding ob_lock, so the protocol thread
+    // can keep storing meanwhile
+    pthread_mutex_lock(&ob_lock);
+    void* const base = ob_base;
+    const size_t size = ob_size;
+    ob_lastSync = mono_ms();
+    pthread_mutex_unlock(&ob_lock);
+    if (base) {
+        msync(base, size, MS_SYNC);
+    }
+}
+
+#endif
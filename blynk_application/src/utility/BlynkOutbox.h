@@ -0,0 +1,103 @@
+/**
+ * @file       BlynkOutbox.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Persistent store-and-forward outbox (Linux)
+ *
+ * With BLYNK_USE_OUTBOX defined, virtualWrite and logEvent commands that
+ * BlynkProtocol would otherwise skip while disconnected are appended to
+ * a memory-mapped ring file. After reconnecting, run() replays the backlog
+ * at a limited rate, interleaved with live traffic.
+ *
+ * Every record carries a sequence number and a CRC, and the position of
+ * the oldest record is stored with a single 64-bit write, so the outbox
+ * survives a crash at any point: after reopening, the valid records are
+ * found again by scanning forward from the oldest one.
+ *
+ * Note: the server stores values in arrival order, so replayed values
+ * reach widgets after the live ones sent since the reconnect.
+ */
+
+#ifndef BlynkOutbox_h
+#define BlynkOutbox_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default ring file size
+#ifndef BLYNK_OUTBOX_FILE_SIZE
+#define BLYNK_OUTBOX_FILE_SIZE    (1UL * 1024 * 1024)
+#endif
+
+// Longest command payload that is stored
+#ifndef BLYNK_OUTBOX_MAX_RECORD
+#define BLYNK_OUTBOX_MAX_RECORD   1024
+#endif
+
+// Replay rate (messages per second) and burst.
+// Keep it below BLYNK_MSG_LIMIT, so live data still gets through.
+#ifndef BLYNK_OUTBOX_REPLAY_RATE
+#define BLYNK_OUTBOX_REPLAY_RATE  10
+#endif
+
+#ifndef BLYNK_OUTBOX_REPLAY_BURST
+#define BLYNK_OUTBOX_REPLAY_BURST 5
+#endif
+
+// Start writing the file back to storage at most this often, without
+// waiting for it (0: only on close). BlynkOutboxSync() waits.
+#ifndef BLYNK_OUTBOX_SYNC_MS
+#define BLYNK_OUTBOX_SYNC_MS      1000
+#endif
+
+enum BlynkOutboxPolicy {
+    BLYNK_OUTBOX_DROP_OLDEST,   // make room by discarding the oldest records
+    BLYNK_OUTBOX_DROP_NEWEST    // refuse new records when full
+};
+
+struct BlynkOutboxStats {
+    uint32_t pending;           // records waiting for replay
+    uint32_t pendingBytes;      // ring bytes in use
+    uint32_t capacity;          // ring bytes
+    uint32_t recovered;         // records found when the file was opened
+    uint32_t stored;            // records added since open
+    uint32_t replayed;          // records sent since open
+    uint32_t droppedOldest;     // discarded to make room
+    uint32_t droppedNewest;     // refused because the ring was full
+    uint32_t replayMs;          // duration of the current (or last) replay
+    float    replayMsgRate;     // messages per second during that replay
+    float    replayByteRate;    // payload bytes per second during that replay
+};
+
+// Opens or creates the ring file; records left from a previous run are kept.
+bool BlynkOutboxOpen(const char* path,
+                     size_t size = BLYNK_OUTBOX_FILE_SIZE,
+                     BlynkOutboxPolicy policy = BLYNK_OUTBOX_DROP_OLDEST);
+void BlynkOutboxClose();
+bool BlynkOutboxIsOpen();
+
+void BlynkOutboxSetPolicy(BlynkOutboxPolicy policy);
+void BlynkOutboxSetReplayRate(unsigned msgPerSec, unsigned burst = BLYNK_OUTBOX_REPLAY_BURST);
+
+// True if the command should be stored when it can't be sent
+bool BlynkOutboxAccepts(uint8_t cmd, const void* data, size_t length);
+
+// Stores a command with its payload, given as two consecutive pieces
+bool BlynkOutboxPush(uint8_t cmd, const void* data, size_t length,
+                     const void* data2 = NULL, size_t length2 = 0);
+
+unsigned BlynkOutboxPending();
+
+// How many records may be replayed now (token bucket)
+unsigned BlynkOutboxReplayBudget(uint32_t nowMs);
+
+// Copies the oldest record. Returns the payload length, or -1 if empty.
+int  BlynkOutboxPeek(uint8_t& cmd, void* buff, size_t size, uint32_t& seq);
+// Removes the oldest record, if it is still 'seq', and accounts it as replayed
+void BlynkOutboxPop(uint32_t seq, uint32_t nowMs);
+
+void BlynkOutboxGetStats(BlynkOutboxStats& stats);
+
+// Writes the file to storage and waits for it. Not while closing.
+void BlynkOutboxSync();
+
+#endif
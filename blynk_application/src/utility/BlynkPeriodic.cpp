@@ -0,0 +1,152 @@
+/**
+ * @file       BlynkPeriodic.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Drift-free periodic scheduling on absolute deadlines (Linux)
+ */
+
+#if defined(LINUX)
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <utility/BlynkPeriodic.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+static uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned jitter_bucket(int64_t ns)
+{
+    uint64_t us = (ns > 0) ? uint64_t(ns) / 1000 : 0;
+    unsigned b = 0;
+    while (us && b < BLYNK_JITTER_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+BlynkPeriodic::BlynkPeriodic()
+    : mPeriodNs(1000000000ULL)
+    , mNextNs(0)
+    , mStarted(false)
+{
+    resetStats();
+}
+
+void BlynkPeriodic::start(uint64_t periodNs)
+{
+    setPeriod(periodNs);
+    mStarted = false;
+}
+
+void BlynkPeriodic::setPeriod(uint64_t periodNs)
+{
+    __atomic_store_n(&mPeriodNs, periodNs ? periodNs : 1, __ATOMIC_RELAXED);
+}
+
+uint64_t BlynkPeriodic::period() const
+{
+    return __atomic_load_n(&mPeriodNs, __ATOMIC_RELAXED);
+}
+
+int64_t BlynkPeriodic::wait()
+{
+    uint64_t now = mono_ns();
+    if (!mStarted) {
+        mStarted = true;
+        mNextNs = now + period();
+        return 0;
+    }
+
+    if (now > mNextNs) {
+        mStats.overruns++;
+        const uint64_t p = period();
+        const uint64_t missed = (now - mNextNs) / p;
+        mStats.skipped += missed;
+        mNextNs += missed * p;
+    } else {
+        struct timespec ts;
+        ts.tv_sec  = mNextNs / 1000000000ULL;
+        ts.tv_nsec = mNextNs % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+    }
+    now = mono_ns();
+
+    const int64_t jitter = int64_t(now - mNextNs);
+    mStats.cycles++;
+    if (jitter < mStats.minJitterNs) mStats.minJitterNs = jitter;
+    if (jitter > mStats.maxJitterNs) mStats.maxJitterNs = jitter;
+    mStats.sumJitterNs += jitter;
+    mStats.hist[jitter_bucket(jitter)]++;
+
+    mNextNs += period();
+    return jitter;
+}
+
+void BlynkPeriodic::resetStats()
+{
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.minJitterNs = INT64_MAX;
+    mStats.maxJitterNs = INT64_MIN;
+}
+
+void BlynkPeriodic::printStats(FILE* out) const
+{
+    const BlynkPeriodicStats& s = mStats;
+    if (!s.cycles) {
+        fprintf(out, "period %llu ms: no cycles yet\n", (unsigned long long)(period() / 1000000));
+        return;
+    }
+    fprintf(out, "period %llu ms: %llu cycles, %llu overruns, %llu skipped, "
+                 "jitter min %lld us, avg %lld us, max %lld us\n",
+            (unsigned long long)(period() / 1000000),
+            (unsigned long long)s.cycles, (unsigned long long)s.overruns, (unsigned long long)s.skipped,
+            (long long)(s.minJitterNs / 1000), (long long)(s.sumJitterNs / int64_t(s.cycles) / 1000),
+            (long long)(s.maxJitterNs / 1000));
+    for (unsigned b = 0; b < BLYNK_JITTER_BUCKETS; b++) {
+        if (!s.hist[b]) continue;
+        const unsigned long lo = b ? 1UL << (b - 1) : 0;
+        fprintf(out, "  %8lu us .. %8lu us: %llu\n", lo, 1UL << b, (unsigned long long)s.hist[b]);
+    }
+}
+
+bool BlynkRealtimeSetup(int fifoPriority, int cpu, bool lockMemory)
+{
+    bool ok = true;
+    if (lockMemory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+            // Touch the stack now, so it doesn't fault later
+            volatile char stack[64 * 1024];
+            memset((char*)stack, 0, sizeof(stack));
+        } else {
+            ok = false;
+        }
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        ok = (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) && ok;
+    }
+    if (fifoPriority > 0) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = fifoPriority;
+        ok = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0) && ok;
+    }
+    return ok;
+}
+
+#endif
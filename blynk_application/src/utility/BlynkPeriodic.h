@@ -0,0 +1,74 @@
+/**
+ * @file       BlynkPeriodic.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Drift-free periodic scheduling on absolute deadlines (Linux)
+ *
+ * wait() sleeps with clock_nanosleep(TIMER_ABSTIME) until the next
+ * deadline, and deadlines are a fixed period apart, so the time spent
+ * between two wait() calls does not add up into drift.
+ *
+ * If a deadline has already passed when wait() is called, that is an
+ * overrun: wait() returns at once, and whole periods that were missed
+ * are skipped instead of being run back to back.
+ *
+ * The start-time jitter (wakeup - deadline) of every cycle is recorded
+ * in a log2 histogram.
+ */
+
+#ifndef BlynkPeriodic_h
+#define BlynkPeriodic_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Histogram bucket i counts jitter in [2^(i-1), 2^i) us; bucket 0 is < 1 us
+#define BLYNK_JITTER_BUCKETS 24
+
+struct BlynkPeriodicStats {
+    uint64_t cycles;
+    uint64_t overruns;          // deadlines that had passed before wait()
+    uint64_t skipped;           // whole periods skipped after an overrun
+    int64_t  minJitterNs;
+    int64_t  maxJitterNs;
+    int64_t  sumJitterNs;
+    uint64_t hist[BLYNK_JITTER_BUCKETS];
+};
+
+class BlynkPeriodic
+{
+public:
+    BlynkPeriodic();
+
+    // (Re)starts: the first wait() returns at once and sets the phase
+    void start(uint64_t periodNs);
+
+    // Takes effect at the next deadline: the one already scheduled is kept,
+    // the one after it is 'periodNs' later. Async-signal-safe.
+    void setPeriod(uint64_t periodNs);
+    uint64_t period() const;
+
+    // Sleeps until the next deadline. Returns the start-time jitter (ns).
+    int64_t wait();
+
+    const BlynkPeriodicStats& stats() const { return mStats; }
+    void resetStats();
+
+    // Prints counters and the jitter histogram
+    void printStats(FILE* out) const;
+
+private:
+    uint64_t mPeriodNs;
+    uint64_t mNextNs;           // CLOCK_MONOTONIC
+    bool     mStarted;
+    BlynkPeriodicStats mStats;
+};
+
+// Prepares the calling thread for periodic work.
+//   fifoPriority: SCHED_FIFO priority (1..99), 0 to keep the current policy
+//   cpu:          CPU to pin the thread to, -1 to keep the current affinity
+//   lockMemory:   mlockall() and prefault some stack, to avoid page faults
+// Returns false if any of the requested settings failed (e.g. no privileges).
+bool BlynkRealtimeSetup(int fifoPriority, int cpu, bool lockMemory);
+
+#endif
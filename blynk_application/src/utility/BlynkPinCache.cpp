@@ -0,0 +1,196 @@
+/**
+ * @file       BlynkPinCache.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Last value written to each virtual pin (Linux)
+ *
+ * Any thread may store. A store makes 'seq' odd (taking it from another
+ * store with a compare-and-swap), writes the entry and makes it even
+ * again; reads retry if 'seq' was odd or changed meanwhile.
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkUtility.h>
+#include <utility/BlynkPinCache.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_WORDS ((BLYNK_PIN_CACHE_DATA + 3) / 4)
+
+// The value is copied word by word
+typedef uint32_t PinCacheWord __attribute__((may_alias));
+
+struct PinEntry {
+    uint32_t seq;               // odd while a store is in progress
+    uint32_t length;            // length + 1, 0 if there is no value
+    uint32_t at;                // BlynkMillis() of the store
+    uint32_t data[PC_WORDS];
+};
+
+static PinEntry pc_pins[BLYNK_PIN_CACHE_PINS];
+static uint32_t pc_maxAge[BLYNK_PIN_CACHE_PINS];
+static uint32_t pc_maxAgeSet[(BLYNK_PIN_CACHE_PINS + 31) / 32];
+
+static BlynkPinCacheStats pc_stats;
+
+#define PC_COUNT(field) __atomic_fetch_add(&pc_stats.field, 1, __ATOMIC_RELAXED)
+
+static
+uint32_t entry_lock(PinEntry& e)
+{
+    uint32_t seq = __atomic_load_n(&e.seq, __ATOMIC_RELAXED);
+    for (;;) {
+        if (!(seq & 1) && __atomic_compare_exchange_n(&e.seq, &seq, seq + 1, true,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+        seq = __atomic_load_n(&e.seq, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return seq;
+}
+
+static
+void entry_write(int pin, const void* data, size_t length)
+{
+    PinEntry& e = pc_pins[pin];
+    uint32_t words[PC_WORDS];
+    const size_t nwords = (length + 3) / 4;
+    if (nwords) {
+        words[nwords - 1] = 0;
+        memcpy(words, data, length);
+    }
+    const uint32_t now = BlynkMillis();
+
+    const uint32_t seq = entry_lock(e);
+    __atomic_store_n(&e.length, uint32_t(length + 1), __ATOMIC_RELAXED);
+    __atomic_store_n(&e.at, now, __ATOMIC_RELAXED);
+    PinCacheWord* dst = (PinCacheWord*)e.data;
+    for (size_t i = 0; i < nwords; i++) {
+        __atomic_store_n(&dst[i], words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&e.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void BlynkPinCacheStore(int pin, const void* data, size_t length)
+{
+    if (pin < 0 || pin >= BLYNK_PIN_CACHE_PINS) {
+        return;
+    }
+    PC_COUNT(stores);
+    if (length > BLYNK_PIN_CACHE_DATA) {
+        PC_COUNT(tooLong);
+        BlynkPinCacheClear(pin);
+        return;
+    }
+    entry_write(pin, data, length);
+}
+
+void BlynkPinCacheStoreCmd(const void* cmd, size_t length)
+{
+    // "vw\0<pin>\0<value>"
+    const char* p = (const char*)cmd;
+    if (length < 5 || memcmp(p, "vw\0", 3)) {
+        return;
+    }
+    const char* pin = p + 3;
+    const char* end = (const char*)memchr(pin, '\0', length - 3);
+    if (!end) {
+        // No value: the command ends with the pin
+        return;
+    }
+    const size_t offset = end + 1 - p;
+    BlynkPinCacheStore(atoi(pin), p + offset, length - offset);
+}
+
+void BlynkPinCacheClear(int pin)
+{
+    if (pin < 0 || pin >= BLYNK_PIN_CACHE_PINS) {
+        return;
+    }
+    PinEntry& e = pc_pins[pin];
+    const uint32_t seq = entry_lock(e);
+    __atomic_store_n(&e.length, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&e.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void BlynkPinCacheClearAll()
+{
+    for (int pin = 0; pin < BLYNK_PIN_CACHE_PINS; pin++) {
+        BlynkPinCacheClear(pin);
+    }
+}
+
+void BlynkPinCacheSetMaxAge(int pin, uint32_t ms)
+{
+    if (pin < 0 || pin >= BLYNK_PIN_CACHE_PINS) {
+        return;
+    }
+    __atomic_store_n(&pc_maxAge[pin], ms, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&pc_maxAgeSet[pin / 32], 1UL << (pin % 32), __ATOMIC_RELEASE);
+}
+
+int BlynkPinCacheRead(int pin, void* buff, uint32_t* age)
+{
+    if (pin < 0 || pin >= BLYNK_PIN_CACHE_PINS) {
+        return -1;
+    }
+    const bool set = __atomic_load_n(&pc_maxAgeSet[pin / 32], __ATOMIC_ACQUIRE) & (1UL << (pin % 32));
+    const uint32_t maxAge = set ? __atomic_load_n(&pc_maxAge[pin], __ATOMIC_RELAXED) : BLYNK_PIN_CACHE_MAX_AGE;
+    if (maxAge == 0) {
+        PC_COUNT(misses);
+        return -1;
+    }
+
+    const PinEntry& e = pc_pins[pin];
+    const PinCacheWord* src = (const PinCacheWord*)e.data;
+    uint32_t words[PC_WORDS];
+    uint32_t length, at;
+    for (;;) {
+        const uint32_t seq1 = __atomic_load_n(&e.seq, __ATOMIC_ACQUIRE);
+        if (seq1 & 1) {
+            continue;
+        }
+        length = __atomic_load_n(&e.length, __ATOMIC_RELAXED);
+        at = __atomic_load_n(&e.at, __ATOMIC_RELAXED);
+        if (length) {
+            for (size_t i = 0; i < (length + 2) / 4; i++) {
+                words[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&e.seq, __ATOMIC_RELAXED) == seq1) {
+            break;
+        }
+    }
+
+    if (!length) {
+        PC_COUNT(misses);
+        return -1;
+    }
+    const uint32_t elapsed = uint32_t(BlynkMillis()) - at;
+    if (elapsed > maxAge) {
+        PC_COUNT(stale);
+        return -1;
+    }
+    if (age) {
+        *age = elapsed;
+    }
+    memcpy(buff, words, length - 1);
+    PC_COUNT(hits);
+    return length - 1;
+}
+
+void BlynkPinCacheGetStats(BlynkPinCacheStats& stats)
+{
+    stats.stores  = __atomic_load_n(&pc_stats.stores,  __ATOMIC_RELAXED);
+    stats.tooLong = __atomic_load_n(&pc_stats.tooLong, __ATOMIC_RELAXED);
+    stats.hits    = __atomic_load_n(&pc_stats.hits,    __ATOMIC_RELAXED);
+    stats.stale   = __atomic_load_n(&pc_stats.stale,   __ATOMIC_RELAXED);
+    stats.misses  = __atomic_load_n(&pc_stats.misses,  __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file       BlynkPinCache.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Last value written to each virtual pin (Linux)
+ *
+ * With BLYNK_USE_PIN_CACHE defined, every virtualWrite() also keeps the
+ * value it sent in a flat array indexed by pin, with the time it was
+ * written. When the app polls a pin (a "vr" command), the value is sent
+ * back from there, and the BLYNK_READ handler is only called if there is
+ * no value yet, or it is older than the pin's maximum age. A thread that
+ * samples sensors can also store values without sending them.
+ *
+ * Each entry is guarded by a sequence counter, like BlynkSnapshot: any
+ * thread may store or read, a read never sees a mix of two values, and
+ * neither side takes a lock.
+ */
+
+#ifndef BlynkPinCache_h
+#define BlynkPinCache_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pins 0 .. BLYNK_PIN_CACHE_PINS-1 are cached
+#ifndef BLYNK_PIN_CACHE_PINS
+#define BLYNK_PIN_CACHE_PINS    128
+#endif
+
+// Longest value kept. A longer one clears the entry, so reads of that pin
+// go to the handler.
+#ifndef BLYNK_PIN_CACHE_DATA
+#define BLYNK_PIN_CACHE_DATA    32
+#endif
+
+#define BLYNK_PIN_CACHE_ANY_AGE 0xFFFFFFFFUL
+
+// Oldest value (ms) that answers a read, unless set for the pin
+#ifndef BLYNK_PIN_CACHE_MAX_AGE
+#define BLYNK_PIN_CACHE_MAX_AGE BLYNK_PIN_CACHE_ANY_AGE
+#endif
+
+struct BlynkPinCacheStats {
+    uint32_t stores;
+    uint32_t tooLong;           // stores that did not fit
+    uint32_t hits;              // reads answered from the cache
+    uint32_t stale;             // reads that found a value too old
+    uint32_t misses;            // reads that found no value, or of a pin set to 0
+};
+
+// Keeps 'data' as the value of 'pin' (the same bytes virtualWrite sends)
+void BlynkPinCacheStore(int pin, const void* data, size_t length);
+// Same, from a "vw" command built for the server
+void BlynkPinCacheStoreCmd(const void* cmd, size_t length);
+void BlynkPinCacheClear(int pin);
+void BlynkPinCacheClearAll();
+
+// Reads older than 'ms' call the handler; 0 always does
+void BlynkPinCacheSetMaxAge(int pin, uint32_t ms);
+
+// Copies the value of 'pin' into 'buff' (BLYNK_PIN_CACHE_DATA bytes) if
+// it may answer a read. Returns its length, or -1.
+int BlynkPinCacheRead(int pin, void* buff, uint32_t* age = NULL);
+
+void BlynkPinCacheGetStats(BlynkPinCacheStats& stats);
+
+#endif
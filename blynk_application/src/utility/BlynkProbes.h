@@ -0,0 +1,57 @@
+/**
+ * @file       BlynkProbes.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      USDT static tracepoints for bpftrace / perf (Linux)
+ *
+ * On Linux, when <sys/sdt.h> is available (package systemtap-sdt-dev),
+ * every BLYNK_PROBEn() is a USDT probe of the "blynk" provider. A probe
+ * compiles to a single NOP plus an ELF note; only when a tracer attaches
+ * is the NOP replaced with a breakpoint. Arguments are described to the
+ * tracer and are not otherwise used.
+ *
+ * Without <sys/sdt.h>, or with BLYNK_NO_USDT defined, probes compile to
+ * nothing. The available probes can be listed with:
+ *   sudo bpftrace -l 'usdt:./blynk:blynk:*'
+ *
+ * Probes (arguments in order):
+ *   send__start      cmd, msg id, payload length
+ *   send__done       cmd, msg id, bytes written
+ *   send__error      cmd, msg id, bytes written
+ *   send__queued     class, msg id, ms in the queue    (BLYNK_USE_SCHEDULER)
+ *   header           cmd, msg id, length (or status for responses)
+ *   input            cmd, msg id, payload length
+ *   input__done      cmd, msg id, payload length
+ *   pin__write       pin number, payload length        (BLYNK_WRITE handler)
+ *   pin__read        pin number                        (BLYNK_READ handler)
+ *   heartbeat        ms since last input, ms since last output
+ *   reconnect        state before
+ *   timer__run       timers called
+ *   stage            stage name (char*), duration in ns (any BlynkLatency)
+ *   sample__start    sample number
+ *   sample__done     sample number, duration in ns
+ *   isr              handler name (char*)
+ */
+
+#ifndef BlynkProbes_h
+#define BlynkProbes_h
+
+#if defined(LINUX) && !defined(BLYNK_NO_USDT) && defined(__has_include)
+    #if __has_include(<sys/sdt.h>)
+        #include <sys/sdt.h>
+        #define BLYNK_HAS_USDT
+    #endif
+#endif
+
+#ifdef BLYNK_HAS_USDT
+    #define BLYNK_PROBE0(name)              DTRACE_PROBE(blynk, name)
+    #define BLYNK_PROBE1(name, a)           DTRACE_PROBE1(blynk, name, a)
+    #define BLYNK_PROBE2(name, a, b)        DTRACE_PROBE2(blynk, name, a, b)
+    #define BLYNK_PROBE3(name, a, b, c)     DTRACE_PROBE3(blynk, name, a, b, c)
+#else
+    #define BLYNK_PROBE0(name)
+    #define BLYNK_PROBE1(name, a)
+    #define BLYNK_PROBE2(name, a, b)
+    #define BLYNK_PROBE3(name, a, b, c)
+#endif
+
+#endif
@@ -0,0 +1,414 @@
+/**
+ * @file       BlynkScheduler.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Prioritized outbound queue that shares the BLYNK_MSG_LIMIT budget
+ *
+ * With BLYNK_USE_SCHEDULER defined, rate-limited commands are queued here
+ * instead of making sendCmd() wait for its turn, and every free send slot
+ * goes to the next command picked by priority class:
+ *
+ *   CONTROL    sync and internal requests, replies to server reads (strict)
+ *   ALARM      notify, email, tweet, sms
+ *   STATE      properties, bridge, digital and analog writes
+ *   TELEMETRY  virtualWrite
+ *   LOG        terminal and other text
+ *
+ * CONTROL always goes first. The other classes share the remaining slots
+ * by weight (start-time fair queuing), so an alarm waits for at most one
+ * slot when it arrives, while bulk traffic still gets its share.
+ *
+ * A queued virtualWrite is replaced by a newer value for the same pin
+ * (except for LOG text). When the queue is full, TELEMETRY and LOG give
+ * up slots: the one holding the most for its weight drops its oldest
+ * entry, so stale values go first and neither class starves the other.
+ * Virtual pins are TELEMETRY unless given a class with setPinClass(), e.g.
+ * a terminal as LOG and an alarm LED as ALARM.
+ *
+ * The queue is a fixed array of BLYNK_SCHED_SLOTS entries; commands longer
+ * than BLYNK_SCHED_SLOT_SIZE bypass it.
+ *
+ * On Linux, other threads may queue commands (e.g. a sensor thread calling
+ * virtualWrite); only the thread that calls run() sends them. If the queue
+ * is full of classes that are never dropped, such a thread waits for
+ * run() to free a slot instead of driving the protocol itself.
+ */
+
+#ifndef BlynkScheduler_h
+#define BlynkScheduler_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <Blynk/BlynkProtocolDefs.h>
+
+#if defined(LINUX)
+    #include <pthread.h>
+    #include <time.h>
+#endif
+
+// Number of queued commands
+#ifndef BLYNK_SCHED_SLOTS
+#define BLYNK_SCHED_SLOTS         16
+#endif
+
+// Longest command payload that is queued
+#ifndef BLYNK_SCHED_SLOT_SIZE
+#define BLYNK_SCHED_SLOT_SIZE     128
+#endif
+
+// Virtual pins with a class other than TELEMETRY
+#ifndef BLYNK_SCHED_PIN_CLASSES
+#define BLYNK_SCHED_PIN_CLASSES   8
+#endif
+
+// Relative share of the send slots
+#ifndef BLYNK_SCHED_WEIGHT_ALARM
+#define BLYNK_SCHED_WEIGHT_ALARM      8
+#endif
+#ifndef BLYNK_SCHED_WEIGHT_STATE
+#define BLYNK_SCHED_WEIGHT_STATE      4
+#endif
+#ifndef BLYNK_SCHED_WEIGHT_TELEMETRY
+#define BLYNK_SCHED_WEIGHT_TELEMETRY  2
+#endif
+#ifndef BLYNK_SCHED_WEIGHT_LOG
+#define BLYNK_SCHED_WEIGHT_LOG        1
+#endif
+
+enum BlynkPriority {
+    BLYNK_PRIO_CONTROL,
+    BLYNK_PRIO_ALARM,
+    BLYNK_PRIO_STATE,
+    BLYNK_PRIO_TELEMETRY,
+    BLYNK_PRIO_LOG,
+    BLYNK_PRIO_COUNT
+};
+
+struct BlynkSchedStats {
+    uint32_t queued;        // accepted into the queue
+    uint32_t sent;          // taken from the queue
+    uint32_t replaced;      // overwritten by a newer value for the same pin
+    uint32_t dropped;       // evicted, or refused, because the queue was full
+    uint32_t waitMaxMs;     // longest time in the queue
+    uint32_t waitTotalMs;   // mean: waitTotalMs / sent
+};
+
+class BlynkScheduler
+{
+public:
+    struct Entry {
+        uint32_t queuedAt;
+        uint16_t id;
+        uint16_t length;
+        int16_t  pin;       // virtualWrite pin, or -1
+        uint8_t  cmd;
+        uint8_t  cls;
+        int8_t   next;
+        uint8_t  data[BLYNK_SCHED_SLOT_SIZE];
+    };
+
+    enum PushResult {
+        QUEUED,
+        DROPPED,            // its class already has more than its share
+        FULL                // only alarms, state and control are queued
+    };
+
+    BlynkScheduler()
+        : vtime(0), count(0), freeList(0)
+    {
+        for (int i = 0; i < BLYNK_SCHED_SLOTS; i++) {
+            slots[i].next = (i + 1 < BLYNK_SCHED_SLOTS) ? i + 1 : -1;
+        }
+        for (int c = 0; c < BLYNK_PRIO_COUNT; c++) {
+            head[c] = tail[c] = -1;
+            size[c] = 0;
+            tag[c] = finish[c] = 0;
+            memset(&stat[c], 0, sizeof(stat[c]));
+        }
+        const unsigned weights[BLYNK_PRIO_COUNT] = { 1, BLYNK_SCHED_WEIGHT_ALARM, BLYNK_SCHED_WEIGHT_STATE,
+                                                     BLYNK_SCHED_WEIGHT_TELEMETRY, BLYNK_SCHED_WEIGHT_LOG };
+        for (int c = 0; c < BLYNK_PRIO_COUNT; c++) {
+            setWeight(BlynkPriority(c), weights[c]);
+        }
+        for (int i = 0; i < BLYNK_SCHED_PIN_CLASSES; i++) {
+            pinClass[i].pin = -1;
+        }
+#if defined(LINUX)
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&room, NULL);
+#endif
+    }
+
+    static bool fits(size_t length) {
+        return length <= BLYNK_SCHED_SLOT_SIZE;
+    }
+
+    void setWeight(BlynkPriority cls, unsigned weight) {
+        cost[cls] = COST_SCALE / (weight ? weight : 1);
+    }
+
+    // Sends virtualWrite on 'pin' with class 'cls' (TELEMETRY to reset)
+    bool setPinClass(int pin, BlynkPriority cls) {
+        lock();
+        int found = -1;
+        for (int i = 0; i < BLYNK_SCHED_PIN_CLASSES; i++) {
+            if (pinClass[i].pin == pin || (found < 0 && pinClass[i].pin < 0)) {
+                found = i;
+                if (pinClass[i].pin == pin) break;
+            }
+        }
+        if (found >= 0) {
+            pinClass[found].pin = (cls == BLYNK_PRIO_TELEMETRY) ? -1 : pin;
+            pinClass[found].cls = cls;
+        }
+        unlock();
+        return found >= 0 || cls == BLYNK_PRIO_TELEMETRY;
+    }
+
+    // Class of a command; 'pin' is set for virtualWrite
+    BlynkPriority classify(uint8_t cmd, const void* data, size_t length, int& pin) {
+        pin = -1;
+        switch (cmd) {
+        case BLYNK_CMD_NOTIFY:
+        case BLYNK_CMD_EMAIL:
+        case BLYNK_CMD_TWEET:
+        case BLYNK_CMD_SMS:
+            return BLYNK_PRIO_ALARM;
+        case BLYNK_CMD_PROPERTY:
+        case BLYNK_CMD_BRIDGE:
+            return BLYNK_PRIO_STATE;
+        case BLYNK_CMD_HARDWARE:
+            break;
+        default:
+            return BLYNK_PRIO_CONTROL;
+        }
+        const char* s = (const char*)data;
+        if (!s || length < 4 || s[0] != 'v' || s[1] != 'w' || s[2] != '\0') {
+            return BLYNK_PRIO_STATE;
+        }
+        pin = 0;
+        for (size_t i = 3; i < length && s[i] >= '0' && s[i] <= '9'; i++) {
+            pin = pin * 10 + (s[i] - '0');
+        }
+        BlynkPriority cls = BLYNK_PRIO_TELEMETRY;
+        lock();
+        for (int i = 0; i < BLYNK_SCHED_PIN_CLASSES; i++) {
+            if (pinClass[i].pin == pin) {
+                cls = BlynkPriority(pinClass[i].cls);
+                break;
+            }
+        }
+        unlock();
+        return cls;
+    }
+
+    // Queues a command, given as two consecutive pieces. A newer value
+    // replaces a queued one for the same pin, unless it is LOG text; when
+    // the queue is full, the oldest entry of a bulk class is dropped.
+    PushResult push(BlynkPriority cls, int pin, uint8_t cmd, uint16_t id,
+                    const void* data, size_t length, const void* data2, size_t length2,
+                    uint32_t now)
+    {
+        if (!data)  length = 0;
+        if (!data2) length2 = 0;
+        lock();
+        int slot = -1;
+        if (pin >= 0 && cls != BLYNK_PRIO_CONTROL && cls != BLYNK_PRIO_LOG) {
+            for (int i = head[cls]; i >= 0; i = slots[i].next) {
+                if (slots[i].pin == pin && slots[i].cmd == cmd) {
+                    slot = i;
+                    stat[cls].replaced++;
+                    break;
+                }
+            }
+        }
+        if (slot < 0) {
+            if (freeList < 0) {
+                // The bulk class using the most slots for its weight, counting the new entry
+                int victim = -1;
+                uint32_t most = 0;
+                for (int c = BLYNK_PRIO_TELEMETRY; c < BLYNK_PRIO_COUNT; c++) {
+                    const uint32_t n = (size[c] + (c == cls)) * cost[c];
+                    if (n && n >= most) {
+                        victim = c;
+                        most = n;
+                    }
+                }
+                if (victim < 0) {
+                    unlock();
+                    return FULL;
+                }
+                stat[victim].dropped++;
+                if (head[victim] < 0) {
+                    unlock();
+                    return DROPPED;
+                }
+                release(unlink(victim));
+            }
+            slot = freeList;
+            freeList = slots[slot].next;
+            append(cls, slot);
+        }
+        Entry& e = slots[slot];
+        e.queuedAt = now;
+        e.id = id;
+        e.length = uint16_t(length + length2);
+        e.pin = int16_t(pin);
+        e.cmd = cmd;
+        e.cls = cls;
+        if (length)  memcpy(e.data, data, length);
+        if (length2) memcpy(e.data + length, data2, length2);
+        stat[cls].queued++;
+        unlock();
+        return QUEUED;
+    }
+
+    // Removes the command to send next; false if the queue is empty
+    bool pop(Entry& out, uint32_t now) {
+        lock();
+        int cls = -1;
+        if (head[BLYNK_PRIO_CONTROL] >= 0) {
+            cls = BLYNK_PRIO_CONTROL;
+        } else {
+            for (int c = BLYNK_PRIO_CONTROL + 1; c < BLYNK_PRIO_COUNT; c++) {
+                if (head[c] >= 0 && (cls < 0 || int32_t(tag[c] - tag[cls]) < 0)) {
+                    cls = c;
+                }
+            }
+        }
+        if (cls < 0) {
+            unlock();
+            return false;
+        }
+        if (cls != BLYNK_PRIO_CONTROL) {
+            vtime = tag[cls];
+            finish[cls] = tag[cls] + cost[cls];
+            tag[cls] = finish[cls];
+        }
+        const int slot = unlink(cls);
+        const Entry& e = slots[slot];
+        memcpy(&out, &e, offsetof(Entry, data) + e.length);
+
+        const uint32_t wait = now - e.queuedAt;
+        BlynkSchedStats& s = stat[cls];
+        s.sent++;
+        s.waitTotalMs += wait;
+        if (wait > s.waitMaxMs) s.waitMaxMs = wait;
+        release(slot);
+#if defined(LINUX)
+        pthread_cond_broadcast(&room);
+#endif
+        unlock();
+        return true;
+    }
+
+#if defined(LINUX)
+    // Waits up to 'ms' for pop() to free a slot, for threads that queue
+    // while another one sends. False if the queue is still full.
+    bool waitForRoom(unsigned ms) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        const long ns = ts.tv_nsec + (ms % 1000) * 1000000L;
+        ts.tv_sec += ms / 1000 + ns / 1000000000L;
+        ts.tv_nsec = ns % 1000000000L;
+        lock();
+        while (freeList < 0) {
+            if (pthread_cond_timedwait(&room, &mutex, &ts) != 0) {
+                break;
+            }
+        }
+        const bool res = (freeList >= 0);
+        unlock();
+        return res;
+    }
+#endif
+
+    unsigned pending() const {
+        return count;
+    }
+
+    void getStats(BlynkPriority cls, BlynkSchedStats& stats) {
+        lock();
+        stats = stat[cls];
+        unlock();
+    }
+
+    void resetStats() {
+        lock();
+        for (int c = 0; c < BLYNK_PRIO_COUNT; c++) {
+            memset(&stat[c], 0, sizeof(stat[c]));
+        }
+        unlock();
+    }
+
+    static const char* className(BlynkPriority cls) {
+        static const char* const names[BLYNK_PRIO_COUNT] = { "control", "alarm", "state", "telemetry", "log" };
+        return (cls < BLYNK_PRIO_COUNT) ? names[cls] : "?";
+    }
+
+private:
+    enum { COST_SCALE = 65536 };
+
+    BlynkScheduler(const BlynkScheduler&);
+    BlynkScheduler& operator=(const BlynkScheduler&);
+
+    void append(int cls, int slot) {
+        slots[slot].next = -1;
+        if (tail[cls] >= 0) {
+            slots[tail[cls]].next = slot;
+        } else {
+            head[cls] = slot;
+            // An idle class starts at the current virtual time
+            tag[cls] = (int32_t(finish[cls] - vtime) > 0) ? finish[cls] : vtime;
+        }
+        tail[cls] = slot;
+        size[cls]++;
+        count++;
+    }
+
+    int unlink(int cls) {
+        const int slot = head[cls];
+        head[cls] = slots[slot].next;
+        if (head[cls] < 0) tail[cls] = -1;
+        size[cls]--;
+        count--;
+        return slot;
+    }
+
+    void release(int slot) {
+        slots[slot].next = freeList;
+        freeList = slot;
+    }
+
+#if defined(LINUX)
+    void lock()   { pthread_mutex_lock(&mutex); }
+    void unlock() { pthread_mutex_unlock(&mutex); }
+    pthread_mutex_t mutex;
+    pthread_cond_t  room;           // signaled when pop() frees a slot
+#else
+    void lock()   {}
+    void unlock() {}
+#endif
+
+    static_assert(BLYNK_SCHED_SLOTS > 0 && BLYNK_SCHED_SLOTS <= 127, "BLYNK_SCHED_SLOTS: 1 to 127");
+
+    struct PinClass {
+        int16_t pin;
+        uint8_t cls;
+    };
+
+    Entry           slots[BLYNK_SCHED_SLOTS];
+    int8_t          head[BLYNK_PRIO_COUNT];
+    int8_t          tail[BLYNK_PRIO_COUNT];
+    uint8_t         size[BLYNK_PRIO_COUNT];
+    uint32_t        tag[BLYNK_PRIO_COUNT];      // start tag of the class head
+    uint32_t        finish[BLYNK_PRIO_COUNT];   // finish tag of its last sent entry
+    uint32_t        cost[BLYNK_PRIO_COUNT];
+    uint32_t        vtime;
+    volatile unsigned count;
+    int8_t          freeList;
+    PinClass        pinClass[BLYNK_SCHED_PIN_CLASSES];
+    BlynkSchedStats stat[BLYNK_PRIO_COUNT];
+};
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file       BlynkSnapshot.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Latest sensor readings in POSIX shared memory (Linux)
+ *
+ * Single writer. An update makes 'seq' odd, writes the sample and makes
+ * it even again; readers retry if 'seq' was odd or changed meanwhile.
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkUtility.h>
+#include <utility/BlynkSnapshot.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static BlynkSnapshot* snap = NULL;
+static char           snap_name[64];
+
+bool BlynkSnapshotOpen(const char* name, const char* const* names, unsigned count)
+{
+    BlynkSnapshotClose();
+    if (count > BLYNK_SNAPSHOT_VALUES || strlen(name) >= sizeof(snap_name)) {
+        return false;
+    }
+    const int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(BlynkSnapshot)) < 0) {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(NULL, sizeof(BlynkSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    snap = (BlynkSnapshot*)p;
+    strcpy(snap_name, name);
+
+    // Readers check the magic last
+    __atomic_store_n(&snap->magic, 0, __ATOMIC_RELAXED);
+    snap->version = BLYNK_SNAPSHOT_VERSION;
+    snap->values = count;
+    snap->writerPid = getpid();
+    memset(snap->names, 0, sizeof(snap->names));
+    for (unsigned i = 0; i < count; i++) {
+        strncpy(snap->names[i], names[i], BLYNK_SNAPSHOT_NAME_LEN - 1);
+    }
+    // Keep 'seq' of a previous writer, so readers never see it go back
+    const uint32_t seq = __atomic_load_n(&snap->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&snap->seq, (seq + 1) & ~1U, __ATOMIC_RELAXED);
+    __atomic_store_n(&snap->magic, BLYNK_SNAPSHOT_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+void BlynkSnapshotClose()
+{
+    if (snap) {
+        munmap(snap, sizeof(BlynkSnapshot));
+        snap = NULL;
+    }
+}
+
+bool BlynkSnapshotIsOpen()
+{
+    return snap != NULL;
+}
+
+void BlynkSnapshotPublish(const float* values, unsigned count, uint32_t flags)
+{
+    if (!snap) {
+        return;
+    }
+    BlynkSnapshotSample smp;
+    memset(&smp, 0, sizeof(smp));
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    smp.timeNs = uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    smp.count = snap->sample.count + 1;
+    smp.flags = flags;
+    memcpy(smp.value, values, BlynkMin(count, (unsigned)BLYNK_SNAPSHOT_VALUES) * sizeof(float));
+
+    const BlynkSnapshotWord* src = (const BlynkSnapshotWord*)&smp;
+    BlynkSnapshotWord* dst = (BlynkSnapshotWord*)&snap->sample;
+    const uint32_t seq = snap->seq;
+    __atomic_store_n(&snap->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i = 0; i < BLYNK_SNAPSHOT_WORDS; i++) {
+        __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+#endif
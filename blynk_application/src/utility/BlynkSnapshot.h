@@ -0,0 +1,144 @@
+/**
+ * @file       BlynkSnapshot.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Latest sensor readings in POSIX shared memory (Linux)
+ *
+ * The sampling loop publishes every sample into a shared-memory segment
+ * guarded by a seqlock. Local processes (display, watchdog, bridges) read
+ * it with no syscalls and no locks; a read that overlaps an update is
+ * detected and retried, so it never returns a mix of two samples.
+ *
+ * This header is all a reader needs, and it also compiles as C:
+ *
+ *   const BlynkSnapshot* s = BlynkSnapshotAttach("/blynk-sensors");
+ *   int hum = BlynkSnapshotFind(s, "humidity");
+ *   BlynkSnapshotSample smp;
+ *   BlynkSnapshotRead(s, &smp);
+ *   printf("%f\n", smp.value[hum]);
+ *
+ * (link with -lrt on older glibc)
+ */
+
+#ifndef BlynkSnapshot_h
+#define BlynkSnapshot_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BLYNK_SNAPSHOT_MAGIC    0x50414E53UL    // "SNAP"
+#define BLYNK_SNAPSHOT_VERSION  1
+#define BLYNK_SNAPSHOT_VALUES   16
+#define BLYNK_SNAPSHOT_NAME_LEN 16
+
+// Default segment name (see shm_overview(7))
+#ifndef BLYNK_SNAPSHOT_NAME
+#define BLYNK_SNAPSHOT_NAME     "/blynk-sensors"
+#endif
+
+typedef struct {
+    uint64_t timeNs;                        // CLOCK_REALTIME of the sample
+    uint32_t count;                         // samples published so far
+    uint32_t flags;                         // application defined
+    float    value[BLYNK_SNAPSHOT_VALUES];
+} BlynkSnapshotSample;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t values;                        // entries used in 'value' and 'names'
+    uint32_t writerPid;
+    char     names[BLYNK_SNAPSHOT_VALUES][BLYNK_SNAPSHOT_NAME_LEN];
+    uint8_t  reserved[48];
+    uint32_t seq;                           // odd while an update is in progress
+    uint32_t reserved2;
+    BlynkSnapshotSample sample;
+} BlynkSnapshot;
+
+// The sample is copied word by word
+typedef uint32_t BlynkSnapshotWord __attribute__((may_alias));
+#define BLYNK_SNAPSHOT_WORDS (sizeof(BlynkSnapshotSample) / sizeof(BlynkSnapshotWord))
+
+/*
+ * Reader
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Maps the segment read-only. Returns NULL if it does not exist (yet).
+static inline
+const BlynkSnapshot* BlynkSnapshotAttach(const char* name)
+{
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    void* p = mmap(NULL, sizeof(BlynkSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    const BlynkSnapshot* s = (const BlynkSnapshot*)p;
+    if (s->magic != BLYNK_SNAPSHOT_MAGIC || s->version != BLYNK_SNAPSHOT_VERSION) {
+        munmap(p, sizeof(BlynkSnapshot));
+        return NULL;
+    }
+    return s;
+}
+
+static inline
+void BlynkSnapshotDetach(const BlynkSnapshot* s)
+{
+    if (s) munmap((void*)s, sizeof(BlynkSnapshot));
+}
+
+// Index of a named value, or -1
+static inline
+int BlynkSnapshotFind(const BlynkSnapshot* s, const char* name)
+{
+    for (uint32_t i = 0; i < s->values && i < BLYNK_SNAPSHOT_VALUES; i++) {
+        if (!strncmp(s->names[i], name, BLYNK_SNAPSHOT_NAME_LEN)) return i;
+    }
+    return -1;
+}
+
+// Copies the latest sample. Returns the number of retries
+// (reads that overlapped an update).
+static inline
+unsigned BlynkSnapshotRead(const BlynkSnapshot* s, BlynkSnapshotSample* out)
+{
+    const BlynkSnapshotWord* src = (const BlynkSnapshotWord*)&s->sample;
+    BlynkSnapshotWord* dst = (BlynkSnapshotWord*)out;
+    for (unsigned retries = 0;; retries++) {
+        const uint32_t seq1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (!(seq1 & 1)) {
+            for (size_t i = 0; i < BLYNK_SNAPSHOT_WORDS; i++) {
+                dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq1) {
+                return retries;
+            }
+        }
+    }
+}
+
+/*
+ * Writer (the library side, BlynkSnapshot.cpp)
+ */
+
+#ifdef __cplusplus
+
+// Creates the segment and sets the value names (at most BLYNK_SNAPSHOT_VALUES)
+bool BlynkSnapshotOpen(const char* name, const char* const* names, unsigned count);
+void BlynkSnapshotClose();
+bool BlynkSnapshotIsOpen();
+
+// Publishes a sample. Values are given in the order of 'names'.
+void BlynkSnapshotPublish(const float* values, unsigned count, uint32_t flags = 0);
+
+#endif
+
+#endif
@@ -0,0 +1,320 @@
+/**
+ * @file       BlynkStats.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Streaming statistics for sensor data
+ *
+ * All containers have a fixed size (template parameter) and never allocate.
+ *
+ *   BlynkEwma<T>               exponentially weighted moving average, O(1)
+ *   BlynkWindowStats<T, N>     mean / variance of the last N samples, O(1)
+ *   BlynkWindowMinMax<T, N>    min / max of the last N samples, amortized O(1)
+ *   BlynkWindowMedian<T, N>    median of the last N samples, O(log N)
+ */
+
+#ifndef BlynkStats_h
+#define BlynkStats_h
+
+#include <math.h>
+#include <stdint.h>
+
+template <typename T = float>
+class BlynkEwma
+{
+public:
+    // alpha: weight of a new sample, 0 < alpha <= 1
+    explicit BlynkEwma(float alpha = 0.1f)
+        : _alpha(alpha), _value(0), _init(false)
+    {}
+
+    // Same smoothing as a moving average over 'samples' points
+    static BlynkEwma window(unsigned samples) {
+        return BlynkEwma(2.0f / (samples + 1));
+    }
+
+    T add(T x) {
+        if (!_init) {
+            _value = x;
+            _init = true;
+        } else {
+            _value += _alpha * (x - _value);
+        }
+        return _value;
+    }
+
+    T    value() const { return _value; }
+    bool ready() const { return _init; }
+    void reset()       { _init = false; _value = 0; }
+
+private:
+    float _alpha;
+    T     _value;
+    bool  _init;
+};
+
+/*
+ * Sliding mean and variance (Welford's update, adapted to replacing
+ * the oldest sample, so there is no catastrophic cancellation of sums).
+ */
+template <typename T, unsigned N>
+class BlynkWindowStats
+{
+public:
+    BlynkWindowStats() { reset(); }
+
+    void reset() {
+        _count = _head = 0;
+        _mean = _m2 = 0;
+    }
+
+    void add(T x) {
+        const double v = x;
+        if (_count < N) {
+            _buf[_head] = x;
+            _count++;
+            const double d = v - _mean;
+            _mean += d / _count;
+            _m2 += d * (v - _mean);
+        } else {
+            const double old = _buf[_head];
+            _buf[_head] = x;
+            const double oldMean = _mean;
+            _mean += (v - old) / N;
+            _m2 += (v - old) * (v - _mean + old - oldMean);
+            if (_m2 < 0) _m2 = 0;
+        }
+        if (++_head == N) _head = 0;
+    }
+
+    unsigned count() const { return _count; }
+    bool     full()  const { return _count == N; }
+    double   mean()  const { return _mean; }
+
+    // Population variance
+    double variance() const {
+        return _count ? _m2 / _count : 0;
+    }
+
+    // Sample variance
+    double sampleVariance() const {
+        return (_count > 1) ? _m2 / (_count - 1) : 0;
+    }
+
+    double stddev() const { return sqrt(variance()); }
+
+    // Oldest to newest: at(0) is the oldest sample in the window
+    T at(unsigned i) const {
+        const unsigned idx = (_head + N - _count + i) % N;
+        return _buf[idx];
+    }
+
+private:
+    T        _buf[N];
+    unsigned _count;
+    unsigned _head;
+    double   _mean;
+    double   _m2;
+};
+
+/*
+ * Sliding minimum and maximum, using two monotonic deques.
+ * Each deque holds (value, sequence number) pairs in a ring of N entries.
+ */
+template <typename T, unsigned N>
+class BlynkWindowMinMax
+{
+public:
+    BlynkWindowMinMax() { reset(); }
+
+    void reset() {
+        _seq = 0;
+        _count = 0;
+        _minHead = _minSize = 0;
+        _maxHead = _maxSize = 0;
+    }
+
+    void add(T x) {
+        const uint32_t seq = _seq++;       // wraps; only differences are used
+        if (_count < N) _count++;
+        push(_minVal, _minSeq, _minHead, _minSize, x, seq, false);
+        push(_maxVal, _maxSeq, _maxHead, _maxSize, x, seq, true);
+    }
+
+    // min() and max() are T() while the window is empty
+    unsigned count() const { return _count; }
+    T        min()   const { return _count ? _minVal[_minHead] : T(); }
+    T        max()   const { return _count ? _maxVal[_maxHead] : T(); }
+
+private:
+    static unsigned wrap(unsigned i) { return (i >= N) ? i - N : i; }
+
+    void push(T* val, uint32_t* seqs, unsigned& head, unsigned& size,
+              T x, uint32_t seq, bool isMax)
+    {
+        // Expire the front element when it leaves the window
+        if (size && seq - seqs[head] >= N) {
+            head = wrap(head + 1);
+            size--;
+        }
+        // Drop the tail elements that can never become the extremum
+        while (size) {
+            const T& tail = val[wrap(head + size - 1)];
+            if (isMax ? (tail > x) : (tail < x)) break;
+            size--;
+        }
+        const unsigned pos = wrap(head + size);
+        val[pos] = x;
+        seqs[pos] = seq;
+        size++;
+    }
+
+    uint32_t _seq;
+    unsigned _count;
+    T        _minVal[N];
+    uint32_t _minSeq[N];
+    unsigned _minHead, _minSize;
+    T        _maxVal[N];
+    uint32_t _maxSeq[N];
+    unsigned _maxHead, _maxSize;
+};
+
+/*
+ * Sliding median, using two indexed heaps over the window slots:
+ * a max-heap with the lower half and a min-heap with the upper half.
+ * A new sample overwrites the oldest slot in place, which is then
+ * re-sifted, so each update costs O(log N).
+ */
+template <typename T, unsigned N>
+class BlynkWindowMedian
+{
+    static_assert(N > 0 && N < 65536, "Window slots are indexed with uint16_t");
+
+public:
+    BlynkWindowMedian() { reset(); }
+
+    void reset() {
+        _count = _head = 0;
+        _loSize = _hiSize = 0;
+    }
+
+    void add(T x) {
+        const uint16_t s = _head;
+        if (++_head == N) _head = 0;
+        _val[s] = x;
+
+        if (_count < N) {
+            _count++;
+            if (!_loSize || !(_val[_lo[0]] < x)) {
+                insert(LO, s);
+            } else {
+                insert(HI, s);
+            }
+            // Keep lo.size == hi.size or hi.size + 1
+            if (_loSize > _hiSize + 1) {
+                const uint16_t t = popTop(LO);
+                insert(HI, t);
+            } else if (_hiSize > _loSize) {
+                const uint16_t t = popTop(HI);
+                insert(LO, t);
+            }
+            return;
+        }
+
+        // Window is full: slot s had the oldest value, re-sift it
+        const uint8_t  h = _heapOf[s];
+        const uint16_t p = _pos[s];
+        siftUp(h, p);
+        siftDown(h, _pos[s]);
+
+        // Restore lo <= hi by exchanging the tops (sizes stay the same)
+        if (_hiSize && _val[_hi[0]] < _val[_lo[0]]) {
+            const uint16_t a = _lo[0], b = _hi[0];
+            place(LO, 0, b);
+            place(HI, 0, a);
+            siftDown(LO, 0);
+            siftDown(HI, 0);
+        }
+    }
+
+    unsigned count() const { return _count; }
+
+    // For an even count, the mean of the two middle values
+    T median() const {
+        if (!_count) return T();
+        if (_loSize > _hiSize) return _val[_lo[0]];
+        return (_val[_lo[0]] + _val[_hi[0]]) / 2;
+    }
+
+    T lowerMedian() const { return _count ? _val[_lo[0]] : T(); }
+
+private:
+    enum { LO, HI };
+
+    uint16_t* heap(uint8_t h)     { return (h == LO) ? _lo : _hi; }
+    unsigned& heapSize(uint8_t h) { return (h == LO) ? _loSize : _hiSize; }
+
+    // True if slot a must be above slot b in heap h
+    bool above(uint8_t h, uint16_t a, uint16_t b) const {
+        return (h == LO) ? (_val[b] < _val[a]) : (_val[a] < _val[b]);
+    }
+
+    void place(uint8_t h, unsigned i, uint16_t s) {
+        heap(h)[i] = s;
+        _heapOf[s] = h;
+        _pos[s] = i;
+    }
+
+    void siftUp(uint8_t h, unsigned i) {
+        uint16_t* q = heap(h);
+        const uint16_t s = q[i];
+        while (i) {
+            const unsigned parent = (i - 1) / 2;
+            if (!above(h, s, q[parent])) break;
+            place(h, i, q[parent]);
+            i = parent;
+        }
+        place(h, i, s);
+    }
+
+    void siftDown(uint8_t h, unsigned i) {
+        uint16_t* q = heap(h);
+        const unsigned n = heapSize(h);
+        const uint16_t s = q[i];
+        for (;;) {
+            unsigned c = 2 * i + 1;
+            if (c >= n) break;
+            if (c + 1 < n && above(h, q[c + 1], q[c])) c++;
+            if (!above(h, q[c], s)) break;
+            place(h, i, q[c]);
+            i = c;
+        }
+        place(h, i, s);
+    }
+
+    void insert(uint8_t h, uint16_t s) {
+        const unsigned i = heapSize(h)++;
+        place(h, i, s);
+        siftUp(h, i);
+    }
+
+    uint16_t popTop(uint8_t h) {
+        uint16_t* q = heap(h);
+        const uint16_t top = q[0];
+        const unsigned n = --heapSize(h);
+        if (n) {
+            place(h, 0, q[n]);
+            siftDown(h, 0);
+        }
+        return top;
+    }
+
+    T        _val[N];
+    uint16_t _pos[N];       // position of each slot in its heap
+    uint8_t  _heapOf[N];
+    uint16_t _lo[(N + 1) / 2 + 1];
+    uint16_t _hi[N / 2 + 1];
+    unsigned _loSize, _hiSize;
+    unsigned _count;
+    unsigned _head;
+};
+
+#endif
@@ -0,0 +1,476 @@
+/**
+ * @file       BlynkStream.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Local Unix-domain-socket streaming of samples (Linux)
+ *
+ * One server thread runs an epoll loop over the listening socket, an
+ * eventfd (new samples / shutdown) and the clients. The publisher only
+ * appends to the ring; the server thread copies frames from the ring into
+ * each client's send queue as far as that client's socket keeps up.
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkUtility.h>
+#include <utility/BlynkStream.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STREAM_FRAME_HDR    5           // length + type
+#define STREAM_REQUEST_MAX  64
+
+struct StreamClient {
+    int      fd;
+    bool     subscribed;
+    bool     wantLatest;
+    bool     wantOut;       // EPOLLOUT is registered
+    uint64_t cursor;        // next sample to send
+    uint64_t histEnd;       // history in progress: send up to here (exclusive)
+    uint32_t histSent;
+    uint32_t outPos;
+    uint32_t outLen;
+    uint32_t inLen;
+    uint32_t frames;        // queued since the last pump()
+    uint8_t  in[STREAM_REQUEST_MAX];
+    uint8_t  out[BLYNK_STREAM_SEND_QUEUE];
+};
+
+static pthread_mutex_t    st_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t          st_thread;
+static bool               st_open = false;
+static volatile bool      st_stop = false;
+static int                st_listen = -1;
+static int                st_event = -1;
+static int                st_epoll = -1;
+static char               st_path[108];
+
+// Under st_lock
+static BlynkStreamSample* st_ring = NULL;
+static size_t             st_cap = 0;
+static uint64_t           st_next = 1;      // seq of the next sample
+static BlynkStreamStats   st_stats;
+
+static unsigned           st_values = 0;
+static char               st_names[BLYNK_STREAM_VALUES][BLYNK_STREAM_NAME_LEN];
+
+// Server thread only
+static StreamClient*      st_clients[BLYNK_STREAM_MAX_CLIENTS];
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t sample_frame_len()
+{
+    return STREAM_FRAME_HDR + 16 + st_values * sizeof(float);
+}
+
+// Appends a frame to the send queue, if there is room
+static bool queue_frame(StreamClient* c, uint8_t type, const void* p1, size_t l1,
+                        const void* p2 = NULL, size_t l2 = 0)
+{
+    const uint32_t len = 1 + l1 + l2;
+    if (c->outPos && c->outLen + 4 + len > sizeof(c->out)) {
+        memmove(c->out, c->out + c->outPos, c->outLen - c->outPos);
+        c->outLen -= c->outPos;
+        c->outPos = 0;
+    }
+    if (c->outLen + 4 + len > sizeof(c->out)) {
+        return false;
+    }
+    uint8_t* d = c->out + c->outLen;
+    memcpy(d, &len, 4);
+    d[4] = type;
+    memcpy(d + STREAM_FRAME_HDR, p1, l1);
+    if (l2) memcpy(d + STREAM_FRAME_HDR + l1, p2, l2);
+    c->outLen += 4 + len;
+    c->frames++;
+    return true;
+}
+
+static bool queue_sample(StreamClient* c, const BlynkStreamSample& s)
+{
+    return queue_frame(c, BLYNK_STREAM_SAMPLE, &s, sample_frame_len() - STREAM_FRAME_HDR);
+}
+
+// Moves as many frames from the ring to the send queue as fit.
+// Returns true if more are waiting.
+static bool fill(StreamClient* c)
+{
+    pthread_mutex_lock(&st_lock);
+    const uint64_t oldest = (st_next > st_cap) ? st_next - st_cap : 1;
+    if (c->wantLatest && st_next > 1) {
+        if (queue_sample(c, st_ring[(st_next - 1) % st_cap])) {
+            c->wantLatest = false;
+        }
+    } else {
+        c->wantLatest = false;
+    }
+    bool more = false;
+    for (;;) {
+        const uint64_t target = BlynkMax(c->subscribed ? st_next : 0, c->histEnd);
+        if (c->cursor >= target) {
+            break;
+        }
+        if (c->cursor < oldest) {
+            const uint64_t skipped = oldest - c->cursor;
+            if (!queue_frame(c, BLYNK_STREAM_GAP, &skipped, sizeof(skipped))) {
+                more = true;
+                break;
+            }
+            st_stats.gaps++;
+            st_stats.skipped += skipped;
+            c->cursor = oldest;
+        }
+        if (!queue_sample(c, st_ring[c->cursor % st_cap])) {
+            more = true;
+            break;
+        }
+        if (c->cursor < c->histEnd) {
+            c->histSent++;
+        }
+        c->cursor++;
+    }
+    if (c->histEnd && c->cursor >= c->histEnd) {
+        if (queue_frame(c, BLYNK_STREAM_HISTORY_END, &c->histSent, sizeof(c->histSent))) {
+            c->histEnd = 0;
+        } else {
+            more = true;
+        }
+    }
+    pthread_mutex_unlock(&st_lock);
+    return more || c->wantLatest;
+}
+
+static void close_client(unsigned i)
+{
+    StreamClient* c = st_clients[i];
+    pthread_mutex_lock(&st_lock);
+    st_stats.clients--;
+    st_stats.subscribers -= c->subscribed;
+    pthread_mutex_unlock(&st_lock);
+    epoll_ctl(st_epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c);
+    st_clients[i] = NULL;
+}
+
+static void set_want_out(StreamClient* c, unsigned i, bool on)
+{
+    if (c->wantOut == on) {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = on ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.u64 = i;
+    epoll_ctl(st_epoll, EPOLL_CTL_MOD, c->fd, &ev);
+    c->wantOut = on;
+}
+
+// Sends until the socket is full or nothing is left
+static void pump(unsigned i)
+{
+    StreamClient* c = st_clients[i];
+    uint64_t bytes = 0;
+    bool blocked = false;
+    for (;;) {
+        const bool more = fill(c);
+        if (c->outPos == c->outLen) {
+            break;
+        }
+        while (c->outPos < c->outLen) {
+            const ssize_t n = send(c->fd, c->out + c->outPos, c->outLen - c->outPos,
+                                   MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    blocked = true;
+                    break;
+                }
+                close_client(i);
+                return;
+            }
+            c->outPos += n;
+            bytes += n;
+        }
+        if (c->outPos == c->outLen) {
+            c->outPos = c->outLen = 0;
+        }
+        if (blocked || !more) {
+            break;
+        }
+    }
+    set_want_out(c, i, blocked);
+
+    pthread_mutex_lock(&st_lock);
+    st_stats.framesSent += c->frames;
+    st_stats.bytesSent += bytes;
+    c->frames = 0;
+    pthread_mutex_unlock(&st_lock);
+}
+
+static void handle_request(StreamClient* c, uint8_t type, const uint8_t* p, uint32_t len)
+{
+    pthread_mutex_lock(&st_lock);
+    const bool wasSubscribed = c->subscribed;
+    switch (type) {
+    case BLYNK_STREAM_GET_LATEST:
+        c->wantLatest = true;
+        break;
+    case BLYNK_STREAM_SUBSCRIBE:
+        if (!c->subscribed) {
+            c->subscribed = true;
+            if (!c->histEnd) c->cursor = st_next;
+        }
+        break;
+    case BLYNK_STREAM_UNSUBSCRIBE:
+        c->subscribed = false;
+        break;
+    case BLYNK_STREAM_HISTORY: {
+        uint32_t seconds = 0;
+        if (len >= 4) memcpy(&seconds, p, 4);
+        const uint64_t since = now_ns() - uint64_t(seconds) * 1000000000ULL;
+        const uint64_t oldest = (st_next > st_cap) ? st_next - st_cap : 1;
+        uint64_t first = st_next;
+        while (first > oldest && st_ring[(first - 1) % st_cap].timeNs >= since) {
+            first--;
+        }
+        // Rewinds the stream position; a subscription continues after it
+        c->cursor = first;
+        c->histEnd = st_next;
+        c->histSent = 0;
+        break;
+    }
+    default:
+        break;
+    }
+    st_stats.subscribers += c->subscribed - wasSubscribed;
+    pthread_mutex_unlock(&st_lock);
+}
+
+// Returns false if the client must be closed
+static bool read_requests(StreamClient* c)
+{
+    for (;;) {
+        const ssize_t n = recv(c->fd, c->in + c->inLen, sizeof(c->in) - c->inLen, MSG_DONTWAIT);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        c->inLen += n;
+        uint32_t pos = 0;
+        while (c->inLen - pos >= STREAM_FRAME_HDR) {
+            uint32_t len;
+            memcpy(&len, c->in + pos, 4);
+            if (len < 1 || len > STREAM_REQUEST_MAX - 4) {
+                return false;
+            }
+            if (c->inLen - pos < 4 + len) {
+                break;
+            }
+            handle_request(c, c->in[pos + 4], c->in + pos + STREAM_FRAME_HDR, len - 1);
+            pos += 4 + len;
+        }
+        memmove(c->in, c->in + pos, c->inLen - pos);
+        c->inLen -= pos;
+    }
+}
+
+static void accept_clients()
+{
+    for (;;) {
+        const int fd = accept4(st_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        unsigned i = 0;
+        while (i < BLYNK_STREAM_MAX_CLIENTS && st_clients[i]) i++;
+        StreamClient* c = (i < BLYNK_STREAM_MAX_CLIENTS) ? (StreamClient*)calloc(1, sizeof(StreamClient)) : NULL;
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        if (epoll_ctl(st_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        st_clients[i] = c;
+        pthread_mutex_lock(&st_lock);
+        st_stats.clients++;
+        pthread_mutex_unlock(&st_lock);
+
+        uint32_t hello[2] = { BLYNK_STREAM_VERSION, st_values };
+        queue_frame(c, BLYNK_STREAM_HELLO, hello, sizeof(hello), st_names, st_values * BLYNK_STREAM_NAME_LEN);
+        pump(i);
+    }
+}
+
+#define STREAM_ID_LISTEN    (BLYNK_STREAM_MAX_CLIENTS + 0)
+#define STREAM_ID_EVENT     (BLYNK_STREAM_MAX_CLIENTS + 1)
+
+static void* stream_thread(void*)
+{
+    struct epoll_event events[32];
+    while (!st_stop) {
+        const int n = epoll_wait(st_epoll, events, 32, -1);
+        bool published = false;
+        for (int e = 0; e < n; e++) {
+            const uint64_t id = events[e].data.u64;
+            if (id == STREAM_ID_LISTEN) {
+                accept_clients();
+            } else if (id == STREAM_ID_EVENT) {
+                uint64_t v;
+                if (read(st_event, &v, sizeof(v)) > 0) published = true;
+            } else if (st_clients[id]) {
+                if ((events[e].events & (EPOLLHUP | EPOLLERR)) ||
+                    ((events[e].events & EPOLLIN) && !read_requests(st_clients[id])))
+                {
+                    close_client(id);
+                    continue;
+                }
+                pump(id);
+            }
+        }
+        if (published) {
+            for (unsigned i = 0; i < BLYNK_STREAM_MAX_CLIENTS; i++) {
+                if (st_clients[i] && !st_clients[i]->wantOut) pump(i);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Closes the sockets and frees the ring (server thread not running)
+static void release()
+{
+    for (unsigned i = 0; i < BLYNK_STREAM_MAX_CLIENTS; i++) {
+        if (st_clients[i]) close_client(i);
+    }
+    if (st_listen >= 0) { close(st_listen); unlink(st_path); }
+    if (st_event >= 0)  close(st_event);
+    if (st_epoll >= 0)  close(st_epoll);
+    st_listen = st_event = st_epoll = -1;
+
+    pthread_mutex_lock(&st_lock);
+    free(st_ring);
+    st_ring = NULL;
+    st_cap = 0;
+    pthread_mutex_unlock(&st_lock);
+}
+
+bool BlynkStreamOpen(const char* path, const char* const* names, unsigned count, size_t history)
+{
+    BlynkStreamClose();
+    if (count > BLYNK_STREAM_VALUES || strlen(path) >= sizeof(st_path) || !history) {
+        return false;
+    }
+    st_ring = (BlynkStreamSample*)calloc(history, sizeof(BlynkStreamSample));
+    if (!st_ring) {
+        return false;
+    }
+    st_cap = history;
+    st_next = 1;
+    memset(&st_stats, 0, sizeof(st_stats));
+    st_values = count;
+    memset(st_names, 0, sizeof(st_names));
+    for (unsigned i = 0; i < count; i++) {
+        strncpy(st_names[i], names[i], BLYNK_STREAM_NAME_LEN - 1);
+    }
+    strcpy(st_path, path);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    st_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    st_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    st_epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    bool ok = st_listen >= 0 && st_event >= 0 && st_epoll >= 0 &&
+              bind(st_listen, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+              listen(st_listen, 64) == 0;
+    ev.data.u64 = STREAM_ID_LISTEN;
+    ok = ok && epoll_ctl(st_epoll, EPOLL_CTL_ADD, st_listen, &ev) == 0;
+    ev.data.u64 = STREAM_ID_EVENT;
+    ok = ok && epoll_ctl(st_epoll, EPOLL_CTL_ADD, st_event, &ev) == 0;
+
+    st_stop = false;
+    if (ok && pthread_create(&st_thread, NULL, stream_thread, NULL) == 0) {
+        st_open = true;
+        return true;
+    }
+    release();
+    return false;
+}
+
+void BlynkStreamClose()
+{
+    if (!st_open) {
+        return;
+    }
+    st_stop = true;
+    const uint64_t one = 1;
+    if (write(st_event, &one, sizeof(one)) < 0) {}
+    pthread_join(st_thread, NULL);
+    release();
+    st_open = false;
+}
+
+bool BlynkStreamIsOpen()
+{
+    return st_open;
+}
+
+void BlynkStreamPublish(const float* values, unsigned count)
+{
+    if (!st_open) {
+        return;
+    }
+    pthread_mutex_lock(&st_lock);
+    if (!st_ring) {
+        pthread_mutex_unlock(&st_lock);
+        return;
+    }
+    BlynkStreamSample& s = st_ring[st_next % st_cap];
+    memset(&s, 0, sizeof(s));
+    s.seq = st_next++;
+    s.timeNs = now_ns();
+    memcpy(s.value, values, BlynkMin(count, (unsigned)BLYNK_STREAM_VALUES) * sizeof(float));
+    st_stats.published++;
+    pthread_mutex_unlock(&st_lock);
+
+    const uint64_t one = 1;
+    if (write(st_event, &one, sizeof(one)) < 0) {}
+}
+
+void BlynkStreamGetStats(BlynkStreamStats& stats)
+{
+    pthread_mutex_lock(&st_lock);
+    stats = st_stats;
+    pthread_mutex_unlock(&st_lock);
+}
+
+#endif
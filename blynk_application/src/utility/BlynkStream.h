@@ -0,0 +1,102 @@
+/**
+ * @file       BlynkStream.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Local Unix-domain-socket streaming of samples (Linux)
+ *
+ * The logger keeps recent samples in an in-memory ring and serves them
+ * on a Unix stream socket. Clients can fetch the latest sample, subscribe
+ * to new ones, or request the last N seconds.
+ *
+ * All frames are length-prefixed, in host byte order:
+ *   uint32_t length   (of type + payload)
+ *   uint8_t  type
+ *   payload
+ *
+ * Client -> server:
+ *   BLYNK_STREAM_GET_LATEST    -
+ *   BLYNK_STREAM_SUBSCRIBE     -
+ *   BLYNK_STREAM_UNSUBSCRIBE   -
+ *   BLYNK_STREAM_HISTORY       uint32_t seconds
+ *
+ * Server -> client:
+ *   BLYNK_STREAM_HELLO         uint32_t version, uint32_t values,
+ *                              char names[values][BLYNK_STREAM_NAME_LEN]
+ *   BLYNK_STREAM_SAMPLE        BlynkStreamSample, only 'values' entries of 'value'
+ *   BLYNK_STREAM_HISTORY_END   uint32_t samples sent
+ *   BLYNK_STREAM_GAP           uint64_t samples skipped (client too slow)
+ *
+ * Each client reads from the shared ring at its own position, so a slow
+ * client never delays the logger or other clients: when it falls more
+ * than the ring size behind, it skips ahead and gets a GAP frame.
+ */
+
+#ifndef BlynkStream_h
+#define BlynkStream_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLYNK_STREAM_VERSION    1
+#define BLYNK_STREAM_VALUES     16
+#define BLYNK_STREAM_NAME_LEN   16
+
+// Default socket path
+#ifndef BLYNK_STREAM_PATH
+#define BLYNK_STREAM_PATH       "/tmp/blynk-sensors.sock"
+#endif
+
+// Samples kept for history requests and slow clients
+#ifndef BLYNK_STREAM_HISTORY_SIZE
+#define BLYNK_STREAM_HISTORY_SIZE 4096
+#endif
+
+#ifndef BLYNK_STREAM_MAX_CLIENTS
+#define BLYNK_STREAM_MAX_CLIENTS 128
+#endif
+
+// Per-client send queue
+#ifndef BLYNK_STREAM_SEND_QUEUE
+#define BLYNK_STREAM_SEND_QUEUE 8192
+#endif
+
+enum BlynkStreamFrameType {
+    BLYNK_STREAM_GET_LATEST   = 0x01,
+    BLYNK_STREAM_SUBSCRIBE    = 0x02,
+    BLYNK_STREAM_UNSUBSCRIBE  = 0x03,
+    BLYNK_STREAM_HISTORY      = 0x04,
+
+    BLYNK_STREAM_HELLO        = 0x81,
+    BLYNK_STREAM_SAMPLE       = 0x82,
+    BLYNK_STREAM_HISTORY_END  = 0x83,
+    BLYNK_STREAM_GAP          = 0x84
+};
+
+struct BlynkStreamSample {
+    uint64_t seq;           // 1, 2, ... since the server was opened
+    uint64_t timeNs;        // CLOCK_REALTIME
+    float    value[BLYNK_STREAM_VALUES];
+};
+
+struct BlynkStreamStats {
+    uint32_t clients;
+    uint32_t subscribers;
+    uint64_t published;
+    uint64_t framesSent;
+    uint64_t bytesSent;
+    uint64_t gaps;          // GAP frames sent
+    uint64_t skipped;       // samples skipped by slow clients
+};
+
+// Starts the server thread. 'names' are sent to every client in HELLO.
+bool BlynkStreamOpen(const char* path, const char* const* names, unsigned count,
+                     size_t history = BLYNK_STREAM_HISTORY_SIZE);
+void BlynkStreamClose();
+bool BlynkStreamIsOpen();
+
+// Adds a sample to the ring and wakes up the server. Values are given
+// in the order of 'names'.
+void BlynkStreamPublish(const float* values, unsigned count);
+
+void BlynkStreamGetStats(BlynkStreamStats& stats);
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * @file       BlynkSync.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Paced, prioritized sync of virtual pins after connecting
+ *
+ * syncAll() makes the server send every stored widget value at once, and
+ * the device runs all those BLYNK_WRITE handlers back to back inside one
+ * run(), holding up pings and any other input. BlynkSync asks for the
+ * pins a few at a time instead:
+ *
+ *   static BlynkSync<BlynkSocket> pinSync(Blynk);
+ *
+ *   pinSync.add(V1, 10);                  // the target temperature first
+ *   for (int pin = V10; pin < V40; pin++) {
+ *       pinSync.add(pin);
+ *   }
+ *
+ *   BLYNK_CONNECTED() {
+ *       pinSync.start();                  // instead of Blynk.syncAll()
+ *   }
+ *
+ * Pins are requested by priority (higher first, then in the order they
+ * were added), BLYNK_SYNC_BATCH pins per syncVirtual() request, with at
+ * most BLYNK_SYNC_IN_FLIGHT requests unanswered, so one run() runs the
+ * handlers of no more than BATCH * IN_FLIGHT pins. Requests are sent from
+ * run() only when the message limit lets them out right away, so they
+ * never make run() wait for it.
+ *
+ * The server answers a request with a write for each pin that has a
+ * value, and nothing for the others. To know when it is done, every
+ * request is followed by a ping: the server answers in order, so the
+ * ping's response comes after the last value. A request whose ping is
+ * not answered within responseTimeout() is given up.
+ *
+ * Responses are seen through BlynkResponseHooks, so the device's own
+ * response handler stays free.
+ */
+
+#ifndef BlynkSync_h
+#define BlynkSync_h
+
+#include <stdint.h>
+#include <string.h>
+#include <Blynk/BlynkProtocol.h>
+
+// Pins that can be added
+#ifndef BLYNK_SYNC_PINS
+#define BLYNK_SYNC_PINS       128
+#endif
+
+// Pins per syncVirtual() request
+#ifndef BLYNK_SYNC_BATCH
+#define BLYNK_SYNC_BATCH      8
+#endif
+
+// Requests waiting for their answers
+#ifndef BLYNK_SYNC_IN_FLIGHT
+#define BLYNK_SYNC_IN_FLIGHT  2
+#endif
+
+struct BlynkSyncStats {
+    uint32_t requests;
+    uint32_t timeouts;          // requests given up
+    uint32_t lastDuration;      // ms from start() to the last answer
+};
+
+template <class Device>
+class BlynkSync
+{
+public:
+    explicit BlynkSync(Device& device)
+        : dev(device)
+        , count(0)
+        , next(0)
+        , flying(0)
+        , running(false)
+        , startedAt(0)
+    {
+        memset(&st, 0, sizeof(st));
+    }
+
+    // Adds a pin to sync. False if BLYNK_SYNC_PINS are added already.
+    bool add(uint8_t pin, uint8_t priority = 0) {
+        if (count >= BLYNK_SYNC_PINS) {
+            return false;
+        }
+        // After the pins of the same or a higher priority
+        unsigned i = count++;
+        for (; i > 0 && prio[i - 1] < priority; i--) {
+            pins[i] = pins[i - 1];
+            prio[i] = prio[i - 1];
+        }
+        pins[i] = pin;
+        prio[i] = priority;
+        return true;
+    }
+
+    // Starts over from the first pin; the requests go out from run()
+    void start() {
+        instance = this;
+        BlynkRunHooks::add(poll);
+        BlynkResponseHooks::add(onResponse);
+        next = 0;
+        flying = 0;
+        running = (count > 0);
+        startedAt = BlynkMillis();
+    }
+
+    // All requests answered (or given up)
+    bool done() const { return !running; }
+
+    // Pins not requested yet
+    unsigned remaining() const { return count - next; }
+
+    const BlynkSyncStats& stats() const { return st; }
+
+private:
+    struct Request {
+        uint16_t      pingId;
+        millis_time_t sentAt;
+    };
+
+    static void poll(millis_time_t now) {
+        if (instance) {
+            instance->step(now);
+        }
+    }
+
+    void step(millis_time_t now) {
+        if (!running) {
+            return;
+        }
+        const uint32_t timeout = dev.responseTimeout();
+        for (unsigned i = 0; i < flying; ) {
+            if (now - req[i].sentAt > timeout) {
+                st.timeouts++;
+                remove(i);
+            } else {
+                i++;
+            }
+        }
+        while (next < count && flying < BLYNK_SYNC_IN_FLIGHT && dev.canSend()) {
+            sendRequest();
+        }
+        finishIfDone();
+    }
+
+    void sendRequest() {
+        char mem[8 + BLYNK_SYNC_BATCH * 4];
+        BlynkParam cmd(mem, 0, sizeof(mem));
+        cmd.add("vr");
+        const unsigned end = BlynkMin(next + BLYNK_SYNC_BATCH, count);
+        for (; next < end; next++) {
+            cmd.add(pins[next]);
+        }
+        dev.sendCmd(BLYNK_CMD_HARDWARE_SYNC, 0, cmd.getBuffer(), cmd.getLength() - 1);
+        dev.sendCmd(BLYNK_CMD_PING);
+        req[flying].pingId = dev.lastMsgId();
+        req[flying].sentAt = BlynkMillis();
+        flying++;
+        st.requests++;
+    }
+
+    void remove(unsigned i) {
+        req[i] = req[--flying];
+    }
+
+    void finishIfDone() {
+        if (running && next >= count && !flying) {
+            running = false;
+            st.lastDuration = BlynkMillis() - startedAt;
+        }
+    }
+
+    void answered(uint16_t msgId) {
+        for (unsigned i = 0; i < flying; i++) {
+            if (req[i].pingId == msgId) {
+                remove(i);
+                finishIfDone();
+                return;
+            }
+        }
+    }
+
+    static void onResponse(uint16_t msgId, uint16_t) {
+        if (instance) {
+            instance->answered(msgId);
+        }
+    }
+
+    Device&        dev;
+    uint8_t        pins[BLYNK_SYNC_PINS];
+    uint8_t        prio[BLYNK_SYNC_PINS];
+    unsigned       count;
+    unsigned       next;
+    Request        req[BLYNK_SYNC_IN_FLIGHT];
+    unsigned       flying;
+    bool           running;
+    millis_time_t  startedAt;
+    BlynkSyncStats st;
+
+    static BlynkSync* instance;
+};
+
+template <class Device>
+BlynkSync<Device>* BlynkSync<Device>::instance = NULL;
+
+#endif
@@ -28,6 +28,7 @@
 
 
 #include "Blynk/BlynkTimer.h"
+#include <utility/BlynkProbes.h>
 #include <string.h>
 
 // Select time function:
@@ -97,9 +98,15 @@ void SimpleTimer::run() {
         }
     }
 
+#ifdef BLYNK_HAS_USDT
+    int called = 0;
+#endif
     for (i = 0; i < MAX_TIMERS; i++) {
         if (timer[i].toBeCalled == DEFCALL_DONTRUN)
             continue;
+#ifdef BLYNK_HAS_USDT
+        called++;
+#endif
 
         if (timer[i].hasParam)
             (*(timer_callback_p)timer[i].callback)(timer[i].param);
@@ -109,6 +116,7 @@ void SimpleTimer::run() {
         if (timer[i].toBeCalled == DEFCALL_RUNANDDEL)
             deleteTimer(i);
     }
+    BLYNK_PROBE1(timer__run, called);
 }
 
 
@@ -0,0 +1,191 @@
+/**
+ * @file       BlynkTrace.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Timeline tracing to Chrome trace JSON (Linux)
+ */
+
+#if defined(LINUX)
+
+#include <utility/BlynkTrace.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+int _blynkTraceOn = 0;
+
+struct BlynkTraceRecord {
+    uint64_t    ts;         // CLOCK_MONOTONIC, ns
+    const char* name;
+    int64_t     arg;
+    char        phase;
+};
+
+// One per thread, written only by that thread
+struct BlynkTraceBuffer {
+    BlynkTraceBuffer* next;
+    pid_t             tid;
+    const char*       name;
+    uint64_t          head;  // events ever recorded
+    BlynkTraceRecord  ev[BLYNK_TRACE_EVENTS];
+};
+
+static BlynkTraceBuffer* buffers = NULL;
+static __thread BlynkTraceBuffer* mine = NULL;
+static __thread const char* mineName = NULL;    // until the buffer exists
+
+static uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static BlynkTraceBuffer* thread_buffer()
+{
+    if (mine) return mine;
+    BlynkTraceBuffer* b = (BlynkTraceBuffer*)calloc(1, sizeof(BlynkTraceBuffer));
+    if (!b) return NULL;
+    b->tid = pid_t(syscall(SYS_gettid));
+    b->name = mineName;
+    // Buffers outlive their threads, so events of finished threads are kept
+    BlynkTraceBuffer* head = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+    do {
+        b->next = head;
+    } while (!__atomic_compare_exchange_n(&buffers, &head, b, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    mine = b;
+    return b;
+}
+
+void BlynkTraceEvent(char phase, const char* name, int64_t arg)
+{
+    BlynkTraceBuffer* b = thread_buffer();
+    if (!b) return;
+    const uint64_t h = b->head;
+    BlynkTraceRecord& e = b->ev[h % BLYNK_TRACE_EVENTS];
+    e.ts = mono_ns();
+    e.name = name;
+    e.arg = arg;
+    e.phase = phase;
+    __atomic_store_n(&b->head, h + 1, __ATOMIC_RELEASE);
+}
+
+void BlynkTraceThreadName(const char* name)
+{
+    // The buffer is allocated by the first event, if tracing is ever on
+    mineName = name;
+    if (mine) {
+        mine->name = name;
+    }
+}
+
+static void write_name(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+long BlynkTraceWrite(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    const int pid = getpid();
+    long written = 0;
+    bool first = true;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (BlynkTraceBuffer* b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+        if (b->name) {
+            fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                    first ? "" : ",\n", pid, b->tid);
+            write_name(f, b->name);
+            fprintf(f, "}}");
+            first = false;
+        }
+
+        const uint64_t h = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+        uint64_t i = (h > BLYNK_TRACE_EVENTS) ? h - BLYNK_TRACE_EVENTS : 0;
+        // End events whose begin was overwritten would confuse the viewer
+        int depth = 0;
+        for (; i < h; i++) {
+            const BlynkTraceRecord e = b->ev[i % BLYNK_TRACE_EVENTS];
+            // The thread may still be recording: skip slots overwritten meanwhile
+            const uint64_t now = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+            if (now >= i + BLYNK_TRACE_EVENTS) continue;
+
+            if (e.phase == 'B') depth++;
+            if (e.phase == 'E' && depth-- <= 0) { depth = 0; continue; }
+
+            fprintf(f, "%s{\"ph\":\"%c\",\"name\":", first ? "" : ",\n", e.phase);
+            write_name(f, e.name);
+            fprintf(f, ",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u", pid, b->tid,
+                    (unsigned long long)(e.ts / 1000), unsigned(e.ts % 1000));
+            if (e.phase == 'i') {
+                fprintf(f, ",\"s\":\"t\",\"args\":{\"arg\":%lld}", (long long)e.arg);
+            } else if (e.phase == 'C') {
+                fprintf(f, ",\"args\":{\"value\":%lld}", (long long)e.arg);
+            } else if (e.phase == 'B' && e.arg) {
+                fprintf(f, ",\"args\":{\"arg\":%lld}", (long long)e.arg);
+            }
+            fputc('}', f);
+            first = false;
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) return -1;
+    return written;
+}
+
+void BlynkTraceClear()
+{
+    for (BlynkTraceBuffer* b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+        __atomic_store_n(&b->head, 0, __ATOMIC_RELEASE);
+    }
+}
+
+uint64_t BlynkTraceDropped()
+{
+    uint64_t dropped = 0;
+    for (BlynkTraceBuffer* b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+        const uint64_t h = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+        if (h > BLYNK_TRACE_EVENTS) dropped += h - BLYNK_TRACE_EVENTS;
+    }
+    return dropped;
+}
+
+static char     tracePath[256];
+static unsigned traceSeconds;
+
+static void* trace_thread(void*)
+{
+    sleep(traceSeconds);
+    BlynkTraceEnable(false);
+    BlynkTraceWrite(tracePath);
+    return NULL;
+}
+
+bool BlynkTraceStart(const char* path, unsigned seconds)
+{
+    if (strlen(path) >= sizeof(tracePath)) return false;
+    strcpy(tracePath, path);
+    traceSeconds = seconds;
+    pthread_t t;
+    BlynkTraceEnable(true);
+    if (pthread_create(&t, NULL, trace_thread, NULL) != 0) {
+        BlynkTraceEnable(false);
+        return false;
+    }
+    pthread_detach(t);
+    return true;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file       BlynkTrace.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Timeline tracing to Chrome trace JSON (Linux)
+ *
+ * While tracing is enabled, begin/end, instant and counter events are
+ * recorded into a ring buffer owned by the calling thread, so recording
+ * takes no locks and threads never contend. BlynkTraceWrite() merges all
+ * buffers into a Chrome trace JSON file, which can be opened in
+ * ui.perfetto.dev or chrome://tracing.
+ *
+ * Event names must be string literals (or otherwise outlive the trace):
+ * only the pointer is stored.
+ *
+ * With BLYNK_USE_TRACE defined, BlynkProtocol records sending, receiving,
+ * logins, reconnects, heartbeats and rate-limit waits. run() itself is
+ * not recorded: it spins while waiting for the rate limit, and would
+ * flood the ring.
+ */
+
+#ifndef BlynkTrace_h
+#define BlynkTrace_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Events kept per thread; when full, the oldest are overwritten
+#ifndef BLYNK_TRACE_EVENTS
+#define BLYNK_TRACE_EVENTS  16384
+#endif
+
+extern int _blynkTraceOn;
+
+// Enable/disable recording. Async-signal-safe.
+static inline
+void BlynkTraceEnable(bool on)
+{
+    __atomic_store_n(&_blynkTraceOn, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+static inline
+bool BlynkTraceEnabled()
+{
+    return __atomic_load_n(&_blynkTraceOn, __ATOMIC_RELAXED);
+}
+
+// Recording, phases as in the Chrome trace format
+void BlynkTraceEvent(char phase, const char* name, int64_t arg);
+
+static inline void BlynkTraceBegin(const char* name, int64_t arg = 0)
+{
+    if (BlynkTraceEnabled()) BlynkTraceEvent('B', name, arg);
+}
+
+static inline void BlynkTraceEnd(const char* name)
+{
+    if (BlynkTraceEnabled()) BlynkTraceEvent('E', name, 0);
+}
+
+static inline void BlynkTraceInstant(const char* name, int64_t arg = 0)
+{
+    if (BlynkTraceEnabled()) BlynkTraceEvent('i', name, arg);
+}
+
+static inline void BlynkTraceCounter(const char* name, int64_t value)
+{
+    if (BlynkTraceEnabled()) BlynkTraceEvent('C', name, value);
+}
+
+// Names the calling thread in the timeline. Cheap while tracing is off:
+// the thread's ring is allocated with its first event.
+void BlynkTraceThreadName(const char* name);
+
+// Begin/end of a scope. The end is recorded if the begin was, so
+// toggling tracing never leaves unbalanced events.
+class BlynkTraceScope
+{
+public:
+    explicit BlynkTraceScope(const char* name, int64_t arg = 0)
+        : mName(BlynkTraceEnabled() ? name : NULL)
+    {
+        if (mName) BlynkTraceEvent('B', mName, arg);
+    }
+    ~BlynkTraceScope() { if (mName) BlynkTraceEvent('E', mName, 0); }
+
+private:
+    const char* mName;
+};
+
+#define BLYNK_TRACE_CONCAT2(a, b) a##b
+#define BLYNK_TRACE_CONCAT(a, b)  BLYNK_TRACE_CONCAT2(a, b)
+#define BLYNK_TRACE_SCOPE(...) BlynkTraceScope BLYNK_TRACE_CONCAT(_blynkTraceScope, __LINE__)(__VA_ARGS__)
+
+// Writes the events of all threads, oldest first. Returns events written.
+long BlynkTraceWrite(const char* path);
+
+// Drops all recorded events
+void BlynkTraceClear();
+
+// Enables tracing, and after 'seconds' disables it and writes 'path'
+// from a background thread
+bool BlynkTraceStart(const char* path, unsigned seconds);
+
+// Events lost to ring overwrites, all threads
+uint64_t BlynkTraceDropped();
+
+#endif
@@ -44,6 +44,8 @@ T BlynkMathClampMap(T x, T2 in_min, T2 in_max, T2 out_min, T2 out_max)
 }
 
 
+// Crude integer moving average, kept for compatibility.
+// See utility/BlynkStats.h for EWMA and windowed statistics.
 template <unsigned WSIZE, typename T>
 void BlynkAverageSample (T& avg, const T& input) {
     avg -= avg/WSIZE;
@@ -56,7 +58,7 @@ void BlynkAverageSample (T& avg, const T& input) {
 }
 
 static inline
-uint32_t BlynkCRC32(const void* data, size_t length, uint32_t previousCrc32 = 0)
+uint32_t BlynkCRC32Bitwise(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
   const uint32_t Polynomial = 0xEDB88320;
   uint32_t crc = ~previousCrc32;
@@ -70,6 +72,16 @@ uint32_t BlynkCRC32(const void* data, size_t length, uint32_t previousCrc32 = 0)
   return ~crc;
 }
 
+#if defined(LINUX) && !defined(BLYNK_NO_FAST_CRC32)
+  #include <utility/BlynkCRC32.h>
+#else
+static inline
+uint32_t BlynkCRC32(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  return BlynkCRC32Bitwise(data, length, previousCrc32);
+}
+#endif
+
 class BlynkHelperAutoInc {
 public:
     BlynkHelperAutoInc(uint8_t& counter) : c(counter) { ++c; }
@@ -0,0 +1,338 @@
+/**
+ * @file       BlynkWorkers.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Worker pool for BLYNK_WRITE / BLYNK_READ handlers (Linux)
+ *
+ * Each worker owns two BlynkFifo queues: jobs, written only by the
+ * protocol thread, and results, written only by the worker. The protocol
+ * thread never blocks on a full job queue: it gets BLYNK_WORKER_BUSY and
+ * sends the posted results before trying again, so a worker blocked on a
+ * full result queue always gets going again.
+ */
+
+#if defined(LINUX)
+
+#include <Blynk/BlynkDebug.h>
+#include <Blynk/BlynkProtocolDefs.h>
+#include <utility/BlynkUtility.h>
+#include <utility/BlynkFifo.h>
+#include <utility/BlynkLatency.h>
+#include <utility/BlynkWorkers.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+enum WorkerJobKind {
+    JOB_WRITE,
+    JOB_READ,
+    JOB_STOP
+};
+
+struct WorkerJob {
+    uint64_t           queuedAt;    // ns
+    WidgetWriteHandler write;
+    WidgetReadHandler  read;
+    uint16_t           msgId;
+    uint16_t           length;
+    uint8_t            kind;
+    uint8_t            pin;
+    char               data[BLYNK_WORKER_DATA + 1];  // zero-terminated
+};
+
+struct Worker {
+    BlynkFifo<WorkerJob, BLYNK_WORKER_DEPTH>         jobs;
+    BlynkFifo<BlynkWorkerResult, BLYNK_WORKER_DEPTH> results;
+    char      send[BLYNK_WORKER_DATA + 1];  // commands of its handlers are built here
+    pthread_t thread;
+    unsigned  queued;       // jobs given, written by the protocol thread
+    unsigned  done;         // jobs finished, written by the worker
+    bool      stopped;
+};
+
+static Worker   wk_workers[BLYNK_WORKER_MAX_THREADS];
+static unsigned wk_threads = 0;
+static unsigned wk_next = 0;                // result queue to look at first
+static uint32_t wk_inline[256 / 32];
+
+static BlynkWorkerStats wk_stats;
+
+static BlynkLatency wk_wait("worker.wait");
+static BlynkLatency wk_handler("worker.handler");
+
+// The worker running on this thread, and the message it is handling
+static __thread Worker*  wk_self = NULL;
+static __thread uint16_t wk_msgId = 0;
+
+static
+unsigned worker_depth(const Worker& w)
+{
+    return w.queued - __atomic_load_n(&w.done, __ATOMIC_ACQUIRE);
+}
+
+static
+void* worker_main(void* arg)
+{
+    Worker& w = *static_cast<Worker*>(arg);
+    wk_self = &w;
+    for (;;) {
+        const WorkerJob* job;
+        while (!w.jobs.readSpan(job)) {
+            w.jobs.peek();                  // sleeps until a job is queued
+        }
+        if (job->kind == JOB_STOP) {
+            w.jobs.commitRead(1);
+            break;
+        }
+
+        const uint64_t start = BlynkLatency::now();
+        wk_wait.record(start - job->queuedAt);
+        wk_msgId = job->msgId;
+
+        BlynkReq req = { job->pin };
+        if (job->kind == JOB_WRITE) {
+            BlynkParam param(job->data, job->length);
+            job->write(req, param);
+        } else {
+            job->read(req);
+        }
+        wk_msgId = 0;
+        wk_handler.record(BlynkLatency::now() - start);
+
+        w.jobs.commitRead(1);
+        __atomic_store_n(&w.done, w.done + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&w.stopped, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+bool BlynkWorkersBegin(unsigned threads)
+{
+    if (wk_threads || !threads) {
+        return false;
+    }
+    if (threads > BLYNK_WORKER_MAX_THREADS) {
+        threads = BLYNK_WORKER_MAX_THREADS;
+    }
+    memset(&wk_stats, 0, sizeof(wk_stats));
+    for (unsigned i = 0; i < threads; i++) {
+        Worker& w = wk_workers[i];
+        w.jobs.clear();
+        w.results.clear();
+        w.queued = w.done = 0;
+        w.stopped = false;
+        if (pthread_create(&w.thread, NULL, worker_main, &w)) {
+            BLYNK_LOG1(BLYNK_F("Cannot start worker thread"));
+            wk_threads = i;
+            BlynkWorkersEnd();
+            return false;
+        }
+    }
+    wk_next = 0;
+    __atomic_store_n(&wk_threads, threads, __ATOMIC_RELEASE);
+    return true;
+}
+
+void BlynkWorkersEnd()
+{
+    const unsigned threads = wk_threads;
+    __atomic_store_n(&wk_threads, 0, __ATOMIC_RELEASE);
+
+    // Results nobody will send are discarded, so no worker stays blocked
+    for (unsigned i = 0; i < threads; i++) {
+        Worker& w = wk_workers[i];
+        WorkerJob* job;
+        while (!w.jobs.writeSpan(job)) {
+            w.results.commitRead(w.results.size());
+            usleep(1000);
+        }
+        job->kind = JOB_STOP;
+        w.jobs.commitWrite(1);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        Worker& w = wk_workers[i];
+        while (!__atomic_load_n(&w.stopped, __ATOMIC_ACQUIRE)) {
+            w.results.commitRead(w.results.size());
+            usleep(1000);
+        }
+        pthread_join(w.thread, NULL);
+    }
+}
+
+bool BlynkWorkersRunning()
+{
+    return __atomic_load_n(&wk_threads, __ATOMIC_ACQUIRE) != 0;
+}
+
+void BlynkWorkersSetInline(uint8_t pin, bool inl)
+{
+    if (inl) {
+        wk_inline[pin / 32] |= (1UL << (pin % 32));
+    } else {
+        wk_inline[pin / 32] &= ~(1UL << (pin % 32));
+    }
+}
+
+// Reserves a job slot on the worker of 'pin', or says why there is none
+static
+BlynkWorkerDispatch worker_job(uint8_t pin, size_t length, WorkerJob*& job, Worker*& worker)
+{
+    if (!wk_threads || (wk_inline[pin / 32] & (1UL << (pin % 32)))) {
+        return BLYNK_WORKER_INLINE;
+    }
+    Worker& w = wk_workers[pin % wk_threads];
+    if (length > BLYNK_WORKER_DATA) {
+        // Still keeps the order of this pin's handlers
+        if (worker_depth(w)) {
+            wk_stats.busy++;
+            return BLYNK_WORKER_BUSY;
+        }
+        wk_stats.inlined++;
+        return BLYNK_WORKER_INLINE;
+    }
+    if (!w.jobs.writeSpan(job)) {
+        wk_stats.busy++;
+        return BLYNK_WORKER_BUSY;
+    }
+    worker = &w;
+    return BLYNK_WORKER_QUEUED;
+}
+
+static
+void worker_commit(Worker& w)
+{
+    w.queued++;
+    w.jobs.commitWrite(1);
+    wk_stats.queued++;
+    const unsigned depth = worker_depth(w);
+    if (depth > wk_stats.maxDepth) {
+        wk_stats.maxDepth = depth;
+    }
+}
+
+BlynkWorkerDispatch BlynkWorkersWrite(WidgetWriteHandler handler, uint8_t pin, uint16_t msgId, const BlynkParam& param)
+{
+    WorkerJob* job = NULL;
+    Worker* w = NULL;
+    const BlynkWorkerDispatch res = worker_job(pin, param.getLength(), job, w);
+    if (res != BLYNK_WORKER_QUEUED) {
+        return res;
+    }
+    job->queuedAt = BlynkLatency::now();
+    job->write = handler;
+    job->msgId = msgId;
+    job->length = param.getLength();
+    job->kind = JOB_WRITE;
+    job->pin = pin;
+    memcpy(job->data, param.getBuffer(), job->length);
+    job->data[job->length] = '\0';
+    worker_commit(*w);
+    return BLYNK_WORKER_QUEUED;
+}
+
+BlynkWorkerDispatch BlynkWorkersRead(WidgetReadHandler handler, uint8_t pin, uint16_t msgId)
+{
+    WorkerJob* job = NULL;
+    Worker* w = NULL;
+    const BlynkWorkerDispatch res = worker_job(pin, 0, job, w);
+    if (res != BLYNK_WORKER_QUEUED) {
+        return res;
+    }
+    job->queuedAt = BlynkLatency::now();
+    job->read = handler;
+    job->msgId = msgId;
+    job->length = 0;
+    job->kind = JOB_READ;
+    job->pin = pin;
+    worker_commit(*w);
+    return BLYNK_WORKER_QUEUED;
+}
+
+static
+void fill_result(BlynkWorkerResult& r, uint8_t cmd, uint16_t id, const void* data, size_t length,
+                 const void* data2, size_t length2)
+{
+    r.cmd = cmd;
+    r.id = id ? id : wk_msgId;
+    r.length = length + length2;
+    if (length)  memcpy(r.data, data, length);
+    if (length2) memcpy(r.data + length, data2, length2);
+}
+
+bool BlynkWorkersPost(uint8_t cmd, uint16_t id, const void* data, size_t length,
+                      const void* data2, size_t length2)
+{
+    Worker* w = wk_self;
+    if (!w) {
+        return false;
+    }
+    if (!data)  length = 0;
+    if (!data2) length2 = 0;
+    if (length + length2 > BLYNK_WORKER_DATA) {
+        __atomic_fetch_add(&wk_stats.resultsDropped, 1, __ATOMIC_RELAXED);
+        BLYNK_LOG2(BLYNK_F("Worker result too big, dropped: cmd "), cmd);
+        return true;
+    }
+
+    BlynkWorkerResult* r;
+    if (w->results.writeSpan(r)) {
+        fill_result(*r, cmd, id, data, length, data2, length2);
+        w->results.commitWrite(1);
+    } else {
+        // Sleeps until run() takes one
+        BlynkWorkerResult full;
+        fill_result(full, cmd, id, data, length, data2, length2);
+        w->results.put(full);
+    }
+    __atomic_fetch_add(&wk_stats.posted, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+char* BlynkWorkersSendBuffer()
+{
+    Worker* w = wk_self;
+    return w ? w->send : NULL;
+}
+
+bool BlynkWorkersTake(BlynkWorkerResult& result)
+{
+    const unsigned threads = wk_threads;
+    for (unsigned i = 0; i < threads; i++) {
+        const unsigned n = (wk_next + i) % threads;
+        Worker& w = wk_workers[n];
+        const BlynkWorkerResult* r;
+        if (w.results.readSpan(r)) {
+            result.cmd = r->cmd;
+            result.id = r->id;
+            result.length = r->length;
+            memcpy(result.data, r->data, r->length);
+            w.results.commitRead(1);
+            wk_next = (n + 1) % threads;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BlynkWorkersIdle()
+{
+    for (unsigned i = 0; i < wk_threads; i++) {
+        if (worker_depth(wk_workers[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BlynkWorkersGetStats(BlynkWorkerStats& stats)
+{
+    stats = wk_stats;
+    stats.posted = __atomic_load_n(&wk_stats.posted, __ATOMIC_RELAXED);
+    stats.resultsDropped = __atomic_load_n(&wk_stats.resultsDropped, __ATOMIC_RELAXED);
+    stats.depth = 0;
+    for (unsigned i = 0; i < wk_threads; i++) {
+        stats.depth += worker_depth(wk_workers[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file       BlynkWorkers.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Worker pool for BLYNK_WRITE / BLYNK_READ handlers (Linux)
+ *
+ * With BLYNK_USE_WORKERS defined and BlynkWorkersBegin() called, virtual
+ * pin handlers run on a small pool of threads instead of inside run(), so
+ * a handler that waits for I2C, SPI or a file does not hold up pings and
+ * other pins.
+ *
+ * Every pin is served by one worker (pin % threads), through a lock-free
+ * single-producer / single-consumer queue, so the handlers of one pin run
+ * one at a time and in the order the commands arrived. Handlers of pins on
+ * different workers run in parallel.
+ *
+ * Commands a handler sends (virtualWrite, setProperty, ...) are posted
+ * back through a second lock-free queue per worker and written by run(),
+ * with the message id of the request, as if the handler had run inline.
+ * A handler on a worker must not call run() itself, and shares any other
+ * state with the main thread at its own risk.
+ *
+ * The time jobs wait in the queue and spend in the handler is recorded in
+ * the "worker.wait" and "worker.handler" latency stages.
+ */
+
+#ifndef BlynkWorkers_h
+#define BlynkWorkers_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Blynk/BlynkParam.h>
+#include <Blynk/BlynkHandlers.h>
+
+// Threads in the pool
+#ifndef BLYNK_WORKER_THREADS
+#define BLYNK_WORKER_THREADS  2
+#endif
+
+// Jobs, and results, queued per worker
+#ifndef BLYNK_WORKER_DEPTH
+#define BLYNK_WORKER_DEPTH    32
+#endif
+
+// Longest value passed to a handler, and longest command it may send.
+// A longer value is handled inline, once its worker is idle.
+#ifndef BLYNK_WORKER_DATA
+#define BLYNK_WORKER_DATA     256
+#endif
+
+#ifndef BLYNK_WORKER_MAX_THREADS
+#define BLYNK_WORKER_MAX_THREADS 8
+#endif
+
+struct BlynkWorkerResult {
+    uint8_t  cmd;
+    uint16_t id;
+    uint16_t length;
+    char     data[BLYNK_WORKER_DATA];
+};
+
+enum BlynkWorkerDispatch {
+    BLYNK_WORKER_INLINE,        // run the handler on this thread
+    BLYNK_WORKER_QUEUED,
+    BLYNK_WORKER_BUSY           // send the posted results and try again
+};
+
+struct BlynkWorkerStats {
+    uint32_t queued;            // handler calls given to a worker
+    uint32_t inlined;           // run inline, because the value was too long
+    uint32_t busy;              // dispatches refused because a queue was full
+    uint32_t posted;            // commands posted back by handlers
+    uint32_t resultsDropped;    // commands too long to post back
+    uint32_t depth;             // jobs queued or running now, all workers
+    uint32_t maxDepth;          // most jobs queued or running on one worker
+};
+
+// Starts the pool; handlers run inline until it is started
+bool BlynkWorkersBegin(unsigned threads = BLYNK_WORKER_THREADS);
+// Runs the jobs queued so far, then stops the threads
+void BlynkWorkersEnd();
+bool BlynkWorkersRunning();
+
+// Keeps the handlers of 'pin' on the protocol thread (e.g. trivial ones)
+void BlynkWorkersSetInline(uint8_t pin, bool inl = true);
+
+// Protocol thread: queues a handler call for the worker of 'pin'
+BlynkWorkerDispatch BlynkWorkersWrite(WidgetWriteHandler handler, uint8_t pin, uint16_t msgId, const BlynkParam& param);
+BlynkWorkerDispatch BlynkWorkersRead(WidgetReadHandler handler, uint8_t pin, uint16_t msgId);
+
+// Called by sendCmd(): on a worker thread, queues the command for run()
+// and returns true; elsewhere returns false.
+bool BlynkWorkersPost(uint8_t cmd, uint16_t id, const void* data, size_t length,
+                      const void* data2, size_t length2);
+
+// On a worker thread: a buffer of BLYNK_WORKER_DATA + 1 bytes of its own,
+// to build the commands its handlers send. NULL on other threads, which
+// use the frame buffers of the connection.
+char* BlynkWorkersSendBuffer();
+
+// Protocol thread: takes the next command posted by a handler
+bool BlynkWorkersTake(BlynkWorkerResult& result);
+
+// True when no handler is queued or running
+bool BlynkWorkersIdle();
+
+void BlynkWorkersGetStats(BlynkWorkerStats& stats);
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * @file       BlynkAllocTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Scripted sessions that must not allocate in steady state
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkAllocTest
+ *
+ * Each session runs a few warm-up iterations, then fails if any further
+ * iteration touches the heap, printing the allocation sites.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+#include "BlynkAllocTrack.h"
+#include <BlynkSocket.h>
+
+#include <utility/BlynkLatency.h>
+#include <utility/BlynkPeriodic.h>
+#include <utility/BlynkTrace.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static BlynkStaticTransport transp;
+static BlynkStaticDevice Blynk(transp);
+static BlynkTimer timer;
+
+static int written = 0;
+static int reads = 0;
+static int ticks = 0;
+
+BLYNK_WRITE(V5)
+{
+    written = param.asInt();
+}
+
+BLYNK_READ(V6)
+{
+    Blynk.virtualWrite(V6, ++reads);
+}
+
+static void run_until_connected()
+{
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        if (!Blynk.connected()) usleep(1000);
+    }
+    CHECK(Blynk.connected());
+}
+
+// Server commands in, widget updates out
+static void test_protocol()
+{
+    const char vw[] = "vw\0" "5\0" "42";
+    const char vr[] = "vr\0" "6";
+    const char rtc[] = "rtc\0" "1514764800";
+    timer.setInterval(1L, []() { ticks++; });
+
+    const unsigned long n = BlynkAllocSteadyState("protocol", 10, 1000, [&]() {
+        transp.clearOutput();
+        transp.send(BLYNK_CMD_HARDWARE, 10, vw, sizeof(vw) - 1);
+        transp.send(BLYNK_CMD_HARDWARE, 11, vr, sizeof(vr) - 1);
+        transp.send(BLYNK_CMD_INTERNAL, 12, rtc, sizeof(rtc) - 1);
+        transp.send(BLYNK_CMD_PING, 13, NULL, 0);
+        Blynk.run();
+
+        Blynk.virtualWrite(V1, 21.5f);
+        Blynk.virtualWrite(V2, "12:00:00", 512, 3.3);
+        BlynkParamFixed<64> labels;
+        labels.add("low");
+        labels.add("high");
+        Blynk.setProperty(V3, "labels", labels);
+        Blynk.syncVirtual(V5);
+        Blynk.notify("alarm");
+        timer.run();
+    });
+    CHECK(written == 42);
+    CHECK(reads == 1010);
+    CHECK(n == 0);
+}
+
+// Link lost and logged in again
+static void test_reconnect()
+{
+    const unsigned long n = BlynkAllocSteadyState("reconnect", 2, 100, []() {
+        transp.dropLink();
+        Blynk.run();
+        CHECK(!Blynk.connected());
+        Blynk.reconnectNow();
+        run_until_connected();
+    });
+    CHECK(n == 0);
+}
+
+// Server moves the device elsewhere; even the first redirect must not allocate
+static void test_redirect()
+{
+    const char redirect[] = "127.0.0.1\0" "8442";
+    const unsigned long n = BlynkAllocSteadyState("redirect", 0, 100, [&]() {
+        transp.send(BLYNK_CMD_REDIRECT, 20, redirect, sizeof(redirect) - 1);
+        Blynk.run();
+        CHECK(!Blynk.connected());
+        run_until_connected();
+    });
+    CHECK(n == 0);
+}
+
+// One sampling pass of linux/main.cpp, minus the hardware
+static void test_sampling()
+{
+    static BlynkLatency adc("alloc.adc");
+    static BlynkLatency format("alloc.format");
+    static BlynkLatency publish("alloc.virtualWrite");
+    BlynkTraceEnable(true);
+    BlynkPeriodic sampler;
+    sampler.start(1000000ULL);
+
+    unsigned sample = 0;
+    const unsigned long n = BlynkAllocSteadyState("sampling loop", 10, 200, [&]() {
+        BlynkLatencyTimer stage;
+        BlynkTraceBegin("sample");
+        const float humidity = (sample % 1024) / 1023.0f * 3.3f;
+        const float temperature = 20.0f + (sample % 50) / 10.0f;
+        const int light = sample % 1024;
+        stage.lap(adc);
+
+        char buffer[80];
+        snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d\t%1.2f V\t\t%2.2f C\t%4d",
+                 sample / 3600 % 24, sample / 60 % 60, sample % 60, humidity, temperature, light);
+        stage.lap(format);
+
+        transp.clearOutput();
+        Blynk.virtualWrite(0, buffer);
+        Blynk.virtualWrite(1, temperature);
+        Blynk.virtualWrite(2, humidity);
+        Blynk.virtualWrite(4, light);
+        stage.lap(publish);
+        BlynkTraceEnd("sample");
+        sample++;
+        sampler.wait();
+    });
+    BlynkTraceEnable(false);
+    CHECK(publish.count() == 210);
+    CHECK(n == 0);
+}
+
+/*
+ * The socket transport, against a local server
+ */
+
+class SocketDevice
+    : public BlynkSocket
+{
+public:
+    SocketDevice(BlynkTransportSocket& transp)
+        : BlynkSocket(transp)
+    {}
+
+    // Skips the 5s pause before the next connection attempt
+    void reconnectNow(const char* auth) {
+        BlynkProtocol<BlynkTransportSocket>::begin(auth);
+    }
+};
+
+static int listener = -1;
+
+// Accepts one connection at a time, answers the login and waits for the close
+static void* local_server(void*)
+{
+    for (;;) {
+        const int c = accept(listener, NULL, NULL);
+        if (c < 0) break;
+        BlynkHeader hdr;
+        char body[64];
+        if (read(c, &hdr, sizeof(hdr)) == sizeof(hdr) && ntohs(hdr.length) <= sizeof(body) &&
+            read(c, body, ntohs(hdr.length)) == ntohs(hdr.length))
+        {
+            const BlynkHeader rsp = { BLYNK_CMD_RESPONSE, hdr.msg_id, htons(BLYNK_SUCCESS) };
+            CHECK(write(c, &rsp, sizeof(rsp)) == sizeof(rsp));
+        }
+        while (read(c, body, sizeof(body)) > 0) {}
+        close(c);
+    }
+    return NULL;
+}
+
+static void test_socket()
+{
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(listener, 4) == 0);
+    socklen_t len = sizeof(addr);
+    getsockname(listener, (struct sockaddr*)&addr, &len);
+    pthread_t server;
+    pthread_create(&server, NULL, local_server, NULL);
+
+    static BlynkTransportSocket sockTransp;
+    static SocketDevice dev(sockTransp);
+    dev.begin("token", "localhost", ntohs(addr.sin_port));
+
+    const unsigned long n = BlynkAllocSteadyState("socket reconnect", 2, 10, []() {
+        dev.reconnectNow("token");
+        CHECK(dev.connect(2000));
+    });
+    dev.disconnect();
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+    pthread_join(server, NULL);
+    CHECK(n == 0);
+}
+
+// The harness itself: an allocating path is caught and attributed
+static void test_detection()
+{
+    const unsigned long n = BlynkAllocSteadyState("BlynkParamAllocated (allocates on purpose)", 0, 3, []() {
+        BlynkParamAllocated items(128);
+        items.add("one");
+        Blynk.setProperty(V3, "labels", items);
+    });
+    CHECK(n == 3);
+    CHECK(_blynkAllocSiteCount == 1);
+    CHECK(_blynkAllocSites[0].count == 3 && _blynkAllocSites[0].bytes == 3 * 128);
+}
+
+int main()
+{
+    Blynk.begin("token");
+    run_until_connected();
+
+    test_protocol();
+    test_reconnect();
+    test_redirect();
+    test_sampling();
+    test_socket();
+    test_detection();
+    return 0;
+}
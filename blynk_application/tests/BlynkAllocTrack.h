@@ -0,0 +1,219 @@
+/**
+ * @file       BlynkAllocTrack.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Heap allocation tracking for tests
+ *
+ * Replaces malloc/calloc/realloc/free and operator new/delete for the
+ * whole test program (include it in exactly one file). Allocations are
+ * always counted; between BlynkAllocTrackStart() and BlynkAllocTrackStop()
+ * each one is also attributed to its call stack, so a test can show where
+ * an unexpected allocation came from:
+ *
+ *   const unsigned long n = BlynkAllocSteadyState("session", 10, 1000, step);
+ *   CHECK(n == 0);     // prints the allocation sites if there were any
+ *
+ * Stack traces are symbolized with backtrace_symbols_fd(); link with
+ * -rdynamic to see function names (addr2line -f -C -e <binary> <addr>
+ * resolves the rest).
+ */
+
+#ifndef BlynkAllocTrack_h
+#define BlynkAllocTrack_h
+
+#include <execinfo.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef BLYNK_ALLOC_DEPTH
+#define BLYNK_ALLOC_DEPTH 16
+#endif
+
+#ifndef BLYNK_ALLOC_SITES
+#define BLYNK_ALLOC_SITES 64
+#endif
+
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void  __libc_free(void*);
+}
+
+struct BlynkAllocSite {
+    const char*   kind;
+    int           depth;
+    void*         stack[BLYNK_ALLOC_DEPTH];
+    unsigned long count;
+    unsigned long bytes;
+};
+
+static unsigned long   _blynkAllocCount = 0;
+static unsigned long   _blynkAllocBytes = 0;
+static unsigned long   _blynkFreeCount = 0;
+static bool            _blynkAllocTracking = false;
+static int             _blynkAllocLock = 0;
+static BlynkAllocSite  _blynkAllocSites[BLYNK_ALLOC_SITES];
+static unsigned        _blynkAllocSiteCount = 0;
+static unsigned long   _blynkAllocUnrecorded = 0;
+static __thread int    _blynkAllocInHook = 0;
+
+// Total number of allocations and bytes since the program started
+inline unsigned long BlynkAllocCount() { return __atomic_load_n(&_blynkAllocCount, __ATOMIC_RELAXED); }
+inline unsigned long BlynkAllocBytes() { return __atomic_load_n(&_blynkAllocBytes, __ATOMIC_RELAXED); }
+inline unsigned long BlynkFreeCount()  { return __atomic_load_n(&_blynkFreeCount, __ATOMIC_RELAXED); }
+
+__attribute__((noinline))
+static void _blynkAllocRecord(const char* kind, size_t size)
+{
+    __atomic_fetch_add(&_blynkAllocCount, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_blynkAllocBytes, size, __ATOMIC_RELAXED);
+    if (!__atomic_load_n(&_blynkAllocTracking, __ATOMIC_RELAXED) || _blynkAllocInHook) {
+        return;
+    }
+    _blynkAllocInHook = 1;
+
+    // Skips this function; the hook may be inlined into its caller
+    void* frames[BLYNK_ALLOC_DEPTH + 1];
+    int depth = backtrace(frames, BLYNK_ALLOC_DEPTH + 1) - 1;
+    if (depth < 0) depth = 0;
+
+    while (__atomic_exchange_n(&_blynkAllocLock, 1, __ATOMIC_ACQUIRE)) {}
+    BlynkAllocSite* site = NULL;
+    for (unsigned i = 0; i < _blynkAllocSiteCount; i++) {
+        BlynkAllocSite& s = _blynkAllocSites[i];
+        if (s.kind == kind && s.depth == depth && !memcmp(s.stack, frames + 1, depth * sizeof(void*))) {
+            site = &s;
+            break;
+        }
+    }
+    if (!site && _blynkAllocSiteCount < BLYNK_ALLOC_SITES) {
+        site = &_blynkAllocSites[_blynkAllocSiteCount++];
+        site->kind = kind;
+        site->depth = depth;
+        memcpy(site->stack, frames + 1, depth * sizeof(void*));
+        site->count = site->bytes = 0;
+    }
+    if (site) {
+        site->count++;
+        site->bytes += size;
+    } else {
+        _blynkAllocUnrecorded++;
+    }
+    __atomic_store_n(&_blynkAllocLock, 0, __ATOMIC_RELEASE);
+
+    _blynkAllocInHook = 0;
+}
+
+// Starts attributing allocations to call stacks, forgetting earlier ones
+inline void BlynkAllocTrackStart()
+{
+    // backtrace() allocates when it is first used
+    void* frames[2];
+    _blynkAllocInHook = 1;
+    backtrace(frames, 2);
+    _blynkAllocInHook = 0;
+
+    _blynkAllocSiteCount = 0;
+    _blynkAllocUnrecorded = 0;
+    __atomic_store_n(&_blynkAllocTracking, true, __ATOMIC_RELEASE);
+}
+
+inline void BlynkAllocTrackStop()
+{
+    __atomic_store_n(&_blynkAllocTracking, false, __ATOMIC_RELEASE);
+}
+
+// Prints the sites recorded since BlynkAllocTrackStart(), most bytes first
+inline void BlynkAllocReport(FILE* out)
+{
+    BlynkAllocTrackStop();
+    unsigned long count = 0, bytes = 0;
+    for (unsigned i = 0; i < _blynkAllocSiteCount; i++) {
+        count += _blynkAllocSites[i].count;
+        bytes += _blynkAllocSites[i].bytes;
+    }
+    fprintf(out, "%lu allocations, %lu bytes, from %u sites\n", count, bytes, _blynkAllocSiteCount);
+
+    bool shown[BLYNK_ALLOC_SITES] = { false };
+    for (unsigned n = 0; n < _blynkAllocSiteCount; n++) {
+        int top = -1;
+        for (unsigned i = 0; i < _blynkAllocSiteCount; i++) {
+            if (!shown[i] && (top < 0 || _blynkAllocSites[i].bytes > _blynkAllocSites[top].bytes)) {
+                top = i;
+            }
+        }
+        const BlynkAllocSite& s = _blynkAllocSites[top];
+        shown[top] = true;
+        fprintf(out, "  %s: %lu allocations, %lu bytes\n", s.kind, s.count, s.bytes);
+        fflush(out);
+        backtrace_symbols_fd(s.stack, s.depth, fileno(out));
+    }
+    if (_blynkAllocUnrecorded) {
+        fprintf(out, "  (%lu more allocations from other sites)\n", _blynkAllocUnrecorded);
+    }
+    fflush(out);
+}
+
+// Runs 'step' 'warmup' times, then 'iterations' times while tracking.
+// Returns the number of allocations in the tracked iterations, and prints
+// where they came from if there were any.
+template <typename F>
+unsigned long BlynkAllocSteadyState(const char* name, unsigned warmup, unsigned iterations, F step)
+{
+    for (unsigned i = 0; i < warmup; i++) {
+        step();
+    }
+    BlynkAllocTrackStart();
+    const unsigned long count = BlynkAllocCount();
+    const unsigned long bytes = BlynkAllocBytes();
+    for (unsigned i = 0; i < iterations; i++) {
+        step();
+    }
+    BlynkAllocTrackStop();
+    const unsigned long allocated = BlynkAllocCount() - count;
+    printf("%s: %lu allocations, %lu bytes in %u iterations\n",
+           name, allocated, BlynkAllocBytes() - bytes, iterations);
+    if (allocated) {
+        BlynkAllocReport(stdout);
+    }
+    return allocated;
+}
+
+extern "C" {
+    void* malloc(size_t n)            { _blynkAllocRecord("malloc", n); return __libc_malloc(n); }
+    void* calloc(size_t n, size_t s)  { _blynkAllocRecord("calloc", n * s); return __libc_calloc(n, s); }
+    void* realloc(void* p, size_t n)  { _blynkAllocRecord("realloc", n); return __libc_realloc(p, n); }
+    void  free(void* p) {
+        if (p) __atomic_fetch_add(&_blynkFreeCount, 1, __ATOMIC_RELAXED);
+        __libc_free(p);
+    }
+}
+
+static inline void* _blynkAllocNew(const char* kind, size_t n)
+{
+    _blynkAllocRecord(kind, n);
+    void* p = __libc_malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t n)                                 { return _blynkAllocNew("new", n); }
+void* operator new[](size_t n)                               { return _blynkAllocNew("new[]", n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+    _blynkAllocRecord("new", n);
+    return __libc_malloc(n ? n : 1);
+}
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+    _blynkAllocRecord("new[]", n);
+    return __libc_malloc(n ? n : 1);
+}
+void operator delete(void* p) noexcept                         { free(p); }
+void operator delete[](void* p) noexcept                       { free(p); }
+void operator delete(void* p, size_t) noexcept                 { free(p); }
+void operator delete[](void* p, size_t) noexcept               { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept  { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file       BlynkCRC32Test.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      CRC-32 engines: equivalence with the bitwise reference and throughput
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkCRC32Test           # equivalence test
+ *   ../tests/BlynkCRC32Test --bench   # GB/s for every engine
+ */
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkUtility.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BlynkTestCheck.h"
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void test_engine(BlynkCRC32Engine e, const uint8_t* buf, size_t size)
+{
+    CHECK(BlynkCRC32With(e, "123456789", 9) == 0xCBF43926);
+    CHECK(BlynkCRC32With(e, NULL, 0, 0x12345678) == 0x12345678);
+
+    unsigned seed = 7;
+    for (int i = 0; i < 20000; i++) {
+        // Random offset (alignment), length and split point
+        const size_t off = rand_r(&seed) % 64;
+        const size_t len = (i < 600) ? i : rand_r(&seed) % (size - off);
+        const size_t split = len ? rand_r(&seed) % len : 0;
+        const uint32_t prev = (i & 1) ? rand_r(&seed) : 0;
+        const uint32_t ref = BlynkCRC32Bitwise(buf + off, len, prev);
+        CHECK(BlynkCRC32With(e, buf + off, len, prev) == ref);
+        const uint32_t part = BlynkCRC32With(e, buf + off, split, prev);
+        CHECK(BlynkCRC32With(e, buf + off + split, len - split, part) == ref);
+    }
+    printf("%-12s OK\n", BlynkCRC32Name(e));
+}
+
+static void bench_engine(BlynkCRC32Engine e, const uint8_t* buf, size_t len)
+{
+    // Run for ~0.3s
+    const size_t total = (e == BLYNK_CRC32_BITWISE) ? (32UL << 20) : (1UL << 30);
+    const size_t iters = total / len;
+    uint32_t crc = 0;
+    const double t = now_s();
+    for (size_t i = 0; i < iters; i++) {
+        crc = BlynkCRC32With(e, buf, len, crc);
+    }
+    const double dt = now_s() - t;
+    printf("  %-12s %8lu B: %7.2f GB/s  (%08x)\n", BlynkCRC32Name(e),
+           (unsigned long)len, iters * len / dt / 1e9, crc);
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t size = 1 << 20;
+    uint8_t* buf = (uint8_t*)malloc(size);
+    unsigned seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = rand_r(&seed);
+    }
+
+    printf("selected: %s\n", BlynkCRC32Name(BlynkCRC32Selected()));
+    CHECK(BlynkCRC32(buf, size) == BlynkCRC32Bitwise(buf, size));
+
+    for (int e = 0; e < BLYNK_CRC32_ENGINES; e++) {
+        if (BlynkCRC32Supported(BlynkCRC32Engine(e))) {
+            test_engine(BlynkCRC32Engine(e), buf, 4096);
+        } else {
+            printf("%-12s not supported\n", BlynkCRC32Name(BlynkCRC32Engine(e)));
+        }
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        const size_t lens[] = { 64, 1024, 65536, size };
+        for (unsigned l = 0; l < sizeof(lens)/sizeof(lens[0]); l++) {
+            for (int e = 0; e < BLYNK_CRC32_ENGINES; e++) {
+                if (BlynkCRC32Supported(BlynkCRC32Engine(e))) {
+                    bench_engine(BlynkCRC32Engine(e), buf, lens[l]);
+                }
+            }
+        }
+    }
+
+    free(buf);
+    return 0;
+}
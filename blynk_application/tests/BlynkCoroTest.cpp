@@ -0,0 +1,300 @@
+/**
+ * @file       BlynkCoroTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Coroutine sessions: awaitables, frame pool, no steady-state allocations,
+ *             use together with BlynkSync
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkCoroTest
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+#include "BlynkAllocTrack.h"
+#include <utility/BlynkCoro.h>
+#include <utility/BlynkSync.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static BlynkStaticTransport transp;
+static BlynkStaticDevice Blynk(transp);
+static BlynkCoroLoop<BlynkStaticDevice> loop(Blynk);
+
+static int handlerWrites = 0;
+
+BLYNK_WRITE(V2)
+{
+    handlerWrites++;
+}
+
+static void send_vw(uint16_t id, int pin, int value)
+{
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "vw%c%d%c%d", 0, pin, 0, value);
+    transp.send(BLYNK_CMD_HARDWARE, id, buf, len);
+}
+
+// Finds the next frame of 'type' written by the device, from 'pos'
+static bool next_frame(size_t& pos, uint8_t type, BlynkHeader& hdr, const uint8_t*& body)
+{
+    while (transp.frame(pos, hdr, body)) {
+        if (hdr.type == type) return true;
+    }
+    return false;
+}
+
+static void run_for(unsigned ms)
+{
+    const millis_time_t end = BlynkMillis() + ms;
+    while (int32_t(BlynkMillis() - end) < 0) {
+        loop.run();
+        usleep(500);
+    }
+}
+
+/*
+ * Connect, sync, wait for the value and the response, then publish
+ */
+
+static int target = 0;
+static int notifyCode = 0;
+static unsigned published = 0;
+static millis_time_t publishedAt[5];
+static bool sessionDone = false;
+
+static BlynkTask session()
+{
+    co_await loop.connected();
+    Blynk.syncVirtual(V1);
+    target = (co_await loop.write(V1)).asInt();
+
+    Blynk.notify("ready");
+    notifyCode = co_await loop.response(Blynk.lastMsgId(), 1000);
+
+    millis_time_t next = BlynkMillis();
+    for (published = 0; published < 5; published++) {
+        Blynk.virtualWrite(V2, target + published);
+        publishedAt[published] = BlynkMillis();
+        co_await loop.sleepUntil(next += 20);
+    }
+    sessionDone = true;
+}
+
+static void test_session()
+{
+    transp.clearOutput();
+    CHECK(loop.spawn(session()));
+    CHECK(loop.waiting() == 1);                 // not connected yet
+
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        loop.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+    loop.run();
+
+    // The sync request went out; answer it like the server would
+    size_t pos = 0;
+    BlynkHeader hdr;
+    const uint8_t* body;
+    CHECK(next_frame(pos, BLYNK_CMD_HARDWARE_SYNC, hdr, body));
+    CHECK(target == 0);
+    send_vw(100, 1, 42);
+    loop.run();
+    CHECK(target == 42);
+
+    CHECK(next_frame(pos, BLYNK_CMD_NOTIFY, hdr, body));
+    CHECK(notifyCode == 0);
+    transp.send(BLYNK_CMD_RESPONSE, hdr.msg_id, NULL, 0, BLYNK_SUCCESS);
+    loop.run();
+    CHECK(notifyCode == BLYNK_SUCCESS);
+
+    run_for(150);
+    CHECK(sessionDone && published == 5);
+    for (int i = 1; i < 5; i++) {
+        const int32_t gap = publishedAt[i] - publishedAt[i - 1];
+        CHECK(gap >= 15 && gap <= 30);
+    }
+    CHECK(BlynkCoroFrames::used() == 0);        // the frame went back to the pool
+    printf("session: OK\n");
+}
+
+/*
+ * Response timeout; a write taken by a coroutine skips BLYNK_WRITE
+ */
+
+static int timeoutCode = 0;
+static int awaitedValue = 0;
+
+static BlynkTask await_timeout()
+{
+    timeoutCode = co_await loop.response(0xFFF0, 30);
+}
+
+static BlynkTask await_v2()
+{
+    awaitedValue = (co_await loop.write(V2)).asInt();
+}
+
+static void test_timeout_and_writes()
+{
+    CHECK(loop.spawn(await_timeout()));
+    run_for(10);
+    CHECK(timeoutCode == 0);
+    run_for(40);
+    CHECK(timeoutCode == BLYNK_CORO_TIMEOUT);
+
+    handlerWrites = 0;
+    CHECK(loop.spawn(await_v2()));
+    send_vw(101, 2, 7);
+    loop.run();
+    CHECK(awaitedValue == 7 && handlerWrites == 0);
+    send_vw(102, 2, 8);
+    loop.run();
+    CHECK(awaitedValue == 7 && handlerWrites == 1);
+    CHECK(loop.waiting() == 0);
+    printf("timeout and writes: OK\n");
+}
+
+/*
+ * Frame pool limits
+ */
+
+static BlynkTask sleeper(uint32_t ms)
+{
+    co_await loop.sleep(ms);
+}
+
+static void test_frame_pool()
+{
+    const unsigned failed = BlynkCoroFrames::failed();
+    for (int i = 0; i < BLYNK_CORO_FRAMES; i++) {
+        CHECK(loop.spawn(sleeper(10)));
+    }
+    CHECK(BlynkCoroFrames::used() == BLYNK_CORO_FRAMES);
+    CHECK(!loop.spawn(sleeper(10)));
+    CHECK(BlynkCoroFrames::failed() == failed + 1);
+    run_for(20);
+    CHECK(BlynkCoroFrames::used() == 0);
+    CHECK(loop.spawn(sleeper(0)));
+    run_for(2);
+    printf("frame pool: OK (max %u frames of %u bytes)\n", BlynkCoroFrames::maxUsed(), BLYNK_CORO_FRAME_SIZE);
+}
+
+/*
+ * Steady state: an echo coroutine, plus short-lived ones
+ */
+
+static BlynkTask echo()
+{
+    for (;;) {
+        const int v = (co_await loop.write(V3)).asInt();
+        Blynk.virtualWrite(V13, v * 2);
+        co_await loop.sleep(0);
+    }
+}
+
+static void test_no_allocations()
+{
+    CHECK(loop.spawn(echo()));
+    int n = 0;
+    const unsigned long allocs = BlynkAllocSteadyState("coroutines", 10, 1000, [&]() {
+        transp.clearOutput();
+        send_vw(200, 3, n++);
+        loop.run();
+        loop.spawn(sleeper(0));
+        loop.run();
+
+        size_t pos = 0;
+        BlynkHeader hdr;
+        const uint8_t* body;
+        CHECK(next_frame(pos, BLYNK_CMD_HARDWARE, hdr, body) && hdr.msg_id == 200);
+    });
+    CHECK(allocs == 0);
+    CHECK(BlynkCoroFrames::used() == 1);        // echo
+    printf("no allocations: OK\n");
+}
+
+/*
+ * Together with BlynkSync: both see every response
+ */
+
+static BlynkSync<BlynkStaticDevice> pinSync(Blynk);
+static int synced[2];
+static int pingCode = 0;
+
+BLYNK_WRITE(V20)
+{
+    synced[0] = param.asInt();
+}
+
+BLYNK_WRITE(V21)
+{
+    synced[1] = param.asInt();
+}
+
+static BlynkTask sync_then_ping()
+{
+    pinSync.start();
+    Blynk.sendCmd(BLYNK_CMD_PING);
+    pingCode = co_await loop.response(Blynk.lastMsgId(), 1000);
+}
+
+// Answers sync requests with a value for each pin, and pings
+static void serve()
+{
+    size_t pos = 0;
+    BlynkHeader hdr;
+    const uint8_t* body;
+    while (transp.frame(pos, hdr, body)) {
+        if (hdr.type == BLYNK_CMD_HARDWARE_SYNC) {
+            const std::string pins((const char*)body, hdr.length);
+            for (size_t p = 3; p < pins.size(); p += strlen(pins.c_str() + p) + 1) {
+                const int pin = atoi(pins.c_str() + p);
+                send_vw(hdr.msg_id, pin, pin * 10);
+            }
+        } else if (hdr.type == BLYNK_CMD_PING) {
+            transp.send(BLYNK_CMD_RESPONSE, hdr.msg_id, NULL, 0, BLYNK_SUCCESS);
+        }
+    }
+    transp.clearOutput();
+}
+
+static void test_with_sync()
+{
+    CHECK(pinSync.add(V20));
+    CHECK(pinSync.add(V21));
+    transp.clearOutput();
+    CHECK(loop.spawn(sync_then_ping()));        // spawn, then start
+    CHECK(loop.spawn(sleeper(0)));              // and spawn again
+    pinSync.start();
+    for (int i = 0; i < 1000 && (!pinSync.done() || !pingCode); i++) {
+        loop.run();
+        serve();
+        usleep(1000);
+    }
+    CHECK(pinSync.done() && pinSync.stats().timeouts == 0);
+    CHECK(synced[0] == 200 && synced[1] == 210);
+    CHECK(pingCode == BLYNK_SUCCESS);
+    printf("with BlynkSync: OK\n");
+}
+
+int main()
+{
+    test_session();
+    test_timeout_and_writes();
+    test_frame_pool();
+    test_no_allocations();
+    test_with_sync();
+    return 0;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file       BlynkFifoTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      BlynkFifo correctness, stress test and throughput benchmark
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkFifoTest           # unit + stress test
+ *   ../tests/BlynkFifoTest --bench   # bytes/sec for every pair of cores
+ */
+
+#define BLYNK_PRINT stdout
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkFifo.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BlynkTestCheck.h"
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin_thread(int cpu)
+{
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void test_basic()
+{
+    BlynkFifo<uint32_t, 6> f; // storage is rounded up to 8
+    CHECK(f.STORAGE == 8);
+    CHECK(f.free() == 6);
+    CHECK(!f.readable());
+
+    uint32_t in[6] = { 1, 2, 3, 4, 5, 6 };
+    CHECK(f.put(in, 6) == 6);
+    CHECK(!f.writeable());
+    CHECK(f.put(in, 1) == 0);
+    CHECK(f.size() == 6);
+    CHECK(f.peek() == 1);
+    CHECK(f.get() == 1);
+    CHECK(f.get() == 2);
+
+    // Wrap around the end of storage
+    for (unsigned i = 3; i < 100; i++) {
+        CHECK(f.get() == i);
+        f.put(i + 4);
+    }
+    f.clear();
+
+    for (unsigned round = 0; round < 50; round++) {
+        uint32_t out[5];
+        for (unsigned i = 0; i < 5; i++) in[i] = round * 5 + i;
+        CHECK(f.put(in, 5) == 5);
+        CHECK(f.get(out, 5) == 5);
+        CHECK(!memcmp(in, out, sizeof(out)));
+    }
+
+    // Spans never cross the end of storage
+    uint32_t* ws;
+    size_t n = f.writeSpan(ws);
+    CHECK(n > 0 && n <= 6);
+    for (size_t i = 0; i < n; i++) ws[i] = 100 + i;
+    f.commitWrite(n);
+    const uint32_t* rs;
+    size_t m = f.readSpan(rs);
+    CHECK(m > 0 && m <= n);
+    CHECK(rs[0] == 100);
+    f.commitRead(m);
+    CHECK(f.size() == n - m);
+
+    printf("basic: OK\n");
+}
+
+static void test_ordering()
+{
+    BlynkFifo<uint8_t, 16> f;
+    for (unsigned i = 0; i < 1000; i++) {
+        f.put(uint8_t(i));
+        f.put(uint8_t(i + 1));
+        CHECK(f.get() == uint8_t(i));
+        CHECK(f.get() == uint8_t(i + 1));
+    }
+    printf("ordering: OK\n");
+}
+
+// Stress: random bulk sizes on both sides, verify sequence
+
+typedef BlynkFifo<uint32_t, 1024> StressFifo;
+
+struct StressCtx {
+    StressFifo* fifo;
+    uint32_t    count;
+    int         cpu;
+};
+
+static void* stress_producer(void* arg)
+{
+    StressCtx* ctx = (StressCtx*)arg;
+    pin_thread(ctx->cpu);
+    unsigned seed = 1;
+    uint32_t seq = 0, buf[300];
+    while (seq < ctx->count) {
+        const int mode = rand_r(&seed) % 3;
+        if (mode == 0) {
+            ctx->fifo->put(seq++);
+        } else {
+            int n = 1 + rand_r(&seed) % 300;
+            if (n > int(ctx->count - seq)) n = ctx->count - seq;
+            for (int i = 0; i < n; i++) buf[i] = seq + i;
+            if (mode == 1) {
+                CHECK(ctx->fifo->put(buf, n, true) == n);
+                seq += n;
+            } else {
+                seq += ctx->fifo->put(buf, n, false);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* stress_consumer(void* arg)
+{
+    StressCtx* ctx = (StressCtx*)arg;
+    pin_thread(ctx->cpu);
+    unsigned seed = 2;
+    uint32_t seq = 0, buf[300];
+    while (seq < ctx->count) {
+        const int mode = rand_r(&seed) % 3;
+        if (mode == 0) {
+            CHECK(ctx->fifo->get() == seq);
+            seq++;
+        } else {
+            int n = 1 + rand_r(&seed) % 300;
+            if (n > int(ctx->count - seq)) n = ctx->count - seq;
+            int got = ctx->fifo->get(buf, n, mode == 1);
+            for (int i = 0; i < got; i++) {
+                CHECK(buf[i] == seq + i);
+            }
+            seq += got;
+        }
+    }
+    return NULL;
+}
+
+static void test_stress(int ncpu)
+{
+    static StressFifo fifo;
+    fifo.clear();
+    StressCtx p = { &fifo, 20000000, ncpu > 1 ? 0 : -1 };
+    StressCtx c = { &fifo, 20000000, ncpu > 1 ? 1 : -1 };
+    pthread_t tp, tc;
+    const double t = now_sec();
+    pthread_create(&tc, NULL, stress_consumer, &c);
+    pthread_create(&tp, NULL, stress_producer, &p);
+    pthread_join(tp, NULL);
+    pthread_join(tc, NULL);
+    CHECK(!fifo.readable());
+    printf("stress: OK (%u items in %.2fs)\n", p.count, now_sec() - t);
+}
+
+// Benchmark: move bytes between two pinned threads
+
+typedef BlynkFifo<uint8_t, 65536> BenchFifo;
+
+struct BenchCtx {
+    BenchFifo* fifo;
+    size_t     total;
+    size_t     chunk;
+    int        cpu;
+};
+
+static void* bench_producer(void* arg)
+{
+    BenchCtx* ctx = (BenchCtx*)arg;
+    pin_thread(ctx->cpu);
+    uint8_t buf[16384];
+    memset(buf, 0x55, sizeof(buf));
+    for (size_t left = ctx->total; left; ) {
+        const size_t n = BlynkMin(left, ctx->chunk);
+        ctx->fifo->put(buf, n, true);
+        left -= n;
+    }
+    return NULL;
+}
+
+static void* bench_consumer(void* arg)
+{
+    BenchCtx* ctx = (BenchCtx*)arg;
+    pin_thread(ctx->cpu);
+    uint8_t buf[16384];
+    for (size_t left = ctx->total; left; ) {
+        const size_t n = BlynkMin(left, ctx->chunk);
+        ctx->fifo->get(buf, n, true);
+        left -= n;
+    }
+    return NULL;
+}
+
+static void bench(int ncpu)
+{
+    static BenchFifo fifo;
+    static const size_t chunks[] = { 1, 64, 4096, 16384 };
+    printf("%-8s %-8s %-8s %12s\n", "prod", "cons", "chunk", "MB/s");
+    for (int pc = 0; pc < ncpu; pc++) {
+        for (int cc = 0; cc < ncpu; cc++) {
+            if (ncpu > 1 && pc == cc) continue;
+            for (size_t i = 0; i < BLYNK_COUNT_OF(chunks); i++) {
+                fifo.clear();
+                const size_t total = (chunks[i] == 1) ? (64UL << 20) : (1024UL << 20);
+                BenchCtx p = { &fifo, total, chunks[i], pc };
+                BenchCtx c = { &fifo, total, chunks[i], cc };
+                pthread_t tp, tc;
+                const double t = now_sec();
+                pthread_create(&tc, NULL, bench_consumer, &c);
+                pthread_create(&tp, NULL, bench_producer, &p);
+                pthread_join(tp, NULL);
+                pthread_join(tc, NULL);
+                const double dt = now_sec() - t;
+                printf("%-8d %-8d %-8zu %12.1f\n", pc, cc, chunks[i], total / dt / 1e6);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench(ncpu);
+        return 0;
+    }
+    test_basic();
+    test_ordering();
+    test_stress(ncpu);
+    return 0;
+}
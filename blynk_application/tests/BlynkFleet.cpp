@@ -0,0 +1,704 @@
+/**
+ * @file       BlynkFleet.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Mock server and device fleet simulator for load testing
+ *
+ * One tool, two roles. Both are epoll-based and built on the library
+ * itself (BlynkProtocol, BlynkParam, BlynkLatency).
+ *
+ *   server  Accepts any number of devices, acknowledges logins, pings and
+ *           commands, and every --inject ms sends each device a
+ *           "vr <pin>" request. The device answers from BLYNK_READ with
+ *           the same message id; the time between the two is the
+ *           device-side latency.
+ *
+ *   fleet   Runs N virtual devices (each one a BlynkProtocol instance) on a
+ *           few threads. Each device sends --rate messages/s with the given
+ *           mix and answers the server's requests. Reports the send rate
+ *           and the command -> acknowledgement round trip.
+ *
+ * Build (inside of the "linux" directory):
+ *   make tools
+ *
+ * Examples:
+ *   ../tests/BlynkFleet server --port=8080 --inject=100
+ *   ../tests/BlynkFleet fleet --port=8080 --devices=2000 --threads=2 --rate=2 \
+ *                             --mix=int:60,float:30,string:10 --duration=30
+ *
+ * Both roles print one line of statistics per second.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include <arpa/inet.h>
+
+#include <Blynk/BlynkProtocol.h>
+#include <BlynkApiLinux.h>
+#include <utility/BlynkLatency.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The pin used for latency requests
+#define FLEET_PROBE_PIN     31
+
+static const char* host = "127.0.0.1";
+static uint16_t port = 8080;
+static unsigned threads = 1;
+static unsigned devices = 100;
+static double rate = 1;                 // messages per second per device
+static unsigned injectMs = 0;           // server: latency requests, 0 = off
+static unsigned duration = 0;           // seconds, 0 = until interrupted
+static unsigned mixWeights[3] = { 100, 0, 0 };   // int, float, string
+static volatile bool stopping = false;
+
+static uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Splits a byte stream into frames, wherever the reads happen to end
+class FrameScanner
+{
+public:
+    FrameScanner() : hdrLen(0), skip(0) {}
+
+    template <typename F>
+    void scan(const char* p, size_t n, F onFrame) {
+        while (n) {
+            if (skip) {
+                const size_t k = BlynkMin(skip, n);
+                if (body.size() < BLYNK_MAX_READBYTES) body.append(p, BlynkMin(k, BLYNK_MAX_READBYTES - body.size()));
+                p += k; n -= k; skip -= k;
+                if (!skip) onFrame(hdr, body);
+                continue;
+            }
+            const size_t k = BlynkMin(sizeof(BlynkHeader) - hdrLen, n);
+            memcpy(raw + hdrLen, p, k);
+            hdrLen += k; p += k; n -= k;
+            if (hdrLen < sizeof(BlynkHeader)) break;
+            hdrLen = 0;
+            memcpy(&hdr, raw, sizeof(hdr));
+            hdr.msg_id = ntohs(hdr.msg_id);
+            hdr.length = ntohs(hdr.length);
+            body.clear();
+            // Responses carry a status instead of a length
+            if (hdr.type != BLYNK_CMD_RESPONSE && hdr.length) {
+                skip = hdr.length;
+            } else {
+                onFrame(hdr, body);
+            }
+        }
+    }
+
+private:
+    char        raw[sizeof(BlynkHeader)];
+    size_t      hdrLen;
+    size_t      skip;
+    BlynkHeader hdr;
+    std::string body;
+};
+
+/*
+ * Server
+ */
+
+struct ServerConn {
+    int          fd;
+    bool         loggedIn;
+    bool         wantOut;
+    uint16_t     nextId;
+    std::string  out;
+    FrameScanner scanner;
+    uint64_t     sentAt[256];   // latency requests in flight, by id & 0xFF
+    uint16_t     sentId[256];
+};
+
+struct ServerStats {
+    uint64_t conns, logins, framesIn, framesOut, injected, answered;
+};
+
+static ServerStats serverStats;
+static BlynkLatency deviceLatency("fleet.device");
+
+static void server_send(int ep, ServerConn* c, uint8_t type, uint16_t id, const void* body, size_t len, uint16_t status = 0)
+{
+    BlynkHeader hdr = { type, htons(id), htons(body ? uint16_t(len) : status) };
+    c->out.append((const char*)&hdr, sizeof(hdr));
+    if (body) c->out.append((const char*)body, len);
+    __atomic_fetch_add(&serverStats.framesOut, 1, __ATOMIC_RELAXED);
+
+    const ssize_t w = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+    if (w > 0) c->out.erase(0, w);
+    if (!c->out.empty() && !c->wantOut) {
+        struct epoll_event ev = { EPOLLIN | EPOLLOUT, { c } };
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->wantOut = true;
+    }
+}
+
+static void server_frame(int ep, ServerConn* c, const BlynkHeader& hdr, const std::string& body)
+{
+    __atomic_fetch_add(&serverStats.framesIn, 1, __ATOMIC_RELAXED);
+    switch (hdr.type) {
+    case BLYNK_CMD_RESPONSE:
+        break;
+    case BLYNK_CMD_LOGIN:
+    case BLYNK_CMD_HW_LOGIN:
+        if (!c->loggedIn) {
+            c->loggedIn = true;
+            __atomic_fetch_add(&serverStats.logins, 1, __ATOMIC_RELAXED);
+        }
+        server_send(ep, c, BLYNK_CMD_RESPONSE, hdr.msg_id, NULL, 0, BLYNK_SUCCESS);
+        break;
+    case BLYNK_CMD_HARDWARE: {
+        // An answer to a latency request has its id, and our pin
+        const unsigned slot = hdr.msg_id & 0xFF;
+        if (c->sentId[slot] == hdr.msg_id && c->sentAt[slot]) {
+            BlynkParam param((void*)body.data(), body.size());
+            BlynkParam::iterator it = param.begin();
+            if (it < param.end() && !strcmp(it.asStr(), "vw") && (++it).asInt() == FLEET_PROBE_PIN) {
+                deviceLatency.record(mono_ns() - c->sentAt[slot]);
+                c->sentAt[slot] = 0;
+                __atomic_fetch_add(&serverStats.answered, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        server_send(ep, c, BLYNK_CMD_RESPONSE, hdr.msg_id, NULL, 0, BLYNK_SUCCESS);
+    } break;
+    default:
+        server_send(ep, c, BLYNK_CMD_RESPONSE, hdr.msg_id, NULL, 0, BLYNK_SUCCESS);
+    }
+}
+
+static void server_inject(int ep, ServerConn* c)
+{
+    char mem[16];
+    BlynkParam cmd(mem, 0, sizeof(mem));
+    cmd.add("vr");
+    cmd.add(FLEET_PROBE_PIN);
+    // Server ids count down from 0xFFFF, away from the device's own ids
+    const uint16_t id = c->nextId--;
+    if (c->nextId < 0x8000) c->nextId = 0xFFFF;
+    c->sentId[id & 0xFF] = id;
+    c->sentAt[id & 0xFF] = mono_ns();
+    server_send(ep, c, BLYNK_CMD_HARDWARE, id, cmd.getBuffer(), cmd.getLength() - 1);
+    __atomic_fetch_add(&serverStats.injected, 1, __ATOMIC_RELAXED);
+}
+
+static void* server_thread(void*)
+{
+    // Every thread has its own listening socket (SO_REUSEPORT) and epoll
+    const int ls = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(ls, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &addr.sin_addr);
+    if (bind(ls, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(ls, 4096) < 0) {
+        perror("listen");
+        exit(1);
+    }
+    set_nonblocking(ls);
+
+    const int ep = epoll_create1(0);
+    struct epoll_event lev = { EPOLLIN, { NULL } };
+    epoll_ctl(ep, EPOLL_CTL_ADD, ls, &lev);
+
+    std::vector<ServerConn*> conns;
+    uint64_t nextInject = mono_ns() + uint64_t(injectMs) * 1000000ULL;
+    struct epoll_event evs[256];
+    char buf[65536];
+
+    while (!stopping) {
+        const int n = epoll_wait(ep, evs, 256, 1);
+        for (int i = 0; i < n; i++) {
+            ServerConn* c = (ServerConn*)evs[i].data.ptr;
+            if (!c) {
+                int fd;
+                while ((fd = accept(ls, NULL, NULL)) >= 0) {
+                    set_nonblocking(fd);
+                    c = new ServerConn();
+                    c->fd = fd;
+                    c->loggedIn = false;
+                    c->wantOut = false;
+                    c->nextId = 0xFFFF;
+                    memset(c->sentAt, 0, sizeof(c->sentAt));
+                    memset(c->sentId, 0, sizeof(c->sentId));
+                    struct epoll_event ev = { EPOLLIN, { c } };
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+                    conns.push_back(c);
+                    __atomic_fetch_add(&serverStats.conns, 1, __ATOMIC_RELAXED);
+                }
+                continue;
+            }
+            bool closed = false;
+            if (evs[i].events & EPOLLIN) {
+                for (;;) {
+                    const ssize_t r = recv(c->fd, buf, sizeof(buf), 0);
+                    if (r > 0) {
+                        c->scanner.scan(buf, r, [&](const BlynkHeader& h, const std::string& b) {
+                            server_frame(ep, c, h, b);
+                        });
+                        continue;
+                    }
+                    closed = (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+                    break;
+                }
+            }
+            if (!closed && (evs[i].events & EPOLLOUT)) {
+                const ssize_t w = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+                if (w > 0) c->out.erase(0, w);
+                if (c->out.empty()) {
+                    struct epoll_event ev = { EPOLLIN, { c } };
+                    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+                    c->wantOut = false;
+                }
+            }
+            if (closed || (evs[i].events & (EPOLLERR | EPOLLHUP))) {
+                close(c->fd);
+                c->fd = -1;
+                __atomic_fetch_sub(&serverStats.conns, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        // Drop closed connections only here, after all events of the batch
+        for (size_t i = 0; i < conns.size(); ) {
+            if (conns[i]->fd < 0) {
+                delete conns[i];
+                conns[i] = conns.back();
+                conns.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        if (injectMs && mono_ns() >= nextInject) {
+            nextInject += uint64_t(injectMs) * 1000000ULL;
+            for (size_t i = 0; i < conns.size(); i++) {
+                if (conns[i]->loggedIn) server_inject(ep, conns[i]);
+            }
+        }
+    }
+    for (size_t i = 0; i < conns.size(); i++) {
+        close(conns[i]->fd);
+        delete conns[i];
+    }
+    close(ep);
+    close(ls);
+    return NULL;
+}
+
+static void server_report(double secs)
+{
+    static ServerStats last;
+    const ServerStats s = serverStats;
+    printf("%7.1f s  conns %6llu  logins %6llu  in %8.0f/s  out %8.0f/s",
+           secs, (unsigned long long)s.conns, (unsigned long long)s.logins,
+           double(s.framesIn - last.framesIn), double(s.framesOut - last.framesOut));
+    if (injectMs) {
+        printf("  requests %6llu/%-6llu  latency p50 %7.1f  p99 %7.1f  max %7.1f us",
+               (unsigned long long)(s.answered - last.answered), (unsigned long long)(s.injected - last.injected),
+               deviceLatency.percentile(50) / 1e3, deviceLatency.percentile(99) / 1e3, deviceLatency.max() / 1e3);
+        deviceLatency.reset();
+    }
+    printf("\n");
+    fflush(stdout);
+    last = s;
+}
+
+/*
+ * Fleet
+ */
+
+struct VirtualDevice;
+static __thread VirtualDevice* current = NULL;
+
+struct FleetStats {
+    uint64_t connected, sent, acked, answered, reconnects;
+};
+
+static FleetStats fleetStats;
+static BlynkLatency ackLatency("fleet.ack");
+
+// Non-blocking socket, buffered both ways; I/O is driven by the thread's epoll
+class FleetTransport
+{
+public:
+    FleetTransport()
+        : ep(-1), owner(NULL), fd(-1), wantOut(false), inPos(0)
+    {
+        memset(sentAt, 0, sizeof(sentAt));
+        memset(sentId, 0, sizeof(sentId));
+    }
+
+    void begin(const char*, uint16_t) {}
+
+    bool connect() {
+        disconnect();
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        set_nonblocking(fd);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host, &addr.sin_addr);
+        if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        // Writes are buffered until the connection completes
+        struct epoll_event ev = { EPOLLIN | EPOLLOUT, { owner } };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        wantOut = true;
+        __atomic_fetch_add(&fleetStats.reconnects, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        in.clear();
+        inPos = 0;
+        out.clear();
+    }
+
+    bool connected() { return fd >= 0; }
+
+    int available() { return int(in.size() - inPos); }
+
+    size_t read(void* buf, size_t len) {
+        len = BlynkMin(len, in.size() - inPos);
+        memcpy(buf, in.data() + inPos, len);
+        inPos += len;
+        if (inPos == in.size()) {
+            in.clear();
+            inPos = 0;
+        }
+        return len;
+    }
+
+    size_t write(const void* buf, size_t len) {
+        if (fd < 0) return 0;
+        // sendCmd() writes each header on its own: note when commands leave
+        const BlynkHeader* hdr = (const BlynkHeader*)buf;
+        if (len == sizeof(BlynkHeader) && hdr->type == BLYNK_CMD_HARDWARE) {
+            const uint16_t id = ntohs(hdr->msg_id);
+            sentId[id & 0xFF] = id;
+            sentAt[id & 0xFF] = mono_ns();
+        }
+        out.append((const char*)buf, len);
+        if (!wantOut) flush();
+        return len;
+    }
+
+    // Socket events
+    void flush() {
+        if (fd < 0) return;
+        if (!out.empty()) {
+            const ssize_t w = send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+            if (w > 0) out.erase(0, w);
+        }
+        const bool want = !out.empty();
+        if (want != wantOut) {
+            struct epoll_event ev = { EPOLLIN | (want ? EPOLLOUT : 0u), { owner } };
+            epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+            wantOut = want;
+        }
+    }
+
+    void receive() {
+        char buf[16384];
+        for (;;) {
+            const ssize_t r = recv(fd, buf, sizeof(buf), 0);
+            if (r > 0) {
+                in.append(buf, r);
+                scanner.scan(buf, r, [&](const BlynkHeader& h, const std::string&) {
+                    if (h.type == BLYNK_CMD_RESPONSE && sentId[h.msg_id & 0xFF] == h.msg_id && sentAt[h.msg_id & 0xFF]) {
+                        ackLatency.record(mono_ns() - sentAt[h.msg_id & 0xFF]);
+                        sentAt[h.msg_id & 0xFF] = 0;
+                        __atomic_fetch_add(&fleetStats.acked, 1, __ATOMIC_RELAXED);
+                    }
+                });
+                continue;
+            }
+            if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                disconnect();
+            }
+            break;
+        }
+    }
+
+    int   ep;
+    void* owner;
+
+private:
+    int          fd;
+    bool         wantOut;
+    std::string  in;
+    size_t       inPos;
+    std::string  out;
+    FrameScanner scanner;
+    uint64_t     sentAt[256];
+    uint16_t     sentId[256];
+};
+
+class FleetDevice
+    : public BlynkProtocol<FleetTransport>
+{
+public:
+    FleetDevice(FleetTransport& transp)
+        : BlynkProtocol<FleetTransport>(transp)
+    {}
+
+    void begin(const char* token) {
+        BlynkProtocol<FleetTransport>::begin(token);
+    }
+};
+
+struct VirtualDevice {
+    FleetTransport transp;      // constructed before the device
+    FleetDevice    device;
+    char           token[33];
+    uint64_t       nextSend;
+    bool           wasConnected;
+    unsigned       seq;
+
+    VirtualDevice() : device(transp), nextSend(0), wasConnected(false), seq(0) {}
+};
+
+// Answers the server's latency requests, from whichever device is running
+BLYNK_READ_DEFAULT()
+{
+    if (current && request.pin == FLEET_PROBE_PIN) {
+        current->device.virtualWrite(FLEET_PROBE_PIN, current->seq);
+        __atomic_fetch_add(&fleetStats.answered, 1, __ATOMIC_RELAXED);
+    }
+}
+
+BLYNK_WRITE_DEFAULT()
+{
+}
+
+static void send_traffic(VirtualDevice& d)
+{
+    const unsigned total = mixWeights[0] + mixWeights[1] + mixWeights[2];
+    const unsigned pick = total ? unsigned(rand()) % total : 0;
+    d.seq++;
+    if (pick < mixWeights[0]) {
+        d.device.virtualWrite(V1, d.seq);
+    } else if (pick < mixWeights[0] + mixWeights[1]) {
+        d.device.virtualWrite(V2, 20.0f + (d.seq % 100) / 10.0f);
+    } else {
+        d.device.virtualWrite(V0, "12:00:01\t22.50 C\t512\t1.25V");
+    }
+    __atomic_fetch_add(&fleetStats.sent, 1, __ATOMIC_RELAXED);
+}
+
+struct FleetThread {
+    pthread_t       thread;
+    unsigned        first;
+    unsigned        count;
+};
+
+static void* fleet_thread(void* arg)
+{
+    FleetThread* ft = (FleetThread*)arg;
+    const int ep = epoll_create1(0);
+    std::vector<VirtualDevice*> devs(ft->count);
+    const uint64_t interval = rate > 0 ? uint64_t(1e9 / rate) : 0;
+    const uint64_t t0 = mono_ns();
+
+    for (unsigned i = 0; i < ft->count; i++) {
+        VirtualDevice* d = new VirtualDevice();
+        d->transp.ep = ep;
+        d->transp.owner = d;
+        snprintf(d->token, sizeof(d->token), "fleet%027u", ft->first + i);
+        d->device.begin(d->token);
+        // Spread the sends of all devices over the interval
+        d->nextSend = t0 + (interval ? uint64_t(rand()) % interval : 0);
+        devs[i] = d;
+    }
+
+    struct epoll_event evs[256];
+    uint64_t nextPoll = 0;
+    while (!stopping) {
+        const int n = epoll_wait(ep, evs, 256, 1);
+        for (int i = 0; i < n; i++) {
+            VirtualDevice* d = (VirtualDevice*)evs[i].data.ptr;
+            if (evs[i].events & EPOLLOUT) d->transp.flush();
+            if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) d->transp.receive();
+            if (d->transp.available()) {
+                current = d;
+                d->device.run();
+            }
+        }
+
+        const uint64_t now = mono_ns();
+        // Timers of the protocol (logins, heartbeats) every 10 ms
+        const bool poll = now >= nextPoll;
+        if (poll) nextPoll = now + 10000000ULL;
+        for (unsigned i = 0; i < ft->count; i++) {
+            VirtualDevice* d = devs[i];
+            current = d;
+            if (poll) d->device.run();
+            const bool conn = d->device.connected();
+            if (conn != d->wasConnected) {
+                d->wasConnected = conn;
+                __atomic_fetch_add(&fleetStats.connected, conn ? 1 : uint64_t(-1), __ATOMIC_RELAXED);
+            }
+            if (conn && interval && now >= d->nextSend) {
+                send_traffic(*d);
+                d->nextSend += interval;
+                if (d->nextSend < now) d->nextSend = now + interval;
+            }
+        }
+    }
+    for (unsigned i = 0; i < ft->count; i++) {
+        devs[i]->transp.disconnect();
+        delete devs[i];
+    }
+    close(ep);
+    return NULL;
+}
+
+static void fleet_report(double secs)
+{
+    static FleetStats last;
+    const FleetStats s = fleetStats;
+    printf("%7.1f s  connected %6llu/%u  sent %8.0f/s  acked %8.0f/s  answered %6llu  "
+           "ack p50 %7.1f  p99 %7.1f  max %7.1f us\n",
+           secs, (unsigned long long)s.connected, devices,
+           double(s.sent - last.sent), double(s.acked - last.acked),
+           (unsigned long long)(s.answered - last.answered),
+           ackLatency.percentile(50) / 1e3, ackLatency.percentile(99) / 1e3, ackLatency.max() / 1e3);
+    fflush(stdout);
+    ackLatency.reset();
+    last = s;
+}
+
+static void parse_mix(const char* s)
+{
+    static const char* const names[3] = { "int", "float", "string" };
+    memset(mixWeights, 0, sizeof(mixWeights));
+    while (*s) {
+        const char* colon = strchr(s, ':');
+        if (!colon) break;
+        for (unsigned i = 0; i < 3; i++) {
+            if (strlen(names[i]) == size_t(colon - s) && !strncmp(s, names[i], colon - s)) {
+                mixWeights[i] = atoi(colon + 1);
+            }
+        }
+        const char* comma = strchr(colon, ',');
+        if (!comma) break;
+        s = comma + 1;
+    }
+}
+
+static void on_signal(int)
+{
+    stopping = true;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: BlynkFleet server [--host=ADDR] [--port=N] [--threads=N] [--inject=MS] [--duration=S]\n"
+        "       BlynkFleet fleet  [--host=ADDR] [--port=N] [--threads=N] [--devices=N]\n"
+        "                         [--rate=MSGS_PER_S] [--mix=int:W,float:W,string:W] [--duration=S]\n");
+    exit(2);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) usage();
+    const bool server = !strcmp(argv[1], "server");
+    if (!server && strcmp(argv[1], "fleet")) usage();
+
+    static struct option opts[] = {
+        { "host",     required_argument, 0, 'h' },
+        { "port",     required_argument, 0, 'p' },
+        { "threads",  required_argument, 0, 't' },
+        { "devices",  required_argument, 0, 'n' },
+        { "rate",     required_argument, 0, 'r' },
+        { "mix",      required_argument, 0, 'm' },
+        { "inject",   required_argument, 0, 'i' },
+        { "duration", required_argument, 0, 'd' },
+        { 0, 0, 0, 0 }
+    };
+    int c;
+    while ((c = getopt_long(argc - 1, argv + 1, "", opts, NULL)) != -1) {
+        switch (c) {
+        case 'h': host = optarg; break;
+        case 'p': port = uint16_t(atoi(optarg)); break;
+        case 't': threads = BlynkMax(1, atoi(optarg)); break;
+        case 'n': devices = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'm': parse_mix(optarg); break;
+        case 'i': injectMs = atoi(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        default:  usage();
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    srand(getpid());
+
+    std::vector<FleetThread> ts(threads);
+    for (unsigned i = 0; i < threads; i++) {
+        ts[i].first = devices * i / threads;
+        ts[i].count = devices * (i + 1) / threads - ts[i].first;
+        pthread_create(&ts[i].thread, NULL, server ? server_thread : fleet_thread, &ts[i]);
+    }
+
+    const uint64_t start = mono_ns();
+    uint64_t next = start + 1000000000ULL;
+    while (!stopping) {
+        const uint64_t now = mono_ns();
+        if (now < next) {
+            usleep(BlynkMin(uint64_t(100000), (next - now) / 1000));
+            continue;
+        }
+        next += 1000000000ULL;
+        const double secs = (now - start) / 1e9;
+        if (server) server_report(secs); else fleet_report(secs);
+        if (duration && secs >= duration) stopping = true;
+    }
+
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(ts[i].thread, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file       BlynkFramePoolTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Frame buffers: tiers, streamed input, no truncation, no allocations
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkFramePoolTest
+ *
+ * Uses the small-device limits (256 bytes in, 128 out) and atomic sends,
+ * so that every path through the frame buffers is taken.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+#define BLYNK_MAX_READBYTES 256
+#define BLYNK_MAX_SENDBYTES 128
+#define BLYNK_SEND_ATOMIC
+
+#include "BlynkTestTransport.h"
+#include "BlynkAllocTrack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static BlynkStaticTransport transp;
+static BlynkStaticDevice Blynk(transp);
+
+static size_t written = 0;
+static char   writtenLast = 0;
+static int    reads = 0;
+
+BLYNK_WRITE(V5)
+{
+    written = strlen(param.asStr());
+    writtenLast = written ? param.asStr()[written - 1] : 0;
+}
+
+BLYNK_READ(V6)
+{
+    Blynk.virtualWrite(V6, ++reads);
+}
+
+// Collects streamed frames
+static char   streamed[4096];
+static size_t streamedLen = 0;
+static size_t streamedChunks = 0;
+static size_t streamedTotal = 0;
+
+static void on_stream(const BlynkHeader& hdr, size_t offset, const uint8_t* data, size_t len)
+{
+    CHECK(offset == streamedLen);
+    CHECK(data[len] == '\0');
+    memcpy(streamed + offset, data, len);
+    streamedLen += len;
+    streamedChunks++;
+    streamedTotal = hdr.length;
+}
+
+// A "vw 5 <text>" command with 'len' characters of text
+static size_t make_write(char* buf, size_t len)
+{
+    const char prefix[] = "vw\0" "5";
+    memcpy(buf, prefix, sizeof(prefix));
+    for (size_t i = 0; i < len; i++) {
+        buf[sizeof(prefix) + i] = 'a' + (i % 26);
+    }
+    return sizeof(prefix) + len;
+}
+
+static void connect()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+}
+
+static void test_param()
+{
+    char mem[12];
+    memset(mem, 'x', sizeof(mem));
+    BlynkParam p(mem, 0, 8);
+    p.add(12345);
+    CHECK(!p.isTruncated());
+    CHECK(p.getLength() == 6);
+    p.add(123456789);
+    CHECK(p.isTruncated());
+    CHECK(p.getLength() == 6);
+    p.add("toolong");
+    CHECK(p.getLength() == 6);
+    p.add(1);
+    CHECK(p.getLength() == 8);
+    p.add(1.5);
+    CHECK(p.getLength() == 8);
+    CHECK(mem[8] == 'x' && mem[11] == 'x');     // nothing written past the buffer
+
+    // Streaming: the full buffer is passed on, nothing is left out
+    std::string out;
+    BlynkParam s(mem, 0, sizeof(mem));
+    s.setSink([](void* ctx, const void* data, size_t len) {
+        ((std::string*)ctx)->append((const char*)data, len);
+    }, &out);
+    s.add("a long string");
+    s.add(123456789);
+    s.add(1.5);
+    s.flush();
+    CHECK(!s.isTruncated());
+    CHECK(out == std::string("a long string\0" "123456789\0" "1.5000000", 34));
+    printf("param: OK\n");
+}
+
+static void test_tiers()
+{
+    BlynkFramePool pool;
+    CHECK(BlynkFramePool::maxSize() == BLYNK_MAX_READBYTES);
+    CHECK(pool.canReceive());
+
+    BlynkFrame a(pool), b(pool), c(pool), d(pool);
+    CHECK(a.acquire(10) && a.size() == BLYNK_FRAME_SMALL_SIZE);
+    CHECK(b.acquire(100) && b.size() == BLYNK_FRAME_LARGE_SIZE);
+    CHECK(!pool.canReceive());
+    CHECK(!c.acquire(100));
+    CHECK(c.acquire(64) && c.size() == BLYNK_FRAME_SMALL_SIZE);
+    CHECK(!d.acquireLargest());
+    CHECK(pool.inUse() == 3);
+
+    // Buffers do not overlap, and each has room for a terminating zero
+    memset(a.data(), 1, a.size() + 1);
+    memset(b.data(), 2, b.size() + 1);
+    memset(c.data(), 3, c.size() + 1);
+    CHECK(a.data()[a.size()] == 1 && b.data()[0] == 2 && c.data()[c.size()] == 3);
+
+    b.release();
+    CHECK(pool.canReceive());
+    a.release();
+    CHECK(a.acquire(10));
+    CHECK(a.grow(a.size()) && a.size() == BLYNK_FRAME_LARGE_SIZE);
+    CHECK(!a.grow(a.size()));
+    CHECK(pool.inUse() == 2);
+    printf("tiers: OK\n");
+}
+
+static void test_streaming()
+{
+    char cmd[2048];
+    transp.clearOutput();
+
+    // With a handler: the whole body arrives in order, in buffer-sized chunks
+    Blynk.setFrameStreamHandler(on_stream);
+    size_t len = make_write(cmd, 1000);
+    transp.send(BLYNK_CMD_HARDWARE, 100, cmd, len);
+    written = 0;
+    len = make_write(cmd, 3);
+    transp.send(BLYNK_CMD_HARDWARE, 101, cmd, len);
+    Blynk.run();
+    CHECK(Blynk.connected());
+    CHECK(streamedTotal == 1005 && streamedLen == 1005);
+    CHECK(streamedChunks == 4);                       // 256 + 256 + 256 + 237
+    make_write(cmd, 1000);
+    CHECK(!memcmp(streamed, cmd, 1005));
+    CHECK(written == 3);                              // the next frame is intact
+
+    // Without one: skipped, and the connection stays in sync
+    Blynk.setFrameStreamHandler(NULL);
+    len = make_write(cmd, 1500);
+    transp.send(BLYNK_CMD_HARDWARE, 102, cmd, len);
+    written = 0;
+    len = make_write(cmd, 7);
+    transp.send(BLYNK_CMD_HARDWARE, 103, cmd, len);
+    Blynk.run();
+    CHECK(Blynk.connected());
+    CHECK(written == 7);
+    CHECK(streamedChunks == 4);
+    printf("streaming: OK (1005 bytes in %zu chunks)\n", streamedChunks);
+}
+
+static void test_send()
+{
+    char text[512];
+    memset(text, 'z', sizeof(text));
+
+    // Over BLYNK_MAX_SENDBYTES: built again in a large frame buffer
+    text[200] = '\0';
+    transp.clearOutput();
+    Blynk.virtualWrite(V7, text);
+    size_t pos = 0;
+    BlynkHeader hdr;
+    const uint8_t* body;
+    CHECK(transp.frame(pos, hdr, body));
+    CHECK(hdr.type == BLYNK_CMD_HARDWARE);
+    CHECK(hdr.length == 3 + 2 + 201 - 1);
+    CHECK(!memcmp(body, "vw\0" "7\0", 5) && body[5 + 199] == 'z');
+    CHECK(!transp.frame(pos, hdr, body));
+
+    // Too big for any buffer: streamed to the transport
+    text[200] = 'z';
+    text[300] = '\0';
+    transp.clearOutput();
+    Blynk.virtualWrite(V7, text);
+    pos = 0;
+    CHECK(transp.frame(pos, hdr, body));
+    CHECK(hdr.length == 3 + 2 + 301 - 1);
+    CHECK(!memcmp(body, "vw\0" "7\0", 5) && body[5 + 299] == 'z');
+    CHECK(!transp.frame(pos, hdr, body));
+    CHECK(Blynk.connected());
+    printf("send: OK (200 characters built in a frame buffer, 300 streamed)\n");
+}
+
+// 1 KB of values, in pieces longer and shorter than the buffers
+static void test_send_large()
+{
+    char kilo[1025];
+    for (size_t i = 0; i < 1024; i++) {
+        kilo[i] = 'a' + (i % 26);
+    }
+    kilo[1024] = '\0';
+    transp.clearOutput();
+    Blynk.virtualWrite(V10, kilo, 12345, "end");
+    size_t pos = 0;
+    BlynkHeader hdr;
+    const uint8_t* body;
+    CHECK(transp.frame(pos, hdr, body));
+    CHECK(hdr.type == BLYNK_CMD_HARDWARE);
+    CHECK(hdr.length == 3 + 3 + 1025 + 6 + 3);
+    CHECK(!memcmp(body, "vw\0" "10\0", 6));
+    CHECK(!memcmp(body + 6, kilo, 1025));
+    CHECK(!memcmp(body + 6 + 1025, "12345\0" "end", 9));
+    CHECK(!transp.frame(pos, hdr, body));
+
+    // Many short values
+    transp.clearOutput();
+    Blynk.virtualWrite(V11, 1000000, 1000001, 1000002, 1000003, 1000004, 1000005,
+                            1000006, 1000007, 1000008, 1000009, 1000010, 1000011,
+                            1000012, 1000013, 1000014, 1000015, 1000016, 1000017,
+                            1000018, 1000019, 1000020, 1000021, 1000022, 1000023,
+                            1000024, 1000025, 1000026, 1000027, 1000028, 1000029,
+                            1000030, 1000031, 1000032, 1000033, 1000034, 1000035,
+                            1000036, 1000037, 1000038, 1000039);
+    pos = 0;
+    CHECK(transp.frame(pos, hdr, body));
+    CHECK(hdr.length == 3 + 3 + 40 * 8 - 1);
+    for (int i = 0; i < 40; i++) {
+        CHECK(atoi((const char*)body + 6 + i * 8) == 1000000 + i);
+    }
+    CHECK(Blynk.connected());
+    printf("send large: OK (1 KB value, 40 values)\n");
+}
+
+static void test_steady_state()
+{
+    char big[300], small[32];
+    const size_t bigLen = make_write(big, 200);
+    const size_t smallLen = make_write(small, 4);
+    const char vr[] = "vr\0" "6";
+    char text[201];
+    memset(text, 'q', 200);
+    text[200] = '\0';
+    char kilo[1025];
+    memset(kilo, 'k', 1024);
+    kilo[1024] = '\0';
+
+    int i = 0;
+    const unsigned long allocated = BlynkAllocSteadyState("steady state (4 frames in, 5 out)", 10, 1000, [&]() {
+        transp.clearOutput();
+        transp.send(BLYNK_CMD_HARDWARE, 200, small, smallLen);
+        transp.send(BLYNK_CMD_HARDWARE, 201, big, bigLen);
+        transp.send(BLYNK_CMD_HARDWARE, 202, vr, sizeof(vr) - 1);
+        transp.send(BLYNK_CMD_PING, 203, NULL, 0);
+        Blynk.run();
+        Blynk.virtualWrite(V8, i++, 1.5f, "str");
+        Blynk.virtualWrite(V9, text);
+        Blynk.virtualWrite(V10, kilo);
+        CHECK(written == 200 && writtenLast == 'a' + 199 % 26);
+    });
+    CHECK(reads == 1010);
+    CHECK(Blynk.connected());
+    CHECK(allocated == 0);
+}
+
+int main()
+{
+    test_param();
+    test_tiers();
+    connect();
+    test_streaming();
+    test_send();
+    test_send_large();
+    test_steady_state();
+    return 0;
+}
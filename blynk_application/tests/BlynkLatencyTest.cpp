@@ -0,0 +1,199 @@
+/**
+ * @file       BlynkLatencyTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Latency histograms: bucket error, percentiles, threads, signal dump
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkLatencyTest           # correctness
+ *   ../tests/BlynkLatencyTest --bench   # cost of one recorded scope
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+#define BLYNK_USE_LATENCY
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <utility/BlynkLatency.h>
+
+#include <algorithm>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BlynkTestCheck.h"
+
+static BlynkLatency* find(const char* name)
+{
+    for (BlynkLatency* s = BlynkLatency::first(); s; s = s->next()) {
+        if (!strcmp(s->name(), name)) return s;
+    }
+    return NULL;
+}
+
+static void test_buckets()
+{
+    // Buckets are contiguous and ordered
+    for (unsigned b = 0; b + 1 < BLYNK_LATENCY_BUCKETS; b++) {
+        const uint64_t high = BlynkLatency::bucketHigh(b);
+        CHECK(BlynkLatency::bucket(high) == b);
+        CHECK(BlynkLatency::bucket(high + 1) == b + 1);
+    }
+    CHECK(BlynkLatency::bucketHigh(BLYNK_LATENCY_BUCKETS - 1) == UINT64_MAX);
+
+    // Any value is reported within 1/16 of itself
+    unsigned seed = 1;
+    for (unsigned i = 0; i < 1000000; i++) {
+        const uint64_t v = (uint64_t(rand_r(&seed)) << 31 | rand_r(&seed)) >> (rand_r(&seed) % 62);
+        const uint64_t high = BlynkLatency::bucketHigh(BlynkLatency::bucket(v));
+        CHECK(high >= v && double(high - v) <= double(v) / 16 + 1);
+    }
+    printf("buckets: OK (%u buckets, %zu bytes per stage)\n",
+           BLYNK_LATENCY_BUCKETS, sizeof(BlynkLatency));
+}
+
+// Long-tailed distribution, compared with exact percentiles
+static void test_percentiles()
+{
+    static BlynkLatency stage("test.percentiles");
+    std::vector<uint64_t> values;
+    unsigned seed = 2;
+    for (unsigned i = 0; i < 200000; i++) {
+        const double u = (rand_r(&seed) + 1.0) / (RAND_MAX + 2.0);
+        uint64_t v = uint64_t(20000 * exp(-log(u) * 0.8));     // ~20 us, heavy tail
+        if (i % 5000 == 0) v = 50000000;                       // rare 50 ms stall
+        values.push_back(v);
+        stage.record(v);
+    }
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    CHECK(stage.count() == n);
+    CHECK(stage.max() == values[n - 1]);
+
+    const double ps[] = { 50, 90, 99, 99.9, 99.99 };
+    for (unsigned i = 0; i < sizeof(ps)/sizeof(ps[0]); i++) {
+        const uint64_t exact = values[size_t(ceil(ps[i] / 100 * n)) - 1];
+        const uint64_t got = stage.percentile(ps[i]);
+        CHECK(got >= exact && double(got - exact) <= double(exact) / 16 + 1);
+    }
+    char line[160];
+    stage.format(line, sizeof(line));
+    printf("%s\n", line);
+
+    stage.reset();
+    CHECK(stage.count() == 0 && stage.max() == 0 && stage.percentile(99) == 0);
+    printf("percentiles: OK\n");
+}
+
+static BlynkLatency threaded("test.threads");
+
+static void* record_many(void* arg)
+{
+    const uint64_t base = (uintptr_t)arg;
+    for (unsigned i = 0; i < 100000; i++) {
+        threaded.record(base + i % 1000);
+    }
+    return NULL;
+}
+
+static void test_threads()
+{
+    pthread_t t[4];
+    for (unsigned i = 0; i < 4; i++) {
+        pthread_create(&t[i], NULL, record_many, (void*)uintptr_t(1000 * (i + 1)));
+    }
+    for (unsigned i = 0; i < 4; i++) {
+        pthread_join(t[i], NULL);
+    }
+    CHECK(threaded.count() == 400000);
+    CHECK(threaded.max() == 4999);
+    printf("threads: OK\n");
+}
+
+// Stages inside the protocol appear when they are first used
+static void test_protocol()
+{
+    CHECK(!find("proto.sendCmd"));
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    BlynkLatency* send = find("proto.sendCmd");
+    BlynkLatency* run = find("proto.run");
+    CHECK(send && run);
+    const uint64_t before = send->count();
+    for (int i = 0; i < 1000; i++) {
+        Blynk.virtualWrite(V1, i);
+    }
+    CHECK(send->count() == before + 1000);
+    CHECK(send->percentile(50) > 0 && send->percentile(50) <= send->max());
+    printf("protocol: OK (sendCmd p50 %.1f us, p99 %.1f us)\n",
+           send->percentile(50) / 1e3, send->percentile(99) / 1e3);
+}
+
+static void test_signal_dump()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/blynk-latency-test-%d.txt", getpid());
+    FILE* out = fopen(path, "w+");
+    CHECK(out);
+    CHECK(BlynkLatencyReporterStart(out, 0, SIGUSR1));
+    CHECK(!BlynkLatencyReporterStart(out, 0, SIGUSR1));
+
+    raise(SIGUSR1);
+    char text[8192] = "";
+    for (int i = 0; i < 200 && !strstr(text, "test.threads"); i++) {
+        usleep(5000);
+        fflush(out);
+        rewind(out);
+        const size_t n = fread(text, 1, sizeof(text) - 1, out);
+        text[n] = '\0';
+    }
+    BlynkLatencyReporterStop();
+    fclose(out);
+    unlink(path);
+
+    CHECK(strstr(text, "--- latency (signal) ---"));
+    CHECK(strstr(text, "proto.sendCmd"));
+    CHECK(strstr(text, "test.threads"));
+    CHECK(strstr(text, "p99.9"));
+    printf("signal dump: OK\n");
+}
+
+static void bench()
+{
+    static BlynkLatency stage("bench.scope");
+    const unsigned N = 10000000;
+    const uint64_t t0 = BlynkLatency::now();
+    for (unsigned i = 0; i < N; i++) {
+        BlynkLatencyScope s(stage);
+    }
+    const uint64_t el = BlynkLatency::now() - t0;
+    printf("bench: %.1f ns per recorded scope (2 clock reads + record)\n", double(el) / N);
+}
+
+int main(int argc, char* argv[])
+{
+    test_buckets();
+    test_percentiles();
+    test_threads();
+    test_protocol();
+    test_signal_dump();
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench();
+    }
+    return 0;
+}
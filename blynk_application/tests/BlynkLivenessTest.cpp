@@ -0,0 +1,265 @@
+/**
+ * @file       BlynkLivenessTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Dead link detection through a proxy that blackholes traffic
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkLivenessTest
+ *
+ * The device talks to a local server through a proxy. At some point the
+ * proxy stops forwarding anything, but keeps both connections open, like
+ * a NAT that forgot the mapping. The device must notice within
+ * BLYNK_DEAD_LINK_MS, whether it is idle or busy writing.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+#define BLYNK_DEAD_LINK_MS 2000UL
+
+#include <BlynkApiLinux.h>
+#include <BlynkSocket.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+// Detection may take one poll of available() longer, plus scheduling noise
+static const uint32_t SLACK_MS = 300;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int listen_local(uint16_t& port, int rcvbuf = 0)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (rcvbuf) {
+        // Inherited by accepted sockets: a blackholed write fills up soon
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(fd, 4) == 0);
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static bool read_full(int fd, void* buf, size_t len)
+{
+    uint8_t* p = (uint8_t*)buf;
+    while (len) {
+        const ssize_t n = read(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Server: accepts logins and answers pings, one connection at a time
+ */
+
+static int serverFd = -1;
+static uint16_t serverPort = 0;
+static unsigned pings = 0;
+
+static void* server_main(void*)
+{
+    for (;;) {
+        const int c = accept(serverFd, NULL, NULL);
+        if (c < 0) break;
+        BlynkHeader hdr;
+        static char body[4096];
+        while (read_full(c, &hdr, sizeof(hdr))) {
+            const uint16_t len = ntohs(hdr.length);
+            if (hdr.type != BLYNK_CMD_RESPONSE && !read_full(c, body, BlynkMin<size_t>(len, sizeof(body)))) break;
+            if (hdr.type == BLYNK_CMD_HW_LOGIN || hdr.type == BLYNK_CMD_PING) {
+                if (hdr.type == BLYNK_CMD_PING) __atomic_fetch_add(&pings, 1, __ATOMIC_RELAXED);
+                const BlynkHeader rsp = { BLYNK_CMD_RESPONSE, hdr.msg_id, htons(BLYNK_SUCCESS) };
+                if (write(c, &rsp, sizeof(rsp)) != sizeof(rsp)) break;
+            }
+        }
+        close(c);
+    }
+    return NULL;
+}
+
+/*
+ * Proxy: forwards both ways until blackholed, then just holds the sockets
+ */
+
+static int proxyFd = -1;
+static uint16_t proxyPort = 0;
+static volatile bool blackhole = false;
+static volatile int  session = 0;       // a new one drops the old connection
+
+static bool forward(int from, int to)
+{
+    char buf[4096];
+    const ssize_t n = read(from, buf, sizeof(buf));
+    return n > 0 && write(to, buf, n) == n;
+}
+
+static void* proxy_main(void*)
+{
+    for (;;) {
+        const int dev = accept(proxyFd, NULL, NULL);
+        if (dev < 0) break;
+        const int srv = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(serverPort);
+        CHECK(connect(srv, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+        const int current = session;
+        while (session == current) {
+            struct pollfd p[2] = { { dev, POLLIN, 0 }, { srv, POLLIN, 0 } };
+            if (poll(p, 2, 10) < 0) break;
+            if (blackhole) {
+                continue;       // both ends stay open, nothing is read
+            }
+            if ((p[0].revents & (POLLIN | POLLHUP | POLLERR)) && !forward(dev, srv)) break;
+            if ((p[1].revents & (POLLIN | POLLHUP | POLLERR)) && !forward(srv, dev)) break;
+        }
+        close(dev);
+        close(srv);
+    }
+    return NULL;
+}
+
+/*
+ * Device
+ */
+
+class LivenessDevice
+    : public BlynkSocket
+{
+public:
+    LivenessDevice(BlynkTransportSocket& transp)
+        : BlynkSocket(transp)
+    {}
+
+    // Skips the 5s pause before the next connection attempt
+    void reconnectNow() {
+        BlynkProtocol<BlynkTransportSocket>::begin("token");
+    }
+};
+
+static BlynkTransportSocket transp;
+static LivenessDevice Blynk(transp);
+
+static void connect_through_proxy()
+{
+    blackhole = false;
+    session++;
+    Blynk.reconnectNow();
+    CHECK(Blynk.connect(2000));
+}
+
+// Pings are timed from the round trip, so an idle link is checked in time
+static void test_adaptive_pings()
+{
+    const unsigned before = pings;
+    const double start = now_ms();
+    while (now_ms() - start < 3500) {
+        Blynk.run();
+        CHECK(Blynk.connected());
+    }
+    const unsigned sent = pings - before;
+    printf("idle 3.5 s: %u pings, rtt %u ms, response timeout %u ms\n",
+           sent, Blynk.rtt(), Blynk.responseTimeout());
+    CHECK(sent >= 2);
+    CHECK(Blynk.rtt() < 50);
+    CHECK(Blynk.responseTimeout() == BLYNK_DEAD_LINK_MS / 4);
+    printf("adaptive pings: OK\n");
+}
+
+static void test_idle_blackhole()
+{
+    connect_through_proxy();
+    for (int i = 0; i < 50; i++) Blynk.run();   // some idle time first
+
+    blackhole = true;
+    const double start = now_ms();
+    while (Blynk.connected() && now_ms() - start < 30000) {
+        Blynk.run();
+    }
+    const double detected = now_ms() - start;
+    printf("idle link blackholed: lost after %.0f ms (bound %lu ms, without pings timed from the rtt: %lu ms)\n",
+           detected, BLYNK_DEAD_LINK_MS, 1000UL * BLYNK_HEARTBEAT + BLYNK_TIMEOUT_MS * 3);
+    CHECK(!Blynk.connected());
+    CHECK(detected <= BLYNK_DEAD_LINK_MS + SLACK_MS);
+    printf("idle blackhole: OK\n");
+}
+
+// A write that can't go anywhere must not block for longer than the bound.
+// Without run(), only the blocked write itself can notice.
+static void test_busy_blackhole()
+{
+    connect_through_proxy();
+    blackhole = true;
+
+    static char text[1024];
+    memset(text, 'x', sizeof(text) - 1);
+    double longest = 0;
+    unsigned writes = 0;
+    const double start = now_ms();
+    while (Blynk.connected() && now_ms() - start < 30000) {
+        const double t = now_ms();
+        Blynk.virtualWrite(V0, text);
+        longest = BlynkMax(longest, now_ms() - t);
+        writes++;
+    }
+    const double detected = now_ms() - start;
+    printf("busy link blackholed: lost after %.0f ms and %u writes, longest call %.0f ms\n",
+           detected, writes, longest);
+    CHECK(!Blynk.connected());
+    CHECK(longest <= BLYNK_DEAD_LINK_MS + SLACK_MS);
+    CHECK(detected <= BLYNK_DEAD_LINK_MS + SLACK_MS);
+    printf("busy blackhole: OK\n");
+}
+
+int main()
+{
+    serverFd = listen_local(serverPort);
+    proxyFd = listen_local(proxyPort, 4096);
+    pthread_t server, proxy;
+    pthread_create(&server, NULL, server_main, NULL);
+    pthread_create(&proxy, NULL, proxy_main, NULL);
+
+    Blynk.begin("token", "127.0.0.1", proxyPort);
+    CHECK(Blynk.connect(2000));
+
+    test_adaptive_pings();
+    test_idle_blackhole();
+    test_busy_blackhole();
+
+    Blynk.disconnect();
+    session++;
+    shutdown(proxyFd, SHUT_RDWR);
+    shutdown(serverFd, SHUT_RDWR);
+    pthread_join(proxy, NULL);
+    pthread_join(server, NULL);
+    return 0;
+}
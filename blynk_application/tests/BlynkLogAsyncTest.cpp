@@ -0,0 +1,135 @@
+/**
+ * @file       BlynkLogAsyncTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Asynchronous logger: formatting, and the cost of a log call
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkLogAsyncTest
+ *
+ * The cost of BLYNK_LOG is printed with room in the ring and with the ring
+ * full. The ring is filled by writing the log into a pipe nobody reads,
+ * so the writer thread blocks and the records stay queued.
+ */
+
+#define BLYNK_LOG_ASYNC
+#define BLYNK_PRINT stdout
+
+#include <Blynk/BlynkDebug.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Formats are applied by the writer, with the captured arguments
+static void test_format()
+{
+    FILE* out = tmpfile();
+    CHECK(out);
+    BlynkLogAsyncBegin(out);
+
+    char name[] = "sensor-0";
+    BLYNK_LOG("int %d, uint %u, hex %04x", -5, 7U, 0xab);
+    BLYNK_LOG("float %.2f, str %s", 3.14159, name);
+    BLYNK_LOG("star %.*s|%*d|%-*d|%.*f", 3, "abcdef", 5, 42, 4, 7, 1, 2.25);
+    BLYNK_LOG("negative %.*s|%*d", -1, "all", -3, 9);
+    BLYNK_LOG2("stream ", 12);
+    BlynkLogAsyncFlush();
+
+    char text[1024];
+    rewind(out);
+    const size_t len = fread(text, 1, sizeof(text) - 1, out);
+    text[len] = '\0';
+    fclose(out);
+
+    CHECK(strstr(text, "] int -5, uint 7, hex 00ab" BLYNK_NEWLINE));
+    CHECK(strstr(text, "] float 3.14, str sensor-0" BLYNK_NEWLINE));
+    CHECK(strstr(text, "] star abc|   42|7   |2.2" BLYNK_NEWLINE));
+    CHECK(strstr(text, "] negative all|9  " BLYNK_NEWLINE));
+    CHECK(strstr(text, "] stream 12\n"));
+    printf("format: OK\n");
+}
+
+static double log_cost_ns(unsigned count)
+{
+    const double start = now_ns();
+    for (unsigned i = 0; i < count; i++) {
+        BLYNK_LOG("sample %u: %d.%d C on %s", i, 21, 5, "ch0");
+    }
+    return (now_ns() - start) / count;
+}
+
+static int pipeFds[2];
+static volatile bool reading = false;
+
+static void* pipe_reader(void*)
+{
+    char buf[4096];
+    while (reading) {
+        if (read(pipeFds[0], buf, sizeof(buf)) <= 0) break;
+    }
+    return NULL;
+}
+
+static void test_cost()
+{
+    // Room in the ring
+    BlynkLogAsyncBegin(fopen("/dev/null", "w"));
+    BlynkLogAsyncFlush();
+    const uint32_t dropped0 = BlynkLogAsyncDropped();
+    const unsigned N = BLYNK_LOG_ASYNC_DEPTH / 2;
+    double room = 1e18;
+    for (int rep = 0; rep < 20; rep++) {
+        BlynkLogAsyncFlush();
+        room = BlynkMin(room, log_cost_ns(N));
+    }
+    BlynkLogAsyncFlush();
+    CHECK(BlynkLogAsyncDropped() == dropped0);
+
+    // Full: the writer blocks on a pipe that is not read
+    CHECK(pipe(pipeFds) == 0);
+    fcntl(pipeFds[1], F_SETPIPE_SZ, 4096);
+    BlynkLogAsyncBegin(fdopen(pipeFds[1], "w"));
+    for (int i = 0; i < 1000 && BlynkLogAsyncDropped() == dropped0; i++) {
+        log_cost_ns(BLYNK_LOG_ASYNC_DEPTH);
+        usleep(1000);
+    }
+    const uint32_t dropped1 = BlynkLogAsyncDropped();
+    const unsigned M = 100000;
+    const double full = log_cost_ns(M);
+    const uint32_t dropped2 = BlynkLogAsyncDropped();
+
+    // Let the writer go before checking anything. The writer may still
+    // have drained a few records during the loop, so not every call of
+    // it is necessarily a drop.
+    pthread_t reader;
+    reading = true;
+    pthread_create(&reader, NULL, pipe_reader, NULL);
+    pthread_detach(reader);
+    BlynkLogAsyncFlush();
+
+    printf("BLYNK_LOG: %.0f ns/call with room in the ring, %.0f ns/call with the ring full\n", room, full);
+    CHECK(dropped1 > dropped0);
+    CHECK(dropped2 > dropped1 && dropped2 - dropped1 <= M);   // nothing blocked, drops counted
+    printf("cost: OK\n");
+}
+
+int main()
+{
+    test_format();
+    test_cost();
+    return 0;
+}
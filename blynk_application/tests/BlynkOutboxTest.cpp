@@ -0,0 +1,238 @@
+/**
+ * @file       BlynkOutboxTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Outbox ring, crash recovery, drop policies and replay through BlynkProtocol
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkOutboxTest [file]
+ */
+
+#define BLYNK_USE_OUTBOX
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+#include <utility/BlynkOutbox.h>
+
+#include <deque>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static const size_t SIZE = 64 * 1024;
+static const char* path;
+
+static std::string make_payload(unsigned n, unsigned seed)
+{
+    char head[32];
+    const int h = snprintf(head, sizeof(head), "vw%c%u%c", 0, n, 0);
+    std::string s(head, h);
+    s.append(seed % 300, char('a' + n % 26));
+    return s;
+}
+
+static std::string peek_pop()
+{
+    char buff[BLYNK_OUTBOX_MAX_RECORD];
+    uint8_t cmd;
+    uint32_t seq;
+    const int len = BlynkOutboxPeek(cmd, buff, sizeof(buff), seq);
+    CHECK(len >= 0 && cmd == BLYNK_CMD_HARDWARE);
+    BlynkOutboxPop(seq, BlynkMillis());
+    return std::string(buff, len);
+}
+
+static void test_ring()
+{
+    unlink(path);
+    CHECK(BlynkOutboxOpen(path, SIZE));
+    CHECK(BlynkOutboxPending() == 0);
+
+    std::deque<std::string> shadow;
+    unsigned seed = 1, n = 0;
+    for (int round = 0; round < 20000; round++) {
+        if (rand_r(&seed) % 3) {
+            const std::string p = make_payload(n++, rand_r(&seed));
+            CHECK(BlynkOutboxPush(BLYNK_CMD_HARDWARE, p.data(), 4, p.data() + 4, p.size() - 4));
+            shadow.push_back(p);
+        }
+        // DROP_OLDEST may have discarded the front
+        while (shadow.size() > BlynkOutboxPending()) shadow.pop_front();
+        if (!shadow.empty() && rand_r(&seed) % 2) {
+            CHECK(peek_pop() == shadow.front());
+            shadow.pop_front();
+        }
+        if (round % 1000 == 0) {
+            // Reopen: everything must be recovered
+            BlynkOutboxClose();
+            CHECK(BlynkOutboxOpen(path, SIZE));
+            CHECK(BlynkOutboxPending() == shadow.size());
+        }
+    }
+    while (!shadow.empty()) {
+        CHECK(peek_pop() == shadow.front());
+        shadow.pop_front();
+    }
+    BlynkOutboxStats st;
+    BlynkOutboxGetStats(st);
+    CHECK(st.pending == 0 && st.pendingBytes == 0);
+    CHECK(st.droppedOldest > 0);
+    printf("ring: OK (%u stored, %u dropped oldest)\n", n, st.droppedOldest);
+}
+
+static void test_drop_newest()
+{
+    unlink(path);
+    CHECK(BlynkOutboxOpen(path, SIZE, BLYNK_OUTBOX_DROP_NEWEST));
+    unsigned n = 0;
+    for (;;) {
+        const std::string p = make_payload(n, 100);
+        if (!BlynkOutboxPush(BLYNK_CMD_HARDWARE, p.data(), p.size())) break;
+        n++;
+    }
+    BlynkOutboxStats st;
+    BlynkOutboxGetStats(st);
+    CHECK(st.droppedNewest == 1 && st.pending == n);
+    CHECK(peek_pop() == make_payload(0, 100));   // oldest kept
+    BlynkOutboxClose();
+    printf("drop newest: OK (%u records fit)\n", n);
+}
+
+// A writer is killed at random moments; the file must recover a
+// consecutive run of intact records.
+static void test_crash()
+{
+    unlink(path);
+    for (int iter = 0; iter < 20; iter++) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            if (!BlynkOutboxOpen(path, SIZE)) _exit(1);
+            unsigned seed = getpid();
+            for (unsigned n = 0;; n++) {
+                const std::string p = make_payload(n, rand_r(&seed));
+                BlynkOutboxPush(BLYNK_CMD_HARDWARE, p.data(), p.size());
+                if (n % 3 == 0) {
+                    char b[BLYNK_OUTBOX_MAX_RECORD]; uint8_t c; uint32_t s;
+                    if (BlynkOutboxPeek(c, b, sizeof(b), s) >= 0) BlynkOutboxPop(s, 0);
+                }
+            }
+        }
+        usleep(1000 + rand() % 20000);
+        kill(pid, SIGKILL);
+        int status;
+        waitpid(pid, &status, 0);
+
+        CHECK(BlynkOutboxOpen(path, SIZE));
+        const unsigned pending = BlynkOutboxPending();
+        CHECK(pending > 0);
+        long prev = -1;
+        for (unsigned i = 0; i < pending; i++) {
+            const std::string p = peek_pop();
+            CHECK(p.compare(0, 3, std::string("vw\0", 3)) == 0);
+            const long n = atol(p.c_str() + 3);
+            CHECK(prev < 0 || n == prev + 1);
+            prev = n;
+        }
+        CHECK(BlynkOutboxPending() == 0);
+        BlynkOutboxClose();
+    }
+    printf("crash recovery: OK\n");
+}
+
+static void run_for(BlynkTestDevice& dev, unsigned ms)
+{
+    const millis_time_t t = BlynkMillis();
+    while (BlynkMillis() - t < ms) {
+        dev.run();
+        usleep(100);
+    }
+}
+
+// Outage -> samples are stored -> reconnect -> replay at the configured
+// rate, interleaved with live values
+static void test_replay()
+{
+    unlink(path);
+    CHECK(BlynkOutboxOpen(path, SIZE));
+    BlynkOutboxSetReplayRate(200, 5);
+
+    BlynkTestTransport transp;
+    BlynkTestDevice dev(transp);
+    dev.begin("token");
+    run_for(dev, 20);
+    CHECK(dev.connected());
+
+    transp.online = false;
+    transp.dropLink();
+    run_for(dev, 10);
+    CHECK(!dev.connected());
+
+    const unsigned N = 100;
+    for (unsigned i = 0; i < N; i++) {
+        dev.virtualWrite(1, i);
+    }
+    dev.virtualWrite(2, "skipped", "notify");   // stored too: it's a virtualWrite
+    dev.syncAll();                              // not stored
+    CHECK(BlynkOutboxPending() == N + 1);
+
+    transp.frames.clear();
+    transp.online = true;
+    dev.reconnectNow();
+    const millis_time_t t0 = BlynkMillis();
+    unsigned live = 0;
+    while (BlynkOutboxPending() && BlynkMillis() - t0 < 5000) {
+        dev.run();
+        if (dev.connected() && live < 10) {
+            dev.virtualWrite(3, live++);
+        }
+        usleep(1000);
+    }
+    CHECK(BlynkOutboxPending() == 0);
+
+    // Backlog arrives in order, with live values in between
+    unsigned next = 0, liveSeen = 0, firstLive = 0, lastBacklog = 0, idx = 0;
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        const BlynkTestFrame& f = transp.frames[i];
+        if (f.type != BLYNK_CMD_HARDWARE) continue;
+        idx++;
+        BlynkParam p((void*)f.body.data(), f.body.size());
+        BlynkParam::iterator it = p.begin();
+        ++it;
+        if (it.asInt() == 1) {
+            CHECK(unsigned((++it).asInt()) == next);
+            next++;
+            lastBacklog = idx;
+        } else if (it.asInt() == 3) {
+            if (!liveSeen++) firstLive = idx;
+        }
+    }
+    CHECK(next == N);
+    CHECK(liveSeen == 10 && firstLive < lastBacklog);
+
+    BlynkOutboxStats st;
+    BlynkOutboxGetStats(st);
+    CHECK(st.replayed == N + 1);
+    printf("replay: OK (%u msgs in %u ms: %.0f msg/s, %.0f B/s, limit 200 msg/s)\n",
+           st.replayed, st.replayMs, st.replayMsgRate, st.replayByteRate);
+    CHECK(st.replayMsgRate < 200 * 1.2);
+    BlynkOutboxClose();
+}
+
+int main(int argc, char* argv[])
+{
+    path = (argc > 1) ? argv[1] : "/tmp/blynk-outbox-test.bin";
+    test_ring();
+    BlynkOutboxClose();
+    test_drop_newest();
+    test_crash();
+    test_replay();
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file       BlynkPeriodicTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Deadline scheduler: drift, overruns, period changes, jitter
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkPeriodicTest
+ *   sudo ../tests/BlynkPeriodicTest --rt   # with SCHED_FIFO, CPU 0 and mlockall
+ */
+
+#include <utility/BlynkPeriodic.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static const uint64_t MS = 1000000ULL;
+
+static uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Busy "acquisition + formatting + network" time
+static void work(uint64_t ns)
+{
+    const uint64_t end = mono_ns() + ns;
+    while (mono_ns() < end) {}
+}
+
+// Same work per cycle; sleep-based loop vs deadlines
+static void test_drift()
+{
+    const unsigned N = 100;
+    const uint64_t P = 10 * MS;
+    unsigned seed = 1;
+
+    uint64_t t0 = mono_ns();
+    for (unsigned i = 0; i < N; i++) {
+        work((rand_r(&seed) % 4) * MS);
+        usleep(P / 1000);
+    }
+    const double sleepDrift = double(mono_ns() - t0 - N * P) / MS;
+
+    seed = 1;
+    BlynkPeriodic per;
+    per.start(P);
+    per.wait();
+    t0 = mono_ns();
+    for (unsigned i = 0; i < N; i++) {
+        work((rand_r(&seed) % 4) * MS);
+        per.wait();
+    }
+    const double deadlineDrift = double(mono_ns() - t0 - N * P) / MS;
+
+    // Whatever the scheduling noise, the end stays within one period of N x P
+    CHECK(per.stats().cycles == N);
+    CHECK(deadlineDrift < double(P / MS));
+    CHECK(sleepDrift > 50.0);
+    printf("drift over %u x 10 ms with 0..3 ms work: sleep() %+.1f ms, deadlines %+.2f ms\n",
+           N, sleepDrift, deadlineDrift);
+    per.printStats(stdout);
+}
+
+static void test_overrun()
+{
+    BlynkPeriodic per;
+    per.start(20 * MS);
+    per.wait();
+    const uint64_t t0 = mono_ns();
+    work(4 * MS);
+    per.wait();                 // 20 ms, on time
+    work(50 * MS);              // 70 ms: deadlines 40 and 60 have passed
+    per.wait();                 // 40 is skipped, 60 runs late
+    per.wait();                 // 80 ms, back in phase
+    const BlynkPeriodicStats& s = per.stats();
+    CHECK(s.cycles == 3 && s.overruns == 1 && s.skipped == 1);
+    // On the 80 ms deadline, not 20 ms after the late run; allow for wakeup noise
+    const uint64_t el = mono_ns() - t0;
+    CHECK(el >= 80 * MS && el < 100 * MS);
+    printf("overrun: OK (%llu overrun, %llu skipped, phase kept)\n",
+           (unsigned long long)s.overruns, (unsigned long long)s.skipped);
+}
+
+static BlynkPeriodic* changing;
+
+static void* change_period(void*)
+{
+    usleep(60000);              // while sleeping towards the 80 ms deadline
+    changing->setPeriod(10 * MS);
+    return NULL;
+}
+
+static void test_period_change()
+{
+    BlynkPeriodic per;
+    changing = &per;
+    per.start(40 * MS);
+    per.wait();
+    const uint64_t t0 = mono_ns();
+    pthread_t t;
+    pthread_create(&t, NULL, change_period, NULL);
+    per.wait();                 // 40 ms
+    per.wait();                 // 80 ms: scheduled before the change
+    const uint64_t t80 = mono_ns() - t0;
+    per.wait();                 // 90 ms: new period
+    const uint64_t t90 = mono_ns() - t0;
+    pthread_join(t, NULL);
+    // Lower bounds are exact; upper ones leave room for wakeup noise,
+    // while still telling the new period (90) from the old one (120)
+    CHECK(t80 >= 80 * MS && t80 < 100 * MS);
+    CHECK(t90 >= 90 * MS && t90 < 110 * MS);
+    printf("period change: OK (takes effect at the next deadline)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "--rt")) {
+        printf("realtime setup: %s\n", BlynkRealtimeSetup(50, 0, true) ? "OK" : "failed (needs root)");
+    }
+    test_drift();
+    test_overrun();
+    test_period_change();
+    return 0;
+}
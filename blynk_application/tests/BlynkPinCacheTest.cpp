@@ -0,0 +1,258 @@
+/**
+ * @file       BlynkPinCacheTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Reads of virtual pins answered from the last written value
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkPinCacheTest
+ *
+ * The last part prints how long a read takes when its handler
+ * recomputes the value, and when it is answered from the cache.
+ */
+
+#define BLYNK_USE_PIN_CACHE
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+static unsigned reads = 0;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+BLYNK_READ(V1)
+{
+    reads++;
+    Blynk.virtualWrite(V1, 20 + reads);
+}
+
+BLYNK_READ(V5)
+{
+    reads++;
+    Blynk.virtualWrite(V5, "short");
+}
+
+// Averages a window of samples, like a smoothed sensor value
+static float samples[4096];
+
+BLYNK_READ(V7)
+{
+    float sum = 0;
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        sum += samples[i];
+    }
+    Blynk.virtualWrite(V7, sum / (sizeof(samples) / sizeof(samples[0])));
+}
+
+static void send_vr(uint16_t id, int pin)
+{
+    char buf[16];
+    const int len = snprintf(buf, sizeof(buf), "vr%c%d", 0, pin);
+    transp.send(BLYNK_CMD_HARDWARE, id, buf, len);
+}
+
+// Body of the answer to request 'id', or "" if there is none
+static std::string answer(uint16_t id)
+{
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        if (transp.frames[i].type == BLYNK_CMD_HARDWARE && transp.frames[i].id == id) {
+            return transp.frames[i].body;
+        }
+    }
+    return std::string();
+}
+
+static std::string vw(int pin, const char* value, size_t len)
+{
+    char buf[16];
+    const int n = snprintf(buf, sizeof(buf), "vw%c%d%c", 0, pin, 0);
+    return std::string(buf, n) + std::string(value, len);
+}
+
+static void test_hit()
+{
+    transp.frames.clear();
+    send_vr(10, 1);
+    Blynk.run();
+    CHECK(reads == 1);
+    CHECK(answer(10) == vw(1, "21", 2));
+
+    send_vr(11, 1);
+    Blynk.run();
+    CHECK(reads == 1);                          // no handler call
+    CHECK(answer(11) == vw(1, "21", 2));        // with the id of the request
+
+    // Stored without sending, e.g. by a sensor thread; V2 has no handler
+    BlynkPinCacheStore(V2, "3.5", 3);
+    send_vr(12, 2);
+    Blynk.run();
+    CHECK(answer(12) == vw(2, "3.5", 3));
+
+    // Binary values and several values are kept as sent
+    Blynk.virtualWriteBinary(V6, "a\0b", 3);
+    Blynk.virtualWrite(V8, 1, "two", 3);
+    send_vr(13, 6);
+    send_vr(14, 8);
+    Blynk.run();
+    CHECK(answer(13) == vw(6, "a\0b", 3));
+    CHECK(answer(14) == vw(8, "1\0two\0" "3", 7));
+    printf("hit: OK\n");
+}
+
+static void test_max_age()
+{
+    BlynkPinCacheSetMaxAge(V1, 20);
+    usleep(30000);
+    transp.frames.clear();
+    send_vr(20, 1);
+    Blynk.run();
+    CHECK(reads == 2);                          // too old: recomputed
+    CHECK(answer(20) == vw(1, "22", 2));
+    send_vr(21, 1);
+    Blynk.run();
+    CHECK(reads == 2);
+    CHECK(answer(21) == vw(1, "22", 2));
+
+    // 0: always the handler
+    BlynkPinCacheSetMaxAge(V1, 0);
+    send_vr(22, 1);
+    send_vr(23, 1);
+    Blynk.run();
+    CHECK(reads == 4);
+    CHECK(answer(23) == vw(1, "24", 2));
+    BlynkPinCacheSetMaxAge(V1, BLYNK_PIN_CACHE_ANY_AGE);
+
+    BlynkPinCacheClear(V1);
+    send_vr(24, 1);
+    Blynk.run();
+    CHECK(reads == 5);
+    printf("max age: OK\n");
+}
+
+// A value that does not fit must not leave the previous one behind
+static void test_too_long()
+{
+    char text[BLYNK_PIN_CACHE_DATA + 2];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    BlynkPinCacheStats before;
+    BlynkPinCacheGetStats(before);
+    Blynk.virtualWrite(V5, "old");
+    Blynk.virtualWrite(V5, text);
+    transp.frames.clear();
+    reads = 0;
+    send_vr(30, 5);
+    Blynk.run();
+    CHECK(reads == 1);
+    CHECK(answer(30) == vw(5, "short", 5));
+
+    BlynkPinCacheStats st;
+    BlynkPinCacheGetStats(st);
+    CHECK(st.tooLong == before.tooLong + 1);
+    printf("too long: OK\n");
+}
+
+/*
+ * A thread stores while the protocol thread reads: never a mix of two values
+ */
+
+static volatile bool storing = true;
+
+static void* store_main(void*)
+{
+    char value[BLYNK_PIN_CACHE_DATA];
+    for (unsigned n = 0; storing; n++) {
+        const size_t len = 1 + n % BLYNK_PIN_CACHE_DATA;
+        memset(value, '0' + n % 10, len);
+        BlynkPinCacheStore(V9, value, len);
+    }
+    return NULL;
+}
+
+static void test_concurrent()
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, store_main, NULL);
+    unsigned checked = 0;
+    const double start = now_ms();
+    while (now_ms() - start < 200) {
+        char value[BLYNK_PIN_CACHE_DATA];
+        const int len = BlynkPinCacheRead(V9, value);
+        if (len < 0) continue;
+        CHECK(len >= 1 && len <= BLYNK_PIN_CACHE_DATA);
+        for (int i = 1; i < len; i++) {
+            CHECK(value[i] == value[0]);
+        }
+        checked++;
+    }
+    storing = false;
+    pthread_join(thread, NULL);
+    printf("concurrent: OK (%u reads)\n", checked);
+}
+
+static double read_cost_us(unsigned count, bool cached)
+{
+    BlynkPinCacheSetMaxAge(V7, cached ? BLYNK_PIN_CACHE_ANY_AGE : 0);
+    const double start = now_ms();
+    for (unsigned i = 0; i < count; i++) {
+        transp.frames.clear();
+        send_vr(1000 + i % 1000, 7);
+        Blynk.run();
+    }
+    return (now_ms() - start) * 1000.0 / count;
+}
+
+static void test_cost()
+{
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        samples[i] = 20.0f + (i % 100) / 100.0f;
+    }
+    const unsigned N = 20000;
+    const double handler = read_cost_us(N, false);
+    const double cached = read_cost_us(N, true);
+    printf("read of V7: %.2f us with the handler, %.2f us from the cache\n", handler, cached);
+
+    BlynkPinCacheStats st;
+    BlynkPinCacheGetStats(st);
+    printf("stores %u, too long %u, hits %u, stale %u, misses %u\n",
+           st.stores, st.tooLong, st.hits, st.stale, st.misses);
+    CHECK(st.hits >= N);
+    printf("cost: OK\n");
+}
+
+int main()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    test_hit();
+    test_max_age();
+    test_too_long();
+    test_concurrent();
+    test_cost();
+    return 0;
+}
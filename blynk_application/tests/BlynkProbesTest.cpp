@@ -0,0 +1,151 @@
+/**
+ * @file       BlynkProbesTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      USDT probes: listed in the ELF notes, and a NOP at every site
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkProbesTest
+ *
+ * Needs <sys/sdt.h> (systemtap-sdt-dev); without it the probes compile
+ * to nothing and only that is checked.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <utility/BlynkLatency.h>
+#include <utility/BlynkProbes.h>
+
+#include <elf.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <set>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static int written = -1;
+
+BLYNK_WRITE(V5)
+{
+    written = param.asInt();
+}
+
+// Exercises every probe that the library has
+static void run_protocol()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    const char vw[] = "vw\0" "5\0" "42";
+    transp.send(BLYNK_CMD_HARDWARE, 7, vw, sizeof(vw) - 1);
+    const char vr[] = "vr\0" "6";
+    transp.send(BLYNK_CMD_HARDWARE, 8, vr, sizeof(vr) - 1);
+    Blynk.run();
+    CHECK(written == 42);
+
+    static BlynkLatency stage("test.stage");
+    BlynkLatencyTimer t;
+    t.lap(stage);
+    CHECK(stage.count() == 1);
+}
+
+#ifdef BLYNK_HAS_USDT
+
+static ElfW(Addr) loadBias;
+
+static int find_bias(struct dl_phdr_info* info, size_t, void*)
+{
+    loadBias = info->dlpi_addr;     // the first object is the executable
+    return 1;
+}
+
+// Probe names of the "blynk" provider, checking that each site is a NOP
+static std::set<std::string> read_probes()
+{
+    std::set<std::string> names;
+    FILE* f = fopen("/proc/self/exe", "rb");
+    CHECK(f);
+    fseek(f, 0, SEEK_END);
+    std::string elf(ftell(f), '\0');
+    rewind(f);
+    CHECK(fread(&elf[0], 1, elf.size(), f) == elf.size());
+    fclose(f);
+
+    const ElfW(Ehdr)* eh = (const ElfW(Ehdr)*)elf.data();
+    const ElfW(Shdr)* sh = (const ElfW(Shdr)*)(elf.data() + eh->e_shoff);
+    const char* shstr = elf.data() + sh[eh->e_shstrndx].sh_offset;
+    dl_iterate_phdr(find_bias, NULL);
+
+    for (unsigned i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type != SHT_NOTE || strcmp(shstr + sh[i].sh_name, ".note.stapsdt")) continue;
+        const char* p = elf.data() + sh[i].sh_offset;
+        const char* end = p + sh[i].sh_size;
+        while (p < end) {
+            const ElfW(Nhdr)* nh = (const ElfW(Nhdr)*)p;
+            const char* name = p + sizeof(*nh);
+            const char* desc = name + ((nh->n_namesz + 3) & ~3U);
+            p = desc + ((nh->n_descsz + 3) & ~3U);
+            if (nh->n_type != 3 || strcmp(name, "stapsdt")) continue;
+
+            ElfW(Addr) pc;
+            memcpy(&pc, desc, sizeof(pc));
+            const char* provider = desc + 3 * sizeof(ElfW(Addr));
+            const char* probe = provider + strlen(provider) + 1;
+            if (strcmp(provider, "blynk")) continue;
+            names.insert(probe);
+
+            // Disabled probe: one NOP, nothing else in line
+            const unsigned char* site = (const unsigned char*)(loadBias + pc);
+#if defined(__x86_64__) || defined(__i386__)
+            CHECK(site[0] == 0x90);
+#elif defined(__aarch64__) || defined(__arm__)
+            uint32_t insn;
+            memcpy(&insn, site, sizeof(insn));
+            CHECK(insn == 0xd503201f || insn == 0xe320f000 || (insn & 0xffff) == 0xbf00);
+#endif
+        }
+    }
+    return names;
+}
+
+int main()
+{
+    run_protocol();
+    const std::set<std::string> names = read_probes();
+    const char* expected[] = {
+        "send__start", "send__done", "send__error", "header", "input", "input__done",
+        "pin__write", "pin__read", "heartbeat", "reconnect", "stage"
+    };
+    for (unsigned i = 0; i < sizeof(expected)/sizeof(expected[0]); i++) {
+        if (!names.count(expected[i])) printf("missing probe: %s\n", expected[i]);
+        CHECK(names.count(expected[i]));
+    }
+    printf("probes: OK (%zu probe names, every site is a NOP)\n", names.size());
+    return 0;
+}
+
+#else
+
+int main()
+{
+    run_protocol();
+    printf("probes: <sys/sdt.h> not available, probes are compiled out\n");
+    return 0;
+}
+
+#endif
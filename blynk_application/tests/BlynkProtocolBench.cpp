@@ -0,0 +1,395 @@
+/**
+ * @file       BlynkProtocolBench.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      BlynkProtocol micro-benchmarks over an in-memory transport
+ *
+ * Measures the library itself, without sockets or a server process:
+ * virtualWrite() encoding, processInput() decoding and dispatch,
+ * BlynkParam operations and BlynkTimer::run(). Built as C++20, it also
+ * compares coroutines (BlynkCoro.h) with the callback style: resuming a
+ * coroutine versus an indirect call, and a pin write that resumes a
+ * coroutine versus one that calls BLYNK_WRITE.
+ *
+ * For each benchmark: ns/op, heap allocations/op and, where the kernel
+ * allows perf_event_open(), user-space instructions/op (otherwise null).
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make bench                              # JSON, e.g. to keep with a commit
+ *   ../tests/BlynkProtocolBench             # table
+ *   ../tests/BlynkProtocolBench --json      # {"schema":1,"benchmarks":[...]}
+ *   ../tests/BlynkProtocolBench --quick     # shorter runs
+ *   ../tests/BlynkProtocolBench --filter=virtualWrite
+ *
+ * The JSON keys and benchmark names are kept stable, so results can be
+ * compared between commits.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include <arpa/inet.h>
+
+#include <Blynk/BlynkProtocol.h>
+#include <BlynkApiLinux.h>
+#include <Blynk/BlynkTimer.h>
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkAllocTrack.h"
+
+#if defined(__cpp_impl_coroutine)
+    #include <utility/BlynkCoro.h>
+#endif
+
+#include "BlynkTestCheck.h"
+
+// Writes are only counted; reads come from a prepared buffer that can be replayed
+class BenchTransport
+{
+public:
+    BenchTransport()
+        : bytesOut(0), isConnected(false), replyLogin(false), in(NULL), inLen(0), inPos(0)
+    {}
+
+    void begin(const char*, uint16_t) {}
+    bool connect() { isConnected = true; return true; }
+    void disconnect() { isConnected = false; }
+    bool connected() { return isConnected; }
+
+    int available() {
+        if (replyLogin) return sizeof(BlynkHeader);
+        return isConnected ? int(inLen - inPos) : 0;
+    }
+
+    size_t read(void* buf, size_t len) {
+        if (replyLogin) {
+            BlynkHeader hdr = { BLYNK_CMD_RESPONSE, htons(1), htons(BLYNK_SUCCESS) };
+            memcpy(buf, &hdr, sizeof(hdr));
+            replyLogin = false;
+            return sizeof(hdr);
+        }
+        len = BlynkMin(len, inLen - inPos);
+        memcpy(buf, in + inPos, len);
+        inPos += len;
+        return len;
+    }
+
+    size_t write(const void* buf, size_t len) {
+        if (!isConnected) return 0;
+        if (((const uint8_t*)buf)[0] == BLYNK_CMD_HW_LOGIN) replyLogin = true;
+        bytesOut += len;
+        return len;
+    }
+
+    void feed(const std::string& data) {
+        in = data.data();
+        inLen = data.size();
+        inPos = 0;
+    }
+
+    void rewind() { inPos = 0; }
+
+    unsigned long bytesOut;
+
+private:
+    bool        isConnected;
+    bool        replyLogin;
+    const char* in;
+    size_t      inLen;
+    size_t      inPos;
+};
+
+class BenchDevice
+    : public BlynkProtocol<BenchTransport>
+{
+public:
+    BenchDevice(BenchTransport& transp)
+        : BlynkProtocol<BenchTransport>(transp)
+    {}
+
+    void begin(const char* token) {
+        BlynkProtocol<BenchTransport>::begin(token);
+    }
+};
+
+static BenchTransport transp;
+static BenchDevice Blynk(transp);
+
+static volatile int sink;
+
+BLYNK_WRITE(V5)
+{
+    sink = param.asInt();
+}
+
+BLYNK_READ(V6)
+{
+    sink = request.pin;
+}
+
+// User-space instructions retired, if the kernel lets us count them
+class InstructionCounter
+{
+public:
+    InstructionCounter() : fd(-1) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~InstructionCounter() { if (fd >= 0) close(fd); }
+
+    bool available() const { return fd >= 0; }
+
+    void start() {
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop() {
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t n = 0;
+        if (::read(fd, &n, sizeof(n)) != sizeof(n)) return 0;
+        return n;
+    }
+
+private:
+    int fd;
+};
+
+static InstructionCounter instructions;
+static bool json = false;
+static bool quick = false;
+static const char* filter = NULL;
+static bool firstResult = true;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Runs 'f' (which performs 'opsPerCall' operations) for about the target time
+template <typename F>
+static void bench(const char* name, unsigned opsPerCall, F f)
+{
+    if (filter && !strstr(name, filter)) return;
+    const uint64_t target = quick ? 20000000ULL : 300000000ULL;
+
+    // Warm up, and find a batch that takes ~1 ms
+    uint64_t batch = 1;
+    for (;;) {
+        const uint64_t t0 = now_ns();
+        for (uint64_t i = 0; i < batch; i++) f();
+        if (now_ns() - t0 > 1000000ULL || batch >= (1ULL << 30)) break;
+        batch *= 2;
+    }
+
+    // Best of several batches is the least disturbed by the scheduler
+    double bestNs = 1e30;
+    uint64_t calls = 0;
+    unsigned long allocs = 0;
+    uint64_t insns = 0;
+    const uint64_t start = now_ns();
+    while (now_ns() - start < target || calls < batch * 3) {
+        const unsigned long a0 = BlynkAllocCount();
+        instructions.start();
+        const uint64_t t0 = now_ns();
+        for (uint64_t i = 0; i < batch; i++) f();
+        const uint64_t el = now_ns() - t0;
+        insns += instructions.stop();
+        allocs += BlynkAllocCount() - a0;
+        calls += batch;
+        const double ns = double(el) / batch;
+        if (ns < bestNs) bestNs = ns;
+    }
+
+    const double ops = double(calls) * opsPerCall;
+    const double nsPerOp = bestNs / opsPerCall;
+    const double allocsPerOp = allocs / ops;
+    if (json) {
+        printf("%s    {\"name\": \"%s\", \"iterations\": %.0f, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, ",
+               firstResult ? "" : ",\n", name, ops, nsPerOp, allocsPerOp);
+        if (instructions.available()) {
+            printf("\"instructions_per_op\": %.1f}", insns / ops);
+        } else {
+            printf("\"instructions_per_op\": null}");
+        }
+    } else {
+        printf("%-32s %12.0f ops %10.2f ns/op %8.3f allocs/op", name, ops, nsPerOp, allocsPerOp);
+        if (instructions.available()) {
+            printf(" %10.1f insns/op", insns / ops);
+        }
+        printf("\n");
+    }
+    firstResult = false;
+}
+
+// 'count' copies of one frame, as the server would send them
+static std::string frames(uint8_t type, const char* body, size_t len, unsigned count)
+{
+    std::string s;
+    for (unsigned i = 0; i < count; i++) {
+        BlynkHeader hdr = { type, htons(uint16_t(i + 2)), htons(uint16_t(len)) };
+        s.append((const char*)&hdr, sizeof(hdr));
+        s.append(body, len);
+    }
+    return s;
+}
+
+static void timer_cb() { sink = sink + 1; }
+
+#if defined(__cpp_impl_coroutine)
+
+static BlynkCoroLoop<BenchDevice> coro(Blynk);
+
+// Suspends on every resume()
+static BlynkTask spin()
+{
+    for (;;) {
+        sink = sink + 1;
+        co_await std::suspend_always();
+    }
+}
+
+// The coroutine version of BLYNK_WRITE(V5)
+static BlynkTask pin_writes()
+{
+    for (;;) {
+        sink = (co_await coro.write(V8)).asInt();
+    }
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json")) json = true;
+        else if (!strcmp(argv[i], "--quick")) quick = true;
+        else if (!strncmp(argv[i], "--filter=", 9)) filter = argv[i] + 9;
+    }
+
+    // The allocation counter must see the allocator
+    const unsigned long a0 = BlynkAllocCount();
+    void* volatile probe = malloc(16);
+    free(probe);
+    CHECK(BlynkAllocCount() == a0 + 1);
+
+    Blynk.begin("0123456789abcdef0123456789abcdef");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    if (json) {
+        printf("{\"schema\": 1, \"suite\": \"BlynkProtocolBench\", \"instructions\": %s, \"benchmarks\": [\n",
+               instructions.available() ? "true" : "false");
+    }
+
+    // Encoding and sending (the transport only counts bytes)
+    int n = 0;
+    bench("virtualWrite.int", 1, [&]() { Blynk.virtualWrite(V1, n++); });
+    bench("virtualWrite.float", 1, [&]() { Blynk.virtualWrite(V1, 22.5f + (n++ & 7)); });
+    bench("virtualWrite.string", 1, [&]() { Blynk.virtualWrite(V0, "12:00:01\t22.50 C\t512"); });
+    bench("virtualWrite.multi3", 1, [&]() { Blynk.virtualWrite(V2, n++, 1.5f, "on"); });
+    bench("virtualWriteBinary.64B", 1, [&]() {
+        static const char blob[64] = { 1, 2, 3 };
+        Blynk.virtualWriteBinary(V7, blob, sizeof(blob));
+    });
+
+    // Decoding and dispatch: run() drains a buffer of 1000 frames
+    const unsigned FRAMES = 1000;
+    static const char vw[] = "vw\0" "5\0" "42";
+    static const char vr[] = "vr\0" "6";
+    const std::string vwFrames = frames(BLYNK_CMD_HARDWARE, vw, sizeof(vw) - 1, FRAMES);
+    const std::string vrFrames = frames(BLYNK_CMD_HARDWARE, vr, sizeof(vr) - 1, FRAMES);
+    const std::string pingFrames = frames(BLYNK_CMD_PING, "", 0, FRAMES);
+    bench("processInput.virtualWrite", FRAMES, [&]() { transp.feed(vwFrames); Blynk.run(); });
+    bench("processInput.virtualRead", FRAMES, [&]() { transp.feed(vrFrames); Blynk.run(); });
+    bench("processInput.ping", FRAMES, [&]() { transp.feed(pingFrames); Blynk.run(); });
+    CHECK(Blynk.connected() && sink != 0);
+
+    // BlynkParam
+    bench("BlynkParam.add.int", 1, [&]() {
+        char mem[32];
+        BlynkParam p(mem, 0, sizeof(mem));
+        p.add(n++);
+        sink = p.getLength();
+    });
+    bench("BlynkParam.add.float", 1, [&]() {
+        char mem[32];
+        BlynkParam p(mem, 0, sizeof(mem));
+        p.add(22.5f);
+        sink = p.getLength();
+    });
+    static const char* volatile name = "temperature";
+    bench("BlynkParam.add.string", 1, [&]() {
+        char mem[64];
+        BlynkParam p(mem, 0, sizeof(mem));
+        p.add(name);
+        sink = p.getLength();
+    });
+    static const char eight[] = "1\0" "22\0" "333\0" "4444\0" "5\0" "66\0" "777\0" "8888";
+    bench("BlynkParam.iterate8.asInt", 8, [&]() {
+        BlynkParam p(eight, sizeof(eight) - 1);
+        int sum = 0;
+        for (BlynkParam::iterator it = p.begin(); it < p.end(); ++it) sum += it.asInt();
+        sink = sum;
+    });
+    bench("BlynkParam.iterate8.asFloat", 8, [&]() {
+        BlynkParam p(eight, sizeof(eight) - 1);
+        float sum = 0;
+        for (BlynkParam::iterator it = p.begin(); it < p.end(); ++it) sum += it.asFloat();
+        sink = int(sum);
+    });
+
+    // BlynkTimer::run() with no timer due, with 1 and 16 timers
+    static BlynkTimer timer1, timer16;
+    timer1.setInterval(100000L, timer_cb);
+    for (int i = 0; i < BlynkTimer::MAX_TIMERS; i++) {
+        timer16.setInterval(100000L + i, timer_cb);
+    }
+    bench("BlynkTimer.run.1", 1, [&]() { timer1.run(); });
+    bench("BlynkTimer.run.16", 1, [&]() { timer16.run(); });
+
+#if defined(__cpp_impl_coroutine)
+    // Context switch: coroutine resume and suspend, against an indirect call
+    static void (*volatile callback)() = timer_cb;
+    bench("callback.call", 1, [&]() { callback(); });
+    BlynkTask task = spin();
+    std::coroutine_handle<> spinner = task.release();
+    bench("coro.resume", 1, [&]() { spinner.resume(); });
+    spinner.destroy();
+
+    // Dispatch of pin writes to a coroutine, against processInput.virtualWrite
+    static const char vw8[] = "vw\0" "8\0" "42";
+    const std::string vw8Frames = frames(BLYNK_CMD_HARDWARE, vw8, sizeof(vw8) - 1, FRAMES);
+    CHECK(coro.spawn(pin_writes()));
+    bench("processInput.virtualWrite.coro", FRAMES, [&]() { transp.feed(vw8Frames); Blynk.run(); });
+    CHECK(sink == 42);
+#endif
+
+    if (json) {
+        printf("\n]}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,421 @@
+/**
+ * @file       BlynkSchedulerTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Outbound priority classes, fair sharing and alarm latency under load
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkSchedulerTest
+ *
+ * The last part saturates a link limited to 100 messages per second with
+ * telemetry and terminal text, raises an alarm every 50 ms and prints how
+ * long each class waited in the queue.
+ */
+
+#define BLYNK_USE_SCHEDULER
+#define BLYNK_USE_OUTBOX
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 100
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+#include <utility/BlynkOutbox.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static const uint32_t SLOT_MS = 1000 / BLYNK_MSG_LIMIT;
+
+static BlynkStaticTransport transp;
+static BlynkStaticDevice Blynk(transp);
+
+BLYNK_READ(V6)
+{
+    Blynk.virtualWrite(V6, 6);
+}
+
+static void push_vw(BlynkScheduler& s, int pin, const char* value, uint32_t now = 0)
+{
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "vw%c%d%c%s", 0, pin, 0, value);
+    int p;
+    const BlynkPriority cls = s.classify(BLYNK_CMD_HARDWARE, buf, len, p);
+    s.push(cls, p, BLYNK_CMD_HARDWARE, 1, buf, len, NULL, 0, now);
+}
+
+static void test_classify()
+{
+    BlynkScheduler s;
+    int pin;
+    CHECK(s.classify(BLYNK_CMD_NOTIFY, "x", 1, pin) == BLYNK_PRIO_ALARM && pin == -1);
+    CHECK(s.classify(BLYNK_CMD_EMAIL, "x", 1, pin) == BLYNK_PRIO_ALARM);
+    CHECK(s.classify(BLYNK_CMD_PROPERTY, "3\0color", 7, pin) == BLYNK_PRIO_STATE);
+    CHECK(s.classify(BLYNK_CMD_HARDWARE, "dw\0" "13\0" "1", 7, pin) == BLYNK_PRIO_STATE);
+    CHECK(s.classify(BLYNK_CMD_HARDWARE_SYNC, "vr\0" "1", 4, pin) == BLYNK_PRIO_CONTROL);
+    CHECK(s.classify(BLYNK_CMD_HARDWARE, "vw\0" "42\0" "1.5", 9, pin) == BLYNK_PRIO_TELEMETRY && pin == 42);
+
+    CHECK(s.setPinClass(0, BLYNK_PRIO_LOG));
+    CHECK(s.setPinClass(3, BLYNK_PRIO_ALARM));
+    CHECK(s.classify(BLYNK_CMD_HARDWARE, "vw\0" "0\0" "text", 9, pin) == BLYNK_PRIO_LOG && pin == 0);
+    CHECK(s.classify(BLYNK_CMD_HARDWARE, "vw\0" "3\0" "255", 8, pin) == BLYNK_PRIO_ALARM && pin == 3);
+    CHECK(s.setPinClass(3, BLYNK_PRIO_TELEMETRY));
+    CHECK(s.classify(BLYNK_CMD_HARDWARE, "vw\0" "3\0" "255", 8, pin) == BLYNK_PRIO_TELEMETRY);
+    for (int i = 0; i < BLYNK_SCHED_PIN_CLASSES - 1; i++) {
+        CHECK(s.setPinClass(100 + i, BLYNK_PRIO_STATE));
+    }
+    CHECK(!s.setPinClass(200, BLYNK_PRIO_STATE));      // table full
+    printf("classify: OK\n");
+}
+
+static void test_replace_and_drop()
+{
+    BlynkScheduler s;
+    s.setPinClass(0, BLYNK_PRIO_LOG);
+    BlynkScheduler::Entry e;
+    BlynkSchedStats st;
+
+    // A newer value for a queued pin takes its place
+    push_vw(s, 5, "1");
+    push_vw(s, 6, "1");
+    push_vw(s, 5, "2");
+    CHECK(s.pending() == 2);
+    CHECK(s.pop(e, 0) && e.pin == 5 && !memcmp(e.data + e.length - 1, "2", 1));
+    s.getStats(BLYNK_PRIO_TELEMETRY, st);
+    CHECK(st.queued == 3 && st.replaced == 1);
+    CHECK(s.pop(e, 0) && e.pin == 6);
+
+    // ... but terminal text is never merged
+    push_vw(s, 0, "line 1");
+    push_vw(s, 0, "line 2");
+    CHECK(s.pending() == 2);
+    CHECK(s.pop(e, 0) && s.pop(e, 0) && !s.pop(e, 0));
+
+    // Full: the oldest telemetry value makes room
+    for (int i = 0; i < BLYNK_SCHED_SLOTS; i++) {
+        push_vw(s, 10 + i, "1");
+    }
+    push_vw(s, 99, "1");
+    s.getStats(BLYNK_PRIO_TELEMETRY, st);
+    CHECK(st.dropped == 1 && s.pending() == BLYNK_SCHED_SLOTS);
+    CHECK(s.pop(e, 0) && e.pin == 11);
+    while (s.pop(e, 0)) {}
+
+    // Bulk classes give up slots in proportion to their weights; alarms are kept
+    for (int i = 0; i < 4; i++) {
+        push_vw(s, 0, "text");
+    }
+    for (int i = 0; i < BLYNK_SCHED_SLOTS - 4; i++) {
+        push_vw(s, 10 + i, "1");
+    }
+    CHECK(s.pending() == BLYNK_SCHED_SLOTS);
+    for (int i = 0; i < 6; i++) {
+        CHECK(s.push(BLYNK_PRIO_ALARM, -1, BLYNK_CMD_NOTIFY, 2, "alarm", 5, NULL, 0, 0) == BlynkScheduler::QUEUED);
+    }
+    BlynkSchedStats log;
+    s.getStats(BLYNK_PRIO_LOG, log);
+    s.getStats(BLYNK_PRIO_TELEMETRY, st);
+    CHECK(st.dropped == 1 + 5 && log.dropped == 1);             // 7 values and 3 lines left
+    while (s.pop(e, 0)) {}
+
+    // Alarms and state only: text is refused, an alarm has to wait
+    for (int i = 0; i < BLYNK_SCHED_SLOTS; i++) {
+        CHECK(s.push(BLYNK_PRIO_STATE, -1, BLYNK_CMD_PROPERTY, 3, "p", 1, NULL, 0, 0) == BlynkScheduler::QUEUED);
+    }
+    CHECK(s.push(BLYNK_PRIO_LOG, 0, BLYNK_CMD_HARDWARE, 4, "vw\0" "0\0" "t", 6, NULL, 0, 0) == BlynkScheduler::DROPPED);
+    CHECK(s.push(BLYNK_PRIO_ALARM, -1, BLYNK_CMD_NOTIFY, 4, "a", 1, NULL, 0, 0) == BlynkScheduler::FULL);
+    printf("replace and drop: OK\n");
+}
+
+// Every class always has something queued: slots are shared by weight
+static void test_shares()
+{
+    BlynkScheduler s;
+    const BlynkPriority classes[] = { BLYNK_PRIO_ALARM, BLYNK_PRIO_STATE, BLYNK_PRIO_TELEMETRY, BLYNK_PRIO_LOG };
+    for (int i = 0; i < 3; i++) {
+        for (unsigned c = 0; c < 4; c++) {
+            s.push(classes[c], -1, BLYNK_CMD_HARDWARE, 1, "x", 1, NULL, 0, 0);
+        }
+    }
+    unsigned sent[BLYNK_PRIO_COUNT] = { 0 };
+    BlynkScheduler::Entry e;
+    for (int i = 0; i < 150; i++) {
+        CHECK(s.pop(e, 0));
+        sent[e.cls]++;
+        s.push(BlynkPriority(e.cls), -1, BLYNK_CMD_HARDWARE, 1, "x", 1, NULL, 0, 0);
+    }
+    printf("shares of 150 slots: alarm %u, state %u, telemetry %u, log %u\n",
+           sent[BLYNK_PRIO_ALARM], sent[BLYNK_PRIO_STATE], sent[BLYNK_PRIO_TELEMETRY], sent[BLYNK_PRIO_LOG]);
+    CHECK(sent[BLYNK_PRIO_ALARM] >= 79 && sent[BLYNK_PRIO_ALARM] <= 81);
+    CHECK(sent[BLYNK_PRIO_STATE] >= 39 && sent[BLYNK_PRIO_STATE] <= 41);
+    CHECK(sent[BLYNK_PRIO_TELEMETRY] >= 19 && sent[BLYNK_PRIO_TELEMETRY] <= 21);
+    CHECK(sent[BLYNK_PRIO_LOG] >= 9 && sent[BLYNK_PRIO_LOG] <= 11);
+
+    // A control command goes first, whatever the tags
+    s.push(BLYNK_PRIO_CONTROL, -1, BLYNK_CMD_HARDWARE_SYNC, 9, "vr", 2, NULL, 0, 0);
+    CHECK(s.pop(e, 0) && e.cls == BLYNK_PRIO_CONTROL && e.id == 9);
+    printf("shares: OK\n");
+}
+
+static void connect()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+}
+
+// Counts the frames written since the last call
+static unsigned drain(unsigned* byType)
+{
+    size_t pos = 0;
+    BlynkHeader hdr;
+    const uint8_t* body;
+    unsigned n = 0;
+    while (transp.frame(pos, hdr, body)) {
+        if (byType) byType[hdr.type]++;
+        n++;
+    }
+    transp.clearOutput();
+    return n;
+}
+
+static void print_stats(BlynkScheduler& s)
+{
+    printf("  %-10s %7s %7s %9s %8s %10s %9s\n", "class", "queued", "sent", "replaced", "dropped", "mean wait", "max wait");
+    for (int c = 0; c < BLYNK_PRIO_COUNT; c++) {
+        BlynkSchedStats st;
+        s.getStats(BlynkPriority(c), st);
+        if (!st.queued) continue;
+        printf("  %-10s %7u %7u %9u %8u %7.1f ms %6u ms\n", BlynkScheduler::className(BlynkPriority(c)),
+               st.queued, st.sent, st.replaced, st.dropped,
+               st.sent ? double(st.waitTotalMs) / st.sent : 0.0, st.waitMaxMs);
+    }
+}
+
+// Replies to server reads go out in the next slot, with the request's id
+static void test_protocol()
+{
+    drain(NULL);
+    for (int i = 0; i < 8; i++) {
+        Blynk.virtualWrite(20 + i, i);
+    }
+    const char vr[] = "vr\0" "6";
+    transp.send(BLYNK_CMD_HARDWARE, 77, vr, sizeof(vr) - 1);
+    Blynk.run();
+    usleep((SLOT_MS + 1) * 1000);   // input counts against the budget too
+    Blynk.run();
+
+    size_t pos = 0;
+    BlynkHeader hdr;
+    const uint8_t* body;
+    bool reply = false;
+    unsigned before = 0;
+    while (transp.frame(pos, hdr, body)) {
+        if (hdr.msg_id == 77) {
+            reply = !memcmp(body, "vw\0" "6\0" "6", 6);
+            break;
+        }
+        CHECK(hdr.type == BLYNK_CMD_HARDWARE);
+        before++;
+    }
+    CHECK(reply);
+    CHECK(before <= 1);
+    CHECK(Blynk.scheduler().pending() > 0);
+    for (int i = 0; i < 200 && Blynk.scheduler().pending(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.scheduler().pending() == 0);
+    drain(NULL);
+    printf("protocol: OK\n");
+}
+
+static void test_alarm_latency()
+{
+    BlynkScheduler& s = Blynk.scheduler();
+    s.setPinClass(V0, BLYNK_PRIO_LOG);      // terminal
+    s.setPinClass(V3, BLYNK_PRIO_ALARM);    // alarm LED
+    s.resetStats();
+    drain(NULL);
+
+    unsigned byType[256] = { 0 };
+    unsigned frames = 0;
+    unsigned alarms = 0;
+    unsigned value = 0;
+    const millis_time_t start = BlynkMillis();
+    millis_time_t nextAlarm = start + 20;
+    millis_time_t now;
+    for (unsigned i = 0; (now = BlynkMillis()) - start < 1500; i++) {
+        // 4000 values for 8 pins and 500 lines of text per second, for 100 slots
+        for (int k = 0; k < 4; k++) {
+            Blynk.virtualWrite(10 + value % 8, value);
+            value++;
+        }
+        if (i % 2 == 0) {
+            Blynk.virtualWrite(V0, "12:00:00\t1.65 V\t\t22.50 C\t 512\n");
+        }
+        if (now >= nextAlarm) {
+            Blynk.notify("Alarm: DAC output out of range");
+            Blynk.virtualWrite(V3, 255);
+            alarms++;
+            nextAlarm += 50;
+        }
+        Blynk.run();
+        frames += drain(byType);
+        usleep(1000);
+    }
+    const millis_time_t elapsed = BlynkMillis() - start;
+
+    printf("alarm latency: %u alarms, %u frames in %u ms (%.0f per second, limit %d)\n",
+           alarms, frames, unsigned(elapsed), frames * 1000.0 / elapsed, BLYNK_MSG_LIMIT);
+    print_stats(s);
+
+    BlynkSchedStats alarm, telemetry, log;
+    s.getStats(BLYNK_PRIO_ALARM, alarm);
+    s.getStats(BLYNK_PRIO_TELEMETRY, telemetry);
+    s.getStats(BLYNK_PRIO_LOG, log);
+    CHECK(alarm.queued == 2 * alarms && alarm.dropped == 0 && alarm.replaced == 0);
+    CHECK(byType[BLYNK_CMD_NOTIFY] >= alarms - 1);
+    // Notification and LED arrive together: the second waits for one more
+    // slot (the margin is for a loaded machine)
+    CHECK(alarm.waitMaxMs <= 5 * SLOT_MS);
+    CHECK(alarm.waitTotalMs <= alarm.sent * 3 * SLOT_MS);
+    // The link stays busy, and bulk traffic still gets through
+    CHECK(frames >= elapsed / SLOT_MS * 8 / 10);
+    CHECK(telemetry.sent >= 30 && telemetry.replaced > 0);
+    CHECK(log.sent >= 15 && log.dropped > 0);
+    CHECK(telemetry.sent > log.sent);
+    CHECK(Blynk.connected());
+}
+
+/*
+ * Another thread finds the queue full: it waits for run() to make room,
+ * and never reads input or writes frames itself
+ */
+
+static const int THREAD_ALARMS = BLYNK_SCHED_SLOTS + 8;
+static int alarmsQueued = 0;
+
+static void* alarm_main(void*)
+{
+    for (int i = 0; i < THREAD_ALARMS; i++) {
+        Blynk.notify("Alarm");
+        __atomic_add_fetch(&alarmsQueued, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void test_other_thread()
+{
+    BlynkScheduler& s = Blynk.scheduler();
+    for (int i = 0; i < 1000 && s.pending(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(s.pending() == 0);
+    drain(NULL);
+
+    const char vr[] = "vr\0" "6";
+    transp.send(BLYNK_CMD_HARDWARE, 88, vr, sizeof(vr) - 1);
+    pthread_t thread;
+    pthread_create(&thread, NULL, alarm_main, NULL);
+    usleep(100000);
+    CHECK(__atomic_load_n(&alarmsQueued, __ATOMIC_RELAXED) == BLYNK_SCHED_SLOTS);
+    CHECK(s.pending() == BLYNK_SCHED_SLOTS);
+    CHECK(drain(NULL) == 0);            // the request is still unread
+
+    unsigned byType[256] = { 0 };
+    for (int i = 0; i < 2000 && (__atomic_load_n(&alarmsQueued, __ATOMIC_RELAXED) < THREAD_ALARMS || s.pending()); i++) {
+        Blynk.run();
+        drain(byType);
+        usleep(1000);
+    }
+    pthread_join(thread, NULL);
+    CHECK(byType[BLYNK_CMD_NOTIFY] == unsigned(THREAD_ALARMS));
+    CHECK(Blynk.connected());
+    printf("other thread: OK (%d alarms, queue of %d)\n", THREAD_ALARMS, BLYNK_SCHED_SLOTS);
+}
+
+// Values stored while offline are all replayed, in order: the queue must
+// not replace them with newer values of the same pin
+static void test_outbox_replay()
+{
+    BlynkScheduler& s = Blynk.scheduler();
+    for (int i = 0; i < 1000 && s.pending(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(s.pending() == 0);
+    s.resetStats();
+
+    const char* path = "/tmp/blynk-scheduler-outbox.bin";
+    unlink(path);
+    CHECK(BlynkOutboxOpen(path, 64 * 1024));
+    BlynkOutboxSetReplayRate(50, 5);
+
+    transp.online = false;
+    transp.dropLink();
+    for (int i = 0; i < 10; i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(!Blynk.connected());
+    const int N = 30;
+    for (int i = 0; i < N; i++) {
+        Blynk.virtualWrite(V1, i);
+    }
+    CHECK(BlynkOutboxPending() == unsigned(N));
+
+    drain(NULL);
+    transp.online = true;
+    Blynk.reconnectNow();
+    int next = 0;
+    const millis_time_t start = BlynkMillis();
+    while ((BlynkOutboxPending() || next < N) && BlynkMillis() - start < 3000) {
+        Blynk.run();
+        size_t pos = 0;
+        BlynkHeader hdr;
+        const uint8_t* body;
+        while (transp.frame(pos, hdr, body)) {
+            if (hdr.type == BLYNK_CMD_HARDWARE && !memcmp(body, "vw\0" "1\0", 5)) {
+                const std::string value((const char*)body + 5, hdr.length - 5);
+                CHECK(atoi(value.c_str()) == next);
+                next++;
+            }
+        }
+        transp.clearOutput();
+        usleep(1000);
+    }
+    CHECK(next == N);
+    CHECK(BlynkOutboxPending() == 0);
+
+    BlynkSchedStats telemetry;
+    s.getStats(BLYNK_PRIO_TELEMETRY, telemetry);
+    CHECK(telemetry.queued == 0 && telemetry.replaced == 0);
+    BlynkOutboxStats st;
+    BlynkOutboxGetStats(st);
+    CHECK(st.replayed == unsigned(N));
+    BlynkOutboxClose();
+    unlink(path);
+    printf("outbox replay: OK (%d of %d delivered, none replaced)\n", next, N);
+}
+
+int main()
+{
+    test_classify();
+    test_replace_and_drop();
+    test_shares();
+    connect();
+    test_protocol();
+    test_alarm_latency();
+    test_other_thread();
+    test_outbox_replay();
+    return 0;
+}
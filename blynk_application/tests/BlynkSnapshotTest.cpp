@@ -0,0 +1,184 @@
+/**
+ * @file       BlynkSnapshotTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Shared-memory snapshot: torn-read freedom and reader latency
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkSnapshotTest
+ *   ../tests/BlynkSnapshotTest --bench   # reader latency under a 1 kHz writer
+ */
+
+#include <utility/BlynkSnapshot.h>
+
+#include <algorithm>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <vector>
+
+#include "BlynkTestCheck.h"
+
+static char name[64];
+static volatile bool stop;
+
+static const char* const NAMES[] = { "humidity", "temperature", "light", "dac", "alarm" };
+static const unsigned VALUES = BLYNK_SNAPSHOT_VALUES;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Every value of sample n is derived from n, so mixing two samples shows
+static void make_sample(uint32_t n, float* v)
+{
+    for (unsigned i = 0; i < VALUES; i++) {
+        v[i] = float((n % 100000) * VALUES + i);
+    }
+}
+
+static void check_sample(const BlynkSnapshotSample& s)
+{
+    float v[VALUES];
+    make_sample(s.count, v);
+    CHECK(s.flags == s.count * 3);
+    for (unsigned i = 0; i < VALUES; i++) {
+        CHECK(s.value[i] == v[i]);
+    }
+}
+
+static void* writer(void* arg)
+{
+    const unsigned periodNs = *(unsigned*)arg;
+    uint32_t n = 0;
+    float v[VALUES];
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!stop) {
+        n++;
+        make_sample(n, v);
+        BlynkSnapshotPublish(v, VALUES, n * 3);
+        if (periodNs) {
+            next.tv_nsec += periodNs;
+            if (next.tv_nsec >= 1000000000L) { next.tv_nsec -= 1000000000L; next.tv_sec++; }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+    return NULL;
+}
+
+// Reads as fast as possible while the writer runs flat out.
+// Returns number of reads and retries.
+static void read_loop(const BlynkSnapshot* s, unsigned ms, uint64_t& reads, uint64_t& retries)
+{
+    reads = retries = 0;
+    uint32_t last = 0;
+    const uint64_t end = now_ns() + ms * 1000000ULL;
+    while (now_ns() < end) {
+        for (int i = 0; i < 1000; i++) {
+            BlynkSnapshotSample smp;
+            retries += BlynkSnapshotRead(s, &smp);
+            if (smp.count) check_sample(smp);
+            CHECK(smp.count >= last);
+            last = smp.count;
+            reads++;
+        }
+    }
+}
+
+static void test_consistency()
+{
+    CHECK(BlynkSnapshotOpen(name, NAMES, 5));
+    const BlynkSnapshot* s = BlynkSnapshotAttach(name);
+    CHECK(s != NULL);
+    CHECK(BlynkSnapshotFind(s, "light") == 2);
+    CHECK(BlynkSnapshotFind(s, "pressure") == -1);
+
+    stop = false;
+    unsigned period = 0;
+    pthread_t w;
+    pthread_create(&w, NULL, writer, &period);
+
+    // Reader in another process
+    const pid_t pid = fork();
+    if (pid == 0) {
+        const BlynkSnapshot* cs = BlynkSnapshotAttach(name);
+        if (!cs) _exit(2);
+        uint64_t reads, retries;
+        read_loop(cs, 300, reads, retries);
+        _exit(0);
+    }
+    uint64_t reads, retries;
+    read_loop(s, 300, reads, retries);
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    stop = true;
+    pthread_join(w, NULL);
+    BlynkSnapshotSample smp;
+    BlynkSnapshotRead(s, &smp);
+    CHECK(smp.count > 0);
+    check_sample(smp);
+    printf("consistency: OK (%llu reads, %llu retries, %u samples written)\n",
+           (unsigned long long)reads, (unsigned long long)retries, smp.count);
+    BlynkSnapshotDetach(s);
+}
+
+static void bench()
+{
+    const BlynkSnapshot* s = BlynkSnapshotAttach(name);
+    CHECK(s != NULL);
+
+    stop = false;
+    unsigned period = 1000000;  // 1 kHz
+    pthread_t w;
+    pthread_create(&w, NULL, writer, &period);
+
+    // Cost of the clock itself, to subtract
+    uint64_t overhead = ~0ULL;
+    for (int i = 0; i < 10000; i++) {
+        const uint64_t t0 = now_ns();
+        overhead = std::min(overhead, now_ns() - t0);
+    }
+
+    std::vector<uint32_t> lat;
+    lat.reserve(2000000);
+    uint64_t retries = 0;
+    const uint64_t end = now_ns() + 2000000000ULL;
+    while (lat.size() < lat.capacity()) {
+        BlynkSnapshotSample smp;
+        const uint64_t t0 = now_ns();
+        retries += BlynkSnapshotRead(s, &smp);
+        const uint64_t t1 = now_ns();
+        lat.push_back(uint32_t(t1 - t0 > overhead ? t1 - t0 - overhead : 0));
+        if (t1 > end) break;
+    }
+    stop = true;
+    pthread_join(w, NULL);
+
+    std::sort(lat.begin(), lat.end());
+    const size_t n = lat.size();
+    printf("reader latency under a 1 kHz writer (%zu reads, %llu retries): "
+           "p50 %u ns, p99 %u ns, p99.99 %u ns, max %u ns\n",
+           n, (unsigned long long)retries,
+           lat[n / 2], lat[n * 99 / 100], lat[n * 9999 / 10000], lat[n - 1]);
+    BlynkSnapshotDetach(s);
+}
+
+int main(int argc, char* argv[])
+{
+    snprintf(name, sizeof(name), "/blynk-snapshot-test-%d", getpid());
+    test_consistency();
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench();
+    }
+    BlynkSnapshotClose();
+    shm_unlink(name);
+    return 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file       BlynkStatsTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Streaming statistics: comparison with brute force and update cost
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkStatsTest           # correctness
+ *   ../tests/BlynkStatsTest --bench   # ns/update and CPU load at 1 kHz / 100 kHz
+ */
+
+#include <Blynk/BlynkDebug.h>
+#include <utility/BlynkStats.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BlynkTestCheck.h"
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ADC-like input: slow signal + noise + occasional spikes
+static float sample(unsigned& seed, int i)
+{
+    float v = 512 + 200 * sinf(i * 0.001f) + (rand_r(&seed) % 64) - 32;
+    if (rand_r(&seed) % 100 == 0) v += 400;
+    return v;
+}
+
+template <unsigned N>
+static void test_window(unsigned seed)
+{
+    BlynkWindowStats<float, N>  stats;
+    BlynkWindowMinMax<float, N> minmax;
+    BlynkWindowMedian<float, N> median;
+    float hist[N * 4 + 5000];
+
+    // Nothing added yet
+    CHECK(stats.count() == 0 && stats.mean() == 0);
+    CHECK(minmax.count() == 0 && minmax.min() == 0 && minmax.max() == 0);
+    CHECK(median.count() == 0 && median.median() == 0);
+
+    for (int i = 0; i < int(sizeof(hist)/sizeof(hist[0])); i++) {
+        const float x = (i % 7 == 3) ? hist[i - 1] : sample(seed, i); // some duplicates
+        hist[i] = x;
+        stats.add(x);
+        minmax.add(x);
+        median.add(x);
+
+        const int n = std::min(i + 1, int(N));
+        const float* w = hist + i + 1 - n;
+        double sum = 0;
+        for (int j = 0; j < n; j++) sum += w[j];
+        const double mean = sum / n;
+        double var = 0;
+        for (int j = 0; j < n; j++) var += (w[j] - mean) * (w[j] - mean);
+        var /= n;
+        float sorted[N];
+        memcpy(sorted, w, n * sizeof(float));
+        std::sort(sorted, sorted + n);
+        const float med = (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+
+        CHECK(stats.count() == unsigned(n));
+        CHECK(fabs(stats.mean() - mean) < 1e-6 * 1024);
+        CHECK(fabs(stats.variance() - var) < 1e-6 * var + 1e-3);
+        CHECK(stats.at(0) == w[0] && stats.at(n - 1) == w[n - 1]);
+        CHECK(minmax.count() == unsigned(n));
+        CHECK(minmax.min() == sorted[0]);
+        CHECK(minmax.max() == sorted[n - 1]);
+        CHECK(median.count() == unsigned(n));
+        CHECK(median.median() == med);
+        CHECK(median.lowerMedian() == sorted[(n - 1) / 2]);
+    }
+    printf("window %4u: OK\n", N);
+}
+
+static void test_ewma()
+{
+    BlynkEwma<float> e(0.5f);
+    CHECK(!e.ready());
+    CHECK(e.add(10) == 10);
+    CHECK(e.add(20) == 15);
+    CHECK(e.add(15) == 15);
+    BlynkEwma<double> w = BlynkEwma<double>::window(9);
+    for (int i = 0; i < 1000; i++) w.add(100);
+    CHECK(fabs(w.value() - 100) < 1e-3);
+    printf("ewma: OK\n");
+}
+
+// Read a result after every update, as a logger would
+static float result(const BlynkEwma<float>& s)             { return s.value(); }
+template <unsigned N>
+static float result(const BlynkWindowStats<float, N>& s)  { return s.mean() + s.variance(); }
+template <unsigned N>
+static float result(const BlynkWindowMinMax<float, N>& s) { return s.min() + s.max(); }
+template <unsigned N>
+static float result(const BlynkWindowMedian<float, N>& s) { return s.median(); }
+
+template <typename S>
+static double bench_one(S& s, const float* in, unsigned n, unsigned reps)
+{
+    volatile float sink = 0;
+    const double t = now_ns();
+    for (unsigned r = 0; r < reps; r++) {
+        float acc = 0;
+        for (unsigned i = 0; i < n; i++) {
+            s.add(in[i]);
+            acc += result(s);
+        }
+        sink = sink + acc;
+    }
+    return (now_ns() - t) / (double(n) * reps);
+}
+
+static void report(const char* name, double ns)
+{
+    // CPU share needed to keep up with the input rate
+    printf("  %-26s %7.1f ns/update   1 kHz: %.5f%% CPU   100 kHz: %.3f%% CPU\n",
+           name, ns, ns * 1e3 / 1e9 * 100, ns * 1e5 / 1e9 * 100);
+}
+
+template <unsigned N>
+static void bench_window(const float* in, unsigned n)
+{
+    char name[64];
+    BlynkWindowStats<float, N>  stats;
+    BlynkWindowMinMax<float, N> minmax;
+    BlynkWindowMedian<float, N> median;
+    snprintf(name, sizeof(name), "BlynkWindowStats<%u>", N);
+    report(name, bench_one(stats, in, n, 20));
+    snprintf(name, sizeof(name), "BlynkWindowMinMax<%u>", N);
+    report(name, bench_one(minmax, in, n, 20));
+    snprintf(name, sizeof(name), "BlynkWindowMedian<%u>", N);
+    report(name, bench_one(median, in, n, 20));
+}
+
+int main(int argc, char* argv[])
+{
+    test_ewma();
+    test_window<1>(1);
+    test_window<2>(2);
+    test_window<5>(3);
+    test_window<16>(4);
+    test_window<101>(5);
+    test_window<256>(6);
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        // 1 second of input at 100 kHz
+        const unsigned n = 100000;
+        float* in = new float[n];
+        unsigned seed = 42;
+        for (unsigned i = 0; i < n; i++) in[i] = sample(seed, i);
+
+        BlynkEwma<float> ewma(0.1f);
+        report("BlynkEwma", bench_one(ewma, in, n, 20));
+        bench_window<16>(in, n);
+        bench_window<128>(in, n);
+        bench_window<1024>(in, n);
+        delete[] in;
+    }
+    return 0;
+}
@@ -0,0 +1,283 @@
+/**
+ * @file       BlynkStreamTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Unix-socket sample streaming: requests, backpressure, 100-subscriber load
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkStreamTest
+ */
+
+#include <utility/BlynkStream.h>
+
+#include <algorithm>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BlynkTestCheck.h"
+
+static char path[108];
+static const char* const NAMES[] = { "humidity", "temperature", "light", "dac", "alarm" };
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+struct Frame {
+    uint8_t     type;
+    std::string body;
+
+    const BlynkStreamSample& sample() const { return *(const BlynkStreamSample*)body.data(); }
+};
+
+struct Client {
+    int         fd;
+    std::string in;
+
+    Client() {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        CHECK(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    }
+    ~Client() { close(fd); }
+
+    void request(uint8_t type, uint32_t arg = 0, bool hasArg = false) {
+        uint8_t buf[9];
+        const uint32_t len = hasArg ? 5 : 1;
+        memcpy(buf, &len, 4);
+        buf[4] = type;
+        memcpy(buf + 5, &arg, 4);
+        CHECK(write(fd, buf, 4 + len) == ssize_t(4 + len));
+    }
+
+    // Parses a complete frame from the input, if there is one
+    bool parse(Frame& f) {
+        if (in.size() < 5) return false;
+        uint32_t len;
+        memcpy(&len, in.data(), 4);
+        if (in.size() < 4 + len) return false;
+        f.type = in[4];
+        f.body.assign(in, 5, len - 1);
+        // Samples are padded to the full struct for convenient access
+        if (f.type == BLYNK_STREAM_SAMPLE) f.body.resize(sizeof(BlynkStreamSample));
+        in.erase(0, 4 + len);
+        return true;
+    }
+
+    bool readSome(int timeoutMs) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, timeoutMs) <= 0) return false;
+        char buf[65536];
+        const ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) return false;
+        in.append(buf, n);
+        return true;
+    }
+
+    bool next(Frame& f, int timeoutMs = 1000) {
+        while (!parse(f)) {
+            if (!readSome(timeoutMs)) return false;
+        }
+        return true;
+    }
+};
+
+static void publish(unsigned n)
+{
+    float v[5] = { float(n), float(n) * 2, float(n) * 3, 0, 0 };
+    BlynkStreamPublish(v, 5);
+}
+
+static void test_requests()
+{
+    CHECK(BlynkStreamOpen(path, NAMES, 5, 100));
+    Client c;
+    Frame f;
+    CHECK(c.next(f) && f.type == BLYNK_STREAM_HELLO);
+    uint32_t hello[2];
+    memcpy(hello, f.body.data(), sizeof(hello));
+    CHECK(hello[0] == BLYNK_STREAM_VERSION && hello[1] == 5);
+    CHECK(f.body.size() == 8 + 5 * BLYNK_STREAM_NAME_LEN);
+    CHECK(!strcmp(f.body.data() + 8 + 2 * BLYNK_STREAM_NAME_LEN, "light"));
+
+    // No samples yet: nothing, then an empty history
+    c.request(BLYNK_STREAM_GET_LATEST);
+    c.request(BLYNK_STREAM_HISTORY, 60, true);
+    CHECK(c.next(f) && f.type == BLYNK_STREAM_HISTORY_END && *(uint32_t*)f.body.data() == 0);
+
+    for (unsigned i = 1; i <= 150; i++) publish(i);
+    c.request(BLYNK_STREAM_GET_LATEST);
+    CHECK(c.next(f) && f.type == BLYNK_STREAM_SAMPLE);
+    CHECK(f.sample().seq == 150 && f.sample().value[2] == 450);
+
+    // History holds the last 100 samples
+    c.request(BLYNK_STREAM_HISTORY, 60, true);
+    for (unsigned i = 51; i <= 150; i++) {
+        CHECK(c.next(f) && f.type == BLYNK_STREAM_SAMPLE && f.sample().seq == i);
+        CHECK(f.sample().value[0] == float(i));
+    }
+    CHECK(c.next(f) && f.type == BLYNK_STREAM_HISTORY_END && *(uint32_t*)f.body.data() == 100);
+
+    // History of 0 seconds: nothing recent
+    c.request(BLYNK_STREAM_HISTORY, 0, true);
+    CHECK(c.next(f) && f.type == BLYNK_STREAM_HISTORY_END && *(uint32_t*)f.body.data() == 0);
+
+    // Subscription gets only new samples
+    c.request(BLYNK_STREAM_SUBSCRIBE);
+    usleep(20000);
+    for (unsigned i = 151; i <= 160; i++) publish(i);
+    for (unsigned i = 151; i <= 160; i++) {
+        CHECK(c.next(f) && f.type == BLYNK_STREAM_SAMPLE && f.sample().seq == i);
+    }
+    c.request(BLYNK_STREAM_UNSUBSCRIBE);
+    usleep(20000);
+    publish(161);
+    CHECK(!c.next(f, 50));
+
+    // Malformed request closes the connection
+    const uint8_t bad[5] = { 0xE8, 0x03, 0, 0, BLYNK_STREAM_SUBSCRIBE };
+    CHECK(write(c.fd, bad, 5) == 5);
+    char b;
+    usleep(20000);
+    CHECK(read(c.fd, &b, 1) == 0);
+
+    BlynkStreamClose();
+    printf("requests: OK\n");
+}
+
+// A client that stops reading skips ahead; others are not affected
+static void test_backpressure()
+{
+    CHECK(BlynkStreamOpen(path, NAMES, 5, 256));
+    Client slow, fast;
+    Frame f;
+    CHECK(slow.next(f) && fast.next(f));
+    slow.request(BLYNK_STREAM_SUBSCRIBE);
+    fast.request(BLYNK_STREAM_SUBSCRIBE);
+    usleep(20000);
+
+    const unsigned N = 50000;
+    uint64_t expect = 1;
+    for (unsigned i = 1; i <= N; i++) {
+        publish(i);
+        if (i % 64 == 0) {
+            usleep(200);    // let the server thread run
+            for (;;) {
+                if (fast.parse(f)) {
+                    CHECK(f.type == BLYNK_STREAM_SAMPLE && f.sample().seq == expect);
+                    expect++;
+                } else if (!fast.readSome(0)) {
+                    break;
+                }
+            }
+        }
+    }
+    while (expect <= N && fast.next(f)) {
+        CHECK(f.type == BLYNK_STREAM_SAMPLE && f.sample().seq == expect);
+        expect++;
+    }
+    CHECK(expect == N + 1);
+
+    // The slow one: contiguous runs, separated by GAP frames
+    uint64_t seen = 0, skipped = 0, next = 1;
+    while (next <= N && slow.next(f)) {
+        if (f.type == BLYNK_STREAM_GAP) {
+            const uint64_t gap = *(uint64_t*)f.body.data();
+            skipped += gap;
+            next += gap;
+            continue;
+        }
+        CHECK(f.type == BLYNK_STREAM_SAMPLE && f.sample().seq == next);
+        next++;
+        seen++;
+    }
+    CHECK(next == N + 1 && seen + skipped == N && skipped > 0);
+
+    BlynkStreamStats st;
+    BlynkStreamGetStats(st);
+    CHECK(st.gaps > 0 && st.skipped == skipped && st.clients == 2 && st.subscribers == 2);
+    BlynkStreamClose();
+    printf("backpressure: OK (slow client skipped %llu of %u samples in %llu gaps)\n",
+           (unsigned long long)skipped, N, (unsigned long long)st.gaps);
+}
+
+static void test_load()
+{
+    const unsigned CLIENTS = 100, RATE = 1000, N = 3000;
+    CHECK(BlynkStreamOpen(path, NAMES, 5));
+    std::vector<Client*> clients;
+    std::vector<uint64_t> expect(CLIENTS, 1);
+    std::vector<pollfd> fds(CLIENTS);
+    Frame f;
+    for (unsigned i = 0; i < CLIENTS; i++) {
+        clients.push_back(new Client());
+        CHECK(clients[i]->next(f) && f.type == BLYNK_STREAM_HELLO);
+        clients[i]->request(BLYNK_STREAM_SUBSCRIBE);
+        fds[i].fd = clients[i]->fd;
+        fds[i].events = POLLIN;
+    }
+    usleep(50000);
+
+    // Latency from publish to arrival at each subscriber
+    std::vector<uint32_t> lat;
+    lat.reserve(CLIENTS * N);
+    const uint64_t start = now_ns();
+    unsigned published = 0;
+    while (lat.size() < CLIENTS * N) {
+        const uint64_t now = now_ns();
+        while (published < N && start + uint64_t(published) * 1000000000ULL / RATE <= now) {
+            publish(++published);
+        }
+        const uint64_t due = start + uint64_t(published) * 1000000000ULL / RATE;
+        const int timeout = (published < N) ? int((due - std::min(due, now)) / 1000000) : 1000;
+        CHECK(poll(&fds[0], CLIENTS, timeout) >= 0 || published < N);
+        const uint64_t t = now_ns();
+        for (unsigned i = 0; i < CLIENTS; i++) {
+            if (!(fds[i].revents & POLLIN)) continue;
+            clients[i]->readSome(0);
+            while (clients[i]->parse(f)) {
+                CHECK(f.type == BLYNK_STREAM_SAMPLE && f.sample().seq == expect[i]);
+                expect[i]++;
+                lat.push_back(uint32_t(t - f.sample().timeNs));
+            }
+        }
+    }
+    const double secs = (now_ns() - start) / 1e9;
+
+    BlynkStreamStats st;
+    BlynkStreamGetStats(st);
+    CHECK(st.gaps == 0 && st.subscribers == CLIENTS);
+    std::sort(lat.begin(), lat.end());
+    const size_t n = lat.size();
+    printf("load: %u subscribers x %u samples at %u Hz in %.2f s, %.0f frames/s, %.1f MB/s; "
+           "latency p50 %u us, p99 %u us, max %u us\n",
+           CLIENTS, N, RATE, secs, st.framesSent / secs, st.bytesSent / secs / 1e6,
+           lat[n / 2] / 1000, lat[n * 99 / 100] / 1000, lat[n - 1] / 1000);
+
+    for (unsigned i = 0; i < CLIENTS; i++) delete clients[i];
+    BlynkStreamClose();
+}
+
+int main()
+{
+    snprintf(path, sizeof(path), "/tmp/blynk-stream-test-%d.sock", getpid());
+    test_requests();
+    test_backpressure();
+    test_load();
+    CHECK(access(path, F_OK) != 0);
+    return 0;
+}
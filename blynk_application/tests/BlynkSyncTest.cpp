@@ -0,0 +1,244 @@
+/**
+ * @file       BlynkSyncTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Paced virtual pin sync versus syncAll(), for 128 pins
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkSyncTest
+ *
+ * A fake server answers sync requests with a value for most pins, and the
+ * handlers take a fixed time each. Both ways of syncing print how long it
+ * took until every pin had its value, the longest run() and the most
+ * handlers that ran in one run().
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_NO_INFO
+#define BLYNK_DEAD_LINK_MS 2000UL   // sync requests are given up after 500 ms
+
+#include "BlynkTestTransport.h"
+#include <utility/BlynkSync.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+static BlynkSync<BlynkTestDevice> pinSync(Blynk);
+
+static const unsigned PINS = 128;
+static const unsigned HANDLER_US = 300;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// The server has no value for every 16th pin
+static bool has_value(unsigned pin)
+{
+    return pin % 16 != 15;
+}
+
+static const unsigned VALUED = PINS - PINS / 16;
+
+/*
+ * Device side
+ */
+
+static int      values[PINS];
+static unsigned order[PINS];        // 1 for the first pin handled
+static unsigned handled = 0;
+
+BLYNK_WRITE_DEFAULT()
+{
+    const double start = now_ms();
+    while ((now_ms() - start) * 1000 < HANDLER_US) {}
+    values[request.pin] = param.asInt();
+    order[request.pin] = ++handled;
+}
+
+/*
+ * Server side
+ */
+
+static size_t   served = 0;         // frames of the device looked at
+static unsigned dropPings = 0;      // pings after a sync request to ignore
+
+static void send_value(uint16_t id, unsigned pin)
+{
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "vw%c%u%c%u", 0, pin, 0, pin * 10);
+    transp.send(BLYNK_CMD_HARDWARE, id, buf, len);
+}
+
+static void serve()
+{
+    bool afterSync = false;
+    for (; served < transp.frames.size(); served++) {
+        const BlynkTestFrame& f = transp.frames[served];
+        if (f.type == BLYNK_CMD_HARDWARE_SYNC) {
+            if (f.body.empty()) {
+                // syncAll()
+                for (unsigned pin = 0; pin < PINS; pin++) {
+                    if (has_value(pin)) send_value(f.id, pin);
+                }
+            } else {
+                // "vr\0pin\0pin..."
+                for (size_t p = 3; p < f.body.size(); p = f.body.find('\0', p) + 1) {
+                    const unsigned pin = atoi(f.body.c_str() + p);
+                    if (has_value(pin)) send_value(f.id, pin);
+                    if (f.body.find('\0', p) == std::string::npos) break;
+                }
+            }
+            afterSync = true;
+            continue;
+        }
+        if (f.type == BLYNK_CMD_PING) {
+            if (afterSync && dropPings) {
+                dropPings--;
+            } else {
+                transp.send(BLYNK_CMD_RESPONSE, f.id, NULL, 0, BLYNK_SUCCESS);
+            }
+        }
+        afterSync = false;
+    }
+}
+
+/*
+ * Measurements
+ */
+
+struct SyncRun {
+    double   elapsed;       // ms until the last pin had its value, or done()
+    double   longestRun;    // ms
+    unsigned mostHandlers;  // in one run()
+};
+
+static void reset_values()
+{
+    memset(values, 0, sizeof(values));
+    memset(order, 0, sizeof(order));
+    handled = 0;
+}
+
+static bool all_values()
+{
+    for (unsigned pin = 0; pin < PINS; pin++) {
+        if (has_value(pin) && values[pin] != int(pin * 10)) return false;
+    }
+    return true;
+}
+
+static SyncRun run_until(bool (*finished)(), double timeout)
+{
+    SyncRun r = { 0, 0, 0 };
+    const double start = now_ms();
+    while (!finished() && now_ms() - start < timeout) {
+        const unsigned before = handled;
+        const double t = now_ms();
+        Blynk.run();
+        r.longestRun = BlynkMax(r.longestRun, now_ms() - t);
+        r.mostHandlers = BlynkMax(r.mostHandlers, handled - before);
+        serve();
+        usleep(100);
+    }
+    r.elapsed = now_ms() - start;
+    return r;
+}
+
+static bool sync_done()
+{
+    return pinSync.done();
+}
+
+static void print_run(const char* name, const SyncRun& r)
+{
+    printf("%-10s %u pins: consistent after %.1f ms, longest run() %.2f ms, at most %u handlers per run()\n",
+           name, PINS, r.elapsed, r.longestRun, r.mostHandlers);
+}
+
+static SyncRun allRun;
+
+static void test_sync_all()
+{
+    reset_values();
+    Blynk.syncAll();
+    allRun = run_until(all_values, 5000);
+    CHECK(all_values());
+    print_run("syncAll", allRun);
+    CHECK(allRun.mostHandlers == VALUED);       // all in one run()
+    printf("syncAll: OK\n");
+}
+
+static void test_paced()
+{
+    // A few pins first, the rest in order
+    for (unsigned pin = 100; pin < 104; pin++) {
+        CHECK(pinSync.add(pin, 10));
+    }
+    for (unsigned pin = 0; pin < PINS; pin++) {
+        if (pin < 100 || pin >= 104) CHECK(pinSync.add(pin));
+    }
+    CHECK(!pinSync.add(0));
+
+    reset_values();
+    pinSync.start();
+    const SyncRun r = run_until(sync_done, 10000);
+    CHECK(pinSync.done());
+    CHECK(all_values());
+    print_run("BlynkSync", r);
+
+    const BlynkSyncStats& st = pinSync.stats();
+    printf("requests %u, timeouts %u, duration %u ms\n", st.requests, st.timeouts, st.lastDuration);
+    CHECK(st.requests == (PINS + BLYNK_SYNC_BATCH - 1) / BLYNK_SYNC_BATCH);
+    CHECK(st.timeouts == 0);
+    CHECK(r.mostHandlers <= BLYNK_SYNC_BATCH * BLYNK_SYNC_IN_FLIGHT);
+    CHECK(r.longestRun < allRun.longestRun);
+    for (unsigned pin = 100; pin < 104; pin++) {
+        CHECK(order[pin] == pin - 99);
+    }
+    printf("paced: OK\n");
+}
+
+// An unanswered request is given up, and the sync still finishes
+static void test_timeout()
+{
+    reset_values();
+    dropPings = 1;
+    pinSync.start();
+    const uint32_t requests = pinSync.stats().requests;
+    const SyncRun r = run_until(sync_done, 10000);
+    CHECK(pinSync.done());
+    const BlynkSyncStats& st = pinSync.stats();
+    printf("one ping lost: done after %.1f ms, response timeout %u ms\n", r.elapsed, Blynk.responseTimeout());
+    CHECK(st.timeouts == 1);
+    CHECK(st.requests == requests + (PINS + BLYNK_SYNC_BATCH - 1) / BLYNK_SYNC_BATCH);
+    CHECK(r.elapsed >= Blynk.responseTimeout());
+    CHECK(all_values());
+    printf("timeout: OK\n");
+}
+
+int main()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        serve();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    test_sync_all();
+    test_paced();
+    test_timeout();
+    return 0;
+}
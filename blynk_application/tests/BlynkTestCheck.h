@@ -0,0 +1,20 @@
+/**
+ * @file       BlynkTestCheck.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      CHECK() for the tests
+ *
+ * A failed check prints where it failed and ends the test with _exit(1).
+ * atexit() handlers of the library (like the flush of the asynchronous
+ * log) are not run: they may wait for a thread the test left stuck, and
+ * turn a failure into a hang.
+ */
+
+#ifndef BlynkTestCheck_h
+#define BlynkTestCheck_h
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define CHECK(expr) { if (!(expr)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #expr); fflush(stdout); _exit(1); } }
+
+#endif
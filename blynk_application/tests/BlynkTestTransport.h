@@ -0,0 +1,230 @@
+/**
+ * @file       BlynkTestTransport.h
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      In-memory transport with a minimal fake server, for tests
+ *
+ * Frames written by the device are parsed and kept in 'frames'.
+ * Logins are accepted automatically; 'online' controls whether
+ * connect() succeeds, and dropLink() simulates a lost connection.
+ *
+ * BlynkStaticTransport does the same with fixed buffers, for tests that
+ * must not see any allocations of the transport itself.
+ */
+
+#ifndef BlynkTestTransport_h
+#define BlynkTestTransport_h
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <Blynk/BlynkProtocol.h>
+#include <BlynkApiLinux.h>
+
+struct BlynkTestFrame {
+    uint8_t     type;
+    uint16_t    id;
+    std::string body;
+};
+
+class BlynkTestTransport
+{
+public:
+    BlynkTestTransport()
+        : online(true), isConnected(false), readPos(0)
+    {}
+
+    void begin(const char*, uint16_t) {}
+
+    bool connect() {
+        isConnected = online;
+        return isConnected;
+    }
+
+    void disconnect() {
+        isConnected = false;
+        input.clear();
+        output.clear();
+        readPos = 0;
+    }
+
+    bool connected() { return isConnected; }
+
+    int available() {
+        return isConnected ? int(input.size() - readPos) : 0;
+    }
+
+    size_t read(void* buf, size_t len) {
+        if (!isConnected) return 0;
+        len = BlynkMin(len, input.size() - readPos);
+        memcpy(buf, input.data() + readPos, len);
+        readPos += len;
+        if (readPos == input.size()) {
+            input.clear();
+            readPos = 0;
+        }
+        return len;
+    }
+
+    size_t write(const void* buf, size_t len) {
+        if (!isConnected) return 0;
+        output.append((const char*)buf, len);
+        parse();
+        return len;
+    }
+
+    // Server -> device
+    void send(uint8_t type, uint16_t id, const void* body, size_t len, uint16_t code = 0) {
+        BlynkHeader hdr = { type, htons(id), htons(body ? len : code) };
+        input.append((const char*)&hdr, sizeof(hdr));
+        if (body) input.append((const char*)body, len);
+    }
+
+    void dropLink() {
+        isConnected = false;
+    }
+
+    bool online;
+    std::vector<BlynkTestFrame> frames;
+
+private:
+    void parse() {
+        while (output.size() >= sizeof(BlynkHeader)) {
+            BlynkHeader hdr;
+            memcpy(&hdr, output.data(), sizeof(hdr));
+            const size_t blen = (hdr.type == BLYNK_CMD_RESPONSE) ? 0 : ntohs(hdr.length);
+            if (output.size() < sizeof(hdr) + blen) break;
+            BlynkTestFrame f = { hdr.type, ntohs(hdr.msg_id), output.substr(sizeof(hdr), blen) };
+            output.erase(0, sizeof(hdr) + blen);
+            if (f.type == BLYNK_CMD_HW_LOGIN) {
+                send(BLYNK_CMD_RESPONSE, f.id, NULL, 0, BLYNK_SUCCESS);
+            }
+            frames.push_back(f);
+        }
+    }
+
+    bool        isConnected;
+    std::string input;
+    std::string output;
+    size_t      readPos;
+};
+
+template <class Transp>
+class BlynkTestDeviceT
+    : public BlynkProtocol<Transp>
+{
+    typedef BlynkProtocol<Transp> Base;
+public:
+    BlynkTestDeviceT(Transp& transp)
+        : Base(transp), auth(NULL)
+    {}
+
+    void begin(const char* token) {
+        auth = token;
+        Base::begin(auth);
+    }
+
+    // Skips the 5s pause before the next connection attempt
+    void reconnectNow() {
+        Base::begin(auth);
+    }
+
+private:
+    const char* auth;
+};
+
+typedef BlynkTestDeviceT<BlynkTestTransport> BlynkTestDevice;
+
+class BlynkStaticTransport
+{
+public:
+    BlynkStaticTransport()
+        : online(true), isConnected(false), inLen(0), inPos(0), outLen(0)
+    {}
+
+    void begin(const char*, uint16_t) {}
+
+    bool connect() {
+        isConnected = online;
+        return isConnected;
+    }
+
+    void disconnect() {
+        isConnected = false;
+        inLen = inPos = 0;
+    }
+
+    bool connected() { return isConnected; }
+
+    int available() {
+        return isConnected ? int(inLen - inPos) : 0;
+    }
+
+    size_t read(void* buf, size_t len) {
+        if (!isConnected) return 0;
+        len = BlynkMin(len, inLen - inPos);
+        memcpy(buf, in + inPos, len);
+        inPos += len;
+        if (inPos == inLen) {
+            inPos = inLen = 0;
+        }
+        return len;
+    }
+
+    // Keeps the output as written, answering logins right away
+    size_t write(const void* buf, size_t len) {
+        if (!isConnected || outLen + len > sizeof(out)) return 0;
+        memcpy(out + outLen, buf, len);
+        outLen += len;
+        if (((const uint8_t*)buf)[0] == BLYNK_CMD_HW_LOGIN) {
+            send(BLYNK_CMD_RESPONSE, 1, NULL, 0, BLYNK_SUCCESS);
+        }
+        return len;
+    }
+
+    // Server -> device
+    void send(uint8_t type, uint16_t id, const void* body, size_t len, uint16_t code = 0) {
+        if (inLen + sizeof(BlynkHeader) + len > sizeof(in)) abort();
+        BlynkHeader hdr = { type, htons(id), htons(body ? len : code) };
+        memcpy(in + inLen, &hdr, sizeof(hdr));
+        inLen += sizeof(hdr);
+        if (body) {
+            memcpy(in + inLen, body, len);
+            inLen += len;
+        }
+    }
+
+    void dropLink() {
+        isConnected = false;
+    }
+
+    // Next frame written by the device, starting at 'pos'
+    bool frame(size_t& pos, BlynkHeader& hdr, const uint8_t*& body) {
+        if (pos + sizeof(hdr) > outLen) return false;
+        memcpy(&hdr, out + pos, sizeof(hdr));
+        hdr.msg_id = ntohs(hdr.msg_id);
+        hdr.length = ntohs(hdr.length);
+        const size_t blen = (hdr.type == BLYNK_CMD_RESPONSE) ? 0 : hdr.length;
+        if (pos + sizeof(hdr) + blen > outLen) return false;
+        body = out + pos + sizeof(hdr);
+        pos += sizeof(hdr) + blen;
+        return true;
+    }
+
+    void clearOutput() { outLen = 0; }
+
+    bool online;
+
+private:
+    bool    isConnected;
+    uint8_t in[8192];
+    size_t  inLen;
+    size_t  inPos;
+    uint8_t out[8192];
+    size_t  outLen;
+};
+
+typedef BlynkTestDeviceT<BlynkStaticTransport> BlynkStaticDevice;
+
+#endif
@@ -0,0 +1,260 @@
+/**
+ * @file       BlynkTraceTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Timeline tracing: per-thread buffers, wrap-around, protocol events, overhead
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkTraceTest
+ *   ../tests/BlynkTraceTest --keep     # leaves /tmp/blynk-trace-test.json for ui.perfetto.dev
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 100
+#define BLYNK_NO_INFO
+#define BLYNK_USE_TRACE
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <utility/BlynkTrace.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static char path[64];
+
+static uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static std::string dump()
+{
+    CHECK(BlynkTraceWrite(path) >= 0);
+    std::string text;
+    FILE* f = fopen(path, "r");
+    CHECK(f);
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+    return text;
+}
+
+static unsigned occurrences(const std::string& text, const char* what)
+{
+    unsigned n = 0;
+    for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) n++;
+    return n;
+}
+
+static void test_disabled()
+{
+    CHECK(!BlynkTraceEnabled());
+    BlynkTraceBegin("nothing");
+    BlynkTraceEnd("nothing");
+    {
+        BLYNK_TRACE_SCOPE("nothing");
+    }
+    CHECK(BlynkTraceWrite(path) == 0);
+    printf("disabled: OK\n");
+}
+
+static void* worker(void* arg)
+{
+    BlynkTraceThreadName((const char*)arg);
+    for (int i = 0; i < 1000; i++) {
+        BLYNK_TRACE_SCOPE("outer", i);
+        {
+            BLYNK_TRACE_SCOPE("inner");
+        }
+        BlynkTraceCounter("i", i);
+    }
+    return NULL;
+}
+
+static void test_threads()
+{
+    BlynkTraceClear();
+    BlynkTraceEnable(true);
+    pthread_t t[3];
+    const char* names[3] = { "worker-a", "worker-b", "worker-c" };
+    for (int i = 0; i < 3; i++) pthread_create(&t[i], NULL, worker, (void*)names[i]);
+    for (int i = 0; i < 3; i++) pthread_join(t[i], NULL);
+    BlynkTraceEnable(false);
+
+    const std::string text = dump();
+    CHECK(text.compare(0, 15, "{\"displayTimeUn") == 0);
+    CHECK(text.compare(text.size() - 4, 4, "\n]}\n") == 0);
+    CHECK(occurrences(text, "\"thread_name\"") == 3);
+    CHECK(occurrences(text, "\"worker-b\"") == 1);
+    CHECK(occurrences(text, "\"ph\":\"B\",\"name\":\"outer\"") == 3000);
+    CHECK(occurrences(text, "\"ph\":\"E\",\"name\":\"inner\"") == 3000);
+    CHECK(occurrences(text, "\"ph\":\"C\"") == 3000);
+    CHECK(occurrences(text, "\"args\":{\"arg\":999}") == 3);
+    CHECK(BlynkTraceDropped() == 0);
+    printf("threads: OK\n");
+}
+
+// A thread named while tracing is off gets no ring until its first event,
+// and the name is kept for it
+static volatile bool lateGo = false;
+
+static void* late_named(void*)
+{
+    BlynkTraceThreadName("late");
+    while (!lateGo) usleep(100);
+    BlynkTraceInstant("late.event");
+    return NULL;
+}
+
+static void test_late_name()
+{
+    BlynkTraceClear();
+    pthread_t t;
+    pthread_create(&t, NULL, late_named, NULL);
+    usleep(10000);
+    CHECK(occurrences(dump(), "\"late\"") == 0);
+    BlynkTraceEnable(true);
+    lateGo = true;
+    pthread_join(t, NULL);
+    BlynkTraceEnable(false);
+
+    const std::string text = dump();
+    CHECK(occurrences(text, "\"late\"") == 1);
+    CHECK(occurrences(text, "\"late.event\"") == 1);
+    printf("late name: OK\n");
+}
+
+// A thread that records more than its ring keeps the newest events,
+// and ends whose begins were overwritten are left out
+static void test_wrap()
+{
+    BlynkTraceClear();
+    BlynkTraceEnable(true);
+    for (int i = 0; i < BLYNK_TRACE_EVENTS; i++) {
+        BlynkTraceInstant("filler");
+    }
+    BlynkTraceBegin("long");
+    for (int i = 0; i < BLYNK_TRACE_EVENTS; i++) {
+        BLYNK_TRACE_SCOPE("short");
+    }
+    BlynkTraceEnd("long");
+    BlynkTraceEnable(false);
+
+    const std::string text = dump();
+    CHECK(BlynkTraceDropped() == 2 * BLYNK_TRACE_EVENTS + 2);
+    CHECK(occurrences(text, "\"filler\"") == 0);
+    CHECK(occurrences(text, "\"long\"") == 0);
+    CHECK(occurrences(text, "\"ph\":\"B\"") == occurrences(text, "\"ph\":\"E\""));
+    printf("wrap: OK (%llu oldest events dropped)\n", (unsigned long long)BlynkTraceDropped());
+}
+
+static volatile bool isrRunning;
+
+// Stands in for a button ISR thread of wiringPi
+static void* button_isr(void*)
+{
+    BlynkTraceThreadName("isr");
+    while (isrRunning) {
+        {
+            BLYNK_TRACE_SCOPE("changeInterval");
+        }
+        usleep(3000);
+    }
+    return NULL;
+}
+
+// Protocol events, with an ISR landing while send waits in the rate limiter
+static void test_protocol()
+{
+    BlynkTraceClear();
+    BlynkTraceThreadName("main");
+    BlynkTraceEnable(true);
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    isrRunning = true;
+    pthread_t t;
+    pthread_create(&t, NULL, button_isr, NULL);
+    for (int i = 0; i < 5; i++) {
+        Blynk.virtualWrite(V1, i);
+    }
+    isrRunning = false;
+    pthread_join(t, NULL);
+    transp.dropLink();
+    for (int i = 0; i < 10; i++) Blynk.run();
+    BlynkTraceEnable(false);
+
+    const std::string text = dump();
+    CHECK(occurrences(text, "\"login\"") >= 1);
+    CHECK(occurrences(text, "\"connected\"") >= 1);
+    CHECK(occurrences(text, "\"reconnect\"") >= 1);
+    CHECK(occurrences(text, "\"ph\":\"B\",\"name\":\"send\"") >= 6);
+    CHECK(occurrences(text, "\"ph\":\"B\",\"name\":\"rateLimit\"") >= 4);
+    CHECK(occurrences(text, "\"ph\":\"B\",\"name\":\"receive\"") >= 1);
+    CHECK(occurrences(text, "\"ph\":\"B\",\"name\":\"changeInterval\"") >= 5);
+    printf("protocol: OK\n");
+}
+
+// Cost of one scope when enabled, and what it means at 100 samples/s
+static void test_overhead()
+{
+    const unsigned N = 200000;
+    BlynkTraceEnable(false);
+    uint64_t t0 = mono_ns();
+    for (unsigned i = 0; i < N; i++) {
+        BLYNK_TRACE_SCOPE("off");
+    }
+    const double offNs = double(mono_ns() - t0) / N;
+
+    BlynkTraceClear();
+    BlynkTraceEnable(true);
+    t0 = mono_ns();
+    for (unsigned i = 0; i < N; i++) {
+        BLYNK_TRACE_SCOPE("on");
+    }
+    const double onNs = double(mono_ns() - t0) / N;
+    BlynkTraceEnable(false);
+
+    // A sample: ~10 stage scopes and ~6 protocol scopes (run, send x4, receive)
+    const unsigned scopesPerSample = 16, rate = 100;
+    const double load = onNs * scopesPerSample * rate / 1e9 * 100;
+    printf("overhead: %.1f ns per scope (%.1f ns disabled); %u scopes x %u Hz = %.4f%% of one CPU\n",
+           onNs, offNs, scopesPerSample, rate, load);
+    CHECK(load < 1.0);
+}
+
+int main(int argc, char* argv[])
+{
+    const bool keep = argc > 1 && !strcmp(argv[1], "--keep");
+    if (keep) {
+        snprintf(path, sizeof(path), "/tmp/blynk-trace-test.json");
+    } else {
+        snprintf(path, sizeof(path), "/tmp/blynk-trace-test-%d.json", getpid());
+    }
+    test_disabled();
+    test_threads();
+    test_late_name();
+    test_wrap();
+    test_overhead();
+    test_protocol();
+    if (!keep) unlink(path);
+    return 0;
+}
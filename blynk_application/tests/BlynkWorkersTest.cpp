@@ -0,0 +1,269 @@
+/**
+ * @file       BlynkWorkersTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      Virtual pin handlers on a worker pool: pings, ordering, replies
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/BlynkWorkersTest
+ *
+ * The first part sends a ping right after a write to a pin whose handler
+ * sleeps for 300 ms, and prints how long the ping waited with the handler
+ * on a worker and inline.
+ */
+
+#define BLYNK_USE_WORKERS
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+#include <utility/BlynkLatency.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+static const unsigned SLOW_MS = 300;
+
+static unsigned sequence[200];
+static unsigned sequenceLen = 0;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Slow sensors, on different workers (pin % 2)
+BLYNK_WRITE(V1)
+{
+    usleep(param.asInt() * 1000);
+}
+
+BLYNK_WRITE(V2)
+{
+    usleep(param.asInt() * 1000);
+}
+
+BLYNK_WRITE(V3)
+{
+    if (sequenceLen < 200) {
+        sequence[sequenceLen++] = param.asInt();
+    }
+}
+
+BLYNK_READ(V4)
+{
+    Blynk.virtualWrite(V4, 44);
+}
+
+BLYNK_WRITE(V5)
+{
+    Blynk.virtualWrite(V15, param.asInt() * 2);
+}
+
+// Sends more than a worker can post back
+BLYNK_WRITE(V6)
+{
+    char text[BLYNK_WORKER_DATA + 16];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    Blynk.virtualWrite(V16, text);
+}
+
+// Longer than BLYNK_MAX_SENDBYTES: built in the worker's own buffer, while
+// the protocol thread uses the frame buffers of the connection
+static std::string long_value(unsigned n)
+{
+    return std::string(200, char('a' + n % 26));
+}
+
+BLYNK_WRITE(V7)
+{
+    Blynk.virtualWrite(V17, long_value(param.asInt()).c_str());
+}
+
+BLYNK_WRITE(V8)
+{
+    Blynk.virtualWrite(V18, long_value(param.asInt()).c_str());
+}
+
+static void send_vw(uint16_t id, int pin, unsigned value)
+{
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "vw%c%d%c%u", 0, pin, 0, value);
+    transp.send(BLYNK_CMD_HARDWARE, id, buf, len);
+}
+
+static void run_until_idle()
+{
+    Blynk.run();
+    for (int i = 0; i < 5000 && !BlynkWorkersIdle(); i++) {
+        usleep(1000);
+        Blynk.run();
+    }
+    CHECK(BlynkWorkersIdle());
+    Blynk.run();    // sends what the last handlers posted
+}
+
+static const BlynkTestFrame* find_frame(uint8_t type, uint16_t id)
+{
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        if (transp.frames[i].type == type && transp.frames[i].id == id) {
+            return &transp.frames[i];
+        }
+    }
+    return NULL;
+}
+
+// Time from a ping arriving after the slow write to its response
+static double ping_delay(uint16_t id)
+{
+    transp.frames.clear();
+    send_vw(id, 1, SLOW_MS);
+    transp.send(BLYNK_CMD_PING, id + 1, NULL, 0);
+    const double start = now_ms();
+    Blynk.run();
+    const double delay = now_ms() - start;
+    CHECK(find_frame(BLYNK_CMD_RESPONSE, id + 1));
+    run_until_idle();
+    return delay;
+}
+
+static void test_slow_handler()
+{
+    const double pooled = ping_delay(10);
+    BlynkWorkersSetInline(V1);
+    const double inlined = ping_delay(20);
+    BlynkWorkersSetInline(V1, false);
+    printf("ping after a %u ms handler: %.1f ms on a worker, %.1f ms inline\n", SLOW_MS, pooled, inlined);
+    CHECK(pooled < 50);
+    CHECK(inlined >= SLOW_MS);
+    printf("slow handler: OK\n");
+}
+
+// Writes to one pin run in the order they arrived, even past the queue depth
+static void test_ordering()
+{
+    sequenceLen = 0;
+    for (unsigned i = 0; i < 100; i++) {
+        send_vw(100 + i, 3, i);
+    }
+    run_until_idle();
+    CHECK(sequenceLen == 100);
+    for (unsigned i = 0; i < 100; i++) {
+        CHECK(sequence[i] == i);
+    }
+    printf("ordering: OK\n");
+}
+
+static void test_parallel()
+{
+    const double start = now_ms();
+    send_vw(300, 1, 200);
+    send_vw(301, 2, 200);
+    run_until_idle();
+    const double elapsed = now_ms() - start;
+    printf("two 200 ms handlers on different workers: %.1f ms\n", elapsed);
+    CHECK(elapsed < 350);
+    printf("parallel: OK\n");
+}
+
+// Commands sent by a handler carry the id of the request, like inline ones
+static void test_replies()
+{
+    transp.frames.clear();
+    const char vr[] = "vr\0" "4";
+    transp.send(BLYNK_CMD_HARDWARE, 400, vr, sizeof(vr) - 1);
+    send_vw(401, 5, 21);
+    run_until_idle();
+
+    const BlynkTestFrame* f = find_frame(BLYNK_CMD_HARDWARE, 400);
+    CHECK(f && f->body == std::string("vw\0" "4\0" "44", 7));
+    f = find_frame(BLYNK_CMD_HARDWARE, 401);
+    CHECK(f && f->body == std::string("vw\0" "15\0" "42", 8));
+
+    BlynkWorkerStats before;
+    BlynkWorkersGetStats(before);
+    send_vw(402, 6, 1);
+    run_until_idle();
+    CHECK(!find_frame(BLYNK_CMD_HARDWARE, 402));
+    BlynkWorkerStats st;
+    BlynkWorkersGetStats(st);
+    CHECK(st.resultsDropped == before.resultsDropped + 1);
+    printf("replies: OK\n");
+}
+
+static void test_long_replies()
+{
+    transp.frames.clear();
+    const unsigned N = 50;
+    std::string big = std::string("vw\0" "9\0", 5) + std::string(200, 'z');
+    for (unsigned i = 0; i < N; i++) {
+        send_vw(500 + i, 7, i);
+        send_vw(600 + i, 8, i);
+        transp.send(BLYNK_CMD_HARDWARE, 700 + i, big.data(), big.size());
+        Blynk.run();
+    }
+    run_until_idle();
+    for (unsigned i = 0; i < N; i++) {
+        const BlynkTestFrame* f = find_frame(BLYNK_CMD_HARDWARE, 500 + i);
+        CHECK(f && f->body == std::string("vw\0" "17\0", 6) + long_value(i));
+        f = find_frame(BLYNK_CMD_HARDWARE, 600 + i);
+        CHECK(f && f->body == std::string("vw\0" "18\0", 6) + long_value(i));
+    }
+    printf("long replies: OK (%u of 200 bytes from each of two workers)\n", N);
+}
+
+static void test_stats()
+{
+    BlynkWorkerStats st;
+    BlynkWorkersGetStats(st);
+    printf("queued %u, inlined %u, busy %u, posted %u, dropped %u, max depth %u\n",
+           st.queued, st.inlined, st.busy, st.posted, st.resultsDropped, st.maxDepth);
+    CHECK(st.queued == 1 + 100 + 2 + 2 + 1 + 100);
+    CHECK(st.posted == 2 + 100);
+    CHECK(st.depth == 0);
+    CHECK(st.maxDepth == BLYNK_WORKER_DEPTH);
+    CHECK(st.busy > 0);
+
+    uint64_t waits = 0, handlers = 0;
+    for (BlynkLatency* s = BlynkLatency::first(); s; s = s->next()) {
+        if (!strcmp(s->name(), "worker.wait"))    waits = s->count();
+        if (!strcmp(s->name(), "worker.handler")) handlers = s->count();
+    }
+    CHECK(waits == st.queued && handlers == st.queued);
+    printf("stats: OK\n");
+}
+
+int main()
+{
+    CHECK(BlynkWorkersBegin(2));
+    CHECK(!BlynkWorkersBegin(2));
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+
+    test_slow_handler();
+    test_ordering();
+    test_parallel();
+    test_replies();
+    test_long_replies();
+    test_stats();
+
+    BlynkWorkersEnd();
+    CHECK(!BlynkWorkersRunning());
+    return 0;
+}
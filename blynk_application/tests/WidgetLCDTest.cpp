@@ -0,0 +1,150 @@
+/**
+ * @file       WidgetLCDTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      WidgetLCD framebuffer diffing: correctness and messages saved
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/WidgetLCDTest
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <WidgetLCD.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static WidgetLCD lcd(V3);
+
+// What the app would display, driven by the commands received
+static char screen[BLYNK_LCD_ROWS][BLYNK_LCD_COLS];
+
+static unsigned apply()
+{
+    unsigned msgs = 0;
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        const BlynkTestFrame& f = transp.frames[i];
+        if (f.type != BLYNK_CMD_HARDWARE) continue;
+        BlynkParam p((void*)f.body.data(), f.body.size());
+        BlynkParam::iterator it = p.begin();
+        CHECK(!strcmp(it.asStr(), "vw") && (++it).asInt() == 3);
+        msgs++;
+        const char* cmd = (++it).asStr();
+        if (!strcmp(cmd, "clr")) {
+            memset(screen, ' ', sizeof(screen));
+        } else {
+            CHECK(!strcmp(cmd, "p"));
+            const int x = (++it).asInt();
+            const int y = (++it).asInt();
+            const char* text = (++it).asStr();
+            for (int c = x; *text && c < BLYNK_LCD_COLS; c++) {
+                screen[y][c] = *text++;
+            }
+        }
+    }
+    transp.frames.clear();
+    return msgs;
+}
+
+static std::string row(int y)
+{
+    return std::string(screen[y], BLYNK_LCD_COLS);
+}
+
+static std::string pad(const char* s)
+{
+    std::string r(s);
+    r.resize(BLYNK_LCD_COLS, ' ');
+    return r;
+}
+
+int main()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+    transp.frames.clear();
+    memset(screen, 'x', sizeof(screen));    // unknown initial state
+
+    // First flush clears the screen, then draws
+    lcd.clear();
+    lcd.print(0, 0, "Temp:");
+    lcd.print(6, 0, 22.5f);
+    lcd.print(0, 1, "Vcc 1.60V");
+    lcd.flush();
+    CHECK(apply() == 3);
+    CHECK(row(0) == pad("Temp: 22.500") && row(1) == pad("Vcc 1.60V"));
+
+    // Identical redraw -> nothing
+    lcd.clear();
+    lcd.print(0, 0, "Temp: 22.500");
+    lcd.print(0, 1, "Vcc 1.60V");
+    lcd.flush();
+    CHECK(apply() == 0);
+
+    // One digit changes -> one short command
+    lcd.clear();
+    lcd.print(0, 0, "Temp: 22.700");
+    lcd.print(0, 1, "Vcc 1.60V");
+    lcd.flush();
+    CHECK(apply() == 1);
+    CHECK(row(0) == pad("Temp: 22.700"));
+
+    // Clipping
+    lcd.print(12, 1, "overflowing");
+    lcd.print(-2, 0, "abcd");
+    lcd.print(0, 5, "ignored");
+    lcd.flush();
+    apply();
+    CHECK(row(0) == pad("cdmp: 22.700") && row(1) == pad("Vcc 1.60V   over"));
+
+    // Flush tick from run()
+    lcd.clear();
+    lcd.print(0, 0, "tick");
+    Blynk.run();
+    CHECK(apply() == 0);
+    usleep((BLYNK_LCD_FLUSH_MS + 10) * 1000);
+    Blynk.run();
+    CHECK(apply() == 2);
+    CHECK(row(0) == pad("tick") && row(1) == pad(""));
+    printf("diffing: OK\n");
+
+    // Synthetic dashboard: every sample redraws the whole LCD with
+    // slowly changing readings
+    const uint32_t calls0 = lcd.calls(), sent0 = lcd.messagesSent();
+    const int REDRAWS = 1000;
+    unsigned seed = 1;
+    float temp = 22.0f, volt = 1.6f;
+    for (int i = 0; i < REDRAWS; i++) {
+        if (rand_r(&seed) % 4 == 0) temp += (rand_r(&seed) % 3 - 1) * 0.1f;
+        if (rand_r(&seed) % 8 == 0) volt += (rand_r(&seed) % 3 - 1) * 0.01f;
+        char l0[32], l1[32];
+        snprintf(l0, sizeof(l0), "T %5.1f C", temp);
+        snprintf(l1, sizeof(l1), "V %4.2f  #%d", volt, i / 60);
+        lcd.clear();
+        lcd.print(0, 0, l0);
+        lcd.print(0, 1, l1);
+        lcd.flush();
+        apply();
+        CHECK(row(0) == pad(l0) && row(1) == pad(l1));
+    }
+    const uint32_t calls = lcd.calls() - calls0, sent = lcd.messagesSent() - sent0;
+    printf("dashboard: %d redraws, %u calls, %u messages (%.2f/redraw), %.2f messages saved per redraw\n",
+           REDRAWS, calls, sent, float(sent) / REDRAWS, float(calls - sent) / REDRAWS);
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file       WidgetTableTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      WidgetTableModel diffs, replace-all and time to sync 1k rows
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/WidgetTableTest
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <WidgetTable.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+// Message rate the real server allows (BlynkConfig.h default)
+static const unsigned DEFAULT_MSG_LIMIT = 15;
+
+typedef WidgetTableModel<1000> Table;
+
+// What the app would display, driven by the commands received
+struct AppRow { std::string name, value; };
+static std::vector<AppRow> app;
+static unsigned appOps;
+
+static unsigned apply()
+{
+    unsigned msgs = 0;
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        const BlynkTestFrame& f = transp.frames[i];
+        if (f.type != BLYNK_CMD_HARDWARE) continue;
+        msgs++;
+        BlynkParam p((void*)f.body.data(), f.body.size());
+        BlynkParam::iterator it = p.begin();
+        CHECK(!strcmp(it.asStr(), "vw") && (++it).asInt() == 5);
+        for (++it; it < p.end(); ++it) {
+            const std::string op = it.asStr();
+            if (op == "clr") {
+                app.clear();
+                continue;
+            }
+            const size_t idx = (++it).asInt();
+            AppRow r;
+            r.name = (++it).asStr();
+            r.value = (++it).asStr();
+            if (op == "add") {
+                CHECK(idx == app.size());
+                app.push_back(r);
+            } else {
+                CHECK(op == "update" && idx < app.size());
+                app[idx] = r;
+            }
+            appOps++;
+        }
+    }
+    transp.frames.clear();
+    return msgs;
+}
+
+static void check_app(const Table& t)
+{
+    CHECK(app.size() == t.rows());
+    for (size_t i = 0; i < app.size(); i++) {
+        CHECK(app[i].name == t.name(i) && app[i].value == t.value(i));
+    }
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void fill(Table& t, size_t rows, unsigned seed, bool replace)
+{
+    if (replace) t.beginReplace();
+    for (size_t i = 0; i < rows; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "Sensor %u", unsigned(i));
+        t.setRow(i, name, float((i * 7 + seed) % 50) / 2);
+    }
+    if (replace) t.endReplace();
+}
+
+static void test_diffs(bool pack)
+{
+    static Table t(V5);
+    t.setPacking(pack);
+    app.clear();
+    t.clear();
+
+    fill(t, 10, 0, false);
+    CHECK(t.sync() > 0);
+    apply();
+    check_app(t);
+
+    // Nothing changed
+    fill(t, 10, 0, false);
+    CHECK(t.sync() == 0);
+
+    // One row changed -> one update
+    appOps = 0;
+    t.setRow(3, "Sensor 3", "hot");
+    CHECK(t.sync() == 1);
+    apply();
+    CHECK(appOps == 1);
+    check_app(t);
+
+    // Gap -> empty rows are added in between
+    t.setRow(12, "last", 1);
+    t.sync();
+    apply();
+    check_app(t);
+    CHECK(app[11].name.empty());
+
+    // Replace with more rows: only differences are sent
+    appOps = 0;
+    t.beginReplace();
+    for (size_t i = 0; i < 13; i++) {
+        t.setRow(i, t.name(i), t.value(i));
+    }
+    t.setRow(13, "new", 2);
+    t.endReplace();
+    t.sync();
+    apply();
+    CHECK(appOps == 1);
+    check_app(t);
+
+    // Replace with fewer rows: clear + add
+    fill(t, 4, 1, true);
+    t.sync();
+    apply();
+    check_app(t);
+    CHECK(t.rows() == 4);
+
+    // Overlong text is truncated
+    t.setRow(0, "a name that is longer than thirty-two characters", "and a long value");
+    t.sync();
+    apply();
+    check_app(t);
+    CHECK(strlen(t.name(0)) == 31 && strlen(t.value(0)) == 15);
+    printf("diffs%s: OK\n", pack ? " (packed)" : "");
+}
+
+static void bench(bool pack)
+{
+    static Table t(V5);
+    t.setPacking(pack);
+    app.clear();
+    t.clear();
+    t.sync();
+    apply();
+
+    const uint32_t m0 = t.messagesSent();
+    double t0 = now_ms();
+    fill(t, 1000, 0, true);
+    t.sync();
+    const double cpu = now_ms() - t0;
+    apply();
+    check_app(t);
+    const uint32_t full = t.messagesSent() - m0;
+
+    // Next sample: a quarter of the readings changed
+    const uint32_t m1 = t.messagesSent();
+    t.beginReplace();
+    for (size_t i = 0; i < 1000; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "Sensor %u", unsigned(i));
+        t.setRow(i, name, (i % 4) ? t.value(i) : "changed");
+    }
+    t.endReplace();
+    t.sync();
+    apply();
+    check_app(t);
+    const uint32_t delta = t.messagesSent() - m1;
+
+    printf("1k rows%s: initial %u msgs (%.1f s at %u msg/s, %.2f ms CPU), "
+           "25%% changed %u msgs (%.1f s); one write per row: %.1f s\n",
+           pack ? ", packed" : "", full, float(full) / DEFAULT_MSG_LIMIT, DEFAULT_MSG_LIMIT, cpu,
+           delta, float(delta) / DEFAULT_MSG_LIMIT, 1000.0f / DEFAULT_MSG_LIMIT);
+}
+
+int main()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+    transp.frames.clear();
+
+    test_diffs(false);
+    test_diffs(true);
+    bench(false);
+    bench(true);
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file       WidgetTerminalLimitTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      WidgetTerminal sending outside of run(), with the default message limit
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/WidgetTerminalLimitTest
+ *
+ * With BLYNK_MSG_LIMIT set, a send waits for the budget by calling run(),
+ * which polls the terminal again while its own send is in progress.
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <WidgetTerminal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static WidgetTerminal terminal(V0);
+
+// Text received by the terminal widget, one string per message
+static std::vector<std::string> messages()
+{
+    std::vector<std::string> res;
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        const BlynkTestFrame& f = transp.frames[i];
+        if (f.type == BLYNK_CMD_HARDWARE && f.body.compare(0, 5, std::string("vw\0" "0\0", 5)) == 0) {
+            res.push_back(f.body.substr(5));
+        }
+    }
+    transp.frames.clear();
+    return res;
+}
+
+static std::string joined(const std::vector<std::string>& m)
+{
+    std::string res;
+    for (size_t i = 0; i < m.size(); i++) {
+        res += m[i];
+    }
+    return res;
+}
+
+int main()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+    messages();
+
+    // flush() right after the login: the send waits for the budget in run()
+    terminal.write("hello\n");
+    terminal.flush();
+    std::vector<std::string> m = messages();
+    CHECK(m.size() == 1 && m[0] == "hello\n");
+    CHECK(terminal.bytesSent() == 6 && terminal.messagesSent() == 1);
+    Blynk.run();
+    CHECK(messages().empty());
+    printf("flush: OK\n");
+
+    // A full buffer is sent from write(), several times in a row
+    std::string all;
+    for (int i = 0; all.size() < 3 * BLYNK_TERMINAL_BUFFER; i++) {
+        const std::string l = "line " + std::to_string(i) + "\n";
+        terminal.write(l.c_str());
+        all += l;
+    }
+    terminal.flush();
+    m = messages();
+    for (size_t i = 0; i < m.size(); i++) {
+        CHECK(m[i].size() <= BLYNK_TERMINAL_BUFFER);
+    }
+    CHECK(joined(m) == all);
+    CHECK(terminal.bytesSent() == 6 + all.size());
+    printf("full buffer: OK (%u msgs)\n", unsigned(m.size()));
+    return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file       WidgetTerminalTest.cpp
+ * @license    This project is released under the MIT License (MIT)
+ * @brief      WidgetTerminal flushing rules and bytes/message efficiency
+ *
+ * Build and run (inside of the "linux" directory):
+ *   make tests
+ *   ../tests/WidgetTerminalTest
+ */
+
+#define BLYNK_NO_DEFAULT_BANNER
+#define BLYNK_MSG_LIMIT 0
+#define BLYNK_NO_INFO
+
+#include "BlynkTestTransport.h"
+
+static BlynkTestTransport transp;
+static BlynkTestDevice Blynk(transp);
+
+#include <WidgetTerminal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "BlynkTestCheck.h"
+
+static WidgetTerminal terminal(V0);
+
+// Text received by the terminal widget, one string per message
+static std::vector<std::string> messages()
+{
+    std::vector<std::string> res;
+    for (size_t i = 0; i < transp.frames.size(); i++) {
+        const BlynkTestFrame& f = transp.frames[i];
+        if (f.type == BLYNK_CMD_HARDWARE && f.body.compare(0, 5, std::string("vw\0" "0\0", 5)) == 0) {
+            res.push_back(f.body.substr(5));
+        }
+    }
+    transp.frames.clear();
+    return res;
+}
+
+// 80-character status line, like the sensor thread prints
+static std::string status_line(int i)
+{
+    char buff[128];
+    snprintf(buff, sizeof(buff), "%02d:%02d:%02d\t%02d:%02d:%02d\t%1.2f V\t\t%2.2f C\t%4d\t%1.2fV\t%c  %018d\n",
+             i / 3600, i / 60 % 60, i % 60, 0, 0, i % 60, 1.5, 22.5, 512, 1.6, ' ', i);
+    return buff;
+}
+
+int main()
+{
+    Blynk.begin("token");
+    for (int i = 0; i < 100 && !Blynk.connected(); i++) {
+        Blynk.run();
+        usleep(1000);
+    }
+    CHECK(Blynk.connected());
+    messages();
+
+    // One status line -> one message, sent by the next run()
+    const std::string line = status_line(1);
+    CHECK(line.size() <= BLYNK_TERMINAL_BUFFER);
+    terminal.write(line.c_str());
+    CHECK(messages().empty());
+    Blynk.run();
+    std::vector<std::string> m = messages();
+    CHECK(m.size() == 1 && m[0] == line);
+
+    // Partial line -> sent after the deadline
+    terminal.write("partial");
+    Blynk.run();
+    CHECK(messages().empty());
+    usleep((BLYNK_TERMINAL_FLUSH_MS + 10) * 1000);
+    Blynk.run();
+    m = messages();
+    CHECK(m.size() == 1 && m[0] == "partial");
+
+    // Lines printed together share messages, split at line boundaries
+    std::string all;
+    for (int i = 0; i < 100; i++) {
+        const std::string l = (i % 3) ? "ok " + std::to_string(i) + "\n" : status_line(i);
+        terminal.write(l.c_str());
+        all += l;
+    }
+    terminal.flush();
+    m = messages();
+    std::string joined;
+    for (size_t i = 0; i < m.size(); i++) {
+        CHECK(m[i].size() <= BLYNK_TERMINAL_BUFFER);
+        CHECK(i + 1 == m.size() || m[i][m[i].size() - 1] == '\n');
+        joined += m[i];
+    }
+    CHECK(joined == all);
+    printf("flush rules: OK\n");
+
+    // Efficiency for a stream of status lines, one per run() iteration
+    const uint32_t bytes0 = terminal.bytesSent(), msgs0 = terminal.messagesSent();
+    size_t legacy = 0, total = 0;
+    for (int i = 0; i < 1000; i++) {
+        const std::string l = status_line(i);
+        terminal.write(l.c_str());
+        Blynk.run();
+        total += l.size();
+        legacy = total / 64;    // old terminal: one message per 64 bytes, tail left behind
+    }
+    messages();
+    const uint32_t bytes = terminal.bytesSent() - bytes0, msgs = terminal.messagesSent() - msgs0;
+    CHECK(msgs == 1000 && bytes == total);
+    printf("status lines: %u msgs, %.1f bytes/msg (64-byte buffer: %lu msgs, lines split)\n",
+           msgs, float(bytes) / msgs, (unsigned long)legacy);
+
+    // Bursts of short lines written between run() calls get packed
+    const uint32_t m0 = terminal.messagesSent(), b0 = terminal.bytesSent();
+    for (int i = 0; i < 1000; i++) {
+        for (int j = 0; j < 5; j++) {
+            char buff[16];
+            snprintf(buff, sizeof(buff), "t=%d ok\n", i);
+            terminal.write(buff);
+        }
+        Blynk.run();
+    }
+    messages();
+    printf("short line bursts: %.1f bytes/msg, flushes: newline %u, size %u, deadline %u, manual %u\n",
+           float(terminal.bytesSent() - b0) / (terminal.messagesSent() - m0),
+           terminal.flushes(WidgetTerminal::FLUSH_NEWLINE), terminal.flushes(WidgetTerminal::FLUSH_SIZE),
+           terminal.flushes(WidgetTerminal::FLUSH_DEADLINE), terminal.flushes(WidgetTerminal::FLUSH_MANUAL));
+    return 0;
+}